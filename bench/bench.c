@@ -0,0 +1,19 @@
+#include "bench.h"
+
+// file local prototypes
+static uint8_t discard_write(void *context, const char *bytes, size_t length);
+
+void bench_vm_init(struct VM *vm) {
+  vm_init(vm, NULL);
+  // still handed over after every result, like the default stdout sink
+  vm_set_output(vm, (struct OutputSink) {discard_write, NULL}, OUTPUT_FLUSH_RESULT);
+}
+
+// file local functions
+
+static uint8_t discard_write(void *context, const char *bytes, size_t length) {
+  (void) context;
+  (void) bytes;
+  (void) length;
+  return TRUE;
+}
@@ -0,0 +1,10 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "vm.h"
+
+// vm_init for a benchmark. the results OPCODE_RETURN prints go to a sink
+// that drops them, so only the vm is timed and stdout is left alone
+void bench_vm_init(struct VM *vm);
+
+#endif // BENCH_H
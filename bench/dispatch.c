@@ -0,0 +1,94 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+#include "chunk.h"
+#include "opcode.h"
+#include "program.h"
+#include "bench.h"
+
+// copies of one group of 8 literals, the copies share the group's constants
+#define GROUP_COUNT 31
+#define DEFAULT_ITERATIONS 200000
+
+// file local prototypes
+static char *build_source(void);
+static size_t count_instructions(struct Chunk *chunk);
+static double now_seconds(void);
+
+int main(int argc, const char *argv[]) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+
+  struct VM vm;
+  bench_vm_init(&vm);
+
+  char *source = build_source();
+  struct Program *program = program_compile(&vm, source);
+  if (program == NULL) {
+    fprintf(stderr, "Error - benchmark source failed to compile\n");
+    return 1;
+  }
+
+  // expressions are straight-line code, every instruction runs exactly once
+  size_t instructions = count_instructions(&program->chunk);
+
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (program_execute(&vm, program) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark source failed at runtime\n");
+      return 1;
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  double executed = (double) instructions * (double) iterations;
+  fprintf(stderr, "%-14s %2lu-byte values  %lu instructions x %lu runs in %.3fs  %.1f ns/run  %.1f M instructions/sec\n",
+          BENCH_LABEL, sizeof(struct Value), instructions, iterations, elapsed,
+          elapsed / (double) iterations * 1e9, executed / elapsed / 1e6);
+
+  program_free(&vm, program);
+  free(source);
+  vm_free(&vm);
+
+  return 0;
+}
+
+// file local functions
+
+static char *build_source(void) {
+  static const char *group = "((1 + 2 * 3 - 4 / 5 < 6) == !(7 >= 8))";
+
+  size_t group_length = strlen(group);
+  size_t capacity = GROUP_COUNT * (group_length + 4) + 1;
+  char *source = (char *) malloc(capacity);
+  if (source == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark source\n");
+    exit(1);
+  }
+
+  // chain groups with == so every comparison result feeds the next one
+  source[0] = '\0';
+  for (size_t i = 0; i < GROUP_COUNT; ++i) {
+    if (i > 0) strcat(source, " == ");
+    strcat(source, group);
+  }
+
+  return source;
+}
+
+static size_t count_instructions(struct Chunk *chunk) {
+  size_t count = 0;
+  for (size_t offset = 0; offset < chunk->byte_count; offset += opcode_size(chunk->buffer[offset])) {
+    count += 1;
+  }
+  return count;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,103 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "executor.h"
+
+#define DEFAULT_JOB_COUNT 4000
+#define MAX_GROUP_COUNT 24
+
+// file local prototypes
+static char *build_source(size_t group_count);
+static double now_seconds(void);
+
+// throughput of the executor from one worker up to max_workers (the number
+// of online cores unless given), every sweep runs the same batch of jobs
+int main(int argc, const char *argv[]) {
+  long online = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_workers = argc > 1 ? strtoul(argv[1], NULL, 10) : (size_t) (online > 0 ? online : 1);
+  size_t job_count = argc > 2 ? strtoul(argv[2], NULL, 10) : DEFAULT_JOB_COUNT;
+
+  // scripts of uneven size so some deques drain early and their workers steal
+  char *sources[MAX_GROUP_COUNT];
+  for (size_t i = 0; i < MAX_GROUP_COUNT; ++i) {
+    sources[i] = build_source(i + 1);
+  }
+
+  struct ExecutorJob *jobs = (struct ExecutorJob *) malloc(sizeof(struct ExecutorJob) * job_count);
+  if (jobs == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark jobs\n");
+    return 1;
+  }
+
+  double single_worker_rate = 0.0;
+  for (size_t worker_count = 1; worker_count <= max_workers; ++worker_count) {
+    struct Executor executor;
+    executor_init(&executor, worker_count, NULL);
+
+    double start = now_seconds();
+    for (size_t i = 0; i < job_count; ++i) {
+      executor_job_init(&jobs[i], sources[(i * 7) % MAX_GROUP_COUNT]);
+      executor_submit(&executor, &jobs[i]);
+    }
+    executor_wait(&executor);
+    double elapsed = now_seconds() - start;
+
+    size_t stolen = 0;
+    for (size_t i = 0; i < worker_count; ++i) {
+      stolen += executor.workers[i].stolen_count;
+    }
+    executor_free(&executor);
+
+    for (size_t i = 0; i < job_count; ++i) {
+      if (jobs[i].result != INTERPRET_RESULT_OK) {
+        fprintf(stderr, "Error - benchmark job %lu failed\n", i);
+        return 1;
+      }
+      executor_job_free(&jobs[i]);
+    }
+
+    double rate = (double) job_count / elapsed;
+    if (worker_count == 1) single_worker_rate = rate;
+    fprintf(stderr, "%2lu workers  %lu jobs in %.3fs  %.0f jobs/sec  %.2fx  %lu stolen\n",
+            worker_count, job_count, elapsed, rate, rate / single_worker_rate, stolen);
+  }
+
+  free(jobs);
+  for (size_t i = 0; i < MAX_GROUP_COUNT; ++i) {
+    free(sources[i]);
+  }
+
+  return 0;
+}
+
+// file local functions
+
+static char *build_source(size_t group_count) {
+  static const char *group = "((\"a\" + \"b\" == \"ab\") == !(1 + 2 * 3 - 4 / 5 < 6))";
+
+  size_t group_length = strlen(group);
+  size_t capacity = group_count * (group_length + 4) + 1;
+  char *source = (char *) malloc(capacity);
+  if (source == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark source\n");
+    exit(1);
+  }
+
+  source[0] = '\0';
+  for (size_t i = 0; i < group_count; ++i) {
+    if (i > 0) strcat(source, " == ");
+    strcat(source, group);
+  }
+
+  return source;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
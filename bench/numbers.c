@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "number.h"
+
+// literals of a generated data table
+#define LITERAL_COUNT 1000000
+#define DEFAULT_ITERATIONS 10
+
+// where each literal is in the table, literals are separated by spaces so
+// strtod stops at the end of each as the scanner would
+struct Literal {
+  size_t offset;
+  size_t length;
+};
+
+// file local prototypes
+static char *build_table(size_t literal_count, struct Literal *literals);
+static double parse_all(const char *table, const struct Literal *literals, size_t literal_count, uint8_t use_strtod);
+static void report(const char *parser, size_t literal_count, size_t iterations, double elapsed);
+static double now_seconds(void);
+
+int main(int argc, const char *argv[]) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+
+  struct Literal *literals = (struct Literal *) malloc(sizeof(struct Literal) * LITERAL_COUNT);
+  if (literals == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark literals\n");
+    return 1;
+  }
+  char *table = build_table(LITERAL_COUNT, literals);
+
+  // both parsers have to agree on every literal before either is timed
+  for (size_t i = 0; i < LITERAL_COUNT; ++i) {
+    double parsed = number_parse(table + literals[i].offset, literals[i].length);
+    double expected = strtod(table + literals[i].offset, NULL);
+    if (memcmp(&parsed, &expected, sizeof(double)) != 0) {
+      fprintf(stderr, "Error - %.*s parsed as %.17g, strtod gives %.17g\n",
+              (int) literals[i].length, table + literals[i].offset, parsed, expected);
+      return 1;
+    }
+  }
+
+  for (uint8_t use_strtod = 0; use_strtod <= 1; ++use_strtod) {
+    double start = now_seconds();
+    double sum = 0;
+    for (size_t i = 0; i < iterations; ++i) sum += parse_all(table, literals, LITERAL_COUNT, use_strtod);
+    double elapsed = now_seconds() - start;
+
+    // keep the sum alive without printing it
+    if (sum == 0) fprintf(stderr, "Error - benchmark literals summed to 0\n");
+    report(use_strtod ? "strtod" : "number_parse", LITERAL_COUNT, iterations, elapsed);
+  }
+
+  free(table);
+  free(literals);
+  return 0;
+}
+
+// file local functions
+
+// a third small integers, a third prices with two decimals and a third
+// measurements with up to 17 significant digits
+static char *build_table(size_t literal_count, struct Literal *literals) {
+  size_t capacity = literal_count * 24 + 1;
+  char *table = (char *) malloc(capacity);
+  if (table == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark table\n");
+    exit(1);
+  }
+
+  uint64_t state = 0x9E3779B97F4A7C15u;
+  size_t used = 0;
+  for (size_t i = 0; i < literal_count; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    literals[i].offset = used;
+    switch (i % 3) {
+      case 0: used += (size_t) snprintf(table + used, capacity - used, "%lu", (unsigned long) (state % 10000)); break;
+      case 1: used += (size_t) snprintf(table + used, capacity - used, "%lu.%02lu", (unsigned long) (state % 100000), (unsigned long) (state >> 40) % 100); break;
+      case 2: used += (size_t) snprintf(table + used, capacity - used, "%lu.%0*lu", (unsigned long) (state % 1000),
+                                        (int) (state >> 60) + 1, (unsigned long) (state >> 8) % 10000000000000ul); break;
+    }
+    literals[i].length = used - literals[i].offset;
+    table[used++] = ' ';
+  }
+  table[used] = '\0';
+
+  return table;
+}
+
+static double parse_all(const char *table, const struct Literal *literals, size_t literal_count, uint8_t use_strtod) {
+  double sum = 0;
+  if (use_strtod) {
+    for (size_t i = 0; i < literal_count; ++i) sum += strtod(table + literals[i].offset, NULL);
+  } else {
+    for (size_t i = 0; i < literal_count; ++i) sum += number_parse(table + literals[i].offset, literals[i].length);
+  }
+  return sum;
+}
+
+static void report(const char *parser, size_t literal_count, size_t iterations, double elapsed) {
+  double parsed = (double) literal_count * (double) iterations;
+  fprintf(stderr, "%-14s %-13s %lu literals x %lu runs in %.3fs  %.1f ns/literal  %.1f M literals/sec\n",
+          BENCH_LABEL, parser, literal_count, iterations, elapsed, elapsed / parsed * 1e9, parsed / elapsed / 1e6);
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
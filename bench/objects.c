@@ -0,0 +1,107 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+#include "program.h"
+#include "bench.h"
+
+// both scripts stay under 256 distinct literals, so every constant is
+// loaded by the one-byte OPCODE_CONSTANT
+#define GROUP_COUNT 50
+#define LITERAL_COUNT 200
+#define DEFAULT_ITERATIONS 20000
+
+// file local prototypes
+static double run_concatenation(struct VM *vm, size_t iterations);
+static double run_literals(struct VM *vm, size_t iterations);
+static char *build_source(const char *separator, const char *piece_format, size_t piece_count);
+static double now_seconds(void);
+
+int main(int argc, const char *argv[]) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+
+  struct VM vm;
+  bench_vm_init(&vm);
+
+  double elapsed = run_concatenation(&vm, iterations);
+  fprintf(stderr, "%-14s %-14s %lu runs in %.3fs  %.2f us/run\n",
+          BENCH_LABEL, "concatenation", iterations, elapsed, elapsed / (double) iterations * 1e6);
+
+  elapsed = run_literals(&vm, iterations);
+  fprintf(stderr, "%-14s %-14s %lu runs in %.3fs  %.2f us/run\n",
+          BENCH_LABEL, "literals", iterations, elapsed, elapsed / (double) iterations * 1e6);
+
+  vm_free(&vm);
+
+  return 0;
+}
+
+// file local functions
+
+// ("a0" + "b" + "c" + "d") == ... compiled once, every run allocates short
+// intermediate strings that die right away
+static double run_concatenation(struct VM *vm, size_t iterations) {
+  char *source = build_source(" == ", "(\"a%lu\" + \"b\" + \"c\" + \"d\")", GROUP_COUNT);
+  struct Program *program = program_compile(vm, source);
+  if (program == NULL) {
+    fprintf(stderr, "Error - benchmark source failed to compile\n");
+    exit(1);
+  }
+
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (program_execute(vm, program) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark source failed at runtime\n");
+      exit(1);
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  program_free(vm, program);
+  free(source);
+  return elapsed;
+}
+
+// "literal 0" == "literal 1" == ... compiled from scratch on every run, each
+// literal becomes a string object (or an intern table hit while it is alive)
+static double run_literals(struct VM *vm, size_t iterations) {
+  char *source = build_source(" == ", "\"literal %lu\"", LITERAL_COUNT);
+
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (vm_interpret(vm, source) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark source failed\n");
+      exit(1);
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  free(source);
+  return elapsed;
+}
+
+static char *build_source(const char *separator, const char *piece_format, size_t piece_count) {
+  size_t capacity = piece_count * (strlen(separator) + strlen(piece_format) + 24) + 1;
+  char *source = (char *) malloc(capacity);
+  if (source == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark source\n");
+    exit(1);
+  }
+
+  size_t length = 0;
+  for (size_t i = 0; i < piece_count; ++i) {
+    if (i > 0) length += (size_t) snprintf(source + length, capacity - length, "%s", separator);
+    length += (size_t) snprintf(source + length, capacity - length, piece_format, i);
+  }
+
+  return source;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+#include "program.h"
+#include "number.h"
+
+// doubles of a generated data table
+#define NUMBER_COUNT 1000000
+#define RESULT_SOURCE "1 / 3 * 7.25"
+#define DEFAULT_ITERATIONS 10
+#define RESULT_ITERATIONS 1000000
+
+// how a table of doubles is turned into text
+enum Formatter {
+  FORMATTER_NUMBER_FORMAT, // shortest round trip
+  FORMATTER_PRINTF_ROUND_TRIP, // %.17g, also round trips but rarely shortest
+  FORMATTER_PRINTF_SHORT // %g, the previous output, 6 significant digits
+};
+
+// file local prototypes
+static double *build_table(size_t number_count);
+static size_t format_all(const double *numbers, size_t number_count, enum Formatter formatter);
+static double run_results(struct VM *vm, struct Program *program, size_t iterations);
+static double now_seconds(void);
+
+int main(int argc, const char *argv[]) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+  double *numbers = build_table(NUMBER_COUNT);
+
+  // every formatted number has to read back as the same double before
+  // anything is timed
+  for (size_t i = 0; i < NUMBER_COUNT; ++i) {
+    char text[NUMBER_FORMAT_MAX];
+    size_t length = number_format(numbers[i], text);
+    double parsed = number_parse(text, length);
+    if (memcmp(&parsed, &numbers[i], sizeof(double)) != 0) {
+      fprintf(stderr, "Error - %.17g formatted as %.*s\n", numbers[i], (int) length, text);
+      return 1;
+    }
+  }
+
+  static const char *formatter_names[] = {"number_format", "printf %.17g", "printf %g"};
+  for (int formatter = FORMATTER_NUMBER_FORMAT; formatter <= FORMATTER_PRINTF_SHORT; ++formatter) {
+    double start = now_seconds();
+    size_t bytes = 0;
+    for (size_t i = 0; i < iterations; ++i) bytes += format_all(numbers, NUMBER_COUNT, (enum Formatter) formatter);
+    double elapsed = now_seconds() - start;
+
+    double formatted = (double) NUMBER_COUNT * (double) iterations;
+    fprintf(stderr, "%-14s %-14s %lu numbers x %lu runs in %.3fs  %.1f ns/number  %.1f bytes/number\n",
+            BENCH_LABEL, formatter_names[formatter], (unsigned long) NUMBER_COUNT, iterations, elapsed,
+            elapsed / formatted * 1e9, (double) bytes / formatted);
+  }
+  free(numbers);
+
+  // results printed by OPCODE_RETURN, handed to the sink after every
+  // result as in the repl or a buffer at a time
+  FILE *null = fopen("/dev/null", "w");
+  if (null == NULL) {
+    fprintf(stderr, "Error - could not open /dev/null\n");
+    return 1;
+  }
+
+  struct VM vm;
+  vm_init(&vm, NULL);
+  struct Program *program = program_compile(&vm, RESULT_SOURCE);
+  if (program == NULL) {
+    fprintf(stderr, "Error - benchmark source failed to compile\n");
+    return 1;
+  }
+
+  static const char *flush_names[] = {"flush result", "flush full"};
+  for (int flush = OUTPUT_FLUSH_RESULT; flush <= OUTPUT_FLUSH_FULL; ++flush) {
+    vm_set_output(&vm, output_file_sink(null), (enum OutputFlush) flush);
+    double elapsed = run_results(&vm, program, RESULT_ITERATIONS);
+    fprintf(stderr, "%-14s %-14s %lu results in %.3fs  %.1f ns/result\n",
+            BENCH_LABEL, flush_names[flush], (unsigned long) RESULT_ITERATIONS, elapsed,
+            elapsed / (double) RESULT_ITERATIONS * 1e9);
+  }
+
+  program_free(&vm, program);
+  vm_free(&vm);
+  fclose(null);
+  return 0;
+}
+
+// file local functions
+
+// a third small integers, a third prices with two decimals and a third
+// measurements with full precision
+static double *build_table(size_t number_count) {
+  double *numbers = (double *) malloc(sizeof(double) * number_count);
+  if (numbers == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark table\n");
+    exit(1);
+  }
+
+  uint64_t state = 0x9E3779B97F4A7C15u;
+  for (size_t i = 0; i < number_count; ++i) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+
+    switch (i % 3) {
+      case 0: numbers[i] = (double) (state % 10000); break;
+      case 1: numbers[i] = (double) (state % 10000000) / 100; break;
+      case 2: numbers[i] = (double) (state >> 11) / (double) (UINT64_C(1) << 43); break;
+    }
+  }
+
+  return numbers;
+}
+
+static size_t format_all(const double *numbers, size_t number_count, enum Formatter formatter) {
+  char text[NUMBER_FORMAT_MAX];
+  size_t bytes = 0;
+  for (size_t i = 0; i < number_count; ++i) {
+    switch (formatter) {
+      case FORMATTER_NUMBER_FORMAT:     bytes += number_format(numbers[i], text); break;
+      case FORMATTER_PRINTF_ROUND_TRIP: bytes += (size_t) snprintf(text, sizeof(text), "%.17g", numbers[i]); break;
+      case FORMATTER_PRINTF_SHORT:      bytes += (size_t) snprintf(text, sizeof(text), "%g", numbers[i]); break;
+    }
+  }
+  return bytes;
+}
+
+static double run_results(struct VM *vm, struct Program *program, size_t iterations) {
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (program_execute(vm, program) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark source failed at runtime\n");
+      exit(1);
+    }
+  }
+  output_flush(&vm->out);
+  return now_seconds() - start;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
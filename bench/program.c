@@ -0,0 +1,153 @@
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+#include "program.h"
+#include "bench.h"
+
+#define DEFAULT_ITERATIONS 200000
+
+// copies of the rule in the startup script, they share one set of constants
+#define STARTUP_RULE_COUNT 200
+#define STARTUP_FILE_PATH "bench_program.bcvm"
+
+// a small rule of the kind evaluated over and over on a hot path
+static const char *RULE_SOURCE = "(\"status\" + \":\" + \"ok\" == \"status:ok\") == !(3 * 7 - 1 < 20 / 4)";
+
+// file local prototypes
+static double run_interpret(struct VM *vm, size_t iterations);
+static double run_program(struct VM *vm, size_t iterations);
+static double run_compile_startup(struct VM *vm, const char *source, size_t iterations);
+static double run_load_startup(struct VM *vm, size_t iterations);
+static char *build_source(size_t rule_count);
+static double now_seconds(void);
+
+// cost of one evaluation when the source is compiled every time against
+// compiling it once into a program
+int main(int argc, const char *argv[]) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+
+  struct VM vm;
+  bench_vm_init(&vm);
+
+  double interpret = run_interpret(&vm, iterations);
+  double program = run_program(&vm, iterations);
+
+  fprintf(stderr, "%-14s %lu runs in %.3fs  %.1f ns/run\n",
+          "vm_interpret", iterations, interpret, interpret / (double) iterations * 1e9);
+  fprintf(stderr, "%-14s %lu runs in %.3fs  %.1f ns/run  %.2fx\n",
+          "program", iterations, program, program / (double) iterations * 1e9, interpret / program);
+
+  // a bigger script started from source against started from a file
+  // written by program_write
+  size_t startup_iterations = iterations / 10;
+  char *source = build_source(STARTUP_RULE_COUNT);
+  double compile_startup = run_compile_startup(&vm, source, startup_iterations);
+  double load_startup = run_load_startup(&vm, startup_iterations);
+
+  fprintf(stderr, "%-14s %lu starts in %.3fs  %.1f ns/start\n",
+          "compile", startup_iterations, compile_startup, compile_startup / (double) startup_iterations * 1e9);
+  fprintf(stderr, "%-14s %lu starts in %.3fs  %.1f ns/start  %.2fx\n",
+          "load", startup_iterations, load_startup, load_startup / (double) startup_iterations * 1e9,
+          compile_startup / load_startup);
+
+  remove(STARTUP_FILE_PATH);
+  free(source);
+  vm_free(&vm);
+
+  return 0;
+}
+
+// file local functions
+
+static double run_interpret(struct VM *vm, size_t iterations) {
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (vm_interpret(vm, RULE_SOURCE) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark source failed\n");
+      exit(1);
+    }
+  }
+  return now_seconds() - start;
+}
+
+static double run_program(struct VM *vm, size_t iterations) {
+  double start = now_seconds();
+  struct Program *program = program_compile(vm, RULE_SOURCE);
+  if (program == NULL) {
+    fprintf(stderr, "Error - benchmark source failed to compile\n");
+    exit(1);
+  }
+
+  for (size_t i = 0; i < iterations; ++i) {
+    if (program_execute(vm, program) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark source failed at runtime\n");
+      exit(1);
+    }
+  }
+
+  program_free(vm, program);
+  return now_seconds() - start;
+}
+
+static double run_compile_startup(struct VM *vm, const char *source, size_t iterations) {
+  struct Program *program = program_compile(vm, source);
+  if (program == NULL || !program_write(vm, program, NULL, STARTUP_FILE_PATH)) {
+    fprintf(stderr, "Error - could not write the startup program\n");
+    exit(1);
+  }
+  program_free(vm, program);
+
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    program = program_compile(vm, source);
+    if (program == NULL || program_execute(vm, program) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark source failed\n");
+      exit(1);
+    }
+    program_free(vm, program);
+  }
+  return now_seconds() - start;
+}
+
+static double run_load_startup(struct VM *vm, size_t iterations) {
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    struct Program *program = program_load(vm, STARTUP_FILE_PATH);
+    if (program == NULL || program_execute(vm, program) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark program failed\n");
+      exit(1);
+    }
+    program_free(vm, program);
+  }
+  return now_seconds() - start;
+}
+
+static char *build_source(size_t rule_count) {
+  size_t rule_length = strlen(RULE_SOURCE);
+  size_t capacity = rule_count * (rule_length + 8) + 1;
+  char *source = (char *) malloc(capacity);
+  if (source == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark source\n");
+    exit(1);
+  }
+
+  source[0] = '\0';
+  for (size_t i = 0; i < rule_count; ++i) {
+    if (i > 0) strcat(source, " == ");
+    strcat(source, "(");
+    strcat(source, RULE_SOURCE);
+    strcat(source, ")");
+  }
+
+  return source;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vm.h"
+#include "program.h"
+#include "bench.h"
+
+#define PIECE "\"0123456789abcdef\""
+#define APPEND_COUNT 1000
+#define CHAIN_COUNT 2000
+#define DEFAULT_ITERATIONS 200
+
+// file local prototypes
+static double run_program(struct VM *vm, const char *source, size_t iterations);
+static double run_compile(struct VM *vm, const char *source, size_t iterations);
+static char *build_appends(size_t count);
+static char *build_chain(size_t count);
+static double now_seconds(void);
+
+int main(int argc, const char *argv[]) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+
+  struct VM vm;
+  bench_vm_init(&vm);
+
+  char *source = build_appends(APPEND_COUNT);
+  double elapsed = run_program(&vm, source, iterations);
+  fprintf(stderr, "%-14s %-14s %lu runs in %.3fs  %.2f us/run\n",
+          BENCH_LABEL, "appends", iterations, elapsed, elapsed / (double) iterations * 1e6);
+  free(source);
+
+  source = build_chain(CHAIN_COUNT);
+  elapsed = run_program(&vm, source, iterations);
+  fprintf(stderr, "%-14s %-14s %lu runs in %.3fs  %.2f us/run\n",
+          BENCH_LABEL, "chain", iterations, elapsed, elapsed / (double) iterations * 1e6);
+  elapsed = run_compile(&vm, source, iterations);
+  fprintf(stderr, "%-14s %-14s %lu compiles in %.3fs  %.2f us/compile\n",
+          BENCH_LABEL, "chain compile", iterations, elapsed, elapsed / (double) iterations * 1e6);
+  free(source);
+
+  vm_free(&vm);
+
+  return 0;
+}
+
+// file local functions
+
+static double run_program(struct VM *vm, const char *source, size_t iterations) {
+  struct Program *program = program_compile(vm, source);
+  if (program == NULL) {
+    fprintf(stderr, "Error - benchmark source failed to compile\n");
+    exit(1);
+  }
+
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (program_execute(vm, program) != INTERPRET_RESULT_OK) {
+      fprintf(stderr, "Error - benchmark source failed at runtime\n");
+      exit(1);
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  program_free(vm, program);
+  return elapsed;
+}
+
+static double run_compile(struct VM *vm, const char *source, size_t iterations) {
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    struct Program *program = program_compile(vm, source);
+    if (program == NULL) {
+      fprintf(stderr, "Error - benchmark source failed to compile\n");
+      exit(1);
+    }
+    program_free(vm, program);
+  }
+  return now_seconds() - start;
+}
+
+// ((p + p) + p) + ... one OPCODE_ADD per append onto an ever longer string,
+// a full copy each time without ropes
+static char *build_appends(size_t count) {
+  size_t piece_length = strlen(PIECE);
+  size_t capacity = count * (piece_length + 5) + piece_length + 1;
+  char *source = (char *) malloc(capacity);
+  if (source == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark source\n");
+    exit(1);
+  }
+
+  size_t length = 0;
+  for (size_t i = 0; i < count; ++i) source[length++] = '(';
+  length += (size_t) snprintf(source + length, capacity - length, "%s", PIECE);
+  for (size_t i = 0; i < count; ++i) {
+    length += (size_t) snprintf(source + length, capacity - length, " + %s)", PIECE);
+  }
+
+  return source;
+}
+
+// p + p + p + ... split into OPCODE_CONCAT_N instructions, each of which
+// starts from the result of the one before
+static char *build_chain(size_t count) {
+  size_t piece_length = strlen(PIECE);
+  size_t capacity = count * (piece_length + 3) + 1;
+  char *source = (char *) malloc(capacity);
+  if (source == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark source\n");
+    exit(1);
+  }
+
+  size_t length = 0;
+  for (size_t i = 0; i < count; ++i) {
+    length += (size_t) snprintf(source + length, capacity - length, i > 0 ? " + %s" : "%s", PIECE);
+  }
+
+  return source;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "scanner.h"
+
+// lines of a generated configuration script, about 2.4 MB in all
+#define LINE_COUNT 60000
+#define DEFAULT_ITERATIONS 20
+
+// file local prototypes
+static char *build_corpus(size_t line_count, size_t *length);
+static size_t scan_all(const char *source);
+static double now_seconds(void);
+
+int main(int argc, const char *argv[]) {
+  size_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_ITERATIONS;
+
+  size_t length = 0;
+  char *source = build_corpus(LINE_COUNT, &length);
+
+  // warm up, and check every configuration sees the same tokens
+  size_t token_count = scan_all(source);
+
+  double start = now_seconds();
+  for (size_t i = 0; i < iterations; ++i) {
+    if (scan_all(source) != token_count) {
+      fprintf(stderr, "Error - token count changed between runs\n");
+      return 1;
+    }
+  }
+  double elapsed = now_seconds() - start;
+
+  struct Scanner scanner;
+  scanner_init(&scanner, source);
+  double tokens = (double) token_count * (double) iterations;
+  double bytes = (double) length * (double) iterations;
+  fprintf(stderr, "%-14s %-7s %lu tokens in %lu bytes x %lu runs in %.3fs  %.1f M tokens/sec  %.1f MB/sec\n",
+          BENCH_LABEL, scanner_kernel_name(&scanner), token_count, length, iterations, elapsed,
+          tokens / elapsed / 1e6, bytes / elapsed / 1e6);
+
+  free(source);
+  return 0;
+}
+
+// file local functions
+
+// indented lines mixing names, keywords, numbers, strings and comments, the
+// shape of the scripts our generators write
+static char *build_corpus(size_t line_count, size_t *length) {
+  static const char *names[] = {"timeout", "retry_count", "upstream_host", "x", "max_connections_per_worker", "i"};
+  static const char *strings[] = {"on", "eu-west-1.internal.example.com", "", "/var/lib/service/cache/objects"};
+  size_t name_count = sizeof(names) / sizeof(names[0]);
+  size_t string_count = sizeof(strings) / sizeof(strings[0]);
+
+  size_t capacity = line_count * 128 + 1;
+  char *source = (char *) malloc(capacity);
+  if (source == NULL) {
+    fprintf(stderr, "Error - not enough memory for benchmark source\n");
+    exit(1);
+  }
+
+  size_t used = 0;
+  for (size_t i = 0; i < line_count; ++i) {
+    const char *name = names[i % name_count];
+    const char *string = strings[i % string_count];
+    const char *indent = i % 3 == 0 ? "" : (i % 3 == 1 ? "  " : "        ");
+    switch (i % 4) {
+      case 0: used += (size_t) snprintf(source + used, capacity - used, "%svar %s_%lu = \"%s\";\n", indent, name, i, string); break;
+      case 1: used += (size_t) snprintf(source + used, capacity - used, "%sif (%s >= %lu.%lu) return %s * 2;\n", indent, name, i, i % 97, name); break;
+      case 2: used += (size_t) snprintf(source + used, capacity - used, "%s// generated from rule %lu, do not edit\n", indent, i); break;
+      case 3: used += (size_t) snprintf(source + used, capacity - used, "%s%s = %s + (%lu - 1) / 3;\n", indent, name, name, i); break;
+    }
+  }
+
+  *length = used;
+  return source;
+}
+
+static size_t scan_all(const char *source) {
+  struct Scanner scanner;
+  scanner_init(&scanner, source);
+
+  size_t count = 0;
+  for (;;) {
+    struct Token token = scanner_scan_token(&scanner);
+    count += 1;
+    if (token.type == TOKEN_TYPE_EOF) return count;
+  }
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
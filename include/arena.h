@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "common.h"
+
+#define ARENA_PAGE_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+// requests above this size skip the size classes and get their own block
+#define ARENA_MAX_SMALL_SIZE 512
+#define ARENA_SIZE_CLASS_COUNT (ARENA_MAX_SMALL_SIZE / ARENA_ALIGNMENT)
+
+struct ArenaPage;
+struct ArenaFreeBlock;
+struct ArenaLargeBlock;
+
+// object memory carved out of large pages: small requests are rounded up to
+// a size class and bumped out of the current page or reused from that class'
+// free list, large requests are kept on their own list so they can be
+// returned individually
+struct Arena {
+  struct ArenaPage *pages; // current page at the head
+  struct ArenaFreeBlock *free_lists[ARENA_SIZE_CLASS_COUNT];
+  struct ArenaLargeBlock *large_blocks;
+  size_t allocated_bytes; // bytes handed out and not yet released
+  size_t page_count;
+};
+
+void arena_init(struct Arena *arena);
+void arena_free(struct VM *vm, struct Arena *arena);
+void *arena_allocate(struct VM *vm, struct Arena *arena, size_t size);
+void arena_release(struct VM *vm, struct Arena *arena, void *pointer, size_t size);
+
+#endif // ARENA_H
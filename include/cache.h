@@ -0,0 +1,31 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "program.h"
+
+// used by --cache when no size is given
+#define CACHE_DEFAULT_MAX_BYTES (64 * 1024 * 1024)
+
+// directory of compiled programs named after the hash of their source, any
+// number of processes may share one. each entry also holds its source, so a
+// hash collision is a miss rather than another script's bytecode. entries are
+// written under a temporary name and renamed into place, and the least
+// recently used ones are removed once the directory grows past max_bytes
+struct CompileCache {
+  char *directory;
+  size_t max_bytes;
+  size_t hit_count;
+  size_t miss_count;
+  size_t store_count;
+  size_t eviction_count;
+};
+
+void cache_init(struct CompileCache *cache, const char *directory, size_t max_bytes);
+void cache_free(struct CompileCache *cache);
+struct Program *cache_compile(struct VM *vm, struct CompileCache *cache, const char *source); // NULL on a compile error
+void cache_print_stats(struct CompileCache *cache, FILE *out);
+
+#endif // CACHE_H
@@ -6,6 +6,10 @@
 #include "value.h"
 
 #define CHUNK_INITIAL_CAPACITY 8
+#define CHUNK_CONSTANT_INDEX_INITIAL_CAPACITY 16
+
+// widest constant index OPCODE_CONSTANT_LONG can encode
+#define CHUNK_CONSTANT_LONG_MAX 0xFFFFFF
 
 struct Chunk {
   // dynamic array
@@ -17,11 +21,26 @@ struct Chunk {
   struct ValueArray constants; // constant pool
 };
 
+// positions of a chunk's constants keyed by value, kept by whoever appends
+// to the chunk so equal constants share one slot of the pool. open
+// addressing, slots hold a constant position + 1 and 0 when empty
+struct ConstantIndex {
+  size_t *slots;
+  size_t count;
+  size_t capacity;
+};
+
 void chunk_init(struct Chunk *chunk);
-void chunk_free(struct Chunk *chunk);
-void chunk_write(struct Chunk *chunk, const uint8_t byte, const size_t line);
-size_t chunk_add_constant(struct Chunk *chunk, const struct Value constant);
-size_t chunk_write_constant(struct Chunk *chunk, const struct Value constant, const size_t line);
+void chunk_free(struct VM *vm, struct Chunk *chunk);
+void chunk_write(struct VM *vm, struct Chunk *chunk, const uint8_t byte, const size_t line, const size_t column);
+size_t chunk_add_constant(struct VM *vm, struct Chunk *chunk, const struct Value constant);
+size_t chunk_add_constant_unique(struct VM *vm, struct Chunk *chunk, struct ConstantIndex *index, const struct Value constant);
+size_t chunk_write_constant(struct VM *vm, struct Chunk *chunk, const struct Value constant, const size_t line, const size_t column);
+void chunk_write_constant_index(struct VM *vm, struct Chunk *chunk, const size_t value_index, const size_t line, const size_t column);
+void chunk_truncate(struct Chunk *chunk, const size_t byte_count, const size_t constant_count);
 size_t chunk_get_line(struct Chunk *const chunk, const size_t offset);
+size_t chunk_get_column(struct Chunk *const chunk, const size_t offset);
+void chunk_constant_index_init(struct ConstantIndex *index);
+void chunk_constant_index_free(struct VM *vm, struct ConstantIndex *index);
 
 #endif // CHUNK_H
\ No newline at end of file
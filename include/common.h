@@ -9,7 +9,72 @@
 #define TRUE  1
 #define FALSE 0
 
+// defined in vm.h, passed to everything that allocates or touches vm state
+struct VM;
+
+// define BCVM_NO_DEBUG to build without disassembly and execution tracing
+#ifndef BCVM_NO_DEBUG
 #define DEBUG_PRINT_CODE
 #define DEBUG_TRACE_EXECUTION
+#endif
+
+// threaded dispatch in vm_run relies on labels-as-values (GCC/Clang),
+// define BCVM_NO_COMPUTED_GOTO to force the portable switch
+#if defined(__GNUC__) && !defined(BCVM_NO_COMPUTED_GOTO)
+#define VM_COMPUTED_GOTO
+#endif
+
+// define BCVM_NO_CONSTANT_FOLDING to emit every operator as written
+#ifndef BCVM_NO_CONSTANT_FOLDING
+#define COMPILER_CONSTANT_FOLDING
+#endif
+
+// define BCVM_NO_PEEPHOLE to skip fusing instructions into superinstructions
+#ifndef BCVM_NO_PEEPHOLE
+#define COMPILER_PEEPHOLE
+#endif
+
+// define BCVM_NO_QUICKENING to keep vm_run from specializing generic
+// arithmetic instructions in place for the operand types it sees
+#ifndef BCVM_NO_QUICKENING
+#define VM_QUICKENING
+#endif
+
+// define BCVM_NAN_BOXING to pack every Value into a single 64-bit word
+#ifdef BCVM_NAN_BOXING
+#define VALUE_NAN_BOXING
+#endif
+
+// define BCVM_NO_OBJECT_ARENA to allocate every object with its own
+// realloc instead of carving objects out of arena pages
+#ifndef BCVM_NO_OBJECT_ARENA
+#define OBJECT_ARENA
+#endif
+
+// define BCVM_NO_ROPES to copy both operands of every string concatenation
+// right away instead of building ropes that are flattened on demand
+#ifndef BCVM_NO_ROPES
+#define OBJECT_ROPES
+#endif
+
+// the scanner skips runs of whitespace, identifiers, numbers and strings
+// with SSE2 or AVX2, whichever the cpu has, on x86-64 with GCC/Clang. define
+// BCVM_NO_SIMD_SCANNER to scan one byte at a time everywhere
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(BCVM_NO_SIMD_SCANNER)
+#define SCANNER_SIMD
+#endif
+
+// define BCVM_TOKEN_STREAM to have the compiler tokenize the whole source
+// into a TokenStream first instead of pulling tokens from the scanner one at
+// a time
+#ifdef BCVM_TOKEN_STREAM
+#define COMPILER_TOKEN_STREAM
+#endif
+
+// define BCVM_GC_STRESS to collect garbage on every allocation, which
+// shakes out objects that are missing from the root set
+#ifdef BCVM_GC_STRESS
+#define DEBUG_STRESS_GC
+#endif
 
 #endif // COMMON_H
\ No newline at end of file
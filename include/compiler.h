@@ -1,9 +1,19 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 
+#include <stdio.h>
+
 #include "common.h"
 #include "chunk.h"
 
-uint8_t compiler_compile(const char *source, struct Chunk *chunk);
+struct CompilerStats {
+  size_t folded_instruction_count; // instructions removed by constant folding
+  size_t fused_instruction_count;  // instructions removed by the peephole pass
+};
+
+uint8_t compiler_compile(struct VM *vm, const char *source, struct Chunk *chunk);
+uint8_t compiler_compile_file(struct VM *vm, FILE *file, struct Chunk *chunk);
+struct CompilerStats compiler_stats(struct VM *vm); // stats of the most recent compiler_compile on vm
+void compiler_mark_roots(struct VM *vm);
 
 #endif // COMPILER_H
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <pthread.h>
+
+#include "common.h"
+#include "vm.h"
+
+// one script to run, owned by the caller. the executor fills in the result
+// and the captured output once the job has run
+struct ExecutorJob {
+  const char *source;
+  enum InterpretResult result;
+  char *output; // everything the script printed
+  size_t output_length;
+  char *errors; // compile and runtime error messages
+  size_t errors_length;
+};
+
+// jobs of one worker, the owner takes the newest from the back and idle
+// workers steal the oldest from the front
+struct JobDeque {
+  pthread_mutex_t lock;
+  struct ExecutorJob **jobs; // ring buffer
+  size_t head;
+  size_t count;
+  size_t capacity;
+};
+
+struct Worker {
+  struct Executor *executor;
+  pthread_t thread;
+  struct VM vm; // stays warm across jobs
+  struct JobDeque deque;
+  size_t executed_count;
+  size_t stolen_count;
+};
+
+// fixed pool of worker threads, each with its own vm, running submitted jobs
+// to completion. submit and wait from a single thread
+struct Executor {
+  struct Worker *workers;
+  size_t worker_count;
+  size_t next_worker; // submissions are spread round robin
+  pthread_mutex_t lock; // guards everything below
+  pthread_cond_t work_available;
+  pthread_cond_t all_done;
+  size_t queued_count;  // submitted and not yet taken by a worker
+  size_t pending_count; // submitted and not yet finished
+  uint8_t shutdown;
+};
+
+void executor_job_init(struct ExecutorJob *job, const char *source);
+void executor_job_free(struct ExecutorJob *job);
+// allocator is shared by every worker vm and must be thread safe, NULL for malloc
+void executor_init(struct Executor *executor, size_t worker_count, const struct Allocator *allocator);
+void executor_free(struct Executor *executor);
+void executor_submit(struct Executor *executor, struct ExecutorJob *job);
+void executor_wait(struct Executor *executor);
+
+#endif // EXECUTOR_H
@@ -0,0 +1,23 @@
+#ifndef GC_H
+#define GC_H
+
+#include "common.h"
+#include "value.h"
+#include "object.h"
+
+// heap size below which no collection is ever scheduled
+#define GC_HEAP_MINIMUM (1024 * 1024)
+
+// marked objects whose references have not been traced yet
+struct GrayStack {
+  struct Object **objects;
+  size_t count;
+  size_t capacity;
+};
+
+void gc_collect(struct VM *vm);
+void gc_mark_value(struct VM *vm, struct Value value);
+void gc_mark_object(struct VM *vm, struct Object *object);
+void gc_mark_array(struct VM *vm, struct ValueArray *value_array);
+
+#endif // GC_H
@@ -4,20 +4,64 @@
 #include "common.h"
 
 #define CHUNK_LINE_INITIAL_CAPACITY 4
+#define CHUNK_COLUMN_INITIAL_CAPACITY 16
 
+// column changes a run holds before the next one starts a run of its own, so
+// a lookup never decodes more than this many
+#define LINE_RUN_MAX_COLUMN_CHANGES 32
+
+// source position of every byte from offset up to the next run's offset
+// (or the end of the chunk). a run starts with every new line, the columns
+// that follow within it are delta encoded in the column stream from
+// column_start up to the next run's column_start
 struct Line {
-  size_t line;
-  size_t line_count;
+  uint32_t offset;
+  uint32_t line;
+  uint32_t column; // of the byte at offset
+  uint32_t column_start;
 };
 
+// runs are appended in bytecode order, so offsets are strictly increasing
+// and finding the run of an offset is a binary search. a column change is
+// two LEB128 numbers, the bytes since the previous change of the run and the
+// zigzag encoded difference from its column
 struct LineArray {
   size_t line_struct_count;
   size_t line_struct_capacity;
   struct Line *lines;
+  size_t column_byte_count;
+  size_t column_byte_capacity;
+  uint8_t *columns;
+  // where the last run stands, for the next write
+  size_t last_change_count;
+  uint32_t last_offset;
+  uint32_t last_column;
+};
+
+struct LinePosition {
+  size_t line;
+  size_t column;
+};
+
+// positions of offsets visited in increasing order, decoded as it goes
+// rather than searched for every offset
+struct LineCursor {
+  const struct LineArray *line_array;
+  size_t run;
+  size_t column_index; // next byte of the run's column changes
+  size_t column_end;
+  size_t change_start; // first byte of the pending change
+  size_t change_offset; // SIZE_MAX once the run has no changes left
+  size_t change_column;
+  struct LinePosition position;
 };
 
 void line_array_init(struct LineArray *line_array);
-void line_array_free(struct LineArray *line_array);
-void line_array_write(struct LineArray *line_array, const size_t line);
+void line_array_free(struct VM *vm, struct LineArray *line_array);
+void line_array_write(struct VM *vm, struct LineArray *line_array, const size_t offset, const size_t line, const size_t column);
+void line_array_truncate(struct LineArray *line_array, const size_t byte_count);
+struct LinePosition line_array_find(const struct LineArray *line_array, const size_t offset); // line 0 if nothing was written at or before offset
+void line_cursor_init(struct LineCursor *cursor, const struct LineArray *line_array);
+struct LinePosition line_cursor_advance(struct LineCursor *cursor, const size_t offset);
 
-#endif // LINE_H
\ No newline at end of file
+#endif // LINE_H
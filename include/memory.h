@@ -3,21 +3,44 @@
 
 #include "common.h"
 
-#define MEMORY_ALLOCATE(type, count) \
-  (type *) memory_reallocate(NULL, 0, sizeof(type) * (count))
-
-#define MEMORY_FREE(type, pointer) \
-  (void) memory_reallocate(pointer, sizeof(type), 0)
+// what an allocation is for, passed down to the allocator by every call site
+enum MemoryTag {
+  MEMORY_TAG_CHUNK_BYTECODE,
+  MEMORY_TAG_LINE_ARRAY,
+  MEMORY_TAG_VALUE_ARRAY,
+  MEMORY_TAG_TABLE,
+  MEMORY_TAG_OBJECT,
+  MEMORY_TAG_SCRATCH, // short-lived working memory of the compiler and collector
+  MEMORY_TAG_COUNT
+};
+
+// host-provided memory, installed at vm_init. reallocate follows realloc
+// with the old size passed along: a NULL buffer allocates, a new_size of 0
+// frees, and a NULL result for a non-zero new_size means out of memory
+struct Allocator {
+  void *(*reallocate)(void *context, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag);
+  void *context;
+};
+
+#define MEMORY_ALLOCATE(vm, type, count, tag) \
+  (type *) memory_reallocate(vm, NULL, 0, sizeof(type) * (count), tag)
+
+#define MEMORY_FREE(vm, type, pointer, tag) \
+  (void) memory_reallocate(vm, pointer, sizeof(type), 0, tag)
 
 #define MEMORY_GROW_CAPACITY(capacity, default_cap) \
   ((capacity) < (default_cap) ? (default_cap) : (capacity) * 2)
 
-#define MEMORY_GROW_ARRAY(type, pointer, old_count, new_count) \
-  (type *) memory_reallocate(pointer, sizeof(type) * (old_count), sizeof(type) * (new_count))
+#define MEMORY_GROW_ARRAY(vm, type, pointer, old_count, new_count, tag) \
+  (type *) memory_reallocate(vm, pointer, sizeof(type) * (old_count), sizeof(type) * (new_count), tag)
 
-#define MEMORY_FREE_ARRAY(type, pointer, old_count) \
-  (void) memory_reallocate(pointer, sizeof(type) * (old_count), 0)
+#define MEMORY_FREE_ARRAY(vm, type, pointer, old_count, tag) \
+  (void) memory_reallocate(vm, pointer, sizeof(type) * (old_count), 0, tag)
 
-void *memory_reallocate(void *buffer, size_t old_size, size_t new_size);
+void *memory_reallocate(struct VM *vm, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag);
+void *memory_reallocate_untracked(struct VM *vm, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag);
+void memory_track(struct VM *vm, size_t old_size, size_t new_size);
+struct Allocator memory_default_allocator(void);
+const char *memory_tag_name(enum MemoryTag tag);
 
-#endif // MEMORY_H
\ No newline at end of file
+#endif // MEMORY_H
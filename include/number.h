@@ -0,0 +1,18 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include "common.h"
+
+// the double nearest to a number literal as scanned, digits with at most
+// one '.' between two of them, with ties going to the even mantissa
+double number_parse(const char *chars, size_t length);
+
+// longest text number_format writes, -d.ddddddddddddddddde-308
+#define NUMBER_FORMAT_MAX 32
+
+// the shortest decimal that number_parse reads back as the same double,
+// laid out like %g. writes at most NUMBER_FORMAT_MAX bytes without a
+// terminator and returns how many
+size_t number_format(double value, char *buffer);
+
+#endif // NUMBER_H
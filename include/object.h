@@ -6,38 +6,74 @@
 #include "memory.h"
 
 enum ObjectType {
-  OBJECT_TYPE_STRING
+  OBJECT_TYPE_STRING,
+  OBJECT_TYPE_ROPE
 };
 
 struct Object {
   enum ObjectType type;
+  uint8_t is_marked; // reached during the current collection
   struct Object *next;
 };
 
-#define OBJECT_TYPE(value) ((value.as.object)->type)
+#define OBJECT_TYPE(value) (VALUE_AS_OBJECT(value)->type)
 
 struct ObjectString {
   struct Object object;
   size_t length;
   uint32_t hash;
-  char buffer[]; // sizeof treats as 0
+  uint8_t is_borrowed; // chars belong to someone else, see object_object_string_borrow
+  const char *chars; // not NUL terminated when borrowed
+  char buffer[]; // sizeof treats as 0, holds the bytes unless chars points elsewhere
 };
 
-#define OBJECT_STRING_FROM_VALUE(value)        ((struct ObjectString *) (value).as.object)
-#define OBJECT_STRING_CSTR_FROM_VALUE(value)   ((struct ObjectString *) (value).as.object)->buffer
+// concatenations shorter than this are copied into a string right away
+#define OBJECT_ROPE_MIN_LENGTH 64
+// most ropes nested down right children, which flattening recurses into
+#define OBJECT_ROPE_MAX_DEPTH 32
+
+// a concatenation whose bytes have not been copied yet, left and right are
+// strings or ropes. once flattened, flat holds the interned result and the
+// children are dropped
+struct ObjectRope {
+  struct Object object;
+  size_t length;
+  size_t depth; // 0 for a string, left children do not count, they are walked in a loop
+  struct Object *left;
+  struct Object *right;
+  struct ObjectString *flat;
+};
+
+#define OBJECT_STRING_FROM_VALUE(value)        ((struct ObjectString *) VALUE_AS_OBJECT(value))
 #define OBJECT_STRING_FROM_OBJECT(object)      ((struct ObjectString *) (object))
-#define OBJECT_STRING_CSTR_FROM_OBJECT(object) ((struct ObjectString *) (object))->buffer
 #define OBJECT_IS_OBJECT_STRING(value)         object_is_object_type(value, OBJECT_TYPE_STRING)
+#define OBJECT_ROPE_FROM_VALUE(value)          ((struct ObjectRope *) VALUE_AS_OBJECT(value))
+#define OBJECT_ROPE_FROM_OBJECT(object)        ((struct ObjectRope *) (object))
+#define OBJECT_IS_OBJECT_ROPE(value)           object_is_object_type(value, OBJECT_TYPE_ROPE)
+// a string as scripts see it, flat or a rope
+#define OBJECT_IS_ANY_STRING(value)            (OBJECT_IS_OBJECT_STRING(value) || OBJECT_IS_OBJECT_ROPE(value))
 static inline uint8_t object_is_object_type(struct Value value, enum ObjectType type) {
   return VALUE_IS_OBJECT(value) && OBJECT_TYPE(value) == type;
 }
 
-struct ObjectString *object_object_string_from_parts(const char *buffer, size_t length);
-struct ObjectString *object_object_string_copy(struct ObjectString *string);
-struct ObjectString *object_object_string_allocate(size_t length);
+// byte length of a string or rope
+static inline size_t object_string_length(struct Object *object) {
+  return object->type == OBJECT_TYPE_ROPE ? OBJECT_ROPE_FROM_OBJECT(object)->length : OBJECT_STRING_FROM_OBJECT(object)->length;
+}
+
+struct ObjectString *object_object_string_from_parts(struct VM *vm, const char *buffer, size_t length);
+struct ObjectString *object_object_string_borrow(struct VM *vm, const char *chars, size_t length, uint32_t hash);
+void object_object_string_detach(struct VM *vm, struct ObjectString *string);
+struct ObjectString *object_object_string_copy(struct VM *vm, struct ObjectString *string);
+struct ObjectString *object_object_string_concatenate(struct VM *vm, struct ObjectString *a, struct ObjectString *b);
+struct ObjectString *object_object_string_concatenate_n(struct VM *vm, const struct Value *parts, size_t count);
+struct ObjectString *object_object_string_allocate(struct VM *vm, size_t length);
+struct Object *object_object_string_join(struct VM *vm, struct Object *a, struct Object *b);
+struct ObjectString *object_object_rope_flatten(struct VM *vm, struct ObjectRope *rope);
 void object_object_string_update_hash(struct ObjectString *string);
-struct Object *object_allocate_object(size_t size, enum ObjectType type);
-void object_free_objects(void);
-void object_print(struct Value value);
+struct Object *object_allocate_object(struct VM *vm, size_t size, enum ObjectType type);
+void object_free_object(struct VM *vm, struct Object *object);
+void object_free_objects(struct VM *vm);
+void object_write(struct Output *output, struct Value value);
 
 #endif // OBJECT_H
\ No newline at end of file
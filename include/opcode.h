@@ -1,25 +1,108 @@
 #ifndef OPCODE_H
 #define OPCODE_H
 
+#include "common.h"
+
+// single source of truth for the instruction set, expanded into the
+// enum below and into the threaded dispatch table in vm_run
+//   X(opcode, operand bytes following the opcode)
+#define OPCODE_LIST(X)       \
+  X(OPCODE_CONSTANT,      1) \
+  X(OPCODE_CONSTANT_LONG, 3) \
+  X(OPCODE_NUMBER_BYTE,   1) \
+  X(OPCODE_NUMBER_SHORT,  2) \
+  X(OPCODE_NIL,           0) \
+  X(OPCODE_TRUE,          0) \
+  X(OPCODE_FALSE,         0) \
+  X(OPCODE_BANG_EQUAL,    0) \
+  X(OPCODE_EQUAL_EQUAL,   0) \
+  X(OPCODE_GREATER,       0) \
+  X(OPCODE_GREATER_EQUAL, 0) \
+  X(OPCODE_LESS,          0) \
+  X(OPCODE_LESS_EQUAL,    0) \
+  X(OPCODE_ADD,           0) \
+  X(OPCODE_SUBTRACT,      0) \
+  X(OPCODE_MULTIPLY,      0) \
+  X(OPCODE_DIVIDE,        0) \
+  X(OPCODE_NOT,           0) \
+  X(OPCODE_NEGATE,        0) \
+  X(OPCODE_CONCAT_N,      1) \
+  X(OPCODE_RETURN,        0) \
+  /* superinstructions, only produced by the peephole pass */ \
+  X(OPCODE_ADD_CONSTANT,           1) \
+  X(OPCODE_SUBTRACT_CONSTANT,      1) \
+  X(OPCODE_MULTIPLY_CONSTANT,      1) \
+  X(OPCODE_DIVIDE_CONSTANT,        1) \
+  X(OPCODE_GREATER_CONSTANT,       1) \
+  X(OPCODE_GREATER_EQUAL_CONSTANT, 1) \
+  X(OPCODE_LESS_CONSTANT,          1) \
+  X(OPCODE_LESS_EQUAL_CONSTANT,    1) \
+  X(OPCODE_EQUAL_CONSTANT,         1) \
+  X(OPCODE_BANG_EQUAL_CONSTANT,    1) \
+  X(OPCODE_NOT_GREATER,            0) \
+  X(OPCODE_NOT_GREATER_EQUAL,      0) \
+  X(OPCODE_NOT_LESS,               0) \
+  X(OPCODE_NOT_LESS_EQUAL,         0) \
+  X(OPCODE_ADD_IMMEDIATE,           1) \
+  X(OPCODE_SUBTRACT_IMMEDIATE,      1) \
+  X(OPCODE_MULTIPLY_IMMEDIATE,      1) \
+  X(OPCODE_DIVIDE_IMMEDIATE,        1) \
+  X(OPCODE_GREATER_IMMEDIATE,       1) \
+  X(OPCODE_GREATER_EQUAL_IMMEDIATE, 1) \
+  X(OPCODE_LESS_IMMEDIATE,          1) \
+  X(OPCODE_LESS_EQUAL_IMMEDIATE,    1) \
+  X(OPCODE_EQUAL_IMMEDIATE,         1) \
+  X(OPCODE_BANG_EQUAL_IMMEDIATE,    1) \
+  /* quickened forms, only written into the bytecode by vm_run */ \
+  X(OPCODE_ADD_NUMBER,           0) \
+  X(OPCODE_ADD_STRING,           0) \
+  X(OPCODE_SUBTRACT_NUMBER,      0) \
+  X(OPCODE_MULTIPLY_NUMBER,      0) \
+  X(OPCODE_DIVIDE_NUMBER,        0) \
+  X(OPCODE_GREATER_NUMBER,       0) \
+  X(OPCODE_GREATER_EQUAL_NUMBER, 0) \
+  X(OPCODE_LESS_NUMBER,          0) \
+  X(OPCODE_LESS_EQUAL_NUMBER,    0)
+
+#define OPCODE_ENUM_ENTRY(opcode, operand_bytes) opcode,
+
 enum OpCode {
-  OPCODE_CONSTANT,      // 8 bits
-  OPCODE_CONSTANT_LONG, // 24 bits
-  OPCODE_NIL,
-  OPCODE_TRUE,
-  OPCODE_FALSE,
-  OPCODE_BANG_EQUAL,
-  OPCODE_EQUAL_EQUAL,
-  OPCODE_GREATER,
-  OPCODE_GREATER_EQUAL,
-  OPCODE_LESS,
-  OPCODE_LESS_EQUAL,
-  OPCODE_ADD,
-  OPCODE_SUBTRACT,
-  OPCODE_MULTIPLY,
-  OPCODE_DIVIDE,
-  OPCODE_NOT,
-  OPCODE_NEGATE,
-  OPCODE_RETURN,
+  OPCODE_LIST(OPCODE_ENUM_ENTRY)
+  OPCODE_COUNT
 };
 
+#undef OPCODE_ENUM_ENTRY
+
+// total encoded size of an instruction, opcode byte included
+static inline size_t opcode_size(uint8_t opcode) {
+  switch (opcode) {
+#define OPCODE_SIZE_CASE(opcode, operand_bytes) case opcode: return 1 + (operand_bytes);
+    OPCODE_LIST(OPCODE_SIZE_CASE)
+#undef OPCODE_SIZE_CASE
+    default: return 1;
+  }
+}
+
+// most operands one OPCODE_CONCAT_N adds together, every operand occupies a
+// stack slot until the instruction runs, so longer chains are split
+#define OPCODE_CONCAT_N_MAX 32
+
+// small integer literals are encoded in the instruction itself as two's
+// complement, one byte for OPCODE_NUMBER_BYTE and the *_IMMEDIATE forms and
+// two big-endian bytes for OPCODE_NUMBER_SHORT
+#define OPCODE_BYTE_IMMEDIATE_MIN  (-128)
+#define OPCODE_BYTE_IMMEDIATE_MAX  127
+#define OPCODE_SHORT_IMMEDIATE_MIN (-32768)
+#define OPCODE_SHORT_IMMEDIATE_MAX 32767
+
+// flipping the sign bit and subtracting it back sign-extends without a branch
+static inline double opcode_byte_immediate(uint8_t byte) {
+  return (double) ((int32_t) (byte ^ 0x80u) - 0x80);
+}
+
+static inline double opcode_short_immediate(uint8_t high, uint8_t low) {
+  uint32_t bits = ((uint32_t) high << 8) | low;
+  return (double) ((int32_t) (bits ^ 0x8000u) - 0x8000);
+}
+
 #endif // OPCODE_H
\ No newline at end of file
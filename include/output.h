@@ -0,0 +1,36 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdio.h>
+
+#include "common.h"
+
+#define OUTPUT_BUFFER_SIZE (8 * 1024)
+
+// where buffered output ends up, installed with vm_set_output. write
+// takes every byte or returns FALSE, after which the bytes are dropped
+struct OutputSink {
+  uint8_t (*write)(void *context, const char *bytes, size_t length);
+  void *context;
+};
+
+// when a buffer is handed to its sink besides whenever it fills up
+enum OutputFlush {
+  OUTPUT_FLUSH_RESULT, // after every result, for interactive use
+  OUTPUT_FLUSH_FULL    // only when full or flushed explicitly
+};
+
+struct Output {
+  struct OutputSink sink;
+  enum OutputFlush flush;
+  size_t length;
+  char buffer[OUTPUT_BUFFER_SIZE];
+};
+
+void output_init(struct Output *output, struct OutputSink sink, enum OutputFlush flush);
+uint8_t output_flush(struct Output *output); // FALSE when the sink failed
+void output_write(struct Output *output, const char *bytes, size_t length);
+void output_end_result(struct Output *output); // newline, then flush as the policy says
+struct OutputSink output_file_sink(FILE *file); // fwrite to file, which is not closed
+
+#endif // OUTPUT_H
@@ -0,0 +1,9 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "common.h"
+#include "chunk.h"
+
+size_t peephole_optimize(struct VM *vm, struct Chunk *chunk);
+
+#endif // PEEPHOLE_H
@@ -0,0 +1,35 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "memory.h"
+
+// power of two size buckets, from <= 16 bytes up to everything past 256 KiB
+#define PROFILER_SMALLEST_BUCKET_SHIFT 4
+#define PROFILER_HISTOGRAM_BUCKETS 16
+
+struct TagProfile {
+  size_t live_bytes;
+  size_t peak_bytes;
+  size_t allocation_count;
+  size_t reallocation_count;
+  size_t free_count;
+  size_t histogram[PROFILER_HISTOGRAM_BUCKETS]; // requested sizes of allocations and resizes
+};
+
+// allocator that records every request per MemoryTag before forwarding it
+// to the allocator it wraps
+struct Profiler {
+  struct Allocator inner;
+  struct TagProfile tags[MEMORY_TAG_COUNT];
+  size_t live_bytes;
+  size_t peak_bytes;
+};
+
+void profiler_init(struct Profiler *profiler, const struct Allocator *inner);
+struct Allocator profiler_allocator(struct Profiler *profiler);
+uint8_t profiler_report(const struct Allocator *allocator, FILE *out);
+
+#endif // PROFILER_H
@@ -0,0 +1,42 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "common.h"
+#include "chunk.h"
+#include "vm.h"
+
+// first bytes of every file written by program_write
+#define PROGRAM_FILE_MAGIC "BCVM"
+#define PROGRAM_FILE_VERSION 8
+
+// starting value for program_hash
+#define PROGRAM_HASH_SEED 14695981039346656037u
+
+struct ProgramFileString;
+
+// source compiled once, executed any number of times on the vm that compiled
+// it. the program owns its chunk and keeps every constant, interned string
+// literals included, alive until program_free
+struct Program {
+  struct Chunk chunk;
+  struct Program *previous; // live programs of the vm, doubly linked so
+  struct Program *next;     // any of them can be freed in any order
+  // set for programs loaded by program_load, whose chunk points into the mapping
+  void *mapping;
+  size_t mapping_size;
+  const struct ProgramFileString *pending_strings; // string constants not yet made into objects
+  size_t pending_string_count;
+};
+
+struct Program *program_compile(struct VM *vm, const char *source); // NULL on a compile error
+struct Program *program_load(struct VM *vm, const char *file_path); // NULL if the file is not a valid program
+uint8_t program_write(struct VM *vm, struct Program *program, const char *source, const char *file_path); // source may be NULL
+uint8_t program_source_matches(struct Program *program, const char *source, size_t length);
+uint8_t program_is_program_file(const char *file_path);
+uint64_t program_hash(uint64_t hash, const void *bytes, size_t length);
+enum InterpretResult program_execute(struct VM *vm, struct Program *program);
+void program_free(struct VM *vm, struct Program *program);
+void program_free_programs(struct VM *vm);
+void program_mark_roots(struct VM *vm);
+
+#endif // PROGRAM_H
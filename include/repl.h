@@ -3,7 +3,9 @@
 
 #include "common.h"
 
-void repl_run(void);
-void repl_run_file(const char *file_path);
+void repl_run(struct VM *vm);
+void repl_run_file(struct VM *vm, const char *file_path);
+void repl_compile_file(struct VM *vm, const char *file_path, const char *output_path);
+void repl_run_files(const char **file_paths, size_t file_count, size_t worker_count);
 
 #endif // REPL_H
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
+#include <stdio.h>
+
 #include "common.h"
 
 enum TokenType {
@@ -30,9 +32,75 @@ struct Token {
   const char *start;
   size_t length;
   size_t line;
+  size_t column; // of the first character, counted in bytes from 1
+};
+
+struct ScannerKernels;
+
+// bytes read from a file at a time when scanning through a window
+#define SCANNER_WINDOW_SIZE (64 * 1024)
+
+// part of a source read from a file, refilled as the scanner reaches its
+// end so the whole source is never in memory at once
+struct ScannerWindow {
+  struct VM *vm;
+  FILE *file;
+  char *buffer; // length bytes of the source followed by '\0'
+  size_t length;
+  size_t capacity; // only grows for tokens that do not fit in the window
+  uint8_t is_eof;
+  uint8_t has_error; // reading file failed, the source ends early
+};
+
+// scanning state of one source string, owned by the compiler using it
+struct Scanner {
+  const char *start;
+  const char *current;
+  const char *line_start; // first character of the current line
+  size_t line;
+  size_t column; // of start
+  const struct ScannerKernels *kernels; // picked for the running cpu by scanner_init
+  struct ScannerWindow *window; // NULL when the whole source is in memory
+  size_t dropped_line;  // line whose beginning was dropped by a window refill
+  size_t dropped_bytes; // how many of its bytes, columns on it count them too
+};
+
+// tokens where every token with index >= token, up to the next run, is on
+// line and has its column counted from line_start
+struct TokenLine {
+  uint32_t token;
+  uint32_t line;
+  uint32_t line_start; // offset into the source
+};
+
+// a whole source tokenized up front, one array per field. a token is its
+// type, the offset of its first character and its length, except error
+// tokens, whose length is an index into messages
+struct TokenStream {
+  const char *source;
+  uint8_t *types;
+  uint32_t *offsets;
+  uint32_t *lengths;
+  size_t count;
+  size_t capacity;
+  struct TokenLine *lines;
+  size_t line_count;
+  size_t line_capacity;
+  const char **messages;
+  size_t message_count;
+  size_t message_capacity;
 };
 
-void scanner_init(const char *source);
-struct Token scanner_scan_token(void);
+void scanner_init(struct Scanner *scanner, const char *source);
+struct Token scanner_scan_token(struct Scanner *scanner);
+void scanner_init_window(struct Scanner *scanner, struct ScannerWindow *window);
+struct Token scanner_scan_token_keeping(struct Scanner *scanner, struct Token *keep);
+void scanner_window_init(struct VM *vm, struct ScannerWindow *window, FILE *file);
+void scanner_window_free(struct ScannerWindow *window);
+const char *scanner_kernel_name(struct Scanner *scanner);
+void token_stream_init(struct TokenStream *stream);
+uint8_t token_stream_scan(struct VM *vm, struct TokenStream *stream, const char *source);
+struct Token token_stream_token(const struct TokenStream *stream, size_t index, size_t *line_run);
+void token_stream_free(struct VM *vm, struct TokenStream *stream);
 
 #endif // SCANNER_H
\ No newline at end of file
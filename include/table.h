@@ -16,10 +16,12 @@ struct Table {
 };
 
 void table_init(struct Table *table);
-void table_free(struct Table *table);
-uint8_t table_set(struct Table *table, struct ObjectString *key, struct Value value);
+void table_free(struct VM *vm, struct Table *table);
+uint8_t table_set(struct VM *vm, struct Table *table, struct ObjectString *key, struct Value value);
 uint8_t table_get(struct Table *table, struct ObjectString *key, struct Value *out);
 uint8_t table_remove(struct Table *table, struct ObjectString *key);
-void table_set_all_from(struct Table *dest, struct Table *src);
+void table_set_all_from(struct VM *vm, struct Table *dest, struct Table *src);
+size_t table_remove_unmarked(struct Table *table);
+struct ObjectString *table_find_string(struct Table *table, const char *buffer, size_t length, uint32_t hash);
 
 #endif // TABLE_H
\ No newline at end of file
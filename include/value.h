@@ -1,7 +1,11 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <stdio.h>
+#include <string.h>
+
 #include "common.h"
+#include "output.h"
 
 #define VALUE_ARRAY_INITIAL_CAPACITY 8
 
@@ -12,6 +16,57 @@ enum ValueType {
   VALUE_TYPE_OBJECT
 };
 
+#ifdef VALUE_NAN_BOXING
+
+// every non-number lives inside the payload of a quiet NaN:
+//   number - any double whose quiet NaN bits are not all set
+//   nil, false, true - quiet NaN with a small tag in the low bits
+//   object - sign bit | quiet NaN | 48-bit pointer
+// 0x7ffc (rather than 0x7ff8) leaves the canonical NaN produced by
+// arithmetic, 0x7ff8000000000000, classified as a number
+#define VALUE_SIGN_BIT  ((uint64_t) 0x8000000000000000)
+#define VALUE_QNAN      ((uint64_t) 0x7ffc000000000000)
+
+#define VALUE_TAG_NIL   1
+#define VALUE_TAG_FALSE 2
+#define VALUE_TAG_TRUE  3
+
+#define VALUE_NIL_BITS   (VALUE_QNAN | VALUE_TAG_NIL)
+#define VALUE_FALSE_BITS (VALUE_QNAN | VALUE_TAG_FALSE)
+#define VALUE_TRUE_BITS  (VALUE_QNAN | VALUE_TAG_TRUE)
+
+struct Value {
+  uint64_t bits;
+};
+
+static inline double value_bits_to_number(uint64_t bits) {
+  double number;
+  memcpy(&number, &bits, sizeof(double));
+  return number;
+}
+
+static inline struct Value value_number_to_value(double number) {
+  struct Value value;
+  memcpy(&value.bits, &number, sizeof(double));
+  return value;
+}
+
+#define VALUE_IS_NIL(value)     ((value).bits == VALUE_NIL_BITS)
+#define VALUE_IS_BOOL(value)    (((value).bits | 1) == VALUE_TRUE_BITS)
+#define VALUE_IS_NUMBER(value)  (((value).bits & VALUE_QNAN) != VALUE_QNAN)
+#define VALUE_IS_OBJECT(value)  (((value).bits & (VALUE_QNAN | VALUE_SIGN_BIT)) == (VALUE_QNAN | VALUE_SIGN_BIT))
+
+#define VALUE_AS_BOOL(value)    ((value).bits == VALUE_TRUE_BITS)
+#define VALUE_AS_NUMBER(value)  value_bits_to_number((value).bits)
+#define VALUE_AS_OBJECT(value)  ((struct Object *) (uintptr_t) ((value).bits & ~(VALUE_SIGN_BIT | VALUE_QNAN)))
+
+#define VALUE_NIL()          ((struct Value) {.bits = VALUE_NIL_BITS})
+#define VALUE_BOOL(value)    ((struct Value) {.bits = (value) ? VALUE_TRUE_BITS : VALUE_FALSE_BITS})
+#define VALUE_NUMBER(value)  value_number_to_value(value)
+#define VALUE_OBJECT(obj)    ((struct Value) {.bits = VALUE_SIGN_BIT | VALUE_QNAN | (uint64_t) (uintptr_t) (obj)})
+
+#else
+
 struct Value {
   enum ValueType type;
   union {
@@ -26,11 +81,17 @@ struct Value {
 #define VALUE_IS_NUMBER(value)  ((value).type == VALUE_TYPE_NUMBER)
 #define VALUE_IS_OBJECT(value)  ((value).type == VALUE_TYPE_OBJECT)
 
+#define VALUE_AS_BOOL(value)    ((value).as.boolean)
+#define VALUE_AS_NUMBER(value)  ((value).as.number)
+#define VALUE_AS_OBJECT(value)  ((value).as.object)
+
 #define VALUE_NIL()          ((struct Value) {.type = VALUE_TYPE_NIL, .as = {.number = 0}})
 #define VALUE_BOOL(value)    ((struct Value) {.type = VALUE_TYPE_BOOL, .as = {.boolean = (value)}})
 #define VALUE_NUMBER(value)  ((struct Value) {.type = VALUE_TYPE_NUMBER, .as = {.number = (value)}})
 #define VALUE_OBJECT(obj)    ((struct Value) {.type = VALUE_TYPE_OBJECT, {.object = (struct Object *) (obj)}})
 
+#endif // VALUE_NAN_BOXING
+
 uint8_t value_equal(struct Value a, struct Value b);
 
 struct ValueArray {
@@ -40,8 +101,9 @@ struct ValueArray {
 };
 
 void value_array_init(struct ValueArray *value_array);
-void value_array_free(struct ValueArray *value_array);
-void value_array_write(struct ValueArray *value_array, struct Value value);
-void value_print(struct Value value);
+void value_array_free(struct VM *vm, struct ValueArray *value_array);
+void value_array_write(struct VM *vm, struct ValueArray *value_array, struct Value value);
+void value_write(struct Output *output, struct Value value);
+void value_print(FILE *out, struct Value value); // unbuffered, for debug output
 
 #endif // VALUE_H
\ No newline at end of file
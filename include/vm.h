@@ -4,6 +4,12 @@
 #include "common.h"
 #include "chunk.h"
 #include "value.h"
+#include "table.h"
+#include "arena.h"
+#include "memory.h"
+#include "gc.h"
+#include "compiler.h"
+#include "output.h"
 
 #define STACK_MAX 256
 
@@ -14,20 +20,42 @@ enum InterpretResult {
 };
 
 struct VM {
-  struct Chunk *chunk;
+  struct Allocator allocator; // every allocation of this vm goes through it
+  struct Chunk *chunk; // running chunk, NULL between runs
+  struct Compiler *compiler; // compilation in progress, NULL otherwise
+  struct Program *programs; // compiled programs not yet freed, their constants are roots
+  struct CompileCache *cache; // consulted when running files, NULL for none
+  struct Output out; // results printed by OPCODE_RETURN, stdout by default
+  FILE *err; // compile and runtime errors, stderr by default
   uint8_t *ip; // instruction pointer
   struct Value stack[STACK_MAX];
   struct Value *stack_top;
   struct Object *objects; // list of allocated object nodes
+  struct Table strings; // intern table, every live string is a key
+  size_t interned_string_count;
+  size_t interned_bytes_saved; // bytes of string allocations a lookup made unnecessary
+  size_t rope_count; // concatenations that deferred their copy
+  size_t flattened_rope_count;
+  size_t bytes_allocated; // live bytes handed out by memory_reallocate
+  size_t next_gc; // collect once bytes_allocated passes this
+  size_t gc_collection_count;
+  size_t gc_freed_bytes;
+  struct GrayStack gray_stack;
+  struct CompilerStats compiler_stats; // of the most recent compiler_compile
+#ifdef OBJECT_ARENA
+  struct Arena object_arena; // backing memory of every object
+#endif
 };
 
-extern struct VM global_vm;
-
-// static singleton instance is modified
-void vm_init(void);
-void vm_free(void);
-enum InterpretResult vm_interpret(const char *source);
-void vm_push(struct Value value);
-struct Value vm_pop();
+// every vm is independent, separate threads may each run their own
+void vm_init(struct VM *vm, const struct Allocator *allocator); // NULL for malloc and friends
+void vm_free(struct VM *vm);
+void vm_set_output(struct VM *vm, struct OutputSink sink, enum OutputFlush flush); // flushes what the previous sink has pending
+enum InterpretResult vm_interpret(struct VM *vm, const char *source); // compile, run once and discard, see program.h to keep it
+enum InterpretResult vm_interpret_file(struct VM *vm, FILE *file); // as vm_interpret, reading the source while compiling it
+enum InterpretResult vm_interpret_chunk(struct VM *vm, struct Chunk *chunk); // run an already compiled chunk
+void vm_print_stats(struct VM *vm);
+void vm_push(struct VM *vm, struct Value value);
+struct Value vm_pop(struct VM *vm);
 
 #endif // VM_H
\ No newline at end of file
@@ -0,0 +1,137 @@
+
+#include "arena.h"
+#include "memory.h"
+
+#define ARENA_ROUND_UP(size) (((size) + ARENA_ALIGNMENT - 1) & ~((size_t) ARENA_ALIGNMENT - 1))
+
+struct ArenaPage {
+  struct ArenaPage *next;
+  size_t used; // bump offset from the start of the page
+};
+
+struct ArenaFreeBlock {
+  struct ArenaFreeBlock *next;
+};
+
+struct ArenaLargeBlock {
+  struct ArenaLargeBlock *previous;
+  struct ArenaLargeBlock *next;
+  size_t size; // of the whole block, header included
+};
+
+#define ARENA_PAGE_HEADER_SIZE  ARENA_ROUND_UP(sizeof(struct ArenaPage))
+#define ARENA_LARGE_HEADER_SIZE ARENA_ROUND_UP(sizeof(struct ArenaLargeBlock))
+
+// file local prototypes
+static void *allocate_small(struct VM *vm, struct Arena *arena, size_t class_size);
+static void *allocate_large(struct VM *vm, struct Arena *arena, size_t size);
+static size_t size_class(size_t size);
+
+void arena_init(struct Arena *arena) {
+  arena->pages = NULL;
+  for (size_t i = 0; i < ARENA_SIZE_CLASS_COUNT; ++i) {
+    arena->free_lists[i] = NULL;
+  }
+  arena->large_blocks = NULL;
+  arena->allocated_bytes = 0;
+  arena->page_count = 0;
+}
+
+// pages are requested from the installed allocator untracked, the objects
+// inside them are what counts against the gc budget
+
+// release everything at once, one free per page rather than per object
+void arena_free(struct VM *vm, struct Arena *arena) {
+  memory_track(vm, arena->allocated_bytes, 0);
+
+  struct ArenaPage *page = arena->pages;
+  while (page != NULL) {
+    struct ArenaPage *next = page->next;
+    memory_reallocate_untracked(vm, page, ARENA_PAGE_SIZE, 0, MEMORY_TAG_OBJECT);
+    page = next;
+  }
+
+  struct ArenaLargeBlock *block = arena->large_blocks;
+  while (block != NULL) {
+    struct ArenaLargeBlock *next = block->next;
+    memory_reallocate_untracked(vm, block, block->size, 0, MEMORY_TAG_OBJECT);
+    block = next;
+  }
+
+  arena_init(arena);
+}
+
+void *arena_allocate(struct VM *vm, struct Arena *arena, size_t size) {
+  assert(size > 0);
+
+  // count the request against the gc budget first, a collection started
+  // here can refill the free lists this allocation is about to use
+  memory_track(vm, 0, size);
+  arena->allocated_bytes += size;
+
+  if (size > ARENA_MAX_SMALL_SIZE) return allocate_large(vm, arena, size);
+
+  size_t index = size_class(size);
+  struct ArenaFreeBlock *block = arena->free_lists[index];
+  if (block != NULL) {
+    arena->free_lists[index] = block->next;
+    return block;
+  }
+
+  return allocate_small(vm, arena, (index + 1) * ARENA_ALIGNMENT);
+}
+
+// size must match the one passed to arena_allocate
+void arena_release(struct VM *vm, struct Arena *arena, void *pointer, size_t size) {
+  memory_track(vm, size, 0);
+  arena->allocated_bytes -= size;
+
+  if (size > ARENA_MAX_SMALL_SIZE) {
+    struct ArenaLargeBlock *block = (struct ArenaLargeBlock *) ((uint8_t *) pointer - ARENA_LARGE_HEADER_SIZE);
+    if (block->previous != NULL) block->previous->next = block->next;
+    else                         arena->large_blocks = block->next;
+    if (block->next != NULL) block->next->previous = block->previous;
+    memory_reallocate_untracked(vm, block, block->size, 0, MEMORY_TAG_OBJECT);
+    return;
+  }
+
+  size_t index = size_class(size);
+  struct ArenaFreeBlock *block = (struct ArenaFreeBlock *) pointer;
+  block->next = arena->free_lists[index];
+  arena->free_lists[index] = block;
+}
+
+// file local functions
+
+static void *allocate_small(struct VM *vm, struct Arena *arena, size_t class_size) {
+  struct ArenaPage *page = arena->pages;
+
+  // whatever is left at the end of a full page is abandoned
+  if (page == NULL || page->used + class_size > ARENA_PAGE_SIZE) {
+    page = (struct ArenaPage *) memory_reallocate_untracked(vm, NULL, 0, ARENA_PAGE_SIZE, MEMORY_TAG_OBJECT);
+    page->next = arena->pages;
+    page->used = ARENA_PAGE_HEADER_SIZE;
+    arena->pages = page;
+    arena->page_count += 1;
+  }
+
+  void *result = (uint8_t *) page + page->used;
+  page->used += class_size;
+  return result;
+}
+
+static void *allocate_large(struct VM *vm, struct Arena *arena, size_t size) {
+  size_t block_size = ARENA_LARGE_HEADER_SIZE + size;
+  struct ArenaLargeBlock *block = (struct ArenaLargeBlock *) memory_reallocate_untracked(vm, NULL, 0, block_size, MEMORY_TAG_OBJECT);
+  block->size = block_size;
+  block->previous = NULL;
+  block->next = arena->large_blocks;
+  if (block->next != NULL) block->next->previous = block;
+  arena->large_blocks = block;
+
+  return (uint8_t *) block + ARENA_LARGE_HEADER_SIZE;
+}
+
+static size_t size_class(size_t size) {
+  return ARENA_ROUND_UP(size) / ARENA_ALIGNMENT - 1;
+}
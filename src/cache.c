@@ -0,0 +1,202 @@
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+#include "vm.h"
+
+#define CACHE_ENTRY_SUFFIX ".bcvm"
+
+// file local prototypes
+static uint64_t source_key(const char *source, size_t length);
+static char *entry_path(struct CompileCache *cache, uint64_t key, size_t length, const char *suffix);
+static void store(struct VM *vm, struct CompileCache *cache, struct Program *program, const char *source, const char *path);
+static void evict(struct CompileCache *cache);
+static int compare_by_access(const void *a, const void *b);
+static void *checked_malloc(size_t size);
+
+// one file of the cache directory, as seen by evict
+struct CacheEntry {
+  char *path;
+  size_t size;
+  struct timespec last_used;
+};
+
+void cache_init(struct CompileCache *cache, const char *directory, size_t max_bytes) {
+  size_t length = strlen(directory);
+  cache->directory = (char *) checked_malloc(length + 1);
+  memcpy(cache->directory, directory, length + 1);
+  cache->max_bytes = max_bytes;
+  cache->hit_count = 0;
+  cache->miss_count = 0;
+  cache->store_count = 0;
+  cache->eviction_count = 0;
+
+  if (mkdir(directory, 0777) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Error - could not create cache directory \"%s\".\n", directory);
+  }
+}
+
+void cache_free(struct CompileCache *cache) {
+  free(cache->directory);
+  cache->directory = NULL;
+}
+
+// load the program compiled from an identical source if there is one,
+// otherwise compile it and store it for the next caller
+struct Program *cache_compile(struct VM *vm, struct CompileCache *cache, const char *source) {
+  size_t length = strlen(source);
+  uint64_t key = source_key(source, length);
+  char *path = entry_path(cache, key, length, CACHE_ENTRY_SUFFIX);
+
+  // a damaged entry fails its checksum in program_load and is replaced. so is
+  // one stored for another source whose key collided with this one
+  struct Program *program = NULL;
+  if (access(path, R_OK) == 0) program = program_load(vm, path);
+  if (program != NULL && !program_source_matches(program, source, length)) {
+    program_free(vm, program);
+    program = NULL;
+  }
+
+  if (program != NULL) {
+    cache->hit_count += 1;
+    // the modification time doubles as the last use for eviction
+    utimensat(AT_FDCWD, path, NULL, 0);
+  } else {
+    cache->miss_count += 1;
+    program = program_compile(vm, source);
+    if (program != NULL) store(vm, cache, program, source, path);
+  }
+
+  free(path);
+  return program;
+}
+
+void cache_print_stats(struct CompileCache *cache, FILE *out) {
+  fprintf(out, "== compile cache ==\n");
+  fprintf(out, "hits:                %lu\n", cache->hit_count);
+  fprintf(out, "misses:              %lu\n", cache->miss_count);
+  fprintf(out, "stored:              %lu\n", cache->store_count);
+  fprintf(out, "evicted:             %lu\n", cache->eviction_count);
+}
+
+// file local functions
+
+// the layout of a program file is part of the key, so builds that cannot
+// load each other's files never collide in a shared directory
+static uint64_t source_key(const char *source, size_t length) {
+  uint32_t layout[] = {PROGRAM_FILE_VERSION, sizeof(struct Value), sizeof(size_t)};
+  uint64_t key = program_hash(PROGRAM_HASH_SEED, layout, sizeof(layout));
+  return program_hash(key, source, length);
+}
+
+// the source length goes into the name too, so a hash collision would also
+// need sources of the same length before cache_compile compares the bytes
+static char *entry_path(struct CompileCache *cache, uint64_t key, size_t length, const char *suffix) {
+  size_t capacity = strlen(cache->directory) + strlen(suffix) + 64;
+  char *path = (char *) checked_malloc(capacity);
+  snprintf(path, capacity, "%s/%016llx-%lu%s", cache->directory, (unsigned long long) key, length, suffix);
+  return path;
+}
+
+// the source is stored with the program for cache_compile to compare. write
+// under a name private to this process, then rename over the entry so
+// readers only ever map complete files
+static void store(struct VM *vm, struct CompileCache *cache, struct Program *program, const char *source, const char *path) {
+  size_t capacity = strlen(path) + 32;
+  char *temporary_path = (char *) checked_malloc(capacity);
+  snprintf(temporary_path, capacity, "%s.%ld.tmp", path, (long) getpid());
+
+  if (program_write(vm, program, source, temporary_path) && rename(temporary_path, path) == 0) {
+    cache->store_count += 1;
+    evict(cache);
+  } else {
+    remove(temporary_path);
+  }
+
+  free(temporary_path);
+}
+
+static void evict(struct CompileCache *cache) {
+  DIR *directory = opendir(cache->directory);
+  if (directory == NULL) return;
+
+  size_t entry_count = 0;
+  size_t entry_capacity = 0;
+  struct CacheEntry *entries = NULL;
+  size_t total_size = 0;
+
+  size_t directory_length = strlen(cache->directory);
+  size_t suffix_length = strlen(CACHE_ENTRY_SUFFIX);
+  for (struct dirent *dirent = readdir(directory); dirent != NULL; dirent = readdir(directory)) {
+    size_t name_length = strlen(dirent->d_name);
+    if (name_length <= suffix_length || strcmp(dirent->d_name + name_length - suffix_length, CACHE_ENTRY_SUFFIX) != 0) {
+      continue;
+    }
+
+    char *path = (char *) checked_malloc(directory_length + name_length + 2);
+    sprintf(path, "%s/%s", cache->directory, dirent->d_name);
+
+    struct stat entry_stat;
+    if (stat(path, &entry_stat) != 0) {
+      free(path);
+      continue;
+    }
+
+    if (entry_count + 1 > entry_capacity) {
+      entry_capacity = MEMORY_GROW_CAPACITY(entry_capacity, 16);
+      entries = (struct CacheEntry *) realloc(entries, sizeof(struct CacheEntry) * entry_capacity);
+      if (entries == NULL) {
+        fprintf(stderr, "Error - not enough memory to scan the compile cache\n");
+        exit(74);
+      }
+    }
+
+    entries[entry_count] = (struct CacheEntry) {
+      .path = path,
+      .size = (size_t) entry_stat.st_size,
+      .last_used = entry_stat.st_mtim
+    };
+    entry_count += 1;
+    total_size += (size_t) entry_stat.st_size;
+  }
+  closedir(directory);
+
+  // least recently used first. another process may have removed an entry
+  // already, which is fine
+  qsort(entries, entry_count, sizeof(struct CacheEntry), compare_by_access);
+  for (size_t i = 0; i < entry_count && total_size > cache->max_bytes; ++i) {
+    if (remove(entries[i].path) == 0) cache->eviction_count += 1;
+    total_size -= entries[i].size;
+  }
+
+  for (size_t i = 0; i < entry_count; ++i) {
+    free(entries[i].path);
+  }
+  free(entries);
+}
+
+static int compare_by_access(const void *a, const void *b) {
+  const struct timespec *x = &((const struct CacheEntry *) a)->last_used;
+  const struct timespec *y = &((const struct CacheEntry *) b)->last_used;
+  if (x->tv_sec != y->tv_sec) return x->tv_sec < y->tv_sec ? -1 : 1;
+  if (x->tv_nsec != y->tv_nsec) return x->tv_nsec < y->tv_nsec ? -1 : 1;
+  return 0;
+}
+
+static void *checked_malloc(size_t size) {
+  void *pointer = malloc(size);
+  if (pointer == NULL) {
+    fprintf(stderr, "Error - not enough memory for the compile cache\n");
+    exit(74);
+  }
+  return pointer;
+}
@@ -1,9 +1,18 @@
 
 #include <stdio.h>
+#include <string.h>
 
 #include "chunk.h"
 #include "opcode.h"
 #include "memory.h"
+#include "vm.h"
+#include "object.h"
+
+// file local prototypes
+static size_t *find_constant_slot(struct Chunk *chunk, struct ConstantIndex *index, struct Value constant);
+static void grow_constant_index(struct VM *vm, struct Chunk *chunk, struct ConstantIndex *index);
+static uint8_t constants_identical(struct Value a, struct Value b);
+static uint32_t hash_constant(struct Value constant);
 
 inline void chunk_init(struct Chunk *chunk) {
   chunk->byte_count = 0;
@@ -14,70 +23,177 @@ inline void chunk_init(struct Chunk *chunk) {
   value_array_init(&chunk->constants);
 }
 
-inline void chunk_free(struct Chunk *chunk) {
-  value_array_free(&chunk->constants);
-  line_array_free(&chunk->lines);
+inline void chunk_free(struct VM *vm, struct Chunk *chunk) {
+  value_array_free(vm, &chunk->constants);
+  line_array_free(vm, &chunk->lines);
 
-  MEMORY_FREE_ARRAY(uint8_t, chunk->buffer, chunk->byte_capacity);
+  MEMORY_FREE_ARRAY(vm, uint8_t, chunk->buffer, chunk->byte_capacity, MEMORY_TAG_CHUNK_BYTECODE);
 
   chunk_init(chunk);
 }
 
-void chunk_write(struct Chunk *chunk, const uint8_t byte, const size_t line) {
+void chunk_write(struct VM *vm, struct Chunk *chunk, const uint8_t byte, const size_t line, const size_t column) {
   size_t initial_byte_count = chunk->byte_count;
   size_t initial_byte_capacity = chunk->byte_capacity;
 
   // resize the byte backing buffer
   if(initial_byte_capacity < initial_byte_count + 1) {
     chunk->byte_capacity = MEMORY_GROW_CAPACITY(initial_byte_capacity, CHUNK_INITIAL_CAPACITY);
-    chunk->buffer = MEMORY_GROW_ARRAY(uint8_t, chunk->buffer, initial_byte_capacity, chunk->byte_capacity);
+    chunk->buffer = MEMORY_GROW_ARRAY(vm, uint8_t, chunk->buffer, initial_byte_capacity, chunk->byte_capacity, MEMORY_TAG_CHUNK_BYTECODE);
   }
 
   // write a byte (0-indexed, so can just use byte_count)
   chunk->buffer[chunk->byte_count] = byte;
   chunk->byte_count += 1;
 
-  line_array_write(&chunk->lines, line);
+  line_array_write(vm, &chunk->lines, chunk->byte_count - 1, line, column);
 }
 
-size_t chunk_add_constant(struct Chunk *chunk, const struct Value constant) {
-  value_array_write(&chunk->constants, constant);
+size_t chunk_add_constant(struct VM *vm, struct Chunk *chunk, const struct Value constant) {
+  // growing the pool may collect garbage, the constant is not a root yet
+  vm_push(vm, constant);
+  value_array_write(vm, &chunk->constants, constant);
+  vm_pop(vm);
   // return index where the constant was inserted for future access
   return chunk->constants.value_count - 1;
 }
 
-size_t chunk_write_constant(struct Chunk *chunk, const struct Value constant, const size_t line) {
-  size_t value_index = chunk_add_constant(chunk, constant);
+// a constant identical to one already in the pool reuses its position
+size_t chunk_add_constant_unique(struct VM *vm, struct Chunk *chunk, struct ConstantIndex *index, const struct Value constant) {
+  // growing the index may collect garbage, the constant is not a root yet
+  vm_push(vm, constant);
+  if (index->count + 1 > index->capacity * 3 / 4) grow_constant_index(vm, chunk, index);
+  vm_pop(vm);
+
+  size_t *slot = find_constant_slot(chunk, index, constant);
+  if (*slot != 0 && *slot - 1 < chunk->constants.value_count) return *slot - 1;
+
+  if (*slot == 0) index->count += 1;
+  size_t value_index = chunk_add_constant(vm, chunk, constant);
+  // the slot stays valid, appending to the pool never touches the index
+  *slot = value_index + 1;
+  return value_index;
+}
+
+size_t chunk_write_constant(struct VM *vm, struct Chunk *chunk, const struct Value constant, const size_t line, const size_t column) {
+  size_t value_index = chunk_add_constant(vm, chunk, constant);
+  chunk_write_constant_index(vm, chunk, value_index, line, column);
+  return value_index;
+}
+
+// the one-byte form while the index fits, OPCODE_CONSTANT_LONG after that
+void chunk_write_constant_index(struct VM *vm, struct Chunk *chunk, const size_t value_index, const size_t line, const size_t column) {
+  assert(value_index <= CHUNK_CONSTANT_LONG_MAX);
 
-  if (chunk->constants.value_count >= 0xFF) {
-    chunk_write(chunk, OPCODE_CONSTANT_LONG, line);
-    chunk_write(chunk, (value_index >> 16) & 0xFF, line);
-    chunk_write(chunk, (value_index >> 8)  & 0xFF, line);
+  if (value_index > UINT8_MAX) {
+    chunk_write(vm, chunk, OPCODE_CONSTANT_LONG, line, column);
+    chunk_write(vm, chunk, (value_index >> 16) & 0xFF, line, column);
+    chunk_write(vm, chunk, (value_index >> 8)  & 0xFF, line, column);
   } else {
-    chunk_write(chunk, OPCODE_CONSTANT, line);
+    chunk_write(vm, chunk, OPCODE_CONSTANT, line, column);
   }
 
-  chunk_write(chunk, value_index & 0xFF, line);
+  chunk_write(vm, chunk, value_index & 0xFF, line, column);
+}
+
+void chunk_truncate(struct Chunk *chunk, const size_t byte_count, const size_t constant_count) {
+  assert(byte_count <= chunk->byte_count);
+  assert(constant_count <= chunk->constants.value_count);
 
-  return chunk->constants.value_count - 1;
+  line_array_truncate(&chunk->lines, byte_count);
+  chunk->byte_count = byte_count;
+  chunk->constants.value_count = constant_count;
 }
 
 size_t chunk_get_line(struct Chunk *const chunk, const size_t offset) {
-  size_t line_struct_count = chunk->lines.line_struct_count;
+  return line_array_find(&chunk->lines, offset).line;
+}
+
+size_t chunk_get_column(struct Chunk *const chunk, const size_t offset) {
+  return line_array_find(&chunk->lines, offset).column;
+}
+
+void chunk_constant_index_init(struct ConstantIndex *index) {
+  index->slots = NULL;
+  index->count = 0;
+  index->capacity = 0;
+}
+
+void chunk_constant_index_free(struct VM *vm, struct ConstantIndex *index) {
+  MEMORY_FREE_ARRAY(vm, size_t, index->slots, index->capacity, MEMORY_TAG_SCRATCH);
+  chunk_constant_index_init(index);
+}
+
+// file local functions
 
-  size_t line = 0;
-  size_t prev_line_count = 0;
-  
-  for(size_t i = 0; i < line_struct_count; ++i) {
-    size_t curr_line_count = chunk->lines.lines[i].line_count + prev_line_count;
+// the slot holding constant, or the slot it would go in. slots left behind by
+// chunk_truncate point past the end of the pool, they never match but are
+// reused by the next insertion that reaches them
+static size_t *find_constant_slot(struct Chunk *chunk, struct ConstantIndex *index, struct Value constant) {
+  size_t mask = index->capacity - 1;
+  size_t *reusable = NULL;
 
-    if(prev_line_count <= offset && offset < curr_line_count) {
-      line = chunk->lines.lines[i].line;
-      break;
+  for (size_t i = hash_constant(constant) & mask;; i = (i + 1) & mask) {
+    size_t *slot = &index->slots[i];
+    if (*slot == 0) return reusable != NULL ? reusable : slot;
+
+    size_t position = *slot - 1;
+    if (position >= chunk->constants.value_count) {
+      if (reusable == NULL) reusable = slot;
+    } else if (constants_identical(chunk->constants.buffer[position], constant)) {
+      return slot;
     }
+  }
+}
+
+static void grow_constant_index(struct VM *vm, struct Chunk *chunk, struct ConstantIndex *index) {
+  size_t old_capacity = index->capacity;
+  size_t *old_slots = index->slots;
+
+  index->capacity = MEMORY_GROW_CAPACITY(old_capacity, CHUNK_CONSTANT_INDEX_INITIAL_CAPACITY);
+  index->slots = MEMORY_ALLOCATE(vm, size_t, index->capacity, MEMORY_TAG_SCRATCH);
+  memset(index->slots, 0, sizeof(size_t) * index->capacity);
+  index->count = 0;
+
+  // stale slots are dropped on the way over
+  for (size_t i = 0; i < old_capacity; ++i) {
+    if (old_slots[i] == 0 || old_slots[i] - 1 >= chunk->constants.value_count) continue;
+
+    size_t *slot = find_constant_slot(chunk, index, chunk->constants.buffer[old_slots[i] - 1]);
+    *slot = old_slots[i];
+    index->count += 1;
+  }
 
-    prev_line_count = curr_line_count;
+  MEMORY_FREE_ARRAY(vm, size_t, old_slots, old_capacity, MEMORY_TAG_SCRATCH);
+}
+
+// stricter than value_equal: numbers match bit for bit, so 0 and -0 or two
+// numbers within its epsilon keep separate constants
+static uint8_t constants_identical(struct Value a, struct Value b) {
+  if (VALUE_IS_NUMBER(a) && VALUE_IS_NUMBER(b)) {
+    double x = VALUE_AS_NUMBER(a);
+    double y = VALUE_AS_NUMBER(b);
+    return memcmp(&x, &y, sizeof(double)) == 0;
+  }
+  if (VALUE_IS_NUMBER(a) || VALUE_IS_NUMBER(b)) return FALSE;
+  return value_equal(a, b);
+}
+
+static uint32_t hash_constant(struct Value constant) {
+  if (OBJECT_IS_OBJECT_STRING(constant)) return OBJECT_STRING_FROM_VALUE(constant)->hash;
+
+  uint64_t bits = 0;
+  if (VALUE_IS_NUMBER(constant)) {
+    double number = VALUE_AS_NUMBER(constant);
+    memcpy(&bits, &number, sizeof(double));
+  } else if (VALUE_IS_OBJECT(constant)) {
+    bits = (uint64_t) (uintptr_t) VALUE_AS_OBJECT(constant);
+  } else {
+    bits = VALUE_IS_BOOL(constant) ? 2 + VALUE_AS_BOOL(constant) : 1;
   }
 
-  return line;
+  // fold the high half in, small integers differ only in the top bits
+  bits ^= bits >> 32;
+  bits *= 0x9E3779B97F4A7C15u;
+  return (uint32_t) (bits >> 32);
 }
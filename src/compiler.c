@@ -1,13 +1,17 @@
 
 #include <stdio.h>
-#include <stdlib.h>
 #include <limits.h>
+#include <math.h>
 
 #include "compiler.h"
 #include "scanner.h"
 #include "opcode.h"
 #include "debug.h"
 #include "object.h"
+#include "peephole.h"
+#include "number.h"
+#include "gc.h"
+#include "vm.h"
 
 struct Parser {
   struct Token current;
@@ -30,39 +34,75 @@ enum Precedence {
   PRECEDENCE_PRIMARY
 };
 
+struct Compiler;
+
 struct ParseRule {
-  void (*prefix)(void);
-  void (*infix)(void);
+  void (*prefix)(struct Compiler *compiler);
+  void (*infix)(struct Compiler *compiler);
   enum Precedence precedence;
 };
 
-// global singleton instance
-static struct Parser global_parser = {0};
+// position in the chunk where an already emitted expression begins
+struct ExpressionMark {
+  size_t byte_offset;
+  size_t constant_count;
+};
 
-static struct Chunk *global_active_chunk = {0};
+// state of one compiler_compile call, nothing is shared between calls
+struct Compiler {
+  struct VM *vm; // owner of the strings the compiler creates
+  struct Scanner scanner;
+#ifdef COMPILER_TOKEN_STREAM
+  // the source tokenized up front, read in order by parser_advance
+  struct TokenStream tokens;
+  uint8_t has_tokens; // FALSE when the source was too long, the scanner is used instead
+  size_t next_token;
+  size_t token_line_run;
+#endif
+  struct Parser parser;
+  struct Chunk *chunk;
+  struct ExpressionMark infix_left; // start of the left operand for the infix rule being dispatched
+  struct ConstantIndex constant_index; // so every literal value is stored once per chunk
+  struct CompilerStats stats;
+};
 
 // file local prototypes
-static void compiler_end_compile(void);
-static void parser_init(void);
-static void parser_advance(void);
-static void parser_expression(void);
-static void parser_expression_number(void);
-static void parser_expression_string(void);
-static void parser_expression_grouping(void);
-static void parser_expression_unary(void);
-static void parser_expression_binary(void);
-static void parser_expression_literal(void);
-static void parser_precedence(enum Precedence precedence);
-static void parser_consume(enum TokenType, const char *error_message);
-static void parser_error_at(struct Token *token, const char *error_message);
-static void parser_error_at_current(const char *error_message);
-static void parser_error_at_previous(const char *error_message);
-static struct Chunk *current_chunk(void);
-static void emit_byte(uint8_t byte);
-static void emit_bytes(uint8_t byte_a, uint8_t byte_b);
-static void emit_return(void);
-static void emit_constant(struct Value value);
-static uint8_t make_constant(struct Value value);
+static uint8_t compile(struct Compiler *compiler, struct VM *vm, struct Chunk *chunk);
+static void compiler_end_compile(struct Compiler *compiler);
+static void parser_init(struct Compiler *compiler);
+static void parser_advance(struct Compiler *compiler);
+static void parser_expression(struct Compiler *compiler);
+static void parser_expression_number(struct Compiler *compiler);
+static struct Token next_token(struct Compiler *compiler);
+static void parser_expression_string(struct Compiler *compiler);
+static void parser_expression_grouping(struct Compiler *compiler);
+static void parser_expression_unary(struct Compiler *compiler);
+static void parser_expression_binary(struct Compiler *compiler);
+static void parser_expression_sum(struct Compiler *compiler);
+static void parser_expression_literal(struct Compiler *compiler);
+static void parser_precedence(struct Compiler *compiler, enum Precedence precedence);
+static void parser_consume(struct Compiler *compiler, enum TokenType, const char *error_message);
+static void parser_error_at(struct Compiler *compiler, struct Token *token, const char *error_message);
+static void parser_error_at_current(struct Compiler *compiler, const char *error_message);
+static void parser_error_at_previous(struct Compiler *compiler, const char *error_message);
+static struct Chunk *current_chunk(struct Compiler *compiler);
+static void emit_byte(struct Compiler *compiler, uint8_t byte);
+static void emit_byte_at(struct Compiler *compiler, uint8_t byte, const struct Token *token);
+static void emit_return(struct Compiler *compiler);
+static void emit_sum(struct Compiler *compiler, size_t operand_count, const struct Token *operator_token);
+static void emit_constant(struct Compiler *compiler, struct Value value);
+static void emit_number(struct Compiler *compiler, double value);
+static size_t make_constant(struct Compiler *compiler, struct Value value);
+static struct ExpressionMark mark_expression(struct Compiler *compiler);
+static uint8_t fold_unary(struct Compiler *compiler, enum TokenType operator_type, struct ExpressionMark operand);
+static uint8_t fold_binary(struct Compiler *compiler, enum TokenType operator_type, struct ExpressionMark left, struct ExpressionMark right);
+static uint8_t fold_sum(struct Compiler *compiler, struct ExpressionMark start, size_t operand_count);
+static uint8_t read_constant_instruction(struct Compiler *compiler, size_t start, size_t end, struct Value *out);
+static uint8_t is_string_constant(struct Compiler *compiler, struct ExpressionMark start);
+#ifdef COMPILER_CONSTANT_FOLDING
+static void emit_value(struct Compiler *compiler, struct Value value);
+static void replace_with_constant(struct Compiler *compiler, struct ExpressionMark start, struct Value value, size_t removed_instruction_count);
+#endif
 static struct ParseRule* get_rule(enum TokenType type);
 
 struct ParseRule parser_rules[] = {
@@ -73,7 +113,7 @@ struct ParseRule parser_rules[] = {
   [TOKEN_TYPE_COMMA]         = {NULL, NULL, PRECEDENCE_NONE},
   [TOKEN_TYPE_DOT]           = {NULL, NULL, PRECEDENCE_NONE},
   [TOKEN_TYPE_MINUS]         = {parser_expression_unary, parser_expression_binary, PRECEDENCE_TERM},
-  [TOKEN_TYPE_PLUS]          = {NULL, parser_expression_binary, PRECEDENCE_TERM},
+  [TOKEN_TYPE_PLUS]          = {NULL, parser_expression_sum, PRECEDENCE_TERM},
   [TOKEN_TYPE_SEMICOLON]     = {NULL, NULL, PRECEDENCE_NONE},
   [TOKEN_TYPE_SLASH]         = {NULL, parser_expression_binary, PRECEDENCE_FACTOR},
   [TOKEN_TYPE_STAR]          = {NULL, parser_expression_binary, PRECEDENCE_FACTOR},
@@ -108,200 +148,544 @@ struct ParseRule parser_rules[] = {
   [TOKEN_TYPE_EOF]           = {NULL, NULL, PRECEDENCE_NONE},
 };
 
-uint8_t compiler_compile(const char *source, struct Chunk *chunk) {
-  scanner_init(source);
-  global_active_chunk = chunk;
+uint8_t compiler_compile(struct VM *vm, const char *source, struct Chunk *chunk) {
+  struct Compiler compiler = {0};
+  scanner_init(&compiler.scanner, source);
+
+#ifdef COMPILER_TOKEN_STREAM
+  token_stream_init(&compiler.tokens);
+  compiler.has_tokens = token_stream_scan(vm, &compiler.tokens, source);
+#endif
+
+  uint8_t compiled = compile(&compiler, vm, chunk);
+
+#ifdef COMPILER_TOKEN_STREAM
+  token_stream_free(vm, &compiler.tokens);
+#endif
+
+  return compiled;
+}
+
+// the source is read from file as it is scanned, through a window of
+// SCANNER_WINDOW_SIZE bytes, rather than loaded first
+uint8_t compiler_compile_file(struct VM *vm, FILE *file, struct Chunk *chunk) {
+  struct ScannerWindow window;
+  scanner_window_init(vm, &window, file);
+
+  struct Compiler compiler = {0};
+  scanner_init_window(&compiler.scanner, &window);
+
+  uint8_t compiled = compile(&compiler, vm, chunk);
+  if (window.has_error) {
+    fprintf(vm->err, "Error - could not read source\n");
+    compiled = FALSE;
+  }
 
-  parser_init();
-  parser_expression();
-  parser_consume(TOKEN_TYPE_EOF, "Error - expect end of expression");
-  compiler_end_compile();
+  scanner_window_free(&window);
+  return compiled;
+}
 
-  return !global_parser.had_error;
+// constants of the chunk being compiled are reachable even before it runs
+void compiler_mark_roots(struct VM *vm) {
+  if (vm->compiler != NULL) gc_mark_array(vm, &vm->compiler->chunk->constants);
+}
+
+struct CompilerStats compiler_stats(struct VM *vm) {
+  return vm->compiler_stats;
 }
 
 // file local functions
 
-static void compiler_end_compile(void) {
-  emit_return();
+static uint8_t compile(struct Compiler *compiler, struct VM *vm, struct Chunk *chunk) {
+  compiler->vm = vm;
+  compiler->chunk = chunk;
+  chunk_constant_index_init(&compiler->constant_index);
+
+  // let the collector find the constants emitted so far
+  vm->compiler = compiler;
+
+  parser_init(compiler);
+  parser_expression(compiler);
+  parser_consume(compiler, TOKEN_TYPE_EOF, "Error - expect end of expression");
+  compiler_end_compile(compiler);
+
+  chunk_constant_index_free(vm, &compiler->constant_index);
+  vm->compiler = NULL;
+  vm->compiler_stats = compiler->stats;
+
+  return !compiler->parser.had_error;
+}
+
+static void compiler_end_compile(struct Compiler *compiler) {
+  emit_return(compiler);
+#ifdef COMPILER_PEEPHOLE
+  if (!compiler->parser.had_error) {
+    compiler->stats.fused_instruction_count = peephole_optimize(compiler->vm, current_chunk(compiler));
+  }
+#endif
 #ifdef DEBUG_PRINT_CODE
-  if (!global_parser.had_error) {
-    debug_disassemble_chunk(current_chunk(), "code");
+  if (!compiler->parser.had_error) {
+    debug_disassemble_chunk(current_chunk(compiler), "code");
+    printf("\n== constant folding removed %lu instructions ==\n", compiler->stats.folded_instruction_count);
+    printf("== peephole pass removed %lu instructions ==\n", compiler->stats.fused_instruction_count);
   }
 #endif
 }
 
-static void parser_init(void) {
-  global_parser.had_error  = FALSE;
-  global_parser.panic_mode = FALSE;
-  parser_advance();
+static void parser_init(struct Compiler *compiler) {
+  compiler->parser.had_error  = FALSE;
+  compiler->parser.panic_mode = FALSE;
+  parser_advance(compiler);
 }
 
-static void parser_advance(void) {
-  global_parser.previous = global_parser.current;
+static void parser_advance(struct Compiler *compiler) {
+  compiler->parser.previous = compiler->parser.current;
 
   for (;;) {
-    global_parser.current = scanner_scan_token();
-    if (global_parser.current.type != TOKEN_TYPE_ERROR) break;
+    compiler->parser.current = next_token(compiler);
+    if (compiler->parser.current.type != TOKEN_TYPE_ERROR) break;
+
+    parser_error_at_current(compiler, compiler->parser.current.start);
+  }
+}
 
-    parser_error_at_current(global_parser.current.start);
+// the token stream ends in a single TOKEN_TYPE_EOF, which is handed out
+// again on every later call, as the scanner does. previous is still to be
+// used by the rule parser_advance dispatches to, so a scanner refilling its
+// window keeps it
+static struct Token next_token(struct Compiler *compiler) {
+#ifdef COMPILER_TOKEN_STREAM
+  if (compiler->has_tokens) {
+    struct Token token = token_stream_token(&compiler->tokens, compiler->next_token, &compiler->token_line_run);
+    if (compiler->next_token + 1 < compiler->tokens.count) compiler->next_token += 1;
+    return token;
   }
+#endif
+  return scanner_scan_token_keeping(&compiler->scanner, &compiler->parser.previous);
 }
 
-static void parser_expression(void) {
-  parser_precedence(PRECEDENCE_ASSIGNMENT);
+static void parser_expression(struct Compiler *compiler) {
+  parser_precedence(compiler, PRECEDENCE_ASSIGNMENT);
 }
 
-static void parser_expression_number(void) {
-  double value = strtod(global_parser.previous.start, NULL);
-  emit_constant(VALUE_NUMBER(value));
+static void parser_expression_number(struct Compiler *compiler) {
+  double value = number_parse(compiler->parser.previous.start, compiler->parser.previous.length);
+  emit_number(compiler, value);
 }
 
-static void parser_expression_string(void) {
-  emit_constant(
+static void parser_expression_string(struct Compiler *compiler) {
+  emit_constant(compiler, 
     VALUE_OBJECT(
-      object_object_string_from_parts(
-        global_parser.previous.start + 1,
-        global_parser.previous.length - 2
+      object_object_string_from_parts(compiler->vm, 
+        compiler->parser.previous.start + 1,
+        compiler->parser.previous.length - 2
       )
     )
   );
 }
 
-static void parser_expression_grouping(void) {
-  parser_expression();
-  parser_consume(TOKEN_TYPE_RIGHT_PAREN, "Error - expect ')' after expression");
+static void parser_expression_grouping(struct Compiler *compiler) {
+  parser_expression(compiler);
+  parser_consume(compiler, TOKEN_TYPE_RIGHT_PAREN, "Error - expect ')' after expression");
 }
 
-static void parser_expression_unary(void) {
-  enum TokenType ot = global_parser.previous.type;
+static void parser_expression_unary(struct Compiler *compiler) {
+  struct Token operator_token = compiler->parser.previous;
+  enum TokenType ot = operator_token.type;
+  struct ExpressionMark operand = mark_expression(compiler);
 
   // compile operand
-  parser_precedence(PRECEDENCE_UNARY);
+  parser_precedence(compiler, PRECEDENCE_UNARY);
+
+  if (fold_unary(compiler, ot, operand)) return;
 
   // emit operator instruction
   switch (ot) {
-    case TOKEN_TYPE_BANG:  emit_byte(OPCODE_NOT);    break;
-    case TOKEN_TYPE_MINUS: emit_byte(OPCODE_NEGATE); break;
+    case TOKEN_TYPE_BANG:  emit_byte_at(compiler, OPCODE_NOT, &operator_token);    break;
+    case TOKEN_TYPE_MINUS: emit_byte_at(compiler, OPCODE_NEGATE, &operator_token); break;
     default: return; // unreachable
   }
 }
 
-static void parser_expression_binary(void) {
-  enum TokenType ot = global_parser.previous.type;
+static void parser_expression_binary(struct Compiler *compiler) {
+  struct Token operator_token = compiler->parser.previous;
+  enum TokenType ot = operator_token.type;
+  struct ExpressionMark left = compiler->infix_left;
+  struct ExpressionMark right = mark_expression(compiler);
+
   struct ParseRule *rule = get_rule(ot);
-  parser_precedence((enum Precedence) (rule->precedence + 1));
+  parser_precedence(compiler, (enum Precedence) (rule->precedence + 1));
+
+  if (fold_binary(compiler, ot, left, right)) return;
 
   switch (ot) {
-    case TOKEN_TYPE_BANG_EQUAL:    emit_byte(OPCODE_BANG_EQUAL);    break;
-    case TOKEN_TYPE_EQUAL_EQUAL:   emit_byte(OPCODE_EQUAL_EQUAL);   break;
-    case TOKEN_TYPE_GREATER:       emit_byte(OPCODE_GREATER);       break;
-    case TOKEN_TYPE_GREATER_EQUAL: emit_byte(OPCODE_GREATER_EQUAL); break;
-    case TOKEN_TYPE_LESS:          emit_byte(OPCODE_LESS);          break;
-    case TOKEN_TYPE_LESS_EQUAL:    emit_byte(OPCODE_LESS_EQUAL);    break;
-
-    case TOKEN_TYPE_PLUS:  emit_byte(OPCODE_ADD);      break;
-    case TOKEN_TYPE_MINUS: emit_byte(OPCODE_SUBTRACT); break;
-    case TOKEN_TYPE_STAR:  emit_byte(OPCODE_MULTIPLY); break;
-    case TOKEN_TYPE_SLASH: emit_byte(OPCODE_DIVIDE);   break;
+    case TOKEN_TYPE_BANG_EQUAL:    emit_byte_at(compiler, OPCODE_BANG_EQUAL, &operator_token);    break;
+    case TOKEN_TYPE_EQUAL_EQUAL:   emit_byte_at(compiler, OPCODE_EQUAL_EQUAL, &operator_token);   break;
+    case TOKEN_TYPE_GREATER:       emit_byte_at(compiler, OPCODE_GREATER, &operator_token);       break;
+    case TOKEN_TYPE_GREATER_EQUAL: emit_byte_at(compiler, OPCODE_GREATER_EQUAL, &operator_token); break;
+    case TOKEN_TYPE_LESS:          emit_byte_at(compiler, OPCODE_LESS, &operator_token);          break;
+    case TOKEN_TYPE_LESS_EQUAL:    emit_byte_at(compiler, OPCODE_LESS_EQUAL, &operator_token);    break;
+
+    case TOKEN_TYPE_MINUS: emit_byte_at(compiler, OPCODE_SUBTRACT, &operator_token); break;
+    case TOKEN_TYPE_STAR:  emit_byte_at(compiler, OPCODE_MULTIPLY, &operator_token); break;
+    case TOKEN_TYPE_SLASH: emit_byte_at(compiler, OPCODE_DIVIDE, &operator_token);   break;
     default: return; // unreachable
   }
 }
 
-static void parser_expression_literal(void) {
-  switch (global_parser.previous.type) {
-    case TOKEN_TYPE_NIL:   emit_byte(OPCODE_NIL);   break;
-    case TOKEN_TYPE_TRUE:  emit_byte(OPCODE_TRUE);  break;
-    case TOKEN_TYPE_FALSE: emit_byte(OPCODE_FALSE); break;
+// a + b + c + ... is gathered into OPCODE_CONCAT_N rather than a chain of
+// OPCODE_ADD, each of which would build an intermediate string. only + at
+// this precedence is taken, which is exactly what parser_precedence would
+// feed back into this rule, so the sum stays left associative.
+// every operand is evaluated before the OPCODE_CONCAT_N that adds it, so
+// only string literals are gathered onto a running result already known to
+// be a string, which cannot fail. any other operand ends the run as its last
+// operand, so the one + that can fail is the one the instruction is
+// attributed to, as its OPCODE_ADD would have been. a sum of nothing but
+// string literals is folded as a whole once it ends
+static void parser_expression_sum(struct Compiler *compiler) {
+  struct ExpressionMark left = compiler->infix_left;
+  uint8_t left_is_string = is_string_constant(compiler, left);
+  size_t literal_count = left_is_string ? 1 : 0; // operands while all of them are string literals, 0 after
+  size_t gathered_count = 0; // string literals on the stack above the running result
+
+  struct Token operator_token;
+  for (;;) {
+    operator_token = compiler->parser.previous;
+    struct ExpressionMark right = mark_expression(compiler);
+    parser_precedence(compiler, (enum Precedence) (PRECEDENCE_TERM + 1));
+    uint8_t right_is_string = is_string_constant(compiler, right);
+
+    if (left_is_string && right_is_string) {
+      if (literal_count > 0) literal_count += 1;
+      gathered_count += 1;
+      if (gathered_count + 1 == OPCODE_CONCAT_N_MAX) {
+        emit_sum(compiler, gathered_count + 1, &operator_token);
+        gathered_count = 0;
+      }
+    } else if (gathered_count == 0 && fold_binary(compiler, TOKEN_TYPE_PLUS, left, right)) {
+      // numbers at the start of the sum still fold one pair at a time
+      left_is_string = is_string_constant(compiler, left);
+    } else {
+      // an OPCODE_ADD that succeeds with a string operand made a string
+      emit_sum(compiler, gathered_count + 2, &operator_token);
+      gathered_count = 0;
+      left_is_string = right_is_string;
+      literal_count = 0;
+    }
+
+    if (compiler->parser.current.type != TOKEN_TYPE_PLUS) break;
+    parser_advance(compiler);
+  }
+
+  if (literal_count > 1 && fold_sum(compiler, left, literal_count)) return;
+  if (gathered_count > 0) emit_sum(compiler, gathered_count + 1, &operator_token);
+}
+
+static void parser_expression_literal(struct Compiler *compiler) {
+  switch (compiler->parser.previous.type) {
+    case TOKEN_TYPE_NIL:   emit_byte(compiler, OPCODE_NIL);   break;
+    case TOKEN_TYPE_TRUE:  emit_byte(compiler, OPCODE_TRUE);  break;
+    case TOKEN_TYPE_FALSE: emit_byte(compiler, OPCODE_FALSE); break;
     default: return; // unreachable
   }
 }
 
-static void parser_precedence(enum Precedence precedence) {
-  parser_advance();
-  void (*prefix_rule)(void) = get_rule(global_parser.previous.type)->prefix;
+static void parser_precedence(struct Compiler *compiler, enum Precedence precedence) {
+  parser_advance(compiler);
+  void (*prefix_rule)(struct Compiler *compiler) = get_rule(compiler->parser.previous.type)->prefix;
+  struct ExpressionMark start = mark_expression(compiler);
 
   if (prefix_rule == NULL) {
-    parser_error_at_previous("Error - expect precedence expression");
+    parser_error_at_previous(compiler, "Error - expect precedence expression");
     return;
   }
 
-  prefix_rule();
+  prefix_rule(compiler);
 
-  while (precedence <= get_rule(global_parser.current.type)->precedence) {
-    parser_advance();
-    void (*infix_rule)(void) = get_rule(global_parser.previous.type)->infix;
-    infix_rule();
+  while (precedence <= get_rule(compiler->parser.current.type)->precedence) {
+    parser_advance(compiler);
+    void (*infix_rule)(struct Compiler *compiler) = get_rule(compiler->parser.previous.type)->infix;
+    // everything emitted since start is the left operand
+    compiler->infix_left = start;
+    infix_rule(compiler);
   }
 }
 
-static void parser_consume(enum TokenType type, const char *error_message) {
-  if (global_parser.current.type == type) {
-    parser_advance();
+static void parser_consume(struct Compiler *compiler, enum TokenType type, const char *error_message) {
+  if (compiler->parser.current.type == type) {
+    parser_advance(compiler);
     return;
   }
 
-  parser_error_at_current(error_message);
+  parser_error_at_current(compiler, error_message);
 }
 
-static void parser_error_at(struct Token *token, const char *error_message) {
-  if (global_parser.panic_mode) return;
-  global_parser.panic_mode = TRUE;
+static void parser_error_at(struct Compiler *compiler, struct Token *token, const char *error_message) {
+  if (compiler->parser.panic_mode) return;
+  compiler->parser.panic_mode = TRUE;
 
-  fprintf(stderr, "[line %lu] Error ", token->line);
+  fprintf(compiler->vm->err, "[line %lu, column %lu] Error ", token->line, token->column);
 
   if (token->type == TOKEN_TYPE_EOF) {
-    fprintf(stderr, "at end");
+    fprintf(compiler->vm->err, "at end");
   } else if (token->type == TOKEN_TYPE_ERROR) {
     {} // nothing
   } else {
     assert(token->length <= INT_MAX);
-    fprintf(stderr, "at '%.*s'", (int) token->length, token->start);
+    fprintf(compiler->vm->err, "at '%.*s'", (int) token->length, token->start);
   }
 
-  fprintf(stderr, ": %s\n", error_message);
-  global_parser.had_error = TRUE;
+  fprintf(compiler->vm->err, ": %s\n", error_message);
+  compiler->parser.had_error = TRUE;
 }
 
-static void parser_error_at_current(const char *error_message) {
-  parser_error_at(&global_parser.current, error_message);
+static void parser_error_at_current(struct Compiler *compiler, const char *error_message) {
+  parser_error_at(compiler, &compiler->parser.current, error_message);
 }
 
-static void parser_error_at_previous(const char *error_message) {
-  parser_error_at(&global_parser.previous, error_message);
+static void parser_error_at_previous(struct Compiler *compiler, const char *error_message) {
+  parser_error_at(compiler, &compiler->parser.previous, error_message);
 }
 
-static struct Chunk *current_chunk(void) {
-  return global_active_chunk;
+static struct Chunk *current_chunk(struct Compiler *compiler) {
+  return compiler->chunk;
 }
 
-static void emit_byte(uint8_t byte) {
-  chunk_write(current_chunk(), byte, global_parser.previous.line);
+static void emit_byte(struct Compiler *compiler, uint8_t byte) {
+  emit_byte_at(compiler, byte, &compiler->parser.previous);
 }
 
-static void emit_bytes(uint8_t byte_a, uint8_t byte_b) {
-  emit_byte(byte_a);
-  emit_byte(byte_b);
+// operators are attributed to their own token rather than to the last token
+// of their operand, which is where a runtime error should point
+static void emit_byte_at(struct Compiler *compiler, uint8_t byte, const struct Token *token) {
+  chunk_write(compiler->vm, current_chunk(compiler), byte, token->line, token->column);
 }
 
-static void emit_return(void) {
-  emit_byte(OPCODE_RETURN);
+static void emit_return(struct Compiler *compiler) {
+  emit_byte(compiler, OPCODE_RETURN);
 }
 
-static void emit_constant(struct Value value) {
-  emit_bytes(OPCODE_CONSTANT, make_constant(value));
+// add the operand_count values on top of the stack, a single pair keeps
+// OPCODE_ADD so it can still be fused and quickened
+static void emit_sum(struct Compiler *compiler, size_t operand_count, const struct Token *operator_token) {
+  if (operand_count == 2) {
+    emit_byte_at(compiler, OPCODE_ADD, operator_token);
+  } else if (operand_count > 2) {
+    emit_byte_at(compiler, OPCODE_CONCAT_N, operator_token);
+    emit_byte_at(compiler, (uint8_t) operand_count, operator_token);
+  }
 }
 
-static uint8_t make_constant(struct Value value) {
-  size_t constant = chunk_add_constant(current_chunk(), value);
-  if (constant > UINT8_MAX) {
-    parser_error_at_previous("Error - too many constants in one chunk");
+static void emit_constant(struct Compiler *compiler, struct Value value) {
+  struct Token *token = &compiler->parser.previous;
+  chunk_write_constant_index(compiler->vm, current_chunk(compiler), make_constant(compiler, value), token->line, token->column);
+}
+
+// integers that fit in 16 bits are carried by the instruction instead of the
+// constant pool. -0 keeps its pool entry since the immediates cannot encode it
+static void emit_number(struct Compiler *compiler, double value) {
+  uint8_t is_short =
+    value >= OPCODE_SHORT_IMMEDIATE_MIN && value <= OPCODE_SHORT_IMMEDIATE_MAX &&
+    value == (double) (int32_t) value && !(value == 0 && signbit(value));
+
+  if (!is_short) {
+    emit_constant(compiler, VALUE_NUMBER(value));
+    return;
+  }
+
+  // two's complement bits of the integer, truncated to the operand width
+  uint32_t bits = (uint32_t) (int32_t) value;
+  if (value >= OPCODE_BYTE_IMMEDIATE_MIN && value <= OPCODE_BYTE_IMMEDIATE_MAX) {
+    emit_byte(compiler, OPCODE_NUMBER_BYTE);
+    emit_byte(compiler, (uint8_t) (bits & 0xFF));
+  } else {
+    emit_byte(compiler, OPCODE_NUMBER_SHORT);
+    emit_byte(compiler, (uint8_t) ((bits >> 8) & 0xFF));
+    emit_byte(compiler, (uint8_t) (bits & 0xFF));
+  }
+}
+
+static size_t make_constant(struct Compiler *compiler, struct Value value) {
+  size_t constant = chunk_add_constant_unique(compiler->vm, current_chunk(compiler), &compiler->constant_index, value);
+  if (constant > CHUNK_CONSTANT_LONG_MAX) {
+    parser_error_at_previous(compiler, "Error - too many constants in one chunk");
     return 0;
   }
 
-  return (uint8_t) constant;
+  return constant;
 }
 
+#ifdef COMPILER_CONSTANT_FOLDING
+static void emit_value(struct Compiler *compiler, struct Value value) {
+  if      (VALUE_IS_NIL(value))    emit_byte(compiler, OPCODE_NIL);
+  else if (VALUE_IS_BOOL(value))   emit_byte(compiler, VALUE_AS_BOOL(value) ? OPCODE_TRUE : OPCODE_FALSE);
+  else if (VALUE_IS_NUMBER(value)) emit_number(compiler, VALUE_AS_NUMBER(value));
+  else                             emit_constant(compiler, value);
+}
+#endif
+
+static struct ExpressionMark mark_expression(struct Compiler *compiler) {
+  return (struct ExpressionMark) {
+    .byte_offset    = current_chunk(compiler)->byte_count,
+    .constant_count = current_chunk(compiler)->constants.value_count
+  };
+}
+
+// succeeds when bytes [start, end) are exactly one instruction pushing a constant
+static uint8_t read_constant_instruction(struct Compiler *compiler, size_t start, size_t end, struct Value *out) {
+  struct Chunk *chunk = current_chunk(compiler);
+  if (start >= end || start + opcode_size(chunk->buffer[start]) != end) return FALSE;
+
+  switch (chunk->buffer[start]) {
+    case OPCODE_CONSTANT: {
+      *out = chunk->constants.buffer[chunk->buffer[start + 1]];
+    } break;
+    case OPCODE_CONSTANT_LONG: {
+      size_t value_index =
+        (chunk->buffer[start + 1] << 16) |
+        (chunk->buffer[start + 2] << 8)  |
+        (chunk->buffer[start + 3] << 0);
+      *out = chunk->constants.buffer[value_index];
+    } break;
+    case OPCODE_NUMBER_BYTE: {
+      *out = VALUE_NUMBER(opcode_byte_immediate(chunk->buffer[start + 1]));
+    } break;
+    case OPCODE_NUMBER_SHORT: {
+      *out = VALUE_NUMBER(opcode_short_immediate(chunk->buffer[start + 1], chunk->buffer[start + 2]));
+    } break;
+    case OPCODE_NIL:   *out = VALUE_NIL();       break;
+    case OPCODE_TRUE:  *out = VALUE_BOOL(TRUE);  break;
+    case OPCODE_FALSE: *out = VALUE_BOOL(FALSE); break;
+    default: return FALSE;
+  }
+
+  return TRUE;
+}
+
+// everything emitted since start is a single string literal
+static uint8_t is_string_constant(struct Compiler *compiler, struct ExpressionMark start) {
+  struct Value value;
+  return read_constant_instruction(compiler, start.byte_offset, current_chunk(compiler)->byte_count, &value) &&
+         OBJECT_IS_OBJECT_STRING(value);
+}
+
+// operators whose result vm_run would compute from constant operands are
+// evaluated here with the same semantics, anything that would raise a
+// runtime error is left for vm_run to report
+static uint8_t fold_unary(struct Compiler *compiler, enum TokenType operator_type, struct ExpressionMark operand) {
+#ifdef COMPILER_CONSTANT_FOLDING
+  struct Value value;
+  if (compiler->parser.had_error ||
+      !read_constant_instruction(compiler, operand.byte_offset, current_chunk(compiler)->byte_count, &value))
+    return FALSE;
+
+  switch (operator_type) {
+    case TOKEN_TYPE_BANG: {
+      // same test as is_falsey in vm_run
+      value = VALUE_BOOL(VALUE_IS_NIL(value) || (VALUE_IS_BOOL(value) && !VALUE_AS_BOOL(value)));
+    } break;
+    case TOKEN_TYPE_MINUS: {
+      if (!VALUE_IS_NUMBER(value)) return FALSE;
+      value = VALUE_NUMBER(-VALUE_AS_NUMBER(value));
+    } break;
+    default: return FALSE;
+  }
+
+  replace_with_constant(compiler, operand, value, 1);
+  return TRUE;
+#else
+  (void) compiler;
+  (void) operator_type;
+  (void) operand;
+  return FALSE;
+#endif
+}
+
+static uint8_t fold_binary(struct Compiler *compiler, enum TokenType operator_type, struct ExpressionMark left, struct ExpressionMark right) {
+#ifdef COMPILER_CONSTANT_FOLDING
+  struct Value a, b, value;
+  if (compiler->parser.had_error ||
+      !read_constant_instruction(compiler, left.byte_offset, right.byte_offset, &a) ||
+      !read_constant_instruction(compiler, right.byte_offset, current_chunk(compiler)->byte_count, &b))
+    return FALSE;
+
+  if (operator_type == TOKEN_TYPE_BANG_EQUAL || operator_type == TOKEN_TYPE_EQUAL_EQUAL) {
+    uint8_t equal = value_equal(a, b);
+    value = VALUE_BOOL(operator_type == TOKEN_TYPE_EQUAL_EQUAL ? equal : !equal);
+  } else if (VALUE_IS_NUMBER(a) && VALUE_IS_NUMBER(b)) {
+    double x = VALUE_AS_NUMBER(a);
+    double y = VALUE_AS_NUMBER(b);
+    switch (operator_type) {
+      case TOKEN_TYPE_GREATER:       value = VALUE_BOOL(x > y);  break;
+      case TOKEN_TYPE_GREATER_EQUAL: value = VALUE_BOOL(x >= y); break;
+      case TOKEN_TYPE_LESS:          value = VALUE_BOOL(x < y);  break;
+      case TOKEN_TYPE_LESS_EQUAL:    value = VALUE_BOOL(x <= y); break;
+
+      case TOKEN_TYPE_PLUS:  value = VALUE_NUMBER(x + y); break;
+      case TOKEN_TYPE_MINUS: value = VALUE_NUMBER(x - y); break;
+      case TOKEN_TYPE_STAR:  value = VALUE_NUMBER(x * y); break;
+      case TOKEN_TYPE_SLASH: value = VALUE_NUMBER(x / y); break;
+      default: return FALSE;
+    }
+  } else {
+    return FALSE;
+  }
+
+  replace_with_constant(compiler, left, value, 2);
+  return TRUE;
+#else
+  (void) compiler;
+  (void) operator_type;
+  (void) left;
+  (void) right;
+  return FALSE;
+#endif
+}
+
+// everything emitted since start is a sum of operand_count string literals,
+// with the OPCODE_CONCAT_N of every full run between them. joining them a
+// pair at a time would copy the running result once per operand
+static uint8_t fold_sum(struct Compiler *compiler, struct ExpressionMark start, size_t operand_count) {
+#ifdef COMPILER_CONSTANT_FOLDING
+  if (compiler->parser.had_error) return FALSE;
+
+  // the parts stay reachable as constants of the chunk until it is truncated
+  struct Chunk *chunk = current_chunk(compiler);
+  struct Value *parts = MEMORY_ALLOCATE(compiler->vm, struct Value, operand_count, MEMORY_TAG_SCRATCH);
+  size_t part_count = 0;
+  for (size_t offset = start.byte_offset; offset < chunk->byte_count; offset += opcode_size(chunk->buffer[offset])) {
+    if (chunk->buffer[offset] == OPCODE_CONCAT_N) continue;
+
+    assert(part_count < operand_count);
+    read_constant_instruction(compiler, offset, offset + opcode_size(chunk->buffer[offset]), &parts[part_count]);
+    part_count += 1;
+  }
+  assert(part_count == operand_count);
+
+  // every operand and every + become the one constant
+  struct Value value = VALUE_OBJECT(object_object_string_concatenate_n(compiler->vm, parts, part_count));
+  replace_with_constant(compiler, start, value, 2 * (operand_count - 1));
+  MEMORY_FREE_ARRAY(compiler->vm, struct Value, parts, operand_count, MEMORY_TAG_SCRATCH);
+  return TRUE;
+#else
+  (void) compiler;
+  (void) start;
+  (void) operand_count;
+  return FALSE;
+#endif
+}
+
+#ifdef COMPILER_CONSTANT_FOLDING
+// drop everything emitted since start, operands and their constants, and
+// push the folded value in their place
+static void replace_with_constant(struct Compiler *compiler, struct ExpressionMark start, struct Value value, size_t removed_instruction_count) {
+  chunk_truncate(current_chunk(compiler), start.byte_offset, start.constant_count);
+  emit_value(compiler, value);
+  compiler->stats.folded_instruction_count += removed_instruction_count;
+}
+#endif
+
 static struct ParseRule* get_rule(enum TokenType type) {
   return &parser_rules[type];
 }
\ No newline at end of file
@@ -9,7 +9,11 @@
 
 static inline size_t display_one_byte_instruction(const char *instruction_name, const size_t offset);
 static inline size_t display_two_byte_instruction(const char *instruction_name, const struct Value value, const size_t offset);
+static inline size_t display_three_byte_instruction(const char *instruction_name, const struct Value value, const size_t offset);
 static inline size_t display_four_byte_instruction(const char *instruction_name, const struct Value value, const size_t offset);
+static inline size_t display_constant_instruction(const char *instruction_name, struct Chunk *chunk, const size_t offset);
+static inline size_t display_immediate_instruction(const char *instruction_name, struct Chunk *chunk, const size_t offset);
+static inline size_t display_count_instruction(const char *instruction_name, struct Chunk *chunk, const size_t offset);
 
 void debug_disassemble_chunk(struct Chunk *chunk, const char *message) {
   printf("== %s ==\n", message);
@@ -24,7 +28,7 @@ void debug_disassemble_chunk(struct Chunk *chunk, const char *message) {
 void debug_disassemble_value_array(struct ValueArray *value_array, const char *message) {
   printf("== %s ==\n", message);
   for(size_t i = 0; i < value_array->value_count; ++i) {
-    value_print(value_array->buffer[i]);
+    value_print(stdout, value_array->buffer[i]);
     printf(" ");
   }
 }
@@ -41,13 +45,7 @@ size_t debug_disassemble_instruction(struct Chunk *chunk, const size_t offset) {
   uint8_t instruction = chunk->buffer[offset];
 
   switch(instruction) {
-    case OPCODE_CONSTANT: {
-      assert(offset+1 < chunk->byte_count);
-      size_t value_index = chunk->buffer[offset + 1];
-      struct Value value = chunk->constants.buffer[value_index];
-      printf("\tat index %lu - ", value_index);
-      return display_two_byte_instruction("OPCODE_CONSTANT", value, offset);
-    } break; // not really needed, but good structure
+    case OPCODE_CONSTANT: return display_constant_instruction("OPCODE_CONSTANT", chunk, offset); break;
     
     case OPCODE_CONSTANT_LONG: {
       size_t value_index = 
@@ -60,6 +58,18 @@ size_t debug_disassemble_instruction(struct Chunk *chunk, const size_t offset) {
       return display_four_byte_instruction("OPCODE_CONSTANT_LONG", value, offset);
     } break; // not really needed, but good structure
 
+    case OPCODE_NUMBER_BYTE: {
+      printf("\t");
+      struct Value value = VALUE_NUMBER(opcode_byte_immediate(chunk->buffer[offset + 1]));
+      return display_two_byte_instruction("OPCODE_NUMBER_BYTE", value, offset);
+    } break;
+
+    case OPCODE_NUMBER_SHORT: {
+      printf("\t");
+      struct Value value = VALUE_NUMBER(opcode_short_immediate(chunk->buffer[offset + 1], chunk->buffer[offset + 2]));
+      return display_three_byte_instruction("OPCODE_NUMBER_SHORT", value, offset);
+    } break;
+
     case OPCODE_NIL:   return display_one_byte_instruction("OPCODE_NIL", offset);   break;
     case OPCODE_TRUE:  return display_one_byte_instruction("OPCODE_TRUE", offset);  break;
     case OPCODE_FALSE: return display_one_byte_instruction("OPCODE_FALSE", offset); break;
@@ -79,8 +89,47 @@ size_t debug_disassemble_instruction(struct Chunk *chunk, const size_t offset) {
     case OPCODE_NOT:    return display_one_byte_instruction("OPCODE_NOT", offset);    break;
     case OPCODE_NEGATE: return display_one_byte_instruction("OPCODE_NEGATE", offset); break;
 
+    case OPCODE_CONCAT_N: return display_count_instruction("OPCODE_CONCAT_N", chunk, offset); break;
+
     case OPCODE_RETURN: return display_one_byte_instruction("OPCODE_RETURN", offset); break;
 
+    case OPCODE_ADD_CONSTANT:           return display_constant_instruction("OPCODE_ADD_CONSTANT", chunk, offset);           break;
+    case OPCODE_SUBTRACT_CONSTANT:      return display_constant_instruction("OPCODE_SUBTRACT_CONSTANT", chunk, offset);      break;
+    case OPCODE_MULTIPLY_CONSTANT:      return display_constant_instruction("OPCODE_MULTIPLY_CONSTANT", chunk, offset);      break;
+    case OPCODE_DIVIDE_CONSTANT:        return display_constant_instruction("OPCODE_DIVIDE_CONSTANT", chunk, offset);        break;
+    case OPCODE_GREATER_CONSTANT:       return display_constant_instruction("OPCODE_GREATER_CONSTANT", chunk, offset);       break;
+    case OPCODE_GREATER_EQUAL_CONSTANT: return display_constant_instruction("OPCODE_GREATER_EQUAL_CONSTANT", chunk, offset); break;
+    case OPCODE_LESS_CONSTANT:          return display_constant_instruction("OPCODE_LESS_CONSTANT", chunk, offset);          break;
+    case OPCODE_LESS_EQUAL_CONSTANT:    return display_constant_instruction("OPCODE_LESS_EQUAL_CONSTANT", chunk, offset);    break;
+    case OPCODE_EQUAL_CONSTANT:         return display_constant_instruction("OPCODE_EQUAL_CONSTANT", chunk, offset);         break;
+    case OPCODE_BANG_EQUAL_CONSTANT:    return display_constant_instruction("OPCODE_BANG_EQUAL_CONSTANT", chunk, offset);    break;
+
+    case OPCODE_ADD_IMMEDIATE:           return display_immediate_instruction("OPCODE_ADD_IMMEDIATE", chunk, offset);           break;
+    case OPCODE_SUBTRACT_IMMEDIATE:      return display_immediate_instruction("OPCODE_SUBTRACT_IMMEDIATE", chunk, offset);      break;
+    case OPCODE_MULTIPLY_IMMEDIATE:      return display_immediate_instruction("OPCODE_MULTIPLY_IMMEDIATE", chunk, offset);      break;
+    case OPCODE_DIVIDE_IMMEDIATE:        return display_immediate_instruction("OPCODE_DIVIDE_IMMEDIATE", chunk, offset);        break;
+    case OPCODE_GREATER_IMMEDIATE:       return display_immediate_instruction("OPCODE_GREATER_IMMEDIATE", chunk, offset);       break;
+    case OPCODE_GREATER_EQUAL_IMMEDIATE: return display_immediate_instruction("OPCODE_GREATER_EQUAL_IMMEDIATE", chunk, offset); break;
+    case OPCODE_LESS_IMMEDIATE:          return display_immediate_instruction("OPCODE_LESS_IMMEDIATE", chunk, offset);          break;
+    case OPCODE_LESS_EQUAL_IMMEDIATE:    return display_immediate_instruction("OPCODE_LESS_EQUAL_IMMEDIATE", chunk, offset);    break;
+    case OPCODE_EQUAL_IMMEDIATE:         return display_immediate_instruction("OPCODE_EQUAL_IMMEDIATE", chunk, offset);         break;
+    case OPCODE_BANG_EQUAL_IMMEDIATE:    return display_immediate_instruction("OPCODE_BANG_EQUAL_IMMEDIATE", chunk, offset);    break;
+
+    case OPCODE_NOT_GREATER:       return display_one_byte_instruction("OPCODE_NOT_GREATER", offset);       break;
+    case OPCODE_NOT_GREATER_EQUAL: return display_one_byte_instruction("OPCODE_NOT_GREATER_EQUAL", offset); break;
+    case OPCODE_NOT_LESS:          return display_one_byte_instruction("OPCODE_NOT_LESS", offset);          break;
+    case OPCODE_NOT_LESS_EQUAL:    return display_one_byte_instruction("OPCODE_NOT_LESS_EQUAL", offset);    break;
+
+    case OPCODE_ADD_NUMBER:           return display_one_byte_instruction("OPCODE_ADD_NUMBER", offset);           break;
+    case OPCODE_ADD_STRING:           return display_one_byte_instruction("OPCODE_ADD_STRING", offset);           break;
+    case OPCODE_SUBTRACT_NUMBER:      return display_one_byte_instruction("OPCODE_SUBTRACT_NUMBER", offset);      break;
+    case OPCODE_MULTIPLY_NUMBER:      return display_one_byte_instruction("OPCODE_MULTIPLY_NUMBER", offset);      break;
+    case OPCODE_DIVIDE_NUMBER:        return display_one_byte_instruction("OPCODE_DIVIDE_NUMBER", offset);        break;
+    case OPCODE_GREATER_NUMBER:       return display_one_byte_instruction("OPCODE_GREATER_NUMBER", offset);       break;
+    case OPCODE_GREATER_EQUAL_NUMBER: return display_one_byte_instruction("OPCODE_GREATER_EQUAL_NUMBER", offset); break;
+    case OPCODE_LESS_NUMBER:          return display_one_byte_instruction("OPCODE_LESS_NUMBER", offset);          break;
+    case OPCODE_LESS_EQUAL_NUMBER:    return display_one_byte_instruction("OPCODE_LESS_EQUAL_NUMBER", offset);    break;
+
     default: {
       printf("Unknown opcode %d\n", instruction);
       return offset + 1;
@@ -97,14 +146,41 @@ static inline size_t display_one_byte_instruction(const char *instruction_name,
 
 static inline size_t display_two_byte_instruction(const char *instruction_name, const struct Value value, const size_t offset) {
   printf("%s ", instruction_name);
-  value_print(value);
+  value_print(stdout, value);
   printf("\n");
   return offset + 2;
 }
 
+static inline size_t display_three_byte_instruction(const char *instruction_name, const struct Value value, const size_t offset) {
+  printf("%s ", instruction_name);
+  value_print(stdout, value);
+  printf("\n");
+  return offset + 3;
+}
+
 static inline size_t display_four_byte_instruction(const char *instruction_name, const struct Value value, const size_t offset) {
   printf("%s ", instruction_name);
-  value_print(value);
+  value_print(stdout, value);
   printf("\n");
   return offset + 4;
-}
\ No newline at end of file
+}
+
+static inline size_t display_constant_instruction(const char *instruction_name, struct Chunk *chunk, const size_t offset) {
+  assert(offset + 1 < chunk->byte_count);
+  size_t value_index = chunk->buffer[offset + 1];
+  struct Value value = chunk->constants.buffer[value_index];
+  printf("\tat index %lu - ", value_index);
+  return display_two_byte_instruction(instruction_name, value, offset);
+}
+static inline size_t display_immediate_instruction(const char *instruction_name, struct Chunk *chunk, const size_t offset) {
+  assert(offset + 1 < chunk->byte_count);
+  struct Value value = VALUE_NUMBER(opcode_byte_immediate(chunk->buffer[offset + 1]));
+  printf("\t");
+  return display_two_byte_instruction(instruction_name, value, offset);
+}
+
+static inline size_t display_count_instruction(const char *instruction_name, struct Chunk *chunk, const size_t offset) {
+  assert(offset + 1 < chunk->byte_count);
+  printf("\t%s %u\n", instruction_name, chunk->buffer[offset + 1]);
+  return offset + 2;
+}
@@ -0,0 +1,277 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "executor.h"
+
+#define JOB_DEQUE_INITIAL_CAPACITY 16
+
+// file local prototypes
+static void *worker_run(void *argument);
+static struct ExecutorJob *worker_take_job(struct Worker *worker);
+static void worker_execute(struct Worker *worker, struct ExecutorJob *job);
+static uint8_t job_output_write(void *context, const char *bytes, size_t length);
+static void job_deque_init(struct JobDeque *deque);
+static void job_deque_free(struct JobDeque *deque);
+static void job_deque_push_back(struct JobDeque *deque, struct ExecutorJob *job);
+static struct ExecutorJob *job_deque_pop_back(struct JobDeque *deque);
+static struct ExecutorJob *job_deque_pop_front(struct JobDeque *deque);
+static void *checked_malloc(size_t size);
+
+void executor_job_init(struct ExecutorJob *job, const char *source) {
+  job->source = source;
+  job->result = INTERPRET_RESULT_OK;
+  job->output = NULL;
+  job->output_length = 0;
+  job->errors = NULL;
+  job->errors_length = 0;
+}
+
+void executor_job_free(struct ExecutorJob *job) {
+  free(job->output);
+  free(job->errors);
+  executor_job_init(job, job->source);
+}
+
+void executor_init(struct Executor *executor, size_t worker_count, const struct Allocator *allocator) {
+  assert(worker_count > 0);
+
+  executor->workers = (struct Worker *) checked_malloc(sizeof(struct Worker) * worker_count);
+  executor->worker_count = worker_count;
+  executor->next_worker = 0;
+  pthread_mutex_init(&executor->lock, NULL);
+  pthread_cond_init(&executor->work_available, NULL);
+  pthread_cond_init(&executor->all_done, NULL);
+  executor->queued_count = 0;
+  executor->pending_count = 0;
+  executor->shutdown = FALSE;
+
+  for (size_t i = 0; i < worker_count; ++i) {
+    struct Worker *worker = &executor->workers[i];
+    worker->executor = executor;
+    vm_init(&worker->vm, allocator);
+    job_deque_init(&worker->deque);
+    worker->executed_count = 0;
+    worker->stolen_count = 0;
+  }
+
+  // start the threads only once every deque they may steal from exists
+  for (size_t i = 0; i < worker_count; ++i) {
+    if (pthread_create(&executor->workers[i].thread, NULL, worker_run, &executor->workers[i]) != 0) {
+      fprintf(stderr, "Error - could not start executor worker %lu\n", i);
+      exit(1);
+    }
+  }
+}
+
+// finishes every submitted job before the workers stop
+void executor_free(struct Executor *executor) {
+  pthread_mutex_lock(&executor->lock);
+  executor->shutdown = TRUE;
+  pthread_cond_broadcast(&executor->work_available);
+  pthread_mutex_unlock(&executor->lock);
+
+  // workers still running may look into the deque of one already stopped
+  for (size_t i = 0; i < executor->worker_count; ++i) {
+    pthread_join(executor->workers[i].thread, NULL);
+  }
+
+  for (size_t i = 0; i < executor->worker_count; ++i) {
+    struct Worker *worker = &executor->workers[i];
+    job_deque_free(&worker->deque);
+    vm_free(&worker->vm);
+  }
+
+  pthread_cond_destroy(&executor->all_done);
+  pthread_cond_destroy(&executor->work_available);
+  pthread_mutex_destroy(&executor->lock);
+  free(executor->workers);
+  executor->workers = NULL;
+  executor->worker_count = 0;
+}
+
+void executor_submit(struct Executor *executor, struct ExecutorJob *job) {
+  struct Worker *worker = &executor->workers[executor->next_worker];
+  executor->next_worker = (executor->next_worker + 1) % executor->worker_count;
+
+  // counted before any worker can see the job, or one could take and finish
+  // it first and wrap the counters below zero. workers never hold a deque
+  // lock while taking this one, so the nesting cannot deadlock
+  pthread_mutex_lock(&executor->lock);
+  executor->queued_count += 1;
+  executor->pending_count += 1;
+  job_deque_push_back(&worker->deque, job);
+  pthread_cond_signal(&executor->work_available);
+  pthread_mutex_unlock(&executor->lock);
+}
+
+// block until every job submitted so far has finished
+void executor_wait(struct Executor *executor) {
+  pthread_mutex_lock(&executor->lock);
+  while (executor->pending_count > 0) {
+    pthread_cond_wait(&executor->all_done, &executor->lock);
+  }
+  pthread_mutex_unlock(&executor->lock);
+}
+
+// file local functions
+
+static void *worker_run(void *argument) {
+  struct Worker *worker = (struct Worker *) argument;
+  struct Executor *executor = worker->executor;
+
+  for (;;) {
+    struct ExecutorJob *job = worker_take_job(worker);
+
+    if (job == NULL) {
+      // a submission between the failed take and this check bumps
+      // queued_count under the lock, so no wakeup is lost
+      pthread_mutex_lock(&executor->lock);
+      while (executor->queued_count == 0 && !executor->shutdown) {
+        pthread_cond_wait(&executor->work_available, &executor->lock);
+      }
+      uint8_t finished = executor->shutdown && executor->queued_count == 0;
+      pthread_mutex_unlock(&executor->lock);
+
+      if (finished) return NULL;
+      continue;
+    }
+
+    pthread_mutex_lock(&executor->lock);
+    executor->queued_count -= 1;
+    pthread_mutex_unlock(&executor->lock);
+
+    worker_execute(worker, job);
+
+    pthread_mutex_lock(&executor->lock);
+    executor->pending_count -= 1;
+    if (executor->pending_count == 0) pthread_cond_broadcast(&executor->all_done);
+    pthread_mutex_unlock(&executor->lock);
+  }
+}
+
+// own deque first, newest job while its source is likely still cached,
+// then the oldest job of the other workers in turn
+static struct ExecutorJob *worker_take_job(struct Worker *worker) {
+  struct ExecutorJob *job = job_deque_pop_back(&worker->deque);
+  if (job != NULL) return job;
+
+  struct Executor *executor = worker->executor;
+  size_t self = (size_t) (worker - executor->workers);
+  for (size_t i = 1; i < executor->worker_count; ++i) {
+    struct Worker *victim = &executor->workers[(self + i) % executor->worker_count];
+    job = job_deque_pop_front(&victim->deque);
+    if (job != NULL) {
+      worker->stolen_count += 1;
+      return job;
+    }
+  }
+
+  return NULL;
+}
+
+static void worker_execute(struct Worker *worker, struct ExecutorJob *job) {
+  FILE *err = open_memstream(&job->errors, &job->errors_length);
+  if (err == NULL) {
+    fprintf(stderr, "Error - could not capture executor job output\n");
+    exit(1);
+  }
+
+  // results only reach the job once the buffer fills or the sink changes
+  vm_set_output(&worker->vm, (struct OutputSink) {job_output_write, job}, OUTPUT_FLUSH_FULL);
+  worker->vm.err = err;
+  job->result = vm_interpret(&worker->vm, job->source);
+  vm_set_output(&worker->vm, output_file_sink(stdout), OUTPUT_FLUSH_RESULT);
+  worker->vm.err = stderr;
+
+  // closing publishes the final buffer pointer and length
+  fclose(err);
+  worker->executed_count += 1;
+}
+
+// appends to the job output, kept NUL terminated like a memstream buffer
+static uint8_t job_output_write(void *context, const char *bytes, size_t length) {
+  struct ExecutorJob *job = (struct ExecutorJob *) context;
+  char *output = (char *) realloc(job->output, job->output_length + length + 1);
+  if (output == NULL) return FALSE;
+
+  memcpy(output + job->output_length, bytes, length);
+  job->output = output;
+  job->output_length += length;
+  job->output[job->output_length] = '\0';
+  return TRUE;
+}
+
+static void job_deque_init(struct JobDeque *deque) {
+  pthread_mutex_init(&deque->lock, NULL);
+  deque->jobs = NULL;
+  deque->head = 0;
+  deque->count = 0;
+  deque->capacity = 0;
+}
+
+static void job_deque_free(struct JobDeque *deque) {
+  free(deque->jobs);
+  pthread_mutex_destroy(&deque->lock);
+}
+
+static void job_deque_push_back(struct JobDeque *deque, struct ExecutorJob *job) {
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->count + 1 > deque->capacity) {
+    // unroll the ring into the front of the bigger buffer
+    size_t capacity = deque->capacity < JOB_DEQUE_INITIAL_CAPACITY ? JOB_DEQUE_INITIAL_CAPACITY : deque->capacity * 2;
+    struct ExecutorJob **jobs = (struct ExecutorJob **) checked_malloc(sizeof(struct ExecutorJob *) * capacity);
+    for (size_t i = 0; i < deque->count; ++i) {
+      jobs[i] = deque->jobs[(deque->head + i) % deque->capacity];
+    }
+    free(deque->jobs);
+
+    deque->jobs = jobs;
+    deque->head = 0;
+    deque->capacity = capacity;
+  }
+
+  deque->jobs[(deque->head + deque->count) % deque->capacity] = job;
+  deque->count += 1;
+
+  pthread_mutex_unlock(&deque->lock);
+}
+
+static struct ExecutorJob *job_deque_pop_back(struct JobDeque *deque) {
+  struct ExecutorJob *job = NULL;
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->count > 0) {
+    deque->count -= 1;
+    job = deque->jobs[(deque->head + deque->count) % deque->capacity];
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+  return job;
+}
+
+static struct ExecutorJob *job_deque_pop_front(struct JobDeque *deque) {
+  struct ExecutorJob *job = NULL;
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->count > 0) {
+    job = deque->jobs[deque->head];
+    deque->head = (deque->head + 1) % deque->capacity;
+    deque->count -= 1;
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+  return job;
+}
+
+static void *checked_malloc(size_t size) {
+  void *result = malloc(size);
+  if (result == NULL) {
+    fprintf(stderr, "Error - result in executor allocation is NULL");
+    exit(1);
+  }
+  return result;
+}
@@ -0,0 +1,134 @@
+
+#include <stdio.h>
+
+#include "gc.h"
+#include "vm.h"
+#include "table.h"
+#include "object.h"
+#include "compiler.h"
+#include "program.h"
+#include "memory.h"
+
+// the heap may grow to between these multiples of the bytes that survived
+// a collection before the next one runs
+#define GC_GROWTH_FACTOR_MIN 1.5
+#define GC_GROWTH_FACTOR_MAX 4.0
+
+// file local prototypes
+static void mark_roots(struct VM *vm);
+static void trace_references(struct VM *vm);
+static void blacken_object(struct VM *vm, struct Object *object);
+static void sweep(struct VM *vm);
+static size_t next_threshold(size_t bytes_before, size_t bytes_after);
+
+void gc_collect(struct VM *vm) {
+  size_t bytes_before = vm->bytes_allocated;
+
+  mark_roots(vm);
+  trace_references(vm);
+
+  // the intern table holds its strings weakly, drop the ones nothing else reaches
+  vm->interned_string_count -= table_remove_unmarked(&vm->strings);
+  sweep(vm);
+
+  size_t bytes_after = vm->bytes_allocated;
+  vm->next_gc = next_threshold(bytes_before, bytes_after);
+  vm->gc_collection_count += 1;
+  vm->gc_freed_bytes += bytes_before - bytes_after;
+}
+
+void gc_mark_value(struct VM *vm, struct Value value) {
+  if (VALUE_IS_OBJECT(value)) gc_mark_object(vm, VALUE_AS_OBJECT(value));
+}
+
+void gc_mark_object(struct VM *vm, struct Object *object) {
+  if (object == NULL || object->is_marked) return;
+  object->is_marked = TRUE;
+
+  // grown untracked, counting it against the budget could start another
+  // collection
+  if (vm->gray_stack.count + 1 > vm->gray_stack.capacity) {
+    size_t old_capacity = vm->gray_stack.capacity;
+    vm->gray_stack.capacity = MEMORY_GROW_CAPACITY(old_capacity, 8);
+    vm->gray_stack.objects = memory_reallocate_untracked(vm, vm->gray_stack.objects,
+                                                            sizeof(struct Object *) * old_capacity,
+                                                            sizeof(struct Object *) * vm->gray_stack.capacity,
+                                                            MEMORY_TAG_SCRATCH);
+  }
+
+  vm->gray_stack.objects[vm->gray_stack.count] = object;
+  vm->gray_stack.count += 1;
+}
+
+void gc_mark_array(struct VM *vm, struct ValueArray *value_array) {
+  for (size_t i = 0; i < value_array->value_count; ++i) {
+    gc_mark_value(vm, value_array->buffer[i]);
+  }
+}
+
+// file local functions
+
+static void mark_roots(struct VM *vm) {
+  for (struct Value *slot = vm->stack; slot < vm->stack_top; ++slot) {
+    gc_mark_value(vm, *slot);
+  }
+
+  if (vm->chunk != NULL) gc_mark_array(vm, &vm->chunk->constants);
+  compiler_mark_roots(vm);
+  program_mark_roots(vm);
+}
+
+static void trace_references(struct VM *vm) {
+  while (vm->gray_stack.count > 0) {
+    vm->gray_stack.count -= 1;
+    blacken_object(vm, vm->gray_stack.objects[vm->gray_stack.count]);
+  }
+
+  memory_reallocate_untracked(vm, vm->gray_stack.objects, sizeof(struct Object *) * vm->gray_stack.capacity, 0, MEMORY_TAG_SCRATCH);
+  vm->gray_stack = (struct GrayStack) {0};
+}
+
+static void blacken_object(struct VM *vm, struct Object *object) {
+  switch (object->type) {
+    case OBJECT_TYPE_STRING: break; // strings reference nothing
+    case OBJECT_TYPE_ROPE: {
+      struct ObjectRope *rope = OBJECT_ROPE_FROM_OBJECT(object);
+      gc_mark_object(vm, rope->left);
+      gc_mark_object(vm, rope->right);
+      gc_mark_object(vm, (struct Object *) rope->flat);
+    } break;
+  }
+}
+
+static void sweep(struct VM *vm) {
+  struct Object *previous = NULL;
+  struct Object *object = vm->objects;
+
+  while (object != NULL) {
+    if (object->is_marked) {
+      // reset for the next collection
+      object->is_marked = FALSE;
+      previous = object;
+      object = object->next;
+      continue;
+    }
+
+    struct Object *unreached = object;
+    object = object->next;
+    if (previous != NULL) previous->next = object;
+    else                  vm->objects = object;
+
+    object_free_object(vm, unreached);
+  }
+}
+
+// a collection that freed little means the live set is large and growing,
+// so give it more headroom before the next one; a collection that freed
+// most of the heap can afford to run again sooner
+static size_t next_threshold(size_t bytes_before, size_t bytes_after) {
+  double survival = bytes_before > 0 ? (double) bytes_after / (double) bytes_before : 0.0;
+  double factor = GC_GROWTH_FACTOR_MIN + (GC_GROWTH_FACTOR_MAX - GC_GROWTH_FACTOR_MIN) * survival;
+
+  size_t threshold = (size_t) ((double) bytes_after * factor);
+  return threshold < GC_HEAP_MINIMUM ? GC_HEAP_MINIMUM : threshold;
+}
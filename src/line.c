@@ -1,43 +1,218 @@
-
 #include <stdio.h>
 
 #include "line.h"
 #include "memory.h"
 
+// file local prototypes
+static void write_number(struct VM *vm, struct LineArray *line_array, uint64_t number);
+static uint8_t read_number(struct LineCursor *cursor, uint64_t *number);
+static void enter_run(struct LineCursor *cursor, size_t run);
+static void read_change(struct LineCursor *cursor);
+
 void line_array_init(struct LineArray *line_array) {
   line_array->line_struct_count = 0;
   line_array->line_struct_capacity = 0;
   line_array->lines = NULL;
+  line_array->column_byte_count = 0;
+  line_array->column_byte_capacity = 0;
+  line_array->columns = NULL;
+  line_array->last_change_count = 0;
+  line_array->last_offset = 0;
+  line_array->last_column = 0;
 }
 
-void line_array_free(struct LineArray *line_array) {
-  MEMORY_FREE_ARRAY(struct Line, line_array->lines, line_array->line_struct_capacity);
+void line_array_free(struct VM *vm, struct LineArray *line_array) {
+  MEMORY_FREE_ARRAY(vm, struct Line, line_array->lines, line_array->line_struct_capacity, MEMORY_TAG_LINE_ARRAY);
+  MEMORY_FREE_ARRAY(vm, uint8_t, line_array->columns, line_array->column_byte_capacity, MEMORY_TAG_LINE_ARRAY);
 
   line_array_init(line_array);
 }
 
-void line_array_write(struct LineArray *line_array, const size_t line) {
+// record that the byte at offset came from line and column, bytes are written
+// in order so only a change of position is stored. a new line starts a run,
+// a new column on the same line is a change within the last run
+void line_array_write(struct VM *vm, struct LineArray *line_array, const size_t offset, const size_t line, const size_t column) {
+  assert(offset <= UINT32_MAX && line <= UINT32_MAX && column <= UINT32_MAX);
+
   size_t initial_line_struct_count = line_array->line_struct_count;
   size_t initial_line_struct_capacity = line_array->line_struct_capacity;
 
-  size_t previous_line = 0;
-  // if a line has already been initialized...
-  if(initial_line_struct_count > 0) {
-    previous_line = line_array->lines[line_array->line_struct_count-1].line;
+  if (initial_line_struct_count > 0) {
+    assert(line_array->last_offset < offset);
+    if (line_array->lines[initial_line_struct_count - 1].line == line) {
+      if (line_array->last_column == column) return;
+
+      if (line_array->last_change_count < LINE_RUN_MAX_COLUMN_CHANGES) {
+        int64_t difference = (int64_t) column - (int64_t) line_array->last_column;
+        write_number(vm, line_array, offset - line_array->last_offset);
+        write_number(vm, line_array, ((uint64_t) difference << 1) ^ (uint64_t) (difference >> 63));
+        line_array->last_change_count += 1;
+        line_array->last_offset = (uint32_t) offset;
+        line_array->last_column = (uint32_t) column;
+        return;
+      }
+    }
   }
 
   // resize the backing buffer used for line debug storage
   if(initial_line_struct_capacity < initial_line_struct_count + 1) {
     line_array->line_struct_capacity = MEMORY_GROW_CAPACITY(initial_line_struct_capacity, CHUNK_LINE_INITIAL_CAPACITY);
-    line_array->lines = MEMORY_GROW_ARRAY(struct Line, line_array->lines, initial_line_struct_capacity, line_array->line_struct_capacity);
+    line_array->lines = MEMORY_GROW_ARRAY(vm, struct Line, line_array->lines, initial_line_struct_capacity, line_array->line_struct_capacity, MEMORY_TAG_LINE_ARRAY);
+  }
+
+  line_array->lines[initial_line_struct_count] = (struct Line) {
+    .offset = (uint32_t) offset,
+    .line = (uint32_t) line,
+    .column = (uint32_t) column,
+    .column_start = (uint32_t) line_array->column_byte_count
+  };
+  line_array->line_struct_count += 1;
+  line_array->last_change_count = 0;
+  line_array->last_offset = (uint32_t) offset;
+  line_array->last_column = (uint32_t) column;
+}
+
+// forget the position of every byte from byte_count on
+void line_array_truncate(struct LineArray *line_array, const size_t byte_count) {
+  while (line_array->line_struct_count > 0 &&
+         line_array->lines[line_array->line_struct_count - 1].offset >= byte_count) {
+    line_array->line_struct_count -= 1;
+  }
+
+  if (line_array->line_struct_count == 0) {
+    line_array->column_byte_count = 0;
+    return;
   }
 
-  // check if line is same as previous, otherwise write a new line
-  if(line == previous_line && previous_line != 0) {
-    // access current line structure
-    line_array->lines[initial_line_struct_count-1].line_count += 1;
+  // keep the changes of the last run that are still before byte_count
+  struct LineCursor cursor;
+  cursor.line_array = line_array;
+  enter_run(&cursor, line_array->line_struct_count - 1);
+
+  size_t change_count = 0;
+  size_t last_offset = line_array->lines[cursor.run].offset;
+  while (cursor.change_offset < byte_count) {
+    cursor.position.column = cursor.change_column;
+    last_offset = cursor.change_offset;
+    change_count += 1;
+    read_change(&cursor);
+  }
+
+  line_array->column_byte_count = cursor.change_start;
+  line_array->last_change_count = change_count;
+  line_array->last_offset = (uint32_t) last_offset;
+  line_array->last_column = (uint32_t) cursor.position.column;
+}
+
+// the position of the byte at offset, found by a binary search for its run
+// and decoding at most LINE_RUN_MAX_COLUMN_CHANGES changes of it
+struct LinePosition line_array_find(const struct LineArray *line_array, const size_t offset) {
+  size_t low = 0;
+  size_t high = line_array->line_struct_count;
+
+  // first run starting after offset, the one before it holds offset
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (line_array->lines[middle].offset <= offset) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+
+  if (low == 0) return (struct LinePosition) {0, 0};
+
+  struct LineCursor cursor;
+  cursor.line_array = line_array;
+  enter_run(&cursor, low - 1);
+  return line_cursor_advance(&cursor, offset);
+}
+
+void line_cursor_init(struct LineCursor *cursor, const struct LineArray *line_array) {
+  cursor->line_array = line_array;
+  if (line_array->line_struct_count > 0) {
+    enter_run(cursor, 0);
   } else {
-    line_array->lines[initial_line_struct_count] = (struct Line) { .line = line, .line_count = 1 };
-    line_array->line_struct_count += 1;
+    cursor->run = 0;
+    cursor->position = (struct LinePosition) {0, 0};
   }
-}
\ No newline at end of file
+}
+
+// offset must not be before one the cursor was advanced to already
+struct LinePosition line_cursor_advance(struct LineCursor *cursor, const size_t offset) {
+  const struct LineArray *line_array = cursor->line_array;
+  if (line_array->line_struct_count == 0 || offset < line_array->lines[0].offset) {
+    return (struct LinePosition) {0, 0};
+  }
+
+  while (cursor->run + 1 < line_array->line_struct_count && line_array->lines[cursor->run + 1].offset <= offset) {
+    enter_run(cursor, cursor->run + 1);
+  }
+
+  while (cursor->change_offset <= offset) {
+    cursor->position.column = cursor->change_column;
+    read_change(cursor);
+  }
+
+  return cursor->position;
+}
+
+// file local functions
+
+static void write_number(struct VM *vm, struct LineArray *line_array, uint64_t number) {
+  do {
+    if (line_array->column_byte_capacity < line_array->column_byte_count + 1) {
+      size_t old_capacity = line_array->column_byte_capacity;
+      line_array->column_byte_capacity = MEMORY_GROW_CAPACITY(old_capacity, CHUNK_COLUMN_INITIAL_CAPACITY);
+      line_array->columns = MEMORY_GROW_ARRAY(vm, uint8_t, line_array->columns, old_capacity, line_array->column_byte_capacity, MEMORY_TAG_LINE_ARRAY);
+    }
+
+    uint8_t byte = number & 0x7F;
+    number >>= 7;
+    line_array->columns[line_array->column_byte_count] = byte | (number != 0 ? 0x80 : 0);
+    line_array->column_byte_count += 1;
+  } while (number != 0);
+}
+
+// FALSE at the end of the run. a loaded program's stream is only known to lie
+// within its section, so a number is never read past the run either
+static uint8_t read_number(struct LineCursor *cursor, uint64_t *number) {
+  *number = 0;
+  for (unsigned shift = 0; cursor->column_index < cursor->column_end && shift < 64; shift += 7) {
+    uint8_t byte = cursor->line_array->columns[cursor->column_index];
+    cursor->column_index += 1;
+    *number |= (uint64_t) (byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) return TRUE;
+  }
+  return FALSE;
+}
+
+static void enter_run(struct LineCursor *cursor, size_t run) {
+  const struct LineArray *line_array = cursor->line_array;
+  const struct Line *line = &line_array->lines[run];
+
+  cursor->run = run;
+  cursor->column_index = line->column_start;
+  cursor->column_end = run + 1 < line_array->line_struct_count
+                       ? line_array->lines[run + 1].column_start
+                       : line_array->column_byte_count;
+  cursor->change_offset = line->offset;
+  cursor->change_column = line->column;
+  cursor->position = (struct LinePosition) {line->line, line->column};
+  read_change(cursor);
+}
+
+// decode the run's next change relative to the one before it
+static void read_change(struct LineCursor *cursor) {
+  cursor->change_start = cursor->column_index;
+
+  uint64_t offset_delta;
+  uint64_t column_delta;
+  if (!read_number(cursor, &offset_delta) || !read_number(cursor, &column_delta)) {
+    cursor->change_offset = SIZE_MAX;
+    return;
+  }
+
+  cursor->change_offset += offset_delta;
+  cursor->change_column += (size_t) ((column_delta >> 1) ^ (~(column_delta & 1) + 1));
+}
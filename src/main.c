@@ -1,32 +1,80 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
 
 #include "vm.h"
 #include "repl.h"
+#include "profiler.h"
+#include "cache.h"
+
+// the interpreter's only vm, file scope so the signal handler can free it
+static struct VM global_vm;
+
+// installed instead of the default allocator with --profile-memory
+static struct Profiler global_profiler;
+
+// compiled programs of files run with --cache
+static struct CompileCache global_cache;
 
 void sighandler(int signum) {
   printf("Caught signal %d, exiting...\n", signum);
-  vm_free();
+  vm_free(&global_vm);
   exit(0);
 }
 
 int main(int argc, const char *argv[]) {
   (void) signal(SIGINT, sighandler); // Ctrl + C
 
-  vm_init();
+  // --jobs runs several files on worker threads, each with its own vm
+  if (argc > 3 && strcmp(argv[1], "--jobs") == 0) {
+    size_t worker_count = strtoul(argv[2], NULL, 10);
+    if (worker_count == 0) {
+      fprintf(stderr, "Error - --jobs expects a positive worker count\n");
+      exit(64);
+    }
+
+    repl_run_files(argv + 3, (size_t) (argc - 3), worker_count);
+    return 0;
+  }
+
+  uint8_t profile_memory = argc > 1 && strcmp(argv[1], "--profile-memory") == 0;
+  if (profile_memory) {
+    argc -= 1;
+    argv += 1;
+
+    profiler_init(&global_profiler, NULL);
+    struct Allocator allocator = profiler_allocator(&global_profiler);
+    vm_init(&global_vm, &allocator);
+  } else {
+    vm_init(&global_vm, NULL);
+  }
+
+  uint8_t use_cache = argc > 2 && strcmp(argv[1], "--cache") == 0;
+  if (use_cache) {
+    cache_init(&global_cache, argv[2], CACHE_DEFAULT_MAX_BYTES);
+    global_vm.cache = &global_cache;
+    argc -= 2;
+    argv += 2;
+  }
 
   if (argc == 1) {
-    repl_run();
+    repl_run(&global_vm);
   } else if (argc == 2) {
-    repl_run_file(argv[1]);
+    repl_run_file(&global_vm, argv[1]);
+  } else if (argc == 4 && strcmp(argv[1], "--compile") == 0) {
+    repl_compile_file(&global_vm, argv[2], argv[3]);
   } else {
-    fprintf(stderr, "Usage: interpreter [path]\n");
+    fprintf(stderr, "Usage: interpreter [--profile-memory] [--cache directory] [path]\n");
+    fprintf(stderr, "       interpreter [--profile-memory] --compile path output\n");
+    fprintf(stderr, "       interpreter --jobs count path...\n");
     exit(64);
   }
 
-  vm_free();
+  if (profile_memory) profiler_report(&global_vm.allocator, stderr);
+  vm_free(&global_vm);
+  if (use_cache) cache_free(&global_cache);
 
   return 0;
 }
@@ -1,23 +1,75 @@
-
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "memory.h"
+#include "vm.h"
+#include "gc.h"
+
+// file local prototypes
+static void *default_reallocate(void *context, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag);
+
+// every heap allocation goes through here, so the vm can keep a running
+// total and collect garbage before the heap grows past its budget
+void *memory_reallocate(struct VM *vm, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag) {
+  memory_track(vm, old_size, new_size);
+  return memory_reallocate_untracked(vm, buffer, old_size, new_size, tag);
+}
+
+// hand the request to the installed allocator without counting it against
+// the gc budget, for memory whose contents are accounted some other way
+void *memory_reallocate_untracked(struct VM *vm, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag) {
+  struct Allocator *allocator = &vm->allocator;
+  void *result = allocator->reallocate(allocator->context, buffer, old_size, new_size, tag);
+
+  if(new_size > 0 && result == NULL) {
+    fprintf(stderr, "Error - result in memory_reallocate is NULL");
+    exit(1);
+  }
+
+  return new_size == 0 ? NULL : result;
+}
+
+// account for a resize of memory that may come from somewhere other than
+// memory_reallocate, growing can start a collection
+void memory_track(struct VM *vm, size_t old_size, size_t new_size) {
+  vm->bytes_allocated += new_size - old_size;
 
-void *memory_reallocate(void *buffer, size_t old_size, size_t new_size) {
+  if (new_size > old_size) {
+#ifdef DEBUG_STRESS_GC
+    gc_collect(vm);
+#else
+    if (vm->bytes_allocated > vm->next_gc) gc_collect(vm);
+#endif
+  }
+}
+
+struct Allocator memory_default_allocator(void) {
+  return (struct Allocator) {default_reallocate, NULL};
+}
+
+const char *memory_tag_name(enum MemoryTag tag) {
+  switch (tag) {
+    case MEMORY_TAG_CHUNK_BYTECODE: return "chunk bytecode";
+    case MEMORY_TAG_LINE_ARRAY:     return "line array";
+    case MEMORY_TAG_VALUE_ARRAY:    return "value array";
+    case MEMORY_TAG_TABLE:          return "table entries";
+    case MEMORY_TAG_OBJECT:         return "objects";
+    case MEMORY_TAG_SCRATCH:        return "scratch";
+    default:                        return "unknown";
+  }
+}
+
+// file local functions
+
+static void *default_reallocate(void *context, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag) {
+  (void) context;
   (void) old_size;
+  (void) tag;
 
   if(new_size == 0) {
     free(buffer);
     return NULL;
   }
 
-  void *result = realloc(buffer, new_size);
-  
-  if(result == NULL) {
-    fprintf(stderr, "Error - result in memory_reallocate is NULL");
-    exit(1);
-  }
-
-  return result;
-}
\ No newline at end of file
+  return realloc(buffer, new_size);
+}
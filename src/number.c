@@ -0,0 +1,2009 @@
+#include <string.h>
+
+#include "number.h"
+
+// literals are parsed as in "Number Parsing at a Gigabyte per Second"
+// (Lemire, 2021): the first 19 significant digits are read into a 64-bit
+// mantissa w and the literal becomes w * 10^q, which a 128-bit
+// approximation of 5^q rounds correctly for any such w ("Fast Number
+// Parsing Without Fallback", Mushtak and Lemire, 2023). only literals with
+// more digits, whose dropped digits straddle a rounding boundary, are
+// settled by comparing them exactly with the halfway point
+//
+// doubles are formatted as in "Ryu: Fast Float-to-String Conversion"
+// (Adams, 2018): the interval of reals that round to the double is scaled
+// by a 125-bit power of five, and digits are dropped from its bounds until
+// one more would leave it, which gives the shortest decimal that parses
+// back to the same double
+
+// decimal exponents with an entry in power_of_five_128, beyond them every
+// literal is 0 or infinity
+#define NUMBER_SMALLEST_POWER_OF_TEN (-342)
+#define NUMBER_LARGEST_POWER_OF_TEN  308
+
+// as many digits as a uint64_t holds whatever they are
+#define NUMBER_MAX_MANTISSA_DIGITS 19
+
+// significant digits the exact comparison looks at. the halfway point
+// between two doubles has at most 767, so any literal that differs from it
+// differs within the first 768 and the rest only matter if it does not
+#define NUMBER_MAX_EXACT_DIGITS 800
+
+// 4096 bits, past anything NUMBER_MAX_EXACT_DIGITS and the double range need
+#define NUMBER_BIGINT_LIMBS 128
+
+// binary64
+#define NUMBER_MANTISSA_BITS 52
+#define NUMBER_MINIMUM_EXPONENT (-1023)
+#define NUMBER_INFINITE_POWER 0x7FF
+#define NUMBER_EXPONENT_BIAS 1023
+
+// bits of the powers of five in the formatting tables
+#define NUMBER_POW5_BITS     125
+#define NUMBER_POW5_INV_BITS 125
+#define NUMBER_POW5_COUNT     326
+#define NUMBER_POW5_INV_COUNT 342
+
+// decimal exponents printed without scientific notation, as by %g with
+// enough precision for any shortest decimal
+#define NUMBER_FIXED_MIN_EXPONENT (-4)
+#define NUMBER_FIXED_MAX_EXPONENT 17
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 number_uint128;
+#endif
+
+// little-endian arbitrary precision integer for the exact comparison
+struct BigInt {
+  uint32_t limbs[NUMBER_BIGINT_LIMBS];
+  size_t count;
+};
+
+// shortest decimal of a double as mantissa * 10^exponent
+struct Decimal {
+  uint64_t mantissa;
+  int32_t exponent;
+};
+
+// file local prototypes
+static uint8_t read_mantissa(const char *chars, size_t length, uint64_t *mantissa, int64_t *exponent);
+static uint64_t compute_float(int64_t exponent, uint64_t mantissa);
+static uint64_t round_exact(const char *chars, size_t length, uint64_t lower);
+static uint64_t multiply_64(uint64_t a, uint64_t b, uint64_t *high);
+static int leading_zeros(uint64_t value);
+static double bits_to_double(uint64_t bits);
+static void bigint_init(struct BigInt *n, uint64_t value);
+static void bigint_multiply_add(struct BigInt *n, uint32_t factor, uint32_t addend);
+static void bigint_multiply_power_of_five(struct BigInt *n, size_t exponent);
+static void bigint_shift_left(struct BigInt *n, size_t bits);
+static int bigint_compare(const struct BigInt *a, const struct BigInt *b);
+static uint8_t small_integer(uint64_t ieee_mantissa, uint32_t ieee_exponent, struct Decimal *decimal);
+static struct Decimal shortest_decimal(uint64_t ieee_mantissa, uint32_t ieee_exponent);
+static size_t write_decimal(struct Decimal decimal, char *buffer);
+static uint64_t multiply_shift(uint64_t m, const uint64_t *factor, int32_t shift);
+static uint32_t decimal_length(uint64_t value);
+static uint32_t pow5_factor(uint64_t value);
+static uint8_t is_multiple_of_pow5(uint64_t value, uint32_t p);
+static uint8_t is_multiple_of_pow2(uint64_t value, uint32_t p);
+static int32_t pow5_bits(int32_t e);
+static uint32_t log10_pow2(int32_t e);
+static uint32_t log10_pow5(int32_t e);
+
+// 5^q for every q in [-342, 308], normalized to 128 bits and truncated,
+// defined at the end of the file
+static const uint64_t power_of_five_128[NUMBER_LARGEST_POWER_OF_TEN - NUMBER_SMALLEST_POWER_OF_TEN + 1][2];
+
+// 5^i and 2^k / 5^i in NUMBER_POW5_BITS bits as {low, high}, defined at the
+// end of the file
+static const uint64_t pow5_split[NUMBER_POW5_COUNT][2];
+static const uint64_t pow5_inv_split[NUMBER_POW5_INV_COUNT][2];
+
+// the powers of ten a double holds exactly
+static const double exact_powers_of_ten[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+double number_parse(const char *chars, size_t length) {
+  uint64_t mantissa;
+  int64_t exponent;
+  uint8_t is_truncated = read_mantissa(chars, length, &mantissa, &exponent);
+
+  if (!is_truncated) {
+    // integers take a single rounding, as do decimals whose digits and
+    // power of ten are both exact doubles
+    if (exponent == 0) return (double) mantissa;
+    if (exponent < 0 && exponent >= -22 && mantissa <= (UINT64_C(1) << 53)) {
+      return (double) mantissa / exact_powers_of_ten[-exponent];
+    }
+    return bits_to_double(compute_float(exponent, mantissa));
+  }
+
+  // the literal lies between mantissa and mantissa + 1 at this exponent,
+  // which nearly always round to the same double
+  uint64_t lower = compute_float(exponent, mantissa);
+  uint64_t upper = compute_float(exponent, mantissa + 1);
+  if (lower == upper) return bits_to_double(lower);
+
+  return bits_to_double(round_exact(chars, length, lower));
+}
+
+size_t number_format(double value, char *buffer) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint8_t sign = (uint8_t) (bits >> 63);
+  uint64_t ieee_mantissa = bits & ((UINT64_C(1) << NUMBER_MANTISSA_BITS) - 1);
+  uint32_t ieee_exponent = (uint32_t) (bits >> NUMBER_MANTISSA_BITS) & NUMBER_INFINITE_POWER;
+
+  size_t length = 0;
+  if (sign) buffer[length++] = '-';
+
+  // spelled as glibc prints them, the sign of a NaN included
+  if (ieee_exponent == NUMBER_INFINITE_POWER) {
+    memcpy(buffer + length, ieee_mantissa != 0 ? "nan" : "inf", 3);
+    return length + 3;
+  }
+  if (ieee_exponent == 0 && ieee_mantissa == 0) {
+    buffer[length++] = '0';
+    return length;
+  }
+
+  struct Decimal decimal;
+  if (small_integer(ieee_mantissa, ieee_exponent, &decimal)) {
+    // integers are exact, only their trailing zeros can go
+    while (decimal.mantissa % 10 == 0) {
+      decimal.mantissa /= 10;
+      decimal.exponent += 1;
+    }
+  } else {
+    decimal = shortest_decimal(ieee_mantissa, ieee_exponent);
+  }
+
+  return length + write_decimal(decimal, buffer + length);
+}
+
+// file local functions
+
+// the literal as mantissa * 10^exponent, keeping its first 19 significant
+// digits. returns TRUE when any digit after those is not zero
+static uint8_t read_mantissa(const char *chars, size_t length, uint64_t *mantissa, int64_t *exponent) {
+  // nearly every literal is short enough that all of its digits fit
+  if (length <= NUMBER_MAX_MANTISSA_DIGITS) {
+    uint64_t digits = 0;
+    size_t point = length;
+    for (size_t i = 0; i < length; ++i) {
+      if (chars[i] == '.') point = i;
+      else                 digits = digits * 10 + (uint64_t) (chars[i] - '0');
+    }
+
+    *mantissa = digits;
+    *exponent = point == length ? 0 : -(int64_t) (length - point - 1);
+    return FALSE;
+  }
+
+  uint64_t digits = 0;
+  int64_t scale = 0;
+  size_t digit_count = 0;
+  uint8_t is_fraction = FALSE;
+  uint8_t is_truncated = FALSE;
+
+  for (size_t i = 0; i < length; ++i) {
+    if (chars[i] == '.') {
+      is_fraction = TRUE;
+      continue;
+    }
+
+    uint64_t digit = (uint64_t) (chars[i] - '0');
+    if (digit_count < NUMBER_MAX_MANTISSA_DIGITS) {
+      // leading zeros leave digits at 0 and are not counted
+      digits = digits * 10 + digit;
+      if (digits != 0) digit_count += 1;
+      if (is_fraction) scale -= 1;
+    } else {
+      if (!is_fraction) scale += 1;
+      if (digit != 0) is_truncated = TRUE;
+    }
+  }
+
+  *mantissa = digits;
+  *exponent = scale;
+  return is_truncated;
+}
+
+// Eisel-Lemire, the bits of the double nearest to mantissa * 10^exponent
+static uint64_t compute_float(int64_t exponent, uint64_t mantissa) {
+  if (mantissa == 0 || exponent < NUMBER_SMALLEST_POWER_OF_TEN) return 0;
+  if (exponent > NUMBER_LARGEST_POWER_OF_TEN) return (uint64_t) NUMBER_INFINITE_POWER << NUMBER_MANTISSA_BITS;
+
+  int zeros = leading_zeros(mantissa);
+  mantissa <<= zeros;
+
+  // the top 55 bits of mantissa * 5^exponent, the low word of the first
+  // product is only short of bits when all of the ones below them are set
+  const uint64_t *power = power_of_five_128[exponent - NUMBER_SMALLEST_POWER_OF_TEN];
+  uint64_t high;
+  uint64_t low = multiply_64(mantissa, power[0], &high);
+  if ((high & 0x1FF) == 0x1FF) {
+    uint64_t second_high;
+    multiply_64(mantissa, power[1], &second_high);
+    low += second_high;
+    if (second_high > low) high += 1;
+  }
+
+  int upper_bit = (int) (high >> 63);
+  int shift = upper_bit + 64 - NUMBER_MANTISSA_BITS - 3;
+  uint64_t bits = high >> shift;
+
+  // floor(log2(10^exponent)) + 63, for the exponents in the table
+  int64_t power2 = (((152170 + 65536) * exponent) >> 16) + 63 + upper_bit - zeros - NUMBER_MINIMUM_EXPONENT;
+
+  if (power2 <= 0) {
+    // subnormal, or too small for even that
+    if (-power2 + 1 >= 64) return 0;
+    bits >>= -power2 + 1;
+    bits += bits & 1;
+    bits >>= 1;
+    power2 = bits < (UINT64_C(1) << NUMBER_MANTISSA_BITS) ? 0 : 1;
+    return (bits & ((UINT64_C(1) << NUMBER_MANTISSA_BITS) - 1)) | ((uint64_t) power2 << NUMBER_MANTISSA_BITS);
+  }
+
+  // exactly halfway between two doubles can only happen for exponents
+  // whose 5^exponent is exact, round to even there instead of up
+  if (low <= 1 && exponent >= -4 && exponent <= 23 && (bits & 3) == 1 && (bits << shift) == high) {
+    bits &= ~UINT64_C(1);
+  }
+
+  bits += bits & 1;
+  bits >>= 1;
+  if (bits >= (UINT64_C(2) << NUMBER_MANTISSA_BITS)) {
+    bits = UINT64_C(1) << NUMBER_MANTISSA_BITS;
+    power2 += 1;
+  }
+
+  bits &= ~(UINT64_C(1) << NUMBER_MANTISSA_BITS);
+  if (power2 >= NUMBER_INFINITE_POWER) return (uint64_t) NUMBER_INFINITE_POWER << NUMBER_MANTISSA_BITS;
+
+  return bits | ((uint64_t) power2 << NUMBER_MANTISSA_BITS);
+}
+
+// the literal rounds to lower or to the double after it, whichever side of
+// the halfway point between them its full digits fall on
+static uint64_t round_exact(const char *chars, size_t length, uint64_t lower) {
+  static const uint32_t powers_of_ten_32[] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+  };
+
+  // digits * 10^exponent, with the digits read 9 at a time
+  struct BigInt digits;
+  bigint_init(&digits, 0);
+  int64_t exponent = 0;
+  size_t digit_count = 0;
+  uint8_t is_fraction = FALSE;
+  uint8_t has_tail = FALSE;
+  uint32_t group = 0;
+  size_t group_length = 0;
+
+  for (size_t i = 0; i < length; ++i) {
+    if (chars[i] == '.') {
+      is_fraction = TRUE;
+      continue;
+    }
+
+    uint32_t digit = (uint32_t) (chars[i] - '0');
+    if (digit_count == 0 && digit == 0) {
+      if (is_fraction) exponent -= 1;
+    } else if (digit_count < NUMBER_MAX_EXACT_DIGITS) {
+      group = group * 10 + digit;
+      group_length += 1;
+      digit_count += 1;
+      if (is_fraction) exponent -= 1;
+
+      if (group_length == 9) {
+        bigint_multiply_add(&digits, powers_of_ten_32[9], group);
+        group = 0;
+        group_length = 0;
+      }
+    } else {
+      if (!is_fraction) exponent += 1;
+      if (digit != 0) has_tail = TRUE;
+    }
+  }
+  if (group_length > 0) bigint_multiply_add(&digits, powers_of_ten_32[group_length], group);
+
+  // lower is m * 2^e, the halfway point (2m + 1) * 2^(e - 1)
+  uint64_t biased = lower >> NUMBER_MANTISSA_BITS;
+  uint64_t m = lower & ((UINT64_C(1) << NUMBER_MANTISSA_BITS) - 1);
+  if (biased != 0) m |= UINT64_C(1) << NUMBER_MANTISSA_BITS;
+  int64_t e = (biased == 0 ? 1 : (int64_t) biased) + NUMBER_MINIMUM_EXPONENT - NUMBER_MANTISSA_BITS;
+
+  struct BigInt halfway;
+  bigint_init(&halfway, 2 * m + 1);
+
+  // both sides times 2^-min(exponent, e - 1) * 5^-min(exponent, 0), as integers
+  if (exponent >= 0) bigint_multiply_power_of_five(&digits, (size_t) exponent);
+  else               bigint_multiply_power_of_five(&halfway, (size_t) -exponent);
+  if (exponent > e - 1) bigint_shift_left(&digits, (size_t) (exponent - (e - 1)));
+  else                  bigint_shift_left(&halfway, (size_t) ((e - 1) - exponent));
+
+  int order = bigint_compare(&digits, &halfway);
+  if (order == 0 && has_tail) order = 1;
+
+  // ties go to the even mantissa
+  if (order < 0 || (order == 0 && (m & 1) == 0)) return lower;
+  return lower + 1;
+}
+
+static uint64_t multiply_64(uint64_t a, uint64_t b, uint64_t *high) {
+#ifdef __SIZEOF_INT128__
+  number_uint128 product = (number_uint128) a * b;
+  *high = (uint64_t) (product >> 64);
+  return (uint64_t) product;
+#else
+  uint64_t a_low = a & 0xFFFFFFFF, a_high = a >> 32;
+  uint64_t b_low = b & 0xFFFFFFFF, b_high = b >> 32;
+  uint64_t low_low = a_low * b_low;
+  uint64_t high_low = a_high * b_low;
+  uint64_t low_high = a_low * b_high;
+  uint64_t high_high = a_high * b_high;
+
+  uint64_t cross = (low_low >> 32) + (high_low & 0xFFFFFFFF) + low_high;
+  *high = high_high + (high_low >> 32) + (cross >> 32);
+  return (cross << 32) | (low_low & 0xFFFFFFFF);
+#endif
+}
+
+static int leading_zeros(uint64_t value) {
+#ifdef __GNUC__
+  return __builtin_clzll(value);
+#else
+  int zeros = 0;
+  while ((value & (UINT64_C(1) << 63)) == 0) {
+    value <<= 1;
+    zeros += 1;
+  }
+  return zeros;
+#endif
+}
+
+static double bits_to_double(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static void bigint_init(struct BigInt *n, uint64_t value) {
+  n->count = 0;
+  while (value != 0) {
+    n->limbs[n->count++] = (uint32_t) value;
+    value >>= 32;
+  }
+}
+
+static void bigint_multiply_add(struct BigInt *n, uint32_t factor, uint32_t addend) {
+  uint64_t carry = addend;
+  for (size_t i = 0; i < n->count; ++i) {
+    uint64_t product = (uint64_t) n->limbs[i] * factor + carry;
+    n->limbs[i] = (uint32_t) product;
+    carry = product >> 32;
+  }
+
+  if (carry != 0) {
+    assert(n->count < NUMBER_BIGINT_LIMBS);
+    n->limbs[n->count++] = (uint32_t) carry;
+  }
+}
+
+static void bigint_multiply_power_of_five(struct BigInt *n, size_t exponent) {
+  // 5^13 is the largest power of five in 32 bits
+  static const uint32_t powers_of_five_32[] = {
+    1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625,
+    48828125, 244140625, 1220703125
+  };
+
+  for (; exponent >= 13; exponent -= 13) bigint_multiply_add(n, powers_of_five_32[13], 0);
+  if (exponent > 0) bigint_multiply_add(n, powers_of_five_32[exponent], 0);
+}
+
+static void bigint_shift_left(struct BigInt *n, size_t bits) {
+  if (n->count == 0) return;
+
+  size_t limbs = bits / 32;
+  size_t rest = bits % 32;
+  assert(n->count + limbs + 1 <= NUMBER_BIGINT_LIMBS);
+
+  n->limbs[n->count] = 0;
+  for (size_t i = n->count + 1; i-- > 0;) {
+    uint32_t shifted = rest == 0 ? n->limbs[i] : n->limbs[i] << rest;
+    if (rest != 0 && i > 0) shifted |= n->limbs[i - 1] >> (32 - rest);
+    n->limbs[i + limbs] = shifted;
+  }
+  memset(n->limbs, 0, limbs * sizeof(uint32_t));
+
+  n->count += limbs + 1;
+  if (n->limbs[n->count - 1] == 0) n->count -= 1;
+}
+
+static int bigint_compare(const struct BigInt *a, const struct BigInt *b) {
+  if (a->count != b->count) return a->count < b->count ? -1 : 1;
+
+  for (size_t i = a->count; i-- > 0;) {
+    if (a->limbs[i] != b->limbs[i]) return a->limbs[i] < b->limbs[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+// integers in [1, 2^53) need no search, they are their own shortest decimal
+static uint8_t small_integer(uint64_t ieee_mantissa, uint32_t ieee_exponent, struct Decimal *decimal) {
+  uint64_t m2 = (UINT64_C(1) << NUMBER_MANTISSA_BITS) | ieee_mantissa;
+  int32_t e2 = (int32_t) ieee_exponent - NUMBER_EXPONENT_BIAS - NUMBER_MANTISSA_BITS;
+  if (e2 > 0 || e2 < -NUMBER_MANTISSA_BITS) return FALSE;
+
+  uint64_t fraction = m2 & ((UINT64_C(1) << -e2) - 1);
+  if (fraction != 0) return FALSE;
+
+  decimal->mantissa = m2 >> -e2;
+  decimal->exponent = 0;
+  return TRUE;
+}
+
+// the double is m2 * 2^e2, every real in (mm, mp) around it rounds to it,
+// and the bounds are included when m2 is even. the three are scaled to
+// vm, vr and vp at a power of ten 10^e10 small enough to keep their digits
+// apart, then digits are removed while vp and vm still differ
+static struct Decimal shortest_decimal(uint64_t ieee_mantissa, uint32_t ieee_exponent) {
+  int32_t e2;
+  uint64_t m2;
+  if (ieee_exponent == 0) {
+    // subnormal, 2 extra bits for the bounds
+    e2 = 1 - NUMBER_EXPONENT_BIAS - NUMBER_MANTISSA_BITS - 2;
+    m2 = ieee_mantissa;
+  } else {
+    e2 = (int32_t) ieee_exponent - NUMBER_EXPONENT_BIAS - NUMBER_MANTISSA_BITS - 2;
+    m2 = (UINT64_C(1) << NUMBER_MANTISSA_BITS) | ieee_mantissa;
+  }
+  uint8_t accept_bounds = (m2 & 1) == 0;
+
+  // the lower bound is closer when the mantissa is a power of two, except
+  // for the smallest normal exponent
+  uint64_t mv = 4 * m2;
+  uint32_t mm_shift = ieee_mantissa != 0 || ieee_exponent <= 1;
+
+  uint64_t vr, vp, vm;
+  int32_t e10;
+  uint8_t vm_is_trailing_zeros = FALSE;
+  uint8_t vr_is_trailing_zeros = FALSE;
+
+  if (e2 >= 0) {
+    uint32_t q = log10_pow2(e2) - (e2 > 3);
+    e10 = (int32_t) q;
+    int32_t k = NUMBER_POW5_INV_BITS + pow5_bits((int32_t) q) - 1;
+    int32_t i = -e2 + (int32_t) q + k;
+    vr = multiply_shift(4 * m2, pow5_inv_split[q], i);
+    vp = multiply_shift(4 * m2 + 2, pow5_inv_split[q], i);
+    vm = multiply_shift(4 * m2 - 1 - mm_shift, pow5_inv_split[q], i);
+
+    if (q <= 21) {
+      // only one of mp, mv and mm can be a multiple of 5, if any
+      if (mv % 5 == 0) {
+        vr_is_trailing_zeros = is_multiple_of_pow5(mv, q);
+      } else if (accept_bounds) {
+        vm_is_trailing_zeros = is_multiple_of_pow5(mv - 1 - mm_shift, q);
+      } else {
+        vp -= is_multiple_of_pow5(mv + 2, q);
+      }
+    }
+  } else {
+    uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+    e10 = (int32_t) q + e2;
+    int32_t i = -e2 - (int32_t) q;
+    int32_t k = pow5_bits(i) - NUMBER_POW5_BITS;
+    int32_t j = (int32_t) q - k;
+    vr = multiply_shift(4 * m2, pow5_split[i], j);
+    vp = multiply_shift(4 * m2 + 2, pow5_split[i], j);
+    vm = multiply_shift(4 * m2 - 1 - mm_shift, pow5_split[i], j);
+
+    if (q <= 1) {
+      // mv = 4 * m2 always has at least two trailing zero bits
+      vr_is_trailing_zeros = TRUE;
+      if (accept_bounds) {
+        vm_is_trailing_zeros = mm_shift == 1;
+      } else {
+        vp -= 1;
+      }
+    } else if (q < 63) {
+      vr_is_trailing_zeros = is_multiple_of_pow2(mv, q);
+    }
+  }
+
+  int32_t removed = 0;
+  uint8_t last_removed_digit = 0;
+  uint64_t output;
+  if (vm_is_trailing_zeros || vr_is_trailing_zeros) {
+    // rare, a bound or the value itself is exact at this power of ten
+    while (vp / 10 > vm / 10) {
+      vm_is_trailing_zeros &= vm % 10 == 0;
+      vr_is_trailing_zeros &= last_removed_digit == 0;
+      last_removed_digit = (uint8_t) (vr % 10);
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      removed += 1;
+    }
+    if (vm_is_trailing_zeros) {
+      while (vm % 10 == 0) {
+        vr_is_trailing_zeros &= last_removed_digit == 0;
+        last_removed_digit = (uint8_t) (vr % 10);
+        vr /= 10;
+        vp /= 10;
+        vm /= 10;
+        removed += 1;
+      }
+    }
+    // an exact tie rounds to even
+    if (vr_is_trailing_zeros && last_removed_digit == 5 && vr % 2 == 0) last_removed_digit = 4;
+    output = vr + ((vr == vm && (!accept_bounds || !vm_is_trailing_zeros)) || last_removed_digit >= 5);
+  } else {
+    // common, only the rounding of vr matters. two digits at a time first
+    uint8_t round_up = FALSE;
+    if (vp / 100 > vm / 100) {
+      round_up = vr % 100 >= 50;
+      vr /= 100;
+      vp /= 100;
+      vm /= 100;
+      removed += 2;
+    }
+    while (vp / 10 > vm / 10) {
+      round_up = vr % 10 >= 5;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      removed += 1;
+    }
+    output = vr + (vr == vm || round_up);
+  }
+
+  return (struct Decimal) {output, e10 + removed};
+}
+
+// laid out as %g would with enough precision: plain digits for decimal
+// exponents in [NUMBER_FIXED_MIN_EXPONENT, NUMBER_FIXED_MAX_EXPONENT) and
+// d.ddde+XX otherwise, with at least two exponent digits
+static size_t write_decimal(struct Decimal decimal, char *buffer) {
+  char digits[20];
+  uint32_t digit_count = decimal_length(decimal.mantissa);
+  for (uint32_t i = digit_count; i-- > 0;) {
+    digits[i] = (char) ('0' + decimal.mantissa % 10);
+    decimal.mantissa /= 10;
+  }
+
+  int32_t exponent = decimal.exponent + (int32_t) digit_count - 1;
+  size_t length = 0;
+
+  if (exponent >= NUMBER_FIXED_MIN_EXPONENT && exponent < NUMBER_FIXED_MAX_EXPONENT) {
+    if (exponent < 0) {
+      // 0.000ddd
+      buffer[length++] = '0';
+      buffer[length++] = '.';
+      for (int32_t i = -1; i > exponent; --i) buffer[length++] = '0';
+      memcpy(buffer + length, digits, digit_count);
+      return length + digit_count;
+    }
+
+    if ((uint32_t) exponent + 1 >= digit_count) {
+      // integer, padded with the zeros that were dropped
+      memcpy(buffer, digits, digit_count);
+      length = digit_count;
+      for (uint32_t i = digit_count; i <= (uint32_t) exponent; ++i) buffer[length++] = '0';
+      return length;
+    }
+
+    // ddd.ddd
+    uint32_t integer_digits = (uint32_t) exponent + 1;
+    memcpy(buffer, digits, integer_digits);
+    buffer[integer_digits] = '.';
+    memcpy(buffer + integer_digits + 1, digits + integer_digits, digit_count - integer_digits);
+    return digit_count + 1;
+  }
+
+  buffer[length++] = digits[0];
+  if (digit_count > 1) {
+    buffer[length++] = '.';
+    memcpy(buffer + length, digits + 1, digit_count - 1);
+    length += digit_count - 1;
+  }
+
+  buffer[length++] = 'e';
+  buffer[length++] = exponent < 0 ? '-' : '+';
+  uint32_t magnitude = (uint32_t) (exponent < 0 ? -exponent : exponent);
+  if (magnitude >= 100) buffer[length++] = (char) ('0' + magnitude / 100);
+  buffer[length++] = (char) ('0' + magnitude / 10 % 10);
+  buffer[length++] = (char) ('0' + magnitude % 10);
+  return length;
+}
+
+// (m * factor) >> shift for a 55-bit m and a 125-bit factor, with the shift
+// past the low 64 bits of the product
+static uint64_t multiply_shift(uint64_t m, const uint64_t *factor, int32_t shift) {
+  uint64_t high_low;
+  multiply_64(m, factor[0], &high_low);
+  uint64_t high_high;
+  uint64_t low_high = multiply_64(m, factor[1], &high_high);
+
+  uint64_t middle = high_low + low_high;
+  if (middle < high_low) high_high += 1;
+
+  int32_t distance = shift - 64;
+  assert(distance > 0 && distance < 64);
+  return (high_high << (64 - distance)) | (middle >> distance);
+}
+
+// at most 17 digits for a shortest decimal
+static uint32_t decimal_length(uint64_t value) {
+  uint32_t length = 1;
+  for (uint64_t bound = 10; length < 17 && value >= bound; bound *= 10) length += 1;
+  return length;
+}
+
+static uint32_t pow5_factor(uint64_t value) {
+  uint32_t count = 0;
+  while (value % 5 == 0) {
+    value /= 5;
+    count += 1;
+  }
+  return count;
+}
+
+static uint8_t is_multiple_of_pow5(uint64_t value, uint32_t p) {
+  return pow5_factor(value) >= p;
+}
+
+static uint8_t is_multiple_of_pow2(uint64_t value, uint32_t p) {
+  return (value & ((UINT64_C(1) << p) - 1)) == 0;
+}
+
+// bits in 5^e, ceil(log2(5^e)) for e in [1, 3528] and 1 for e = 0
+static int32_t pow5_bits(int32_t e) {
+  return (int32_t) (((uint32_t) e * 1217359) >> 19) + 1;
+}
+
+// floor(log10(2^e)) for e in [0, 1650]
+static uint32_t log10_pow2(int32_t e) {
+  return ((uint32_t) e * 78913) >> 18;
+}
+
+// floor(log10(5^e)) for e in [0, 2620]
+static uint32_t log10_pow5(int32_t e) {
+  return ((uint32_t) e * 732923) >> 20;
+}
+
+// generated as in fast_float: 5^q shifted left until its top bit is bit
+// 127, or 2^b / 5^-q + 1 with b large enough for 128 bits when q < 0
+static const uint64_t power_of_five_128[NUMBER_LARGEST_POWER_OF_TEN - NUMBER_SMALLEST_POWER_OF_TEN + 1][2] = {
+  {0xeef453d6923bd65au, 0x113faa2906a13b3fu}, // 5^-342
+  {0x9558b4661b6565f8u, 0x4ac7ca59a424c507u}, // 5^-341
+  {0xbaaee17fa23ebf76u, 0x5d79bcf00d2df649u}, // 5^-340
+  {0xe95a99df8ace6f53u, 0xf4d82c2c107973dcu}, // 5^-339
+  {0x91d8a02bb6c10594u, 0x79071b9b8a4be869u}, // 5^-338
+  {0xb64ec836a47146f9u, 0x9748e2826cdee284u}, // 5^-337
+  {0xe3e27a444d8d98b7u, 0xfd1b1b2308169b25u}, // 5^-336
+  {0x8e6d8c6ab0787f72u, 0xfe30f0f5e50e20f7u}, // 5^-335
+  {0xb208ef855c969f4fu, 0xbdbd2d335e51a935u}, // 5^-334
+  {0xde8b2b66b3bc4723u, 0xad2c788035e61382u}, // 5^-333
+  {0x8b16fb203055ac76u, 0x4c3bcb5021afcc31u}, // 5^-332
+  {0xaddcb9e83c6b1793u, 0xdf4abe242a1bbf3du}, // 5^-331
+  {0xd953e8624b85dd78u, 0xd71d6dad34a2af0du}, // 5^-330
+  {0x87d4713d6f33aa6bu, 0x8672648c40e5ad68u}, // 5^-329
+  {0xa9c98d8ccb009506u, 0x680efdaf511f18c2u}, // 5^-328
+  {0xd43bf0effdc0ba48u, 0x0212bd1b2566def2u}, // 5^-327
+  {0x84a57695fe98746du, 0x014bb630f7604b57u}, // 5^-326
+  {0xa5ced43b7e3e9188u, 0x419ea3bd35385e2du}, // 5^-325
+  {0xcf42894a5dce35eau, 0x52064cac828675b9u}, // 5^-324
+  {0x818995ce7aa0e1b2u, 0x7343efebd1940993u}, // 5^-323
+  {0xa1ebfb4219491a1fu, 0x1014ebe6c5f90bf8u}, // 5^-322
+  {0xca66fa129f9b60a6u, 0xd41a26e077774ef6u}, // 5^-321
+  {0xfd00b897478238d0u, 0x8920b098955522b4u}, // 5^-320
+  {0x9e20735e8cb16382u, 0x55b46e5f5d5535b0u}, // 5^-319
+  {0xc5a890362fddbc62u, 0xeb2189f734aa831du}, // 5^-318
+  {0xf712b443bbd52b7bu, 0xa5e9ec7501d523e4u}, // 5^-317
+  {0x9a6bb0aa55653b2du, 0x47b233c92125366eu}, // 5^-316
+  {0xc1069cd4eabe89f8u, 0x999ec0bb696e840au}, // 5^-315
+  {0xf148440a256e2c76u, 0xc00670ea43ca250du}, // 5^-314
+  {0x96cd2a865764dbcau, 0x380406926a5e5728u}, // 5^-313
+  {0xbc807527ed3e12bcu, 0xc605083704f5ecf2u}, // 5^-312
+  {0xeba09271e88d976bu, 0xf7864a44c633682eu}, // 5^-311
+  {0x93445b8731587ea3u, 0x7ab3ee6afbe0211du}, // 5^-310
+  {0xb8157268fdae9e4cu, 0x5960ea05bad82964u}, // 5^-309
+  {0xe61acf033d1a45dfu, 0x6fb92487298e33bdu}, // 5^-308
+  {0x8fd0c16206306babu, 0xa5d3b6d479f8e056u}, // 5^-307
+  {0xb3c4f1ba87bc8696u, 0x8f48a4899877186cu}, // 5^-306
+  {0xe0b62e2929aba83cu, 0x331acdabfe94de87u}, // 5^-305
+  {0x8c71dcd9ba0b4925u, 0x9ff0c08b7f1d0b14u}, // 5^-304
+  {0xaf8e5410288e1b6fu, 0x07ecf0ae5ee44dd9u}, // 5^-303
+  {0xdb71e91432b1a24au, 0xc9e82cd9f69d6150u}, // 5^-302
+  {0x892731ac9faf056eu, 0xbe311c083a225cd2u}, // 5^-301
+  {0xab70fe17c79ac6cau, 0x6dbd630a48aaf406u}, // 5^-300
+  {0xd64d3d9db981787du, 0x092cbbccdad5b108u}, // 5^-299
+  {0x85f0468293f0eb4eu, 0x25bbf56008c58ea5u}, // 5^-298
+  {0xa76c582338ed2621u, 0xaf2af2b80af6f24eu}, // 5^-297
+  {0xd1476e2c07286faau, 0x1af5af660db4aee1u}, // 5^-296
+  {0x82cca4db847945cau, 0x50d98d9fc890ed4du}, // 5^-295
+  {0xa37fce126597973cu, 0xe50ff107bab528a0u}, // 5^-294
+  {0xcc5fc196fefd7d0cu, 0x1e53ed49a96272c8u}, // 5^-293
+  {0xff77b1fcbebcdc4fu, 0x25e8e89c13bb0f7au}, // 5^-292
+  {0x9faacf3df73609b1u, 0x77b191618c54e9acu}, // 5^-291
+  {0xc795830d75038c1du, 0xd59df5b9ef6a2417u}, // 5^-290
+  {0xf97ae3d0d2446f25u, 0x4b0573286b44ad1du}, // 5^-289
+  {0x9becce62836ac577u, 0x4ee367f9430aec32u}, // 5^-288
+  {0xc2e801fb244576d5u, 0x229c41f793cda73fu}, // 5^-287
+  {0xf3a20279ed56d48au, 0x6b43527578c1110fu}, // 5^-286
+  {0x9845418c345644d6u, 0x830a13896b78aaa9u}, // 5^-285
+  {0xbe5691ef416bd60cu, 0x23cc986bc656d553u}, // 5^-284
+  {0xedec366b11c6cb8fu, 0x2cbfbe86b7ec8aa8u}, // 5^-283
+  {0x94b3a202eb1c3f39u, 0x7bf7d71432f3d6a9u}, // 5^-282
+  {0xb9e08a83a5e34f07u, 0xdaf5ccd93fb0cc53u}, // 5^-281
+  {0xe858ad248f5c22c9u, 0xd1b3400f8f9cff68u}, // 5^-280
+  {0x91376c36d99995beu, 0x23100809b9c21fa1u}, // 5^-279
+  {0xb58547448ffffb2du, 0xabd40a0c2832a78au}, // 5^-278
+  {0xe2e69915b3fff9f9u, 0x16c90c8f323f516cu}, // 5^-277
+  {0x8dd01fad907ffc3bu, 0xae3da7d97f6792e3u}, // 5^-276
+  {0xb1442798f49ffb4au, 0x99cd11cfdf41779cu}, // 5^-275
+  {0xdd95317f31c7fa1du, 0x40405643d711d583u}, // 5^-274
+  {0x8a7d3eef7f1cfc52u, 0x482835ea666b2572u}, // 5^-273
+  {0xad1c8eab5ee43b66u, 0xda3243650005eecfu}, // 5^-272
+  {0xd863b256369d4a40u, 0x90bed43e40076a82u}, // 5^-271
+  {0x873e4f75e2224e68u, 0x5a7744a6e804a291u}, // 5^-270
+  {0xa90de3535aaae202u, 0x711515d0a205cb36u}, // 5^-269
+  {0xd3515c2831559a83u, 0x0d5a5b44ca873e03u}, // 5^-268
+  {0x8412d9991ed58091u, 0xe858790afe9486c2u}, // 5^-267
+  {0xa5178fff668ae0b6u, 0x626e974dbe39a872u}, // 5^-266
+  {0xce5d73ff402d98e3u, 0xfb0a3d212dc8128fu}, // 5^-265
+  {0x80fa687f881c7f8eu, 0x7ce66634bc9d0b99u}, // 5^-264
+  {0xa139029f6a239f72u, 0x1c1fffc1ebc44e80u}, // 5^-263
+  {0xc987434744ac874eu, 0xa327ffb266b56220u}, // 5^-262
+  {0xfbe9141915d7a922u, 0x4bf1ff9f0062baa8u}, // 5^-261
+  {0x9d71ac8fada6c9b5u, 0x6f773fc3603db4a9u}, // 5^-260
+  {0xc4ce17b399107c22u, 0xcb550fb4384d21d3u}, // 5^-259
+  {0xf6019da07f549b2bu, 0x7e2a53a146606a48u}, // 5^-258
+  {0x99c102844f94e0fbu, 0x2eda7444cbfc426du}, // 5^-257
+  {0xc0314325637a1939u, 0xfa911155fefb5308u}, // 5^-256
+  {0xf03d93eebc589f88u, 0x793555ab7eba27cau}, // 5^-255
+  {0x96267c7535b763b5u, 0x4bc1558b2f3458deu}, // 5^-254
+  {0xbbb01b9283253ca2u, 0x9eb1aaedfb016f16u}, // 5^-253
+  {0xea9c227723ee8bcbu, 0x465e15a979c1cadcu}, // 5^-252
+  {0x92a1958a7675175fu, 0x0bfacd89ec191ec9u}, // 5^-251
+  {0xb749faed14125d36u, 0xcef980ec671f667bu}, // 5^-250
+  {0xe51c79a85916f484u, 0x82b7e12780e7401au}, // 5^-249
+  {0x8f31cc0937ae58d2u, 0xd1b2ecb8b0908810u}, // 5^-248
+  {0xb2fe3f0b8599ef07u, 0x861fa7e6dcb4aa15u}, // 5^-247
+  {0xdfbdcece67006ac9u, 0x67a791e093e1d49au}, // 5^-246
+  {0x8bd6a141006042bdu, 0xe0c8bb2c5c6d24e0u}, // 5^-245
+  {0xaecc49914078536du, 0x58fae9f773886e18u}, // 5^-244
+  {0xda7f5bf590966848u, 0xaf39a475506a899eu}, // 5^-243
+  {0x888f99797a5e012du, 0x6d8406c952429603u}, // 5^-242
+  {0xaab37fd7d8f58178u, 0xc8e5087ba6d33b83u}, // 5^-241
+  {0xd5605fcdcf32e1d6u, 0xfb1e4a9a90880a64u}, // 5^-240
+  {0x855c3be0a17fcd26u, 0x5cf2eea09a55067fu}, // 5^-239
+  {0xa6b34ad8c9dfc06fu, 0xf42faa48c0ea481eu}, // 5^-238
+  {0xd0601d8efc57b08bu, 0xf13b94daf124da26u}, // 5^-237
+  {0x823c12795db6ce57u, 0x76c53d08d6b70858u}, // 5^-236
+  {0xa2cb1717b52481edu, 0x54768c4b0c64ca6eu}, // 5^-235
+  {0xcb7ddcdda26da268u, 0xa9942f5dcf7dfd09u}, // 5^-234
+  {0xfe5d54150b090b02u, 0xd3f93b35435d7c4cu}, // 5^-233
+  {0x9efa548d26e5a6e1u, 0xc47bc5014a1a6dafu}, // 5^-232
+  {0xc6b8e9b0709f109au, 0x359ab6419ca1091bu}, // 5^-231
+  {0xf867241c8cc6d4c0u, 0xc30163d203c94b62u}, // 5^-230
+  {0x9b407691d7fc44f8u, 0x79e0de63425dcf1du}, // 5^-229
+  {0xc21094364dfb5636u, 0x985915fc12f542e4u}, // 5^-228
+  {0xf294b943e17a2bc4u, 0x3e6f5b7b17b2939du}, // 5^-227
+  {0x979cf3ca6cec5b5au, 0xa705992ceecf9c42u}, // 5^-226
+  {0xbd8430bd08277231u, 0x50c6ff782a838353u}, // 5^-225
+  {0xece53cec4a314ebdu, 0xa4f8bf5635246428u}, // 5^-224
+  {0x940f4613ae5ed136u, 0x871b7795e136be99u}, // 5^-223
+  {0xb913179899f68584u, 0x28e2557b59846e3fu}, // 5^-222
+  {0xe757dd7ec07426e5u, 0x331aeada2fe589cfu}, // 5^-221
+  {0x9096ea6f3848984fu, 0x3ff0d2c85def7621u}, // 5^-220
+  {0xb4bca50b065abe63u, 0x0fed077a756b53a9u}, // 5^-219
+  {0xe1ebce4dc7f16dfbu, 0xd3e8495912c62894u}, // 5^-218
+  {0x8d3360f09cf6e4bdu, 0x64712dd7abbbd95cu}, // 5^-217
+  {0xb080392cc4349decu, 0xbd8d794d96aacfb3u}, // 5^-216
+  {0xdca04777f541c567u, 0xecf0d7a0fc5583a0u}, // 5^-215
+  {0x89e42caaf9491b60u, 0xf41686c49db57244u}, // 5^-214
+  {0xac5d37d5b79b6239u, 0x311c2875c522ced5u}, // 5^-213
+  {0xd77485cb25823ac7u, 0x7d633293366b828bu}, // 5^-212
+  {0x86a8d39ef77164bcu, 0xae5dff9c02033197u}, // 5^-211
+  {0xa8530886b54dbdebu, 0xd9f57f830283fdfcu}, // 5^-210
+  {0xd267caa862a12d66u, 0xd072df63c324fd7bu}, // 5^-209
+  {0x8380dea93da4bc60u, 0x4247cb9e59f71e6du}, // 5^-208
+  {0xa46116538d0deb78u, 0x52d9be85f074e608u}, // 5^-207
+  {0xcd795be870516656u, 0x67902e276c921f8bu}, // 5^-206
+  {0x806bd9714632dff6u, 0x00ba1cd8a3db53b6u}, // 5^-205
+  {0xa086cfcd97bf97f3u, 0x80e8a40eccd228a4u}, // 5^-204
+  {0xc8a883c0fdaf7df0u, 0x6122cd128006b2cdu}, // 5^-203
+  {0xfad2a4b13d1b5d6cu, 0x796b805720085f81u}, // 5^-202
+  {0x9cc3a6eec6311a63u, 0xcbe3303674053bb0u}, // 5^-201
+  {0xc3f490aa77bd60fcu, 0xbedbfc4411068a9cu}, // 5^-200
+  {0xf4f1b4d515acb93bu, 0xee92fb5515482d44u}, // 5^-199
+  {0x991711052d8bf3c5u, 0x751bdd152d4d1c4au}, // 5^-198
+  {0xbf5cd54678eef0b6u, 0xd262d45a78a0635du}, // 5^-197
+  {0xef340a98172aace4u, 0x86fb897116c87c34u}, // 5^-196
+  {0x9580869f0e7aac0eu, 0xd45d35e6ae3d4da0u}, // 5^-195
+  {0xbae0a846d2195712u, 0x8974836059cca109u}, // 5^-194
+  {0xe998d258869facd7u, 0x2bd1a438703fc94bu}, // 5^-193
+  {0x91ff83775423cc06u, 0x7b6306a34627ddcfu}, // 5^-192
+  {0xb67f6455292cbf08u, 0x1a3bc84c17b1d542u}, // 5^-191
+  {0xe41f3d6a7377eecau, 0x20caba5f1d9e4a93u}, // 5^-190
+  {0x8e938662882af53eu, 0x547eb47b7282ee9cu}, // 5^-189
+  {0xb23867fb2a35b28du, 0xe99e619a4f23aa43u}, // 5^-188
+  {0xdec681f9f4c31f31u, 0x6405fa00e2ec94d4u}, // 5^-187
+  {0x8b3c113c38f9f37eu, 0xde83bc408dd3dd04u}, // 5^-186
+  {0xae0b158b4738705eu, 0x9624ab50b148d445u}, // 5^-185
+  {0xd98ddaee19068c76u, 0x3badd624dd9b0957u}, // 5^-184
+  {0x87f8a8d4cfa417c9u, 0xe54ca5d70a80e5d6u}, // 5^-183
+  {0xa9f6d30a038d1dbcu, 0x5e9fcf4ccd211f4cu}, // 5^-182
+  {0xd47487cc8470652bu, 0x7647c3200069671fu}, // 5^-181
+  {0x84c8d4dfd2c63f3bu, 0x29ecd9f40041e073u}, // 5^-180
+  {0xa5fb0a17c777cf09u, 0xf468107100525890u}, // 5^-179
+  {0xcf79cc9db955c2ccu, 0x7182148d4066eeb4u}, // 5^-178
+  {0x81ac1fe293d599bfu, 0xc6f14cd848405530u}, // 5^-177
+  {0xa21727db38cb002fu, 0xb8ada00e5a506a7cu}, // 5^-176
+  {0xca9cf1d206fdc03bu, 0xa6d90811f0e4851cu}, // 5^-175
+  {0xfd442e4688bd304au, 0x908f4a166d1da663u}, // 5^-174
+  {0x9e4a9cec15763e2eu, 0x9a598e4e043287feu}, // 5^-173
+  {0xc5dd44271ad3cdbau, 0x40eff1e1853f29fdu}, // 5^-172
+  {0xf7549530e188c128u, 0xd12bee59e68ef47cu}, // 5^-171
+  {0x9a94dd3e8cf578b9u, 0x82bb74f8301958ceu}, // 5^-170
+  {0xc13a148e3032d6e7u, 0xe36a52363c1faf01u}, // 5^-169
+  {0xf18899b1bc3f8ca1u, 0xdc44e6c3cb279ac1u}, // 5^-168
+  {0x96f5600f15a7b7e5u, 0x29ab103a5ef8c0b9u}, // 5^-167
+  {0xbcb2b812db11a5deu, 0x7415d448f6b6f0e7u}, // 5^-166
+  {0xebdf661791d60f56u, 0x111b495b3464ad21u}, // 5^-165
+  {0x936b9fcebb25c995u, 0xcab10dd900beec34u}, // 5^-164
+  {0xb84687c269ef3bfbu, 0x3d5d514f40eea742u}, // 5^-163
+  {0xe65829b3046b0afau, 0x0cb4a5a3112a5112u}, // 5^-162
+  {0x8ff71a0fe2c2e6dcu, 0x47f0e785eaba72abu}, // 5^-161
+  {0xb3f4e093db73a093u, 0x59ed216765690f56u}, // 5^-160
+  {0xe0f218b8d25088b8u, 0x306869c13ec3532cu}, // 5^-159
+  {0x8c974f7383725573u, 0x1e414218c73a13fbu}, // 5^-158
+  {0xafbd2350644eeacfu, 0xe5d1929ef90898fau}, // 5^-157
+  {0xdbac6c247d62a583u, 0xdf45f746b74abf39u}, // 5^-156
+  {0x894bc396ce5da772u, 0x6b8bba8c328eb783u}, // 5^-155
+  {0xab9eb47c81f5114fu, 0x066ea92f3f326564u}, // 5^-154
+  {0xd686619ba27255a2u, 0xc80a537b0efefebdu}, // 5^-153
+  {0x8613fd0145877585u, 0xbd06742ce95f5f36u}, // 5^-152
+  {0xa798fc4196e952e7u, 0x2c48113823b73704u}, // 5^-151
+  {0xd17f3b51fca3a7a0u, 0xf75a15862ca504c5u}, // 5^-150
+  {0x82ef85133de648c4u, 0x9a984d73dbe722fbu}, // 5^-149
+  {0xa3ab66580d5fdaf5u, 0xc13e60d0d2e0ebbau}, // 5^-148
+  {0xcc963fee10b7d1b3u, 0x318df905079926a8u}, // 5^-147
+  {0xffbbcfe994e5c61fu, 0xfdf17746497f7052u}, // 5^-146
+  {0x9fd561f1fd0f9bd3u, 0xfeb6ea8bedefa633u}, // 5^-145
+  {0xc7caba6e7c5382c8u, 0xfe64a52ee96b8fc0u}, // 5^-144
+  {0xf9bd690a1b68637bu, 0x3dfdce7aa3c673b0u}, // 5^-143
+  {0x9c1661a651213e2du, 0x06bea10ca65c084eu}, // 5^-142
+  {0xc31bfa0fe5698db8u, 0x486e494fcff30a62u}, // 5^-141
+  {0xf3e2f893dec3f126u, 0x5a89dba3c3efccfau}, // 5^-140
+  {0x986ddb5c6b3a76b7u, 0xf89629465a75e01cu}, // 5^-139
+  {0xbe89523386091465u, 0xf6bbb397f1135823u}, // 5^-138
+  {0xee2ba6c0678b597fu, 0x746aa07ded582e2cu}, // 5^-137
+  {0x94db483840b717efu, 0xa8c2a44eb4571cdcu}, // 5^-136
+  {0xba121a4650e4ddebu, 0x92f34d62616ce413u}, // 5^-135
+  {0xe896a0d7e51e1566u, 0x77b020baf9c81d17u}, // 5^-134
+  {0x915e2486ef32cd60u, 0x0ace1474dc1d122eu}, // 5^-133
+  {0xb5b5ada8aaff80b8u, 0x0d819992132456bau}, // 5^-132
+  {0xe3231912d5bf60e6u, 0x10e1fff697ed6c69u}, // 5^-131
+  {0x8df5efabc5979c8fu, 0xca8d3ffa1ef463c1u}, // 5^-130
+  {0xb1736b96b6fd83b3u, 0xbd308ff8a6b17cb2u}, // 5^-129
+  {0xddd0467c64bce4a0u, 0xac7cb3f6d05ddbdeu}, // 5^-128
+  {0x8aa22c0dbef60ee4u, 0x6bcdf07a423aa96bu}, // 5^-127
+  {0xad4ab7112eb3929du, 0x86c16c98d2c953c6u}, // 5^-126
+  {0xd89d64d57a607744u, 0xe871c7bf077ba8b7u}, // 5^-125
+  {0x87625f056c7c4a8bu, 0x11471cd764ad4972u}, // 5^-124
+  {0xa93af6c6c79b5d2du, 0xd598e40d3dd89bcfu}, // 5^-123
+  {0xd389b47879823479u, 0x4aff1d108d4ec2c3u}, // 5^-122
+  {0x843610cb4bf160cbu, 0xcedf722a585139bau}, // 5^-121
+  {0xa54394fe1eedb8feu, 0xc2974eb4ee658828u}, // 5^-120
+  {0xce947a3da6a9273eu, 0x733d226229feea32u}, // 5^-119
+  {0x811ccc668829b887u, 0x0806357d5a3f525fu}, // 5^-118
+  {0xa163ff802a3426a8u, 0xca07c2dcb0cf26f7u}, // 5^-117
+  {0xc9bcff6034c13052u, 0xfc89b393dd02f0b5u}, // 5^-116
+  {0xfc2c3f3841f17c67u, 0xbbac2078d443ace2u}, // 5^-115
+  {0x9d9ba7832936edc0u, 0xd54b944b84aa4c0du}, // 5^-114
+  {0xc5029163f384a931u, 0x0a9e795e65d4df11u}, // 5^-113
+  {0xf64335bcf065d37du, 0x4d4617b5ff4a16d5u}, // 5^-112
+  {0x99ea0196163fa42eu, 0x504bced1bf8e4e45u}, // 5^-111
+  {0xc06481fb9bcf8d39u, 0xe45ec2862f71e1d6u}, // 5^-110
+  {0xf07da27a82c37088u, 0x5d767327bb4e5a4cu}, // 5^-109
+  {0x964e858c91ba2655u, 0x3a6a07f8d510f86fu}, // 5^-108
+  {0xbbe226efb628afeau, 0x890489f70a55368bu}, // 5^-107
+  {0xeadab0aba3b2dbe5u, 0x2b45ac74ccea842eu}, // 5^-106
+  {0x92c8ae6b464fc96fu, 0x3b0b8bc90012929du}, // 5^-105
+  {0xb77ada0617e3bbcbu, 0x09ce6ebb40173744u}, // 5^-104
+  {0xe55990879ddcaabdu, 0xcc420a6a101d0515u}, // 5^-103
+  {0x8f57fa54c2a9eab6u, 0x9fa946824a12232du}, // 5^-102
+  {0xb32df8e9f3546564u, 0x47939822dc96abf9u}, // 5^-101
+  {0xdff9772470297ebdu, 0x59787e2b93bc56f7u}, // 5^-100
+  {0x8bfbea76c619ef36u, 0x57eb4edb3c55b65au}, // 5^-99
+  {0xaefae51477a06b03u, 0xede622920b6b23f1u}, // 5^-98
+  {0xdab99e59958885c4u, 0xe95fab368e45ecedu}, // 5^-97
+  {0x88b402f7fd75539bu, 0x11dbcb0218ebb414u}, // 5^-96
+  {0xaae103b5fcd2a881u, 0xd652bdc29f26a119u}, // 5^-95
+  {0xd59944a37c0752a2u, 0x4be76d3346f0495fu}, // 5^-94
+  {0x857fcae62d8493a5u, 0x6f70a4400c562ddbu}, // 5^-93
+  {0xa6dfbd9fb8e5b88eu, 0xcb4ccd500f6bb952u}, // 5^-92
+  {0xd097ad07a71f26b2u, 0x7e2000a41346a7a7u}, // 5^-91
+  {0x825ecc24c873782fu, 0x8ed400668c0c28c8u}, // 5^-90
+  {0xa2f67f2dfa90563bu, 0x728900802f0f32fau}, // 5^-89
+  {0xcbb41ef979346bcau, 0x4f2b40a03ad2ffb9u}, // 5^-88
+  {0xfea126b7d78186bcu, 0xe2f610c84987bfa8u}, // 5^-87
+  {0x9f24b832e6b0f436u, 0x0dd9ca7d2df4d7c9u}, // 5^-86
+  {0xc6ede63fa05d3143u, 0x91503d1c79720dbbu}, // 5^-85
+  {0xf8a95fcf88747d94u, 0x75a44c6397ce912au}, // 5^-84
+  {0x9b69dbe1b548ce7cu, 0xc986afbe3ee11abau}, // 5^-83
+  {0xc24452da229b021bu, 0xfbe85badce996168u}, // 5^-82
+  {0xf2d56790ab41c2a2u, 0xfae27299423fb9c3u}, // 5^-81
+  {0x97c560ba6b0919a5u, 0xdccd879fc967d41au}, // 5^-80
+  {0xbdb6b8e905cb600fu, 0x5400e987bbc1c920u}, // 5^-79
+  {0xed246723473e3813u, 0x290123e9aab23b68u}, // 5^-78
+  {0x9436c0760c86e30bu, 0xf9a0b6720aaf6521u}, // 5^-77
+  {0xb94470938fa89bceu, 0xf808e40e8d5b3e69u}, // 5^-76
+  {0xe7958cb87392c2c2u, 0xb60b1d1230b20e04u}, // 5^-75
+  {0x90bd77f3483bb9b9u, 0xb1c6f22b5e6f48c2u}, // 5^-74
+  {0xb4ecd5f01a4aa828u, 0x1e38aeb6360b1af3u}, // 5^-73
+  {0xe2280b6c20dd5232u, 0x25c6da63c38de1b0u}, // 5^-72
+  {0x8d590723948a535fu, 0x579c487e5a38ad0eu}, // 5^-71
+  {0xb0af48ec79ace837u, 0x2d835a9df0c6d851u}, // 5^-70
+  {0xdcdb1b2798182244u, 0xf8e431456cf88e65u}, // 5^-69
+  {0x8a08f0f8bf0f156bu, 0x1b8e9ecb641b58ffu}, // 5^-68
+  {0xac8b2d36eed2dac5u, 0xe272467e3d222f3fu}, // 5^-67
+  {0xd7adf884aa879177u, 0x5b0ed81dcc6abb0fu}, // 5^-66
+  {0x86ccbb52ea94baeau, 0x98e947129fc2b4e9u}, // 5^-65
+  {0xa87fea27a539e9a5u, 0x3f2398d747b36224u}, // 5^-64
+  {0xd29fe4b18e88640eu, 0x8eec7f0d19a03aadu}, // 5^-63
+  {0x83a3eeeef9153e89u, 0x1953cf68300424acu}, // 5^-62
+  {0xa48ceaaab75a8e2bu, 0x5fa8c3423c052dd7u}, // 5^-61
+  {0xcdb02555653131b6u, 0x3792f412cb06794du}, // 5^-60
+  {0x808e17555f3ebf11u, 0xe2bbd88bbee40bd0u}, // 5^-59
+  {0xa0b19d2ab70e6ed6u, 0x5b6aceaeae9d0ec4u}, // 5^-58
+  {0xc8de047564d20a8bu, 0xf245825a5a445275u}, // 5^-57
+  {0xfb158592be068d2eu, 0xeed6e2f0f0d56712u}, // 5^-56
+  {0x9ced737bb6c4183du, 0x55464dd69685606bu}, // 5^-55
+  {0xc428d05aa4751e4cu, 0xaa97e14c3c26b886u}, // 5^-54
+  {0xf53304714d9265dfu, 0xd53dd99f4b3066a8u}, // 5^-53
+  {0x993fe2c6d07b7fabu, 0xe546a8038efe4029u}, // 5^-52
+  {0xbf8fdb78849a5f96u, 0xde98520472bdd033u}, // 5^-51
+  {0xef73d256a5c0f77cu, 0x963e66858f6d4440u}, // 5^-50
+  {0x95a8637627989aadu, 0xdde7001379a44aa8u}, // 5^-49
+  {0xbb127c53b17ec159u, 0x5560c018580d5d52u}, // 5^-48
+  {0xe9d71b689dde71afu, 0xaab8f01e6e10b4a6u}, // 5^-47
+  {0x9226712162ab070du, 0xcab3961304ca70e8u}, // 5^-46
+  {0xb6b00d69bb55c8d1u, 0x3d607b97c5fd0d22u}, // 5^-45
+  {0xe45c10c42a2b3b05u, 0x8cb89a7db77c506au}, // 5^-44
+  {0x8eb98a7a9a5b04e3u, 0x77f3608e92adb242u}, // 5^-43
+  {0xb267ed1940f1c61cu, 0x55f038b237591ed3u}, // 5^-42
+  {0xdf01e85f912e37a3u, 0x6b6c46dec52f6688u}, // 5^-41
+  {0x8b61313bbabce2c6u, 0x2323ac4b3b3da015u}, // 5^-40
+  {0xae397d8aa96c1b77u, 0xabec975e0a0d081au}, // 5^-39
+  {0xd9c7dced53c72255u, 0x96e7bd358c904a21u}, // 5^-38
+  {0x881cea14545c7575u, 0x7e50d64177da2e54u}, // 5^-37
+  {0xaa242499697392d2u, 0xdde50bd1d5d0b9e9u}, // 5^-36
+  {0xd4ad2dbfc3d07787u, 0x955e4ec64b44e864u}, // 5^-35
+  {0x84ec3c97da624ab4u, 0xbd5af13bef0b113eu}, // 5^-34
+  {0xa6274bbdd0fadd61u, 0xecb1ad8aeacdd58eu}, // 5^-33
+  {0xcfb11ead453994bau, 0x67de18eda5814af2u}, // 5^-32
+  {0x81ceb32c4b43fcf4u, 0x80eacf948770ced7u}, // 5^-31
+  {0xa2425ff75e14fc31u, 0xa1258379a94d028du}, // 5^-30
+  {0xcad2f7f5359a3b3eu, 0x096ee45813a04330u}, // 5^-29
+  {0xfd87b5f28300ca0du, 0x8bca9d6e188853fcu}, // 5^-28
+  {0x9e74d1b791e07e48u, 0x775ea264cf55347eu}, // 5^-27
+  {0xc612062576589ddau, 0x95364afe032a819eu}, // 5^-26
+  {0xf79687aed3eec551u, 0x3a83ddbd83f52205u}, // 5^-25
+  {0x9abe14cd44753b52u, 0xc4926a9672793543u}, // 5^-24
+  {0xc16d9a0095928a27u, 0x75b7053c0f178294u}, // 5^-23
+  {0xf1c90080baf72cb1u, 0x5324c68b12dd6339u}, // 5^-22
+  {0x971da05074da7beeu, 0xd3f6fc16ebca5e04u}, // 5^-21
+  {0xbce5086492111aeau, 0x88f4bb1ca6bcf585u}, // 5^-20
+  {0xec1e4a7db69561a5u, 0x2b31e9e3d06c32e6u}, // 5^-19
+  {0x9392ee8e921d5d07u, 0x3aff322e62439fd0u}, // 5^-18
+  {0xb877aa3236a4b449u, 0x09befeb9fad487c3u}, // 5^-17
+  {0xe69594bec44de15bu, 0x4c2ebe687989a9b4u}, // 5^-16
+  {0x901d7cf73ab0acd9u, 0x0f9d37014bf60a11u}, // 5^-15
+  {0xb424dc35095cd80fu, 0x538484c19ef38c95u}, // 5^-14
+  {0xe12e13424bb40e13u, 0x2865a5f206b06fbau}, // 5^-13
+  {0x8cbccc096f5088cbu, 0xf93f87b7442e45d4u}, // 5^-12
+  {0xafebff0bcb24aafeu, 0xf78f69a51539d749u}, // 5^-11
+  {0xdbe6fecebdedd5beu, 0xb573440e5a884d1cu}, // 5^-10
+  {0x89705f4136b4a597u, 0x31680a88f8953031u}, // 5^-9
+  {0xabcc77118461cefcu, 0xfdc20d2b36ba7c3eu}, // 5^-8
+  {0xd6bf94d5e57a42bcu, 0x3d32907604691b4du}, // 5^-7
+  {0x8637bd05af6c69b5u, 0xa63f9a49c2c1b110u}, // 5^-6
+  {0xa7c5ac471b478423u, 0x0fcf80dc33721d54u}, // 5^-5
+  {0xd1b71758e219652bu, 0xd3c36113404ea4a9u}, // 5^-4
+  {0x83126e978d4fdf3bu, 0x645a1cac083126eau}, // 5^-3
+  {0xa3d70a3d70a3d70au, 0x3d70a3d70a3d70a4u}, // 5^-2
+  {0xccccccccccccccccu, 0xcccccccccccccccdu}, // 5^-1
+  {0x8000000000000000u, 0x0000000000000000u}, // 5^0
+  {0xa000000000000000u, 0x0000000000000000u}, // 5^1
+  {0xc800000000000000u, 0x0000000000000000u}, // 5^2
+  {0xfa00000000000000u, 0x0000000000000000u}, // 5^3
+  {0x9c40000000000000u, 0x0000000000000000u}, // 5^4
+  {0xc350000000000000u, 0x0000000000000000u}, // 5^5
+  {0xf424000000000000u, 0x0000000000000000u}, // 5^6
+  {0x9896800000000000u, 0x0000000000000000u}, // 5^7
+  {0xbebc200000000000u, 0x0000000000000000u}, // 5^8
+  {0xee6b280000000000u, 0x0000000000000000u}, // 5^9
+  {0x9502f90000000000u, 0x0000000000000000u}, // 5^10
+  {0xba43b74000000000u, 0x0000000000000000u}, // 5^11
+  {0xe8d4a51000000000u, 0x0000000000000000u}, // 5^12
+  {0x9184e72a00000000u, 0x0000000000000000u}, // 5^13
+  {0xb5e620f480000000u, 0x0000000000000000u}, // 5^14
+  {0xe35fa931a0000000u, 0x0000000000000000u}, // 5^15
+  {0x8e1bc9bf04000000u, 0x0000000000000000u}, // 5^16
+  {0xb1a2bc2ec5000000u, 0x0000000000000000u}, // 5^17
+  {0xde0b6b3a76400000u, 0x0000000000000000u}, // 5^18
+  {0x8ac7230489e80000u, 0x0000000000000000u}, // 5^19
+  {0xad78ebc5ac620000u, 0x0000000000000000u}, // 5^20
+  {0xd8d726b7177a8000u, 0x0000000000000000u}, // 5^21
+  {0x878678326eac9000u, 0x0000000000000000u}, // 5^22
+  {0xa968163f0a57b400u, 0x0000000000000000u}, // 5^23
+  {0xd3c21bcecceda100u, 0x0000000000000000u}, // 5^24
+  {0x84595161401484a0u, 0x0000000000000000u}, // 5^25
+  {0xa56fa5b99019a5c8u, 0x0000000000000000u}, // 5^26
+  {0xcecb8f27f4200f3au, 0x0000000000000000u}, // 5^27
+  {0x813f3978f8940984u, 0x4000000000000000u}, // 5^28
+  {0xa18f07d736b90be5u, 0x5000000000000000u}, // 5^29
+  {0xc9f2c9cd04674edeu, 0xa400000000000000u}, // 5^30
+  {0xfc6f7c4045812296u, 0x4d00000000000000u}, // 5^31
+  {0x9dc5ada82b70b59du, 0xf020000000000000u}, // 5^32
+  {0xc5371912364ce305u, 0x6c28000000000000u}, // 5^33
+  {0xf684df56c3e01bc6u, 0xc732000000000000u}, // 5^34
+  {0x9a130b963a6c115cu, 0x3c7f400000000000u}, // 5^35
+  {0xc097ce7bc90715b3u, 0x4b9f100000000000u}, // 5^36
+  {0xf0bdc21abb48db20u, 0x1e86d40000000000u}, // 5^37
+  {0x96769950b50d88f4u, 0x1314448000000000u}, // 5^38
+  {0xbc143fa4e250eb31u, 0x17d955a000000000u}, // 5^39
+  {0xeb194f8e1ae525fdu, 0x5dcfab0800000000u}, // 5^40
+  {0x92efd1b8d0cf37beu, 0x5aa1cae500000000u}, // 5^41
+  {0xb7abc627050305adu, 0xf14a3d9e40000000u}, // 5^42
+  {0xe596b7b0c643c719u, 0x6d9ccd05d0000000u}, // 5^43
+  {0x8f7e32ce7bea5c6fu, 0xe4820023a2000000u}, // 5^44
+  {0xb35dbf821ae4f38bu, 0xdda2802c8a800000u}, // 5^45
+  {0xe0352f62a19e306eu, 0xd50b2037ad200000u}, // 5^46
+  {0x8c213d9da502de45u, 0x4526f422cc340000u}, // 5^47
+  {0xaf298d050e4395d6u, 0x9670b12b7f410000u}, // 5^48
+  {0xdaf3f04651d47b4cu, 0x3c0cdd765f114000u}, // 5^49
+  {0x88d8762bf324cd0fu, 0xa5880a69fb6ac800u}, // 5^50
+  {0xab0e93b6efee0053u, 0x8eea0d047a457a00u}, // 5^51
+  {0xd5d238a4abe98068u, 0x72a4904598d6d880u}, // 5^52
+  {0x85a36366eb71f041u, 0x47a6da2b7f864750u}, // 5^53
+  {0xa70c3c40a64e6c51u, 0x999090b65f67d924u}, // 5^54
+  {0xd0cf4b50cfe20765u, 0xfff4b4e3f741cf6du}, // 5^55
+  {0x82818f1281ed449fu, 0xbff8f10e7a8921a4u}, // 5^56
+  {0xa321f2d7226895c7u, 0xaff72d52192b6a0du}, // 5^57
+  {0xcbea6f8ceb02bb39u, 0x9bf4f8a69f764490u}, // 5^58
+  {0xfee50b7025c36a08u, 0x02f236d04753d5b4u}, // 5^59
+  {0x9f4f2726179a2245u, 0x01d762422c946590u}, // 5^60
+  {0xc722f0ef9d80aad6u, 0x424d3ad2b7b97ef5u}, // 5^61
+  {0xf8ebad2b84e0d58bu, 0xd2e0898765a7deb2u}, // 5^62
+  {0x9b934c3b330c8577u, 0x63cc55f49f88eb2fu}, // 5^63
+  {0xc2781f49ffcfa6d5u, 0x3cbf6b71c76b25fbu}, // 5^64
+  {0xf316271c7fc3908au, 0x8bef464e3945ef7au}, // 5^65
+  {0x97edd871cfda3a56u, 0x97758bf0e3cbb5acu}, // 5^66
+  {0xbde94e8e43d0c8ecu, 0x3d52eeed1cbea317u}, // 5^67
+  {0xed63a231d4c4fb27u, 0x4ca7aaa863ee4bddu}, // 5^68
+  {0x945e455f24fb1cf8u, 0x8fe8caa93e74ef6au}, // 5^69
+  {0xb975d6b6ee39e436u, 0xb3e2fd538e122b44u}, // 5^70
+  {0xe7d34c64a9c85d44u, 0x60dbbca87196b616u}, // 5^71
+  {0x90e40fbeea1d3a4au, 0xbc8955e946fe31cdu}, // 5^72
+  {0xb51d13aea4a488ddu, 0x6babab6398bdbe41u}, // 5^73
+  {0xe264589a4dcdab14u, 0xc696963c7eed2dd1u}, // 5^74
+  {0x8d7eb76070a08aecu, 0xfc1e1de5cf543ca2u}, // 5^75
+  {0xb0de65388cc8ada8u, 0x3b25a55f43294bcbu}, // 5^76
+  {0xdd15fe86affad912u, 0x49ef0eb713f39ebeu}, // 5^77
+  {0x8a2dbf142dfcc7abu, 0x6e3569326c784337u}, // 5^78
+  {0xacb92ed9397bf996u, 0x49c2c37f07965404u}, // 5^79
+  {0xd7e77a8f87daf7fbu, 0xdc33745ec97be906u}, // 5^80
+  {0x86f0ac99b4e8dafdu, 0x69a028bb3ded71a3u}, // 5^81
+  {0xa8acd7c0222311bcu, 0xc40832ea0d68ce0cu}, // 5^82
+  {0xd2d80db02aabd62bu, 0xf50a3fa490c30190u}, // 5^83
+  {0x83c7088e1aab65dbu, 0x792667c6da79e0fau}, // 5^84
+  {0xa4b8cab1a1563f52u, 0x577001b891185938u}, // 5^85
+  {0xcde6fd5e09abcf26u, 0xed4c0226b55e6f86u}, // 5^86
+  {0x80b05e5ac60b6178u, 0x544f8158315b05b4u}, // 5^87
+  {0xa0dc75f1778e39d6u, 0x696361ae3db1c721u}, // 5^88
+  {0xc913936dd571c84cu, 0x03bc3a19cd1e38e9u}, // 5^89
+  {0xfb5878494ace3a5fu, 0x04ab48a04065c723u}, // 5^90
+  {0x9d174b2dcec0e47bu, 0x62eb0d64283f9c76u}, // 5^91
+  {0xc45d1df942711d9au, 0x3ba5d0bd324f8394u}, // 5^92
+  {0xf5746577930d6500u, 0xca8f44ec7ee36479u}, // 5^93
+  {0x9968bf6abbe85f20u, 0x7e998b13cf4e1ecbu}, // 5^94
+  {0xbfc2ef456ae276e8u, 0x9e3fedd8c321a67eu}, // 5^95
+  {0xefb3ab16c59b14a2u, 0xc5cfe94ef3ea101eu}, // 5^96
+  {0x95d04aee3b80ece5u, 0xbba1f1d158724a12u}, // 5^97
+  {0xbb445da9ca61281fu, 0x2a8a6e45ae8edc97u}, // 5^98
+  {0xea1575143cf97226u, 0xf52d09d71a3293bdu}, // 5^99
+  {0x924d692ca61be758u, 0x593c2626705f9c56u}, // 5^100
+  {0xb6e0c377cfa2e12eu, 0x6f8b2fb00c77836cu}, // 5^101
+  {0xe498f455c38b997au, 0x0b6dfb9c0f956447u}, // 5^102
+  {0x8edf98b59a373fecu, 0x4724bd4189bd5eacu}, // 5^103
+  {0xb2977ee300c50fe7u, 0x58edec91ec2cb657u}, // 5^104
+  {0xdf3d5e9bc0f653e1u, 0x2f2967b66737e3edu}, // 5^105
+  {0x8b865b215899f46cu, 0xbd79e0d20082ee74u}, // 5^106
+  {0xae67f1e9aec07187u, 0xecd8590680a3aa11u}, // 5^107
+  {0xda01ee641a708de9u, 0xe80e6f4820cc9495u}, // 5^108
+  {0x884134fe908658b2u, 0x3109058d147fdcddu}, // 5^109
+  {0xaa51823e34a7eedeu, 0xbd4b46f0599fd415u}, // 5^110
+  {0xd4e5e2cdc1d1ea96u, 0x6c9e18ac7007c91au}, // 5^111
+  {0x850fadc09923329eu, 0x03e2cf6bc604ddb0u}, // 5^112
+  {0xa6539930bf6bff45u, 0x84db8346b786151cu}, // 5^113
+  {0xcfe87f7cef46ff16u, 0xe612641865679a63u}, // 5^114
+  {0x81f14fae158c5f6eu, 0x4fcb7e8f3f60c07eu}, // 5^115
+  {0xa26da3999aef7749u, 0xe3be5e330f38f09du}, // 5^116
+  {0xcb090c8001ab551cu, 0x5cadf5bfd3072cc5u}, // 5^117
+  {0xfdcb4fa002162a63u, 0x73d9732fc7c8f7f6u}, // 5^118
+  {0x9e9f11c4014dda7eu, 0x2867e7fddcdd9afau}, // 5^119
+  {0xc646d63501a1511du, 0xb281e1fd541501b8u}, // 5^120
+  {0xf7d88bc24209a565u, 0x1f225a7ca91a4226u}, // 5^121
+  {0x9ae757596946075fu, 0x3375788de9b06958u}, // 5^122
+  {0xc1a12d2fc3978937u, 0x0052d6b1641c83aeu}, // 5^123
+  {0xf209787bb47d6b84u, 0xc0678c5dbd23a49au}, // 5^124
+  {0x9745eb4d50ce6332u, 0xf840b7ba963646e0u}, // 5^125
+  {0xbd176620a501fbffu, 0xb650e5a93bc3d898u}, // 5^126
+  {0xec5d3fa8ce427affu, 0xa3e51f138ab4cebeu}, // 5^127
+  {0x93ba47c980e98cdfu, 0xc66f336c36b10137u}, // 5^128
+  {0xb8a8d9bbe123f017u, 0xb80b0047445d4184u}, // 5^129
+  {0xe6d3102ad96cec1du, 0xa60dc059157491e5u}, // 5^130
+  {0x9043ea1ac7e41392u, 0x87c89837ad68db2fu}, // 5^131
+  {0xb454e4a179dd1877u, 0x29babe4598c311fbu}, // 5^132
+  {0xe16a1dc9d8545e94u, 0xf4296dd6fef3d67au}, // 5^133
+  {0x8ce2529e2734bb1du, 0x1899e4a65f58660cu}, // 5^134
+  {0xb01ae745b101e9e4u, 0x5ec05dcff72e7f8fu}, // 5^135
+  {0xdc21a1171d42645du, 0x76707543f4fa1f73u}, // 5^136
+  {0x899504ae72497ebau, 0x6a06494a791c53a8u}, // 5^137
+  {0xabfa45da0edbde69u, 0x0487db9d17636892u}, // 5^138
+  {0xd6f8d7509292d603u, 0x45a9d2845d3c42b6u}, // 5^139
+  {0x865b86925b9bc5c2u, 0x0b8a2392ba45a9b2u}, // 5^140
+  {0xa7f26836f282b732u, 0x8e6cac7768d7141eu}, // 5^141
+  {0xd1ef0244af2364ffu, 0x3207d795430cd926u}, // 5^142
+  {0x8335616aed761f1fu, 0x7f44e6bd49e807b8u}, // 5^143
+  {0xa402b9c5a8d3a6e7u, 0x5f16206c9c6209a6u}, // 5^144
+  {0xcd036837130890a1u, 0x36dba887c37a8c0fu}, // 5^145
+  {0x802221226be55a64u, 0xc2494954da2c9789u}, // 5^146
+  {0xa02aa96b06deb0fdu, 0xf2db9baa10b7bd6cu}, // 5^147
+  {0xc83553c5c8965d3du, 0x6f92829494e5acc7u}, // 5^148
+  {0xfa42a8b73abbf48cu, 0xcb772339ba1f17f9u}, // 5^149
+  {0x9c69a97284b578d7u, 0xff2a760414536efbu}, // 5^150
+  {0xc38413cf25e2d70du, 0xfef5138519684abau}, // 5^151
+  {0xf46518c2ef5b8cd1u, 0x7eb258665fc25d69u}, // 5^152
+  {0x98bf2f79d5993802u, 0xef2f773ffbd97a61u}, // 5^153
+  {0xbeeefb584aff8603u, 0xaafb550ffacfd8fau}, // 5^154
+  {0xeeaaba2e5dbf6784u, 0x95ba2a53f983cf38u}, // 5^155
+  {0x952ab45cfa97a0b2u, 0xdd945a747bf26183u}, // 5^156
+  {0xba756174393d88dfu, 0x94f971119aeef9e4u}, // 5^157
+  {0xe912b9d1478ceb17u, 0x7a37cd5601aab85du}, // 5^158
+  {0x91abb422ccb812eeu, 0xac62e055c10ab33au}, // 5^159
+  {0xb616a12b7fe617aau, 0x577b986b314d6009u}, // 5^160
+  {0xe39c49765fdf9d94u, 0xed5a7e85fda0b80bu}, // 5^161
+  {0x8e41ade9fbebc27du, 0x14588f13be847307u}, // 5^162
+  {0xb1d219647ae6b31cu, 0x596eb2d8ae258fc8u}, // 5^163
+  {0xde469fbd99a05fe3u, 0x6fca5f8ed9aef3bbu}, // 5^164
+  {0x8aec23d680043beeu, 0x25de7bb9480d5854u}, // 5^165
+  {0xada72ccc20054ae9u, 0xaf561aa79a10ae6au}, // 5^166
+  {0xd910f7ff28069da4u, 0x1b2ba1518094da04u}, // 5^167
+  {0x87aa9aff79042286u, 0x90fb44d2f05d0842u}, // 5^168
+  {0xa99541bf57452b28u, 0x353a1607ac744a53u}, // 5^169
+  {0xd3fa922f2d1675f2u, 0x42889b8997915ce8u}, // 5^170
+  {0x847c9b5d7c2e09b7u, 0x69956135febada11u}, // 5^171
+  {0xa59bc234db398c25u, 0x43fab9837e699095u}, // 5^172
+  {0xcf02b2c21207ef2eu, 0x94f967e45e03f4bbu}, // 5^173
+  {0x8161afb94b44f57du, 0x1d1be0eebac278f5u}, // 5^174
+  {0xa1ba1ba79e1632dcu, 0x6462d92a69731732u}, // 5^175
+  {0xca28a291859bbf93u, 0x7d7b8f7503cfdcfeu}, // 5^176
+  {0xfcb2cb35e702af78u, 0x5cda735244c3d43eu}, // 5^177
+  {0x9defbf01b061adabu, 0x3a0888136afa64a7u}, // 5^178
+  {0xc56baec21c7a1916u, 0x088aaa1845b8fdd0u}, // 5^179
+  {0xf6c69a72a3989f5bu, 0x8aad549e57273d45u}, // 5^180
+  {0x9a3c2087a63f6399u, 0x36ac54e2f678864bu}, // 5^181
+  {0xc0cb28a98fcf3c7fu, 0x84576a1bb416a7ddu}, // 5^182
+  {0xf0fdf2d3f3c30b9fu, 0x656d44a2a11c51d5u}, // 5^183
+  {0x969eb7c47859e743u, 0x9f644ae5a4b1b325u}, // 5^184
+  {0xbc4665b596706114u, 0x873d5d9f0dde1feeu}, // 5^185
+  {0xeb57ff22fc0c7959u, 0xa90cb506d155a7eau}, // 5^186
+  {0x9316ff75dd87cbd8u, 0x09a7f12442d588f2u}, // 5^187
+  {0xb7dcbf5354e9beceu, 0x0c11ed6d538aeb2fu}, // 5^188
+  {0xe5d3ef282a242e81u, 0x8f1668c8a86da5fau}, // 5^189
+  {0x8fa475791a569d10u, 0xf96e017d694487bcu}, // 5^190
+  {0xb38d92d760ec4455u, 0x37c981dcc395a9acu}, // 5^191
+  {0xe070f78d3927556au, 0x85bbe253f47b1417u}, // 5^192
+  {0x8c469ab843b89562u, 0x93956d7478ccec8eu}, // 5^193
+  {0xaf58416654a6babbu, 0x387ac8d1970027b2u}, // 5^194
+  {0xdb2e51bfe9d0696au, 0x06997b05fcc0319eu}, // 5^195
+  {0x88fcf317f22241e2u, 0x441fece3bdf81f03u}, // 5^196
+  {0xab3c2fddeeaad25au, 0xd527e81cad7626c3u}, // 5^197
+  {0xd60b3bd56a5586f1u, 0x8a71e223d8d3b074u}, // 5^198
+  {0x85c7056562757456u, 0xf6872d5667844e49u}, // 5^199
+  {0xa738c6bebb12d16cu, 0xb428f8ac016561dbu}, // 5^200
+  {0xd106f86e69d785c7u, 0xe13336d701beba52u}, // 5^201
+  {0x82a45b450226b39cu, 0xecc0024661173473u}, // 5^202
+  {0xa34d721642b06084u, 0x27f002d7f95d0190u}, // 5^203
+  {0xcc20ce9bd35c78a5u, 0x31ec038df7b441f4u}, // 5^204
+  {0xff290242c83396ceu, 0x7e67047175a15271u}, // 5^205
+  {0x9f79a169bd203e41u, 0x0f0062c6e984d386u}, // 5^206
+  {0xc75809c42c684dd1u, 0x52c07b78a3e60868u}, // 5^207
+  {0xf92e0c3537826145u, 0xa7709a56ccdf8a82u}, // 5^208
+  {0x9bbcc7a142b17ccbu, 0x88a66076400bb691u}, // 5^209
+  {0xc2abf989935ddbfeu, 0x6acff893d00ea435u}, // 5^210
+  {0xf356f7ebf83552feu, 0x0583f6b8c4124d43u}, // 5^211
+  {0x98165af37b2153deu, 0xc3727a337a8b704au}, // 5^212
+  {0xbe1bf1b059e9a8d6u, 0x744f18c0592e4c5cu}, // 5^213
+  {0xeda2ee1c7064130cu, 0x1162def06f79df73u}, // 5^214
+  {0x9485d4d1c63e8be7u, 0x8addcb5645ac2ba8u}, // 5^215
+  {0xb9a74a0637ce2ee1u, 0x6d953e2bd7173692u}, // 5^216
+  {0xe8111c87c5c1ba99u, 0xc8fa8db6ccdd0437u}, // 5^217
+  {0x910ab1d4db9914a0u, 0x1d9c9892400a22a2u}, // 5^218
+  {0xb54d5e4a127f59c8u, 0x2503beb6d00cab4bu}, // 5^219
+  {0xe2a0b5dc971f303au, 0x2e44ae64840fd61du}, // 5^220
+  {0x8da471a9de737e24u, 0x5ceaecfed289e5d2u}, // 5^221
+  {0xb10d8e1456105dadu, 0x7425a83e872c5f47u}, // 5^222
+  {0xdd50f1996b947518u, 0xd12f124e28f77719u}, // 5^223
+  {0x8a5296ffe33cc92fu, 0x82bd6b70d99aaa6fu}, // 5^224
+  {0xace73cbfdc0bfb7bu, 0x636cc64d1001550bu}, // 5^225
+  {0xd8210befd30efa5au, 0x3c47f7e05401aa4eu}, // 5^226
+  {0x8714a775e3e95c78u, 0x65acfaec34810a71u}, // 5^227
+  {0xa8d9d1535ce3b396u, 0x7f1839a741a14d0du}, // 5^228
+  {0xd31045a8341ca07cu, 0x1ede48111209a050u}, // 5^229
+  {0x83ea2b892091e44du, 0x934aed0aab460432u}, // 5^230
+  {0xa4e4b66b68b65d60u, 0xf81da84d5617853fu}, // 5^231
+  {0xce1de40642e3f4b9u, 0x36251260ab9d668eu}, // 5^232
+  {0x80d2ae83e9ce78f3u, 0xc1d72b7c6b426019u}, // 5^233
+  {0xa1075a24e4421730u, 0xb24cf65b8612f81fu}, // 5^234
+  {0xc94930ae1d529cfcu, 0xdee033f26797b627u}, // 5^235
+  {0xfb9b7cd9a4a7443cu, 0x169840ef017da3b1u}, // 5^236
+  {0x9d412e0806e88aa5u, 0x8e1f289560ee864eu}, // 5^237
+  {0xc491798a08a2ad4eu, 0xf1a6f2bab92a27e2u}, // 5^238
+  {0xf5b5d7ec8acb58a2u, 0xae10af696774b1dbu}, // 5^239
+  {0x9991a6f3d6bf1765u, 0xacca6da1e0a8ef29u}, // 5^240
+  {0xbff610b0cc6edd3fu, 0x17fd090a58d32af3u}, // 5^241
+  {0xeff394dcff8a948eu, 0xddfc4b4cef07f5b0u}, // 5^242
+  {0x95f83d0a1fb69cd9u, 0x4abdaf101564f98eu}, // 5^243
+  {0xbb764c4ca7a4440fu, 0x9d6d1ad41abe37f1u}, // 5^244
+  {0xea53df5fd18d5513u, 0x84c86189216dc5edu}, // 5^245
+  {0x92746b9be2f8552cu, 0x32fd3cf5b4e49bb4u}, // 5^246
+  {0xb7118682dbb66a77u, 0x3fbc8c33221dc2a1u}, // 5^247
+  {0xe4d5e82392a40515u, 0x0fabaf3feaa5334au}, // 5^248
+  {0x8f05b1163ba6832du, 0x29cb4d87f2a7400eu}, // 5^249
+  {0xb2c71d5bca9023f8u, 0x743e20e9ef511012u}, // 5^250
+  {0xdf78e4b2bd342cf6u, 0x914da9246b255416u}, // 5^251
+  {0x8bab8eefb6409c1au, 0x1ad089b6c2f7548eu}, // 5^252
+  {0xae9672aba3d0c320u, 0xa184ac2473b529b1u}, // 5^253
+  {0xda3c0f568cc4f3e8u, 0xc9e5d72d90a2741eu}, // 5^254
+  {0x8865899617fb1871u, 0x7e2fa67c7a658892u}, // 5^255
+  {0xaa7eebfb9df9de8du, 0xddbb901b98feeab7u}, // 5^256
+  {0xd51ea6fa85785631u, 0x552a74227f3ea565u}, // 5^257
+  {0x8533285c936b35deu, 0xd53a88958f87275fu}, // 5^258
+  {0xa67ff273b8460356u, 0x8a892abaf368f137u}, // 5^259
+  {0xd01fef10a657842cu, 0x2d2b7569b0432d85u}, // 5^260
+  {0x8213f56a67f6b29bu, 0x9c3b29620e29fc73u}, // 5^261
+  {0xa298f2c501f45f42u, 0x8349f3ba91b47b8fu}, // 5^262
+  {0xcb3f2f7642717713u, 0x241c70a936219a73u}, // 5^263
+  {0xfe0efb53d30dd4d7u, 0xed238cd383aa0110u}, // 5^264
+  {0x9ec95d1463e8a506u, 0xf4363804324a40aau}, // 5^265
+  {0xc67bb4597ce2ce48u, 0xb143c6053edcd0d5u}, // 5^266
+  {0xf81aa16fdc1b81dau, 0xdd94b7868e94050au}, // 5^267
+  {0x9b10a4e5e9913128u, 0xca7cf2b4191c8326u}, // 5^268
+  {0xc1d4ce1f63f57d72u, 0xfd1c2f611f63a3f0u}, // 5^269
+  {0xf24a01a73cf2dccfu, 0xbc633b39673c8cecu}, // 5^270
+  {0x976e41088617ca01u, 0xd5be0503e085d813u}, // 5^271
+  {0xbd49d14aa79dbc82u, 0x4b2d8644d8a74e18u}, // 5^272
+  {0xec9c459d51852ba2u, 0xddf8e7d60ed1219eu}, // 5^273
+  {0x93e1ab8252f33b45u, 0xcabb90e5c942b503u}, // 5^274
+  {0xb8da1662e7b00a17u, 0x3d6a751f3b936243u}, // 5^275
+  {0xe7109bfba19c0c9du, 0x0cc512670a783ad4u}, // 5^276
+  {0x906a617d450187e2u, 0x27fb2b80668b24c5u}, // 5^277
+  {0xb484f9dc9641e9dau, 0xb1f9f660802dedf6u}, // 5^278
+  {0xe1a63853bbd26451u, 0x5e7873f8a0396973u}, // 5^279
+  {0x8d07e33455637eb2u, 0xdb0b487b6423e1e8u}, // 5^280
+  {0xb049dc016abc5e5fu, 0x91ce1a9a3d2cda62u}, // 5^281
+  {0xdc5c5301c56b75f7u, 0x7641a140cc7810fbu}, // 5^282
+  {0x89b9b3e11b6329bau, 0xa9e904c87fcb0a9du}, // 5^283
+  {0xac2820d9623bf429u, 0x546345fa9fbdcd44u}, // 5^284
+  {0xd732290fbacaf133u, 0xa97c177947ad4095u}, // 5^285
+  {0x867f59a9d4bed6c0u, 0x49ed8eabcccc485du}, // 5^286
+  {0xa81f301449ee8c70u, 0x5c68f256bfff5a74u}, // 5^287
+  {0xd226fc195c6a2f8cu, 0x73832eec6fff3111u}, // 5^288
+  {0x83585d8fd9c25db7u, 0xc831fd53c5ff7eabu}, // 5^289
+  {0xa42e74f3d032f525u, 0xba3e7ca8b77f5e55u}, // 5^290
+  {0xcd3a1230c43fb26fu, 0x28ce1bd2e55f35ebu}, // 5^291
+  {0x80444b5e7aa7cf85u, 0x7980d163cf5b81b3u}, // 5^292
+  {0xa0555e361951c366u, 0xd7e105bcc332621fu}, // 5^293
+  {0xc86ab5c39fa63440u, 0x8dd9472bf3fefaa7u}, // 5^294
+  {0xfa856334878fc150u, 0xb14f98f6f0feb951u}, // 5^295
+  {0x9c935e00d4b9d8d2u, 0x6ed1bf9a569f33d3u}, // 5^296
+  {0xc3b8358109e84f07u, 0x0a862f80ec4700c8u}, // 5^297
+  {0xf4a642e14c6262c8u, 0xcd27bb612758c0fau}, // 5^298
+  {0x98e7e9cccfbd7dbdu, 0x8038d51cb897789cu}, // 5^299
+  {0xbf21e44003acdd2cu, 0xe0470a63e6bd56c3u}, // 5^300
+  {0xeeea5d5004981478u, 0x1858ccfce06cac74u}, // 5^301
+  {0x95527a5202df0ccbu, 0x0f37801e0c43ebc8u}, // 5^302
+  {0xbaa718e68396cffdu, 0xd30560258f54e6bau}, // 5^303
+  {0xe950df20247c83fdu, 0x47c6b82ef32a2069u}, // 5^304
+  {0x91d28b7416cdd27eu, 0x4cdc331d57fa5441u}, // 5^305
+  {0xb6472e511c81471du, 0xe0133fe4adf8e952u}, // 5^306
+  {0xe3d8f9e563a198e5u, 0x58180fddd97723a6u}, // 5^307
+  {0x8e679c2f5e44ff8fu, 0x570f09eaa7ea7648u}, // 5^308
+};
+
+// generated as in Ryu: 5^i shifted to its top NUMBER_POW5_BITS bits
+static const uint64_t pow5_split[NUMBER_POW5_COUNT][2] = {
+  {0x0000000000000000u, 0x1000000000000000u}, // 5^0
+  {0x0000000000000000u, 0x1400000000000000u}, // 5^1
+  {0x0000000000000000u, 0x1900000000000000u}, // 5^2
+  {0x0000000000000000u, 0x1f40000000000000u}, // 5^3
+  {0x0000000000000000u, 0x1388000000000000u}, // 5^4
+  {0x0000000000000000u, 0x186a000000000000u}, // 5^5
+  {0x0000000000000000u, 0x1e84800000000000u}, // 5^6
+  {0x0000000000000000u, 0x1312d00000000000u}, // 5^7
+  {0x0000000000000000u, 0x17d7840000000000u}, // 5^8
+  {0x0000000000000000u, 0x1dcd650000000000u}, // 5^9
+  {0x0000000000000000u, 0x12a05f2000000000u}, // 5^10
+  {0x0000000000000000u, 0x174876e800000000u}, // 5^11
+  {0x0000000000000000u, 0x1d1a94a200000000u}, // 5^12
+  {0x0000000000000000u, 0x12309ce540000000u}, // 5^13
+  {0x0000000000000000u, 0x16bcc41e90000000u}, // 5^14
+  {0x0000000000000000u, 0x1c6bf52634000000u}, // 5^15
+  {0x0000000000000000u, 0x11c37937e0800000u}, // 5^16
+  {0x0000000000000000u, 0x16345785d8a00000u}, // 5^17
+  {0x0000000000000000u, 0x1bc16d674ec80000u}, // 5^18
+  {0x0000000000000000u, 0x1158e460913d0000u}, // 5^19
+  {0x0000000000000000u, 0x15af1d78b58c4000u}, // 5^20
+  {0x0000000000000000u, 0x1b1ae4d6e2ef5000u}, // 5^21
+  {0x0000000000000000u, 0x10f0cf064dd59200u}, // 5^22
+  {0x0000000000000000u, 0x152d02c7e14af680u}, // 5^23
+  {0x0000000000000000u, 0x1a784379d99db420u}, // 5^24
+  {0x0000000000000000u, 0x108b2a2c28029094u}, // 5^25
+  {0x0000000000000000u, 0x14adf4b7320334b9u}, // 5^26
+  {0x4000000000000000u, 0x19d971e4fe8401e7u}, // 5^27
+  {0x8800000000000000u, 0x1027e72f1f128130u}, // 5^28
+  {0xaa00000000000000u, 0x1431e0fae6d7217cu}, // 5^29
+  {0xd480000000000000u, 0x193e5939a08ce9dbu}, // 5^30
+  {0xc9a0000000000000u, 0x1f8def8808b02452u}, // 5^31
+  {0xbe04000000000000u, 0x13b8b5b5056e16b3u}, // 5^32
+  {0xad85000000000000u, 0x18a6e32246c99c60u}, // 5^33
+  {0xd8e6400000000000u, 0x1ed09bead87c0378u}, // 5^34
+  {0x878fe80000000000u, 0x13426172c74d822bu}, // 5^35
+  {0x6973e20000000000u, 0x1812f9cf7920e2b6u}, // 5^36
+  {0x03d0da8000000000u, 0x1e17b84357691b64u}, // 5^37
+  {0x8262889000000000u, 0x12ced32a16a1b11eu}, // 5^38
+  {0x22fb2ab400000000u, 0x178287f49c4a1d66u}, // 5^39
+  {0xabb9f56100000000u, 0x1d6329f1c35ca4bfu}, // 5^40
+  {0xcb54395ca0000000u, 0x125dfa371a19e6f7u}, // 5^41
+  {0xbe2947b3c8000000u, 0x16f578c4e0a060b5u}, // 5^42
+  {0x2db399a0ba000000u, 0x1cb2d6f618c878e3u}, // 5^43
+  {0xfc90400474400000u, 0x11efc659cf7d4b8du}, // 5^44
+  {0x7bb4500591500000u, 0x166bb7f0435c9e71u}, // 5^45
+  {0xdaa16406f5a40000u, 0x1c06a5ec5433c60du}, // 5^46
+  {0xa8a4de8459868000u, 0x118427b3b4a05bc8u}, // 5^47
+  {0xd2ce16256fe82000u, 0x15e531a0a1c872bau}, // 5^48
+  {0x87819baecbe22800u, 0x1b5e7e08ca3a8f69u}, // 5^49
+  {0xf4b1014d3f6d5900u, 0x111b0ec57e6499a1u}, // 5^50
+  {0x71dd41a08f48af40u, 0x1561d276ddfdc00au}, // 5^51
+  {0x0e549208b31adb10u, 0x1aba4714957d300du}, // 5^52
+  {0x28f4db456ff0c8eau, 0x10b46c6cdd6e3e08u}, // 5^53
+  {0x33321216cbecfb24u, 0x14e1878814c9cd8au}, // 5^54
+  {0xbffe969c7ee839edu, 0x1a19e96a19fc40ecu}, // 5^55
+  {0xf7ff1e21cf512434u, 0x105031e2503da893u}, // 5^56
+  {0xf5fee5aa43256d41u, 0x14643e5ae44d12b8u}, // 5^57
+  {0x337e9f14d3eec892u, 0x197d4df19d605767u}, // 5^58
+  {0x005e46da08ea7ab6u, 0x1fdca16e04b86d41u}, // 5^59
+  {0xa03aec4845928cb2u, 0x13e9e4e4c2f34448u}, // 5^60
+  {0xc849a75a56f72fdeu, 0x18e45e1df3b0155au}, // 5^61
+  {0x7a5c1130ecb4fbd6u, 0x1f1d75a5709c1ab1u}, // 5^62
+  {0xec798abe93f11d65u, 0x13726987666190aeu}, // 5^63
+  {0xa797ed6e38ed64bfu, 0x184f03e93ff9f4dau}, // 5^64
+  {0x517de8c9c728bdefu, 0x1e62c4e38ff87211u}, // 5^65
+  {0xd2eeb17e1c7976b5u, 0x12fdbb0e39fb474au}, // 5^66
+  {0x87aa5ddda397d462u, 0x17bd29d1c87a191du}, // 5^67
+  {0xe994f5550c7dc97bu, 0x1dac74463a989f64u}, // 5^68
+  {0x11fd195527ce9dedu, 0x128bc8abe49f639fu}, // 5^69
+  {0xd67c5faa71c24568u, 0x172ebad6ddc73c86u}, // 5^70
+  {0x8c1b77950e32d6c2u, 0x1cfa698c95390ba8u}, // 5^71
+  {0x57912abd28dfc639u, 0x121c81f7dd43a749u}, // 5^72
+  {0xad75756c7317b7c8u, 0x16a3a275d494911bu}, // 5^73
+  {0x98d2d2c78fdda5bau, 0x1c4c8b1349b9b562u}, // 5^74
+  {0x9f83c3bcb9ea8794u, 0x11afd6ec0e14115du}, // 5^75
+  {0x0764b4abe8652979u, 0x161bcca7119915b5u}, // 5^76
+  {0x493de1d6e27e73d7u, 0x1ba2bfd0d5ff5b22u}, // 5^77
+  {0x6dc6ad264d8f0866u, 0x1145b7e285bf98f5u}, // 5^78
+  {0xc938586fe0f2ca80u, 0x159725db272f7f32u}, // 5^79
+  {0x7b866e8bd92f7d20u, 0x1afcef51f0fb5effu}, // 5^80
+  {0xad34051767bdae34u, 0x10de1593369d1b5fu}, // 5^81
+  {0x9881065d41ad19c1u, 0x15159af804446237u}, // 5^82
+  {0x7ea147f492186032u, 0x1a5b01b605557ac5u}, // 5^83
+  {0x6f24ccf8db4f3c1fu, 0x1078e111c3556cbbu}, // 5^84
+  {0x4aee003712230b27u, 0x14971956342ac7eau}, // 5^85
+  {0xdda98044d6abcdf0u, 0x19bcdfabc13579e4u}, // 5^86
+  {0x0a89f02b062b60b6u, 0x10160bcb58c16c2fu}, // 5^87
+  {0xcd2c6c35c7b638e4u, 0x141b8ebe2ef1c73au}, // 5^88
+  {0x8077874339a3c71du, 0x1922726dbaae3909u}, // 5^89
+  {0xe0956914080cb8e4u, 0x1f6b0f092959c74bu}, // 5^90
+  {0x6c5d61ac8507f38eu, 0x13a2e965b9d81c8fu}, // 5^91
+  {0x4774ba17a649f072u, 0x188ba3bf284e23b3u}, // 5^92
+  {0x1951e89d8fdc6c8fu, 0x1eae8caef261aca0u}, // 5^93
+  {0x0fd3316279e9c3d9u, 0x132d17ed577d0be4u}, // 5^94
+  {0x13c7fdbb186434cfu, 0x17f85de8ad5c4eddu}, // 5^95
+  {0x58b9fd29de7d4203u, 0x1df67562d8b36294u}, // 5^96
+  {0xb7743e3a2b0e4942u, 0x12ba095dc7701d9cu}, // 5^97
+  {0xe5514dc8b5d1db92u, 0x17688bb5394c2503u}, // 5^98
+  {0xdea5a13ae3465277u, 0x1d42aea2879f2e44u}, // 5^99
+  {0x0b2784c4ce0bf38au, 0x1249ad2594c37cebu}, // 5^100
+  {0xcdf165f6018ef06du, 0x16dc186ef9f45c25u}, // 5^101
+  {0x416dbf7381f2ac88u, 0x1c931e8ab871732fu}, // 5^102
+  {0x88e497a83137abd5u, 0x11dbf316b346e7fdu}, // 5^103
+  {0xeb1dbd923d8596cau, 0x1652efdc6018a1fcu}, // 5^104
+  {0x25e52cf6cce6fc7du, 0x1be7abd3781eca7cu}, // 5^105
+  {0x97af3c1a40105dceu, 0x1170cb642b133e8du}, // 5^106
+  {0xfd9b0b20d0147542u, 0x15ccfe3d35d80e30u}, // 5^107
+  {0x3d01cde904199292u, 0x1b403dcc834e11bdu}, // 5^108
+  {0x462120b1a28ffb9bu, 0x1108269fd210cb16u}, // 5^109
+  {0xd7a968de0b33fa82u, 0x154a3047c694fddbu}, // 5^110
+  {0xcd93c3158e00f923u, 0x1a9cbc59b83a3d52u}, // 5^111
+  {0xc07c59ed78c09bb6u, 0x10a1f5b813246653u}, // 5^112
+  {0xb09b7068d6f0c2a3u, 0x14ca732617ed7fe8u}, // 5^113
+  {0xdcc24c830cacf34cu, 0x19fd0fef9de8dfe2u}, // 5^114
+  {0xc9f96fd1e7ec180fu, 0x103e29f5c2b18bedu}, // 5^115
+  {0x3c77cbc661e71e13u, 0x144db473335deee9u}, // 5^116
+  {0x8b95beb7fa60e598u, 0x1961219000356aa3u}, // 5^117
+  {0x6e7b2e65f8f91efeu, 0x1fb969f40042c54cu}, // 5^118
+  {0xc50cfcffbb9bb35fu, 0x13d3e2388029bb4fu}, // 5^119
+  {0xb6503c3faa82a037u, 0x18c8dac6a0342a23u}, // 5^120
+  {0xa3e44b4f95234844u, 0x1efb1178484134acu}, // 5^121
+  {0xe66eaf11bd360d2bu, 0x135ceaeb2d28c0ebu}, // 5^122
+  {0xe00a5ad62c839075u, 0x183425a5f872f126u}, // 5^123
+  {0x980cf18bb7a47493u, 0x1e412f0f768fad70u}, // 5^124
+  {0x5f0816f752c6c8dcu, 0x12e8bd69aa19cc66u}, // 5^125
+  {0xf6ca1cb527787b13u, 0x17a2ecc414a03f7fu}, // 5^126
+  {0xf47ca3e2715699d7u, 0x1d8ba7f519c84f5fu}, // 5^127
+  {0xf8cde66d86d62026u, 0x127748f9301d319bu}, // 5^128
+  {0xf7016008e88ba830u, 0x17151b377c247e02u}, // 5^129
+  {0xb4c1b80b22ae923cu, 0x1cda62055b2d9d83u}, // 5^130
+  {0x50f91306f5ad1b65u, 0x12087d4358fc8272u}, // 5^131
+  {0xe53757c8b318623fu, 0x168a9c942f3ba30eu}, // 5^132
+  {0x9e852dbadfde7acfu, 0x1c2d43b93b0a8bd2u}, // 5^133
+  {0xa3133c94cbeb0cc1u, 0x119c4a53c4e69763u}, // 5^134
+  {0x8bd80bb9fee5cff1u, 0x16035ce8b6203d3cu}, // 5^135
+  {0xaece0ea87e9f43eeu, 0x1b843422e3a84c8bu}, // 5^136
+  {0x4d40c9294f238a75u, 0x1132a095ce492fd7u}, // 5^137
+  {0x2090fb73a2ec6d12u, 0x157f48bb41db7bcdu}, // 5^138
+  {0x68b53a508ba78856u, 0x1adf1aea12525ac0u}, // 5^139
+  {0x417144725748b536u, 0x10cb70d24b7378b8u}, // 5^140
+  {0x51cd958eed1ae283u, 0x14fe4d06de5056e6u}, // 5^141
+  {0xe640faf2a8619b24u, 0x1a3de04895e46c9fu}, // 5^142
+  {0xefe89cd7a93d00f7u, 0x1066ac2d5daec3e3u}, // 5^143
+  {0xebe2c40d938c4134u, 0x14805738b51a74dcu}, // 5^144
+  {0x26db7510f86f5181u, 0x19a06d06e2611214u}, // 5^145
+  {0x9849292a9b4592f1u, 0x100444244d7cab4cu}, // 5^146
+  {0xbe5b73754216f7adu, 0x1405552d60dbd61fu}, // 5^147
+  {0xadf25052929cb598u, 0x1906aa78b912cba7u}, // 5^148
+  {0x996ee4673743e2ffu, 0x1f485516e7577e91u}, // 5^149
+  {0xffe54ec0828a6ddfu, 0x138d352e5096af1au}, // 5^150
+  {0xbfdea270a32d0957u, 0x18708279e4bc5ae1u}, // 5^151
+  {0x2fd64b0ccbf84badu, 0x1e8ca3185deb719au}, // 5^152
+  {0x5de5eee7ff7b2f4cu, 0x1317e5ef3ab32700u}, // 5^153
+  {0x755f6aa1ff59fb1fu, 0x17dddf6b095ff0c0u}, // 5^154
+  {0x92b7454a7f3079e7u, 0x1dd55745cbb7ecf0u}, // 5^155
+  {0x5bb28b4e8f7e4c30u, 0x12a5568b9f52f416u}, // 5^156
+  {0xf29f2e22335ddf3cu, 0x174eac2e8727b11bu}, // 5^157
+  {0xef46f9aac035570bu, 0x1d22573a28f19d62u}, // 5^158
+  {0xd58c5c0ab8215667u, 0x123576845997025du}, // 5^159
+  {0x4aef730d6629ac01u, 0x16c2d4256ffcc2f5u}, // 5^160
+  {0x9dab4fd0bfb41701u, 0x1c73892ecbfbf3b2u}, // 5^161
+  {0xa28b11e277d08e60u, 0x11c835bd3f7d784fu}, // 5^162
+  {0x8b2dd65b15c4b1f9u, 0x163a432c8f5cd663u}, // 5^163
+  {0x6df94bf1db35de77u, 0x1bc8d3f7b3340bfcu}, // 5^164
+  {0xc4bbcf772901ab0au, 0x115d847ad000877du}, // 5^165
+  {0x35eac354f34215cdu, 0x15b4e5998400a95du}, // 5^166
+  {0x8365742a30129b40u, 0x1b221effe500d3b4u}, // 5^167
+  {0xd21f689a5e0ba108u, 0x10f5535fef208450u}, // 5^168
+  {0x06a742c0f58e894au, 0x1532a837eae8a565u}, // 5^169
+  {0x4851137132f22b9du, 0x1a7f5245e5a2cebeu}, // 5^170
+  {0xed32ac26bfd75b42u, 0x108f936baf85c136u}, // 5^171
+  {0xa87f57306fcd3212u, 0x14b378469b673184u}, // 5^172
+  {0xd29f2cfc8bc07e97u, 0x19e056584240fde5u}, // 5^173
+  {0xa3a37c1dd7584f1eu, 0x102c35f729689eafu}, // 5^174
+  {0x8c8c5b254d2e62e6u, 0x14374374f3c2c65bu}, // 5^175
+  {0x6faf71eea079fb9fu, 0x1945145230b377f2u}, // 5^176
+  {0x0b9b4e6a48987a87u, 0x1f965966bce055efu}, // 5^177
+  {0x674111026d5f4c94u, 0x13bdf7e0360c35b5u}, // 5^178
+  {0xc111554308b71fbau, 0x18ad75d8438f4322u}, // 5^179
+  {0x7155aa93cae4e7a8u, 0x1ed8d34e547313ebu}, // 5^180
+  {0x26d58a9c5ecf10c9u, 0x13478410f4c7ec73u}, // 5^181
+  {0xf08aed437682d4fbu, 0x1819651531f9e78fu}, // 5^182
+  {0xecada89454238a3au, 0x1e1fbe5a7e786173u}, // 5^183
+  {0x73ec895cb4963664u, 0x12d3d6f88f0b3ce8u}, // 5^184
+  {0x90e7abb3e1bbc3fdu, 0x1788ccb6b2ce0c22u}, // 5^185
+  {0x352196a0da2ab4fdu, 0x1d6affe45f818f2bu}, // 5^186
+  {0x0134fe24885ab11eu, 0x1262dfeebbb0f97bu}, // 5^187
+  {0xc1823dadaa715d65u, 0x16fb97ea6a9d37d9u}, // 5^188
+  {0x31e2cd19150db4bfu, 0x1cba7de5054485d0u}, // 5^189
+  {0x1f2dc02fad2890f7u, 0x11f48eaf234ad3a2u}, // 5^190
+  {0xa6f9303b9872b535u, 0x1671b25aec1d888au}, // 5^191
+  {0x50b77c4a7e8f6282u, 0x1c0e1ef1a724eaadu}, // 5^192
+  {0x5272adae8f199d91u, 0x1188d357087712acu}, // 5^193
+  {0x670f591a32e004f6u, 0x15eb082cca94d757u}, // 5^194
+  {0x40d32f60bf980633u, 0x1b65ca37fd3a0d2du}, // 5^195
+  {0x4883fd9c77bf03e0u, 0x111f9e62fe44483cu}, // 5^196
+  {0x5aa4fd0395aec4d8u, 0x156785fbbdd55a4bu}, // 5^197
+  {0x314e3c447b1a760eu, 0x1ac1677aad4ab0deu}, // 5^198
+  {0xded0e5aaccf089c9u, 0x10b8e0acac4eae8au}, // 5^199
+  {0x96851f15802cac3bu, 0x14e718d7d7625a2du}, // 5^200
+  {0xfc2666dae037d74au, 0x1a20df0dcd3af0b8u}, // 5^201
+  {0x9d980048cc22e68eu, 0x10548b68a044d673u}, // 5^202
+  {0x84fe005aff2ba032u, 0x1469ae42c8560c10u}, // 5^203
+  {0xa63d8071bef6883eu, 0x198419d37a6b8f14u}, // 5^204
+  {0xcfcce08e2eb42a4eu, 0x1fe52048590672d9u}, // 5^205
+  {0x21e00c58dd309a70u, 0x13ef342d37a407c8u}, // 5^206
+  {0x2a580f6f147cc10du, 0x18eb0138858d09bau}, // 5^207
+  {0xb4ee134ad99bf150u, 0x1f25c186a6f04c28u}, // 5^208
+  {0x7114cc0ec80176d2u, 0x137798f428562f99u}, // 5^209
+  {0xcd59ff127a01d486u, 0x18557f31326bbb7fu}, // 5^210
+  {0xc0b07ed7188249a8u, 0x1e6adefd7f06aa5fu}, // 5^211
+  {0xd86e4f466f516e09u, 0x1302cb5e6f642a7bu}, // 5^212
+  {0xce89e3180b25c98bu, 0x17c37e360b3d351au}, // 5^213
+  {0x822c5bde0def3beeu, 0x1db45dc38e0c8261u}, // 5^214
+  {0xf15bb96ac8b58575u, 0x1290ba9a38c7d17cu}, // 5^215
+  {0x2db2a7c57ae2e6d2u, 0x1734e940c6f9c5dcu}, // 5^216
+  {0x391f51b6d99ba086u, 0x1d022390f8b83753u}, // 5^217
+  {0x03b3931248014454u, 0x1221563a9b732294u}, // 5^218
+  {0x04a077d6da019569u, 0x16a9abc9424feb39u}, // 5^219
+  {0x45c895cc9081fac3u, 0x1c5416bb92e3e607u}, // 5^220
+  {0x8b9d5d9fda513cbau, 0x11b48e353bce6fc4u}, // 5^221
+  {0xae84b507d0e58be8u, 0x1621b1c28ac20bb5u}, // 5^222
+  {0x1a25e249c51eeee3u, 0x1baa1e332d728ea3u}, // 5^223
+  {0xf057ad6e1b33554du, 0x114a52dffc679925u}, // 5^224
+  {0x6c6d98c9a2002aa1u, 0x159ce797fb817f6fu}, // 5^225
+  {0x4788fefc0a803549u, 0x1b04217dfa61df4bu}, // 5^226
+  {0x0cb59f5d8690214eu, 0x10e294eebc7d2b8fu}, // 5^227
+  {0xcfe30734e83429a1u, 0x151b3a2a6b9c7672u}, // 5^228
+  {0x83dbc9022241340au, 0x1a6208b50683940fu}, // 5^229
+  {0xb2695da15568c086u, 0x107d457124123c89u}, // 5^230
+  {0x1f03b509aac2f0a7u, 0x149c96cd6d16cbacu}, // 5^231
+  {0x26c4a24c1573acd1u, 0x19c3bc80c85c7e97u}, // 5^232
+  {0x783ae56f8d684c03u, 0x101a55d07d39cf1eu}, // 5^233
+  {0x16499ecb70c25f03u, 0x1420eb449c8842e6u}, // 5^234
+  {0x9bdc067e4cf2f6c4u, 0x19292615c3aa539fu}, // 5^235
+  {0x82d3081de02fb476u, 0x1f736f9b3494e887u}, // 5^236
+  {0xb1c3e512ac1dd0c9u, 0x13a825c100dd1154u}, // 5^237
+  {0xde34de57572544fcu, 0x18922f31411455a9u}, // 5^238
+  {0x55c215ed2cee963bu, 0x1eb6bafd91596b14u}, // 5^239
+  {0xb5994db43c151de5u, 0x133234de7ad7e2ecu}, // 5^240
+  {0xe2ffa1214b1a655eu, 0x17fec216198ddba7u}, // 5^241
+  {0xdbbf89699de0feb6u, 0x1dfe729b9ff15291u}, // 5^242
+  {0x2957b5e202ac9f31u, 0x12bf07a143f6d39bu}, // 5^243
+  {0xf3ada35a8357c6feu, 0x176ec98994f48881u}, // 5^244
+  {0x70990c31242db8bdu, 0x1d4a7bebfa31aaa2u}, // 5^245
+  {0x865fa79eb69c9376u, 0x124e8d737c5f0aa5u}, // 5^246
+  {0xe7f791866443b854u, 0x16e230d05b76cd4eu}, // 5^247
+  {0xa1f575e7fd54a669u, 0x1c9abd04725480a2u}, // 5^248
+  {0xa53969b0fe54e801u, 0x11e0b622c774d065u}, // 5^249
+  {0x0e87c41d3dea2202u, 0x1658e3ab7952047fu}, // 5^250
+  {0xd229b5248d64aa82u, 0x1bef1c9657a6859eu}, // 5^251
+  {0x435a1136d85eea91u, 0x117571ddf6c81383u}, // 5^252
+  {0x143095848e76a536u, 0x15d2ce55747a1864u}, // 5^253
+  {0x193cbae5b2144e83u, 0x1b4781ead1989e7du}, // 5^254
+  {0x2fc5f4cf8f4cb112u, 0x110cb132c2ff630eu}, // 5^255
+  {0xbbb77203731fdd56u, 0x154fdd7f73bf3bd1u}, // 5^256
+  {0x2aa54e844fe7d4acu, 0x1aa3d4df50af0ac6u}, // 5^257
+  {0xdaa75112b1f0e4ebu, 0x10a6650b926d66bbu}, // 5^258
+  {0xd15125575e6d1e26u, 0x14cffe4e7708c06au}, // 5^259
+  {0x85a56ead360865b0u, 0x1a03fde214caf085u}, // 5^260
+  {0x7387652c41c53f8eu, 0x10427ead4cfed653u}, // 5^261
+  {0x50693e7752368f71u, 0x14531e58a03e8be8u}, // 5^262
+  {0x64838e1526c4334eu, 0x1967e5eec84e2ee2u}, // 5^263
+  {0xfda4719a70754022u, 0x1fc1df6a7a61ba9au}, // 5^264
+  {0xde86c70086494815u, 0x13d92ba28c7d14a0u}, // 5^265
+  {0x162878c0a7db9a1au, 0x18cf768b2f9c59c9u}, // 5^266
+  {0x5bb296f0d1d280a1u, 0x1f03542dfb83703bu}, // 5^267
+  {0x194f9e5683239064u, 0x1362149cbd322625u}, // 5^268
+  {0x5fa385ec23ec747eu, 0x183a99c3ec7eafaeu}, // 5^269
+  {0xf78c67672ce7919du, 0x1e494034e79e5b99u}, // 5^270
+  {0x3ab7c0a07c10bb02u, 0x12edc82110c2f940u}, // 5^271
+  {0x4965b0c89b14e9c3u, 0x17a93a2954f3b790u}, // 5^272
+  {0x5bbf1cfac1da2433u, 0x1d9388b3aa30a574u}, // 5^273
+  {0xb957721cb92856a0u, 0x127c35704a5e6768u}, // 5^274
+  {0xe7ad4ea3e7726c48u, 0x171b42cc5cf60142u}, // 5^275
+  {0xa198a24ce14f075au, 0x1ce2137f74338193u}, // 5^276
+  {0x44ff65700cd16498u, 0x120d4c2fa8a030fcu}, // 5^277
+  {0x563f3ecc1005bdbeu, 0x16909f3b92c83d3bu}, // 5^278
+  {0x2bcf0e7f14072d2eu, 0x1c34c70a777a4c8au}, // 5^279
+  {0x5b61690f6c847c3du, 0x11a0fc668aac6fd6u}, // 5^280
+  {0xf239c35347a59b4cu, 0x16093b802d578bcbu}, // 5^281
+  {0xeec83428198f021fu, 0x1b8b8a6038ad6ebeu}, // 5^282
+  {0x553d20990ff96153u, 0x1137367c236c6537u}, // 5^283
+  {0x2a8c68bf53f7b9a8u, 0x1585041b2c477e85u}, // 5^284
+  {0x752f82ef28f5a812u, 0x1ae64521f7595e26u}, // 5^285
+  {0x093db1d57999890bu, 0x10cfeb353a97dad8u}, // 5^286
+  {0x0b8d1e4ad7ffeb4eu, 0x1503e602893dd18eu}, // 5^287
+  {0x8e7065dd8dffe622u, 0x1a44df832b8d45f1u}, // 5^288
+  {0xf9063faa78bfefd5u, 0x106b0bb1fb384bb6u}, // 5^289
+  {0xb747cf9516efebcau, 0x1485ce9e7a065ea4u}, // 5^290
+  {0xe519c37a5cabe6bdu, 0x19a742461887f64du}, // 5^291
+  {0xaf301a2c79eb7036u, 0x1008896bcf54f9f0u}, // 5^292
+  {0xdafc20b798664c43u, 0x140aabc6c32a386cu}, // 5^293
+  {0x11bb28e57e7fdf54u, 0x190d56b873f4c688u}, // 5^294
+  {0x1629f31ede1fd72au, 0x1f50ac6690f1f82au}, // 5^295
+  {0x4dda37f34ad3e67au, 0x13926bc01a973b1au}, // 5^296
+  {0xe150c5f01d88e019u, 0x187706b0213d09e0u}, // 5^297
+  {0x19a4f76c24eb181fu, 0x1e94c85c298c4c59u}, // 5^298
+  {0xb0071aa39712ef13u, 0x131cfd3999f7afb7u}, // 5^299
+  {0x9c08e14c7cd7aad8u, 0x17e43c8800759ba5u}, // 5^300
+  {0x030b199f9c0d958eu, 0x1ddd4baa0093028fu}, // 5^301
+  {0x61e6f003c1887d79u, 0x12aa4f4a405be199u}, // 5^302
+  {0xba60ac04b1ea9cd7u, 0x1754e31cd072d9ffu}, // 5^303
+  {0xa8f8d705de65440du, 0x1d2a1be4048f907fu}, // 5^304
+  {0xc99b8663aaff4a88u, 0x123a516e82d9ba4fu}, // 5^305
+  {0xbc0267fc95bf1d2au, 0x16c8e5ca239028e3u}, // 5^306
+  {0xab0301fbbb2ee474u, 0x1c7b1f3cac74331cu}, // 5^307
+  {0xeae1e13d54fd4ec9u, 0x11ccf385ebc89ff1u}, // 5^308
+  {0x659a598caa3ca27bu, 0x1640306766bac7eeu}, // 5^309
+  {0xff00efefd4cbcb1au, 0x1bd03c81406979e9u}, // 5^310
+  {0x3f6095f5e4ff5ef0u, 0x116225d0c841ec32u}, // 5^311
+  {0xcf38bb735e3f36acu, 0x15baaf44fa52673eu}, // 5^312
+  {0x8306ea5035cf0457u, 0x1b295b1638e7010eu}, // 5^313
+  {0x11e4527221a162b6u, 0x10f9d8ede39060a9u}, // 5^314
+  {0x565d670eaa09bb64u, 0x15384f295c7478d3u}, // 5^315
+  {0x2bf4c0d2548c2a3du, 0x1a8662f3b3919708u}, // 5^316
+  {0x1b78f88374d79a66u, 0x1093fdd8503afe65u}, // 5^317
+  {0x625736a4520d8100u, 0x14b8fd4e6449bdfeu}, // 5^318
+  {0xfaed044d6690e140u, 0x19e73ca1fd5c2d7du}, // 5^319
+  {0xbcd422b0601a8cc8u, 0x103085e53e599c6eu}, // 5^320
+  {0x6c092b5c78212ffau, 0x143ca75e8df0038au}, // 5^321
+  {0x070b763396297bf8u, 0x194bd136316c046du}, // 5^322
+  {0x48ce53c07bb3daf6u, 0x1f9ec583bdc70588u}, // 5^323
+  {0x2d80f4584d5068dau, 0x13c33b72569c6375u}, // 5^324
+  {0x78e1316e60a48310u, 0x18b40a4eec437c52u}, // 5^325
+};
+
+// generated as in Ryu: 2^(pow5_bits(i) - 1 + NUMBER_POW5_INV_BITS) / 5^i + 1
+static const uint64_t pow5_inv_split[NUMBER_POW5_INV_COUNT][2] = {
+  {0x0000000000000001u, 0x2000000000000000u}, // 5^-0
+  {0x999999999999999au, 0x1999999999999999u}, // 5^-1
+  {0x47ae147ae147ae15u, 0x147ae147ae147ae1u}, // 5^-2
+  {0x6c8b4395810624deu, 0x10624dd2f1a9fbe7u}, // 5^-3
+  {0x7a786c226809d496u, 0x1a36e2eb1c432ca5u}, // 5^-4
+  {0x61f9f01b866e43abu, 0x14f8b588e368f084u}, // 5^-5
+  {0xb4c7f34938583622u, 0x10c6f7a0b5ed8d36u}, // 5^-6
+  {0x87a6520ec08d236au, 0x1ad7f29abcaf4857u}, // 5^-7
+  {0x9fb841a566d74f88u, 0x15798ee2308c39dfu}, // 5^-8
+  {0xe62d01511f12a607u, 0x112e0be826d694b2u}, // 5^-9
+  {0xd6ae6881cb5109a4u, 0x1b7cdfd9d7bdbab7u}, // 5^-10
+  {0xdef1ed34a2a73aeau, 0x15fd7fe17964955fu}, // 5^-11
+  {0x7f27f0f6e885c8bbu, 0x119799812dea1119u}, // 5^-12
+  {0x650cb4be40d60df8u, 0x1c25c268497681c2u}, // 5^-13
+  {0xea70909833de7193u, 0x16849b86a12b9b01u}, // 5^-14
+  {0x21f3a6e0297ec143u, 0x1203af9ee756159bu}, // 5^-15
+  {0x6985d7cd0f313537u, 0x1cd2b297d889bc2bu}, // 5^-16
+  {0x2137dfd73f5a90f9u, 0x170ef54646d49689u}, // 5^-17
+  {0xe75fe645cc4873fau, 0x12725dd1d243aba0u}, // 5^-18
+  {0xa5663d3c7a0d865du, 0x1d83c94fb6d2ac34u}, // 5^-19
+  {0x511e976394d79eb1u, 0x179ca10c9242235du}, // 5^-20
+  {0xda7edf82dd794bc1u, 0x12e3b40a0e9b4f7du}, // 5^-21
+  {0x2a6498d1625bac68u, 0x1e392010175ee596u}, // 5^-22
+  {0xeeb6e0a781e2f053u, 0x182db34012b25144u}, // 5^-23
+  {0x58924d52ce4f26a9u, 0x1357c299a88ea76au}, // 5^-24
+  {0x27507bb7b07ea441u, 0x1ef2d0f5da7dd8aau}, // 5^-25
+  {0x52a6c95fc0655034u, 0x18c240c4aecb13bbu}, // 5^-26
+  {0x0eebd44c99eaa690u, 0x13ce9a36f23c0fc9u}, // 5^-27
+  {0xb17953adc3110a80u, 0x1fb0f6be50601941u}, // 5^-28
+  {0xc12ddc8b02740867u, 0x195a5efea6b34767u}, // 5^-29
+  {0x3424b06f3529a052u, 0x14484bfeebc29f86u}, // 5^-30
+  {0x901d59f290ee19dbu, 0x1039d66589687f9eu}, // 5^-31
+  {0x4cfbc31db4b0295fu, 0x19f623d5a8a73297u}, // 5^-32
+  {0x3d9635b15d59bab2u, 0x14c4e977ba1f5bacu}, // 5^-33
+  {0x97ab5e277de16228u, 0x109d8792fb4c4956u}, // 5^-34
+  {0xf2abc9d8c9689d0du, 0x1a95a5b7f87a0ef0u}, // 5^-35
+  {0x5bbca17a3aba173eu, 0x154484932d2e725au}, // 5^-36
+  {0xafca1ac82efb45cbu, 0x11039d428a8b8eaeu}, // 5^-37
+  {0xb2dcf7a6b1920945u, 0x1b38fb9daa78e44au}, // 5^-38
+  {0xf57d92ebc141a104u, 0x15c72fb1552d836eu}, // 5^-39
+  {0xc46475896767b403u, 0x116c262777579c58u}, // 5^-40
+  {0x6d6d88dbd8a5ecd2u, 0x1be03d0bf225c6f4u}, // 5^-41
+  {0x8abe071646eb23dbu, 0x164cfda3281e38c3u}, // 5^-42
+  {0x6efe6c11d255b649u, 0x11d7314f534b609cu}, // 5^-43
+  {0xb197134fb6ef8a0eu, 0x1c8b821885456760u}, // 5^-44
+  {0x27ac0f72f8bfa1a5u, 0x16d601ad376ab91au}, // 5^-45
+  {0xb95672c260994e1eu, 0x1244ce242c5560e1u}, // 5^-46
+  {0xf5571e03cdc21695u, 0x1d3ae36d13bbce35u}, // 5^-47
+  {0x2aac18030b01ababu, 0x17624f8a762fd82bu}, // 5^-48
+  {0xbbbce0026f348956u, 0x12b50c6ec4f31355u}, // 5^-49
+  {0x92c7ccd0b1eda889u, 0x1dee7a4ad4b81eefu}, // 5^-50
+  {0xdbd30a408e57ba07u, 0x17f1fb6f10934bf2u}, // 5^-51
+  {0x7ca8d50071dfc806u, 0x1327fc58da0f6ff5u}, // 5^-52
+  {0xfaa7bb33e9660cd6u, 0x1ea6608e29b24cbbu}, // 5^-53
+  {0x9552fc298784d711u, 0x18851a0b548ea3c9u}, // 5^-54
+  {0xaaa8c9bad2d0ac0eu, 0x139dae6f76d88307u}, // 5^-55
+  {0xdddadc5e1e1aace3u, 0x1f62b0b257c0d1a5u}, // 5^-56
+  {0x7e48b04b4b488a4fu, 0x191bc08eac9a4151u}, // 5^-57
+  {0xcb6d59d5d5d3a1d9u, 0x141633a556e1cddau}, // 5^-58
+  {0x3c577b1177dc817bu, 0x1011c2eaabe7d7e2u}, // 5^-59
+  {0xc6f25e825960cf2au, 0x19b604aaaca62636u}, // 5^-60
+  {0x6bf518684780a5bbu, 0x14919d5556eb51c5u}, // 5^-61
+  {0x232a79ed06008496u, 0x10747ddddf22a7d1u}, // 5^-62
+  {0xd1dd8fe1a3340756u, 0x1a53fc9631d10c81u}, // 5^-63
+  {0xa7e4731ae8f66c45u, 0x150ffd44f4a73d34u}, // 5^-64
+  {0x531d28e253f8569eu, 0x10d9976a5d52975du}, // 5^-65
+  {0xeb61db03b98d5762u, 0x1af5bf109550f22eu}, // 5^-66
+  {0xbc4e48cfc7a445e8u, 0x159165a6ddda5b58u}, // 5^-67
+  {0x6371d3d96c836b20u, 0x11411e1f17e1e2adu}, // 5^-68
+  {0x9f1c8628ad9f11cdu, 0x1b9b6364f3030448u}, // 5^-69
+  {0xe5b06b53be18db0bu, 0x1615e91d8f359d06u}, // 5^-70
+  {0xeaf3890fcb4715a2u, 0x11ab20e472914a6bu}, // 5^-71
+  {0x44b8db4c7871bc37u, 0x1c45016d841baa46u}, // 5^-72
+  {0x03c715d6c6c1635fu, 0x169d9abe03495505u}, // 5^-73
+  {0x3638de456bcde919u, 0x1217aefe69077737u}, // 5^-74
+  {0x56c163a2461641c1u, 0x1cf2b1970e725858u}, // 5^-75
+  {0xdf011c81d1ab67ceu, 0x17288e1271f51379u}, // 5^-76
+  {0x7f3416ce4155eca5u, 0x1286d80ec190dc61u}, // 5^-77
+  {0x6520247d3556476eu, 0x1da48ce468e7c702u}, // 5^-78
+  {0xea801d30f7783925u, 0x17b6d71d20b96c01u}, // 5^-79
+  {0xbb99b0f3f92cfa84u, 0x12f8ac174d612334u}, // 5^-80
+  {0x5f5c4e532847f739u, 0x1e5aacf215683854u}, // 5^-81
+  {0x7f7d0b75b9d32c2eu, 0x18488a5b44536043u}, // 5^-82
+  {0x9930d5f7c7dc2358u, 0x136d3b7c36a919cfu}, // 5^-83
+  {0x8eb4898c72f9d226u, 0x1f152bf9f10e8fb2u}, // 5^-84
+  {0x722a07a38f2e41b8u, 0x18ddbcc7f40ba628u}, // 5^-85
+  {0xc1bb394fa5be9afau, 0x13e497065cd61e86u}, // 5^-86
+  {0x9c5ec2190930f7f6u, 0x1fd424d6faf030d7u}, // 5^-87
+  {0x49e56814075a5ff8u, 0x197683df2f268d79u}, // 5^-88
+  {0x6e51201005e1e660u, 0x145ecfe5bf520ac7u}, // 5^-89
+  {0xf1da800cd181851au, 0x104bd984990e6f05u}, // 5^-90
+  {0x4fc400148268d4f5u, 0x1a12f5a0f4e3e4d6u}, // 5^-91
+  {0xd96999aa01ed772bu, 0x14dbf7b3f71cb711u}, // 5^-92
+  {0xadee1488018ac5bcu, 0x10aff95cc5b09274u}, // 5^-93
+  {0x497ceda668de092cu, 0x1ab328946f80ea54u}, // 5^-94
+  {0x3aca57b853e4d424u, 0x155c2076bf9a5510u}, // 5^-95
+  {0x623b7960431d7683u, 0x1116805effaeaa73u}, // 5^-96
+  {0x9d2bf566d1c8bd9eu, 0x1b5733cb32b110b8u}, // 5^-97
+  {0x7dbcc452416d647fu, 0x15df5ca28ef40d60u}, // 5^-98
+  {0xcafd69db678ab6ccu, 0x117f7d4ed8c33de6u}, // 5^-99
+  {0xab2f0fc572778adfu, 0x1bff2ee48e052fd7u}, // 5^-100
+  {0x88f273045b92d580u, 0x1665bf1d3e6a8cacu}, // 5^-101
+  {0xd3f528d049424466u, 0x11eaff4a98553d56u}, // 5^-102
+  {0xb988414d4203a0a3u, 0x1cab3210f3bb9557u}, // 5^-103
+  {0x6139cdd76802e6e9u, 0x16ef5b40c2fc7779u}, // 5^-104
+  {0xe761717920025254u, 0x125915cd68c9f92du}, // 5^-105
+  {0xa568b58e999d5086u, 0x1d5b561574765b7cu}, // 5^-106
+  {0x5120913ee14aa6d2u, 0x177c44ddf6c515fdu}, // 5^-107
+  {0xa74d40ff1aa21f0eu, 0x12c9d0b1923744cau}, // 5^-108
+  {0x0baece64f769cb4au, 0x1e0fb44f50586e11u}, // 5^-109
+  {0x3c8bd850c5ee3c3bu, 0x180c903f7379f1a7u}, // 5^-110
+  {0xca0979da37f1c9c9u, 0x133d4032c2c7f485u}, // 5^-111
+  {0xa9a8c2f6bfe942dbu, 0x1ec866b79e0cba6fu}, // 5^-112
+  {0x2153cf2bccba9be3u, 0x18a0522c7e709526u}, // 5^-113
+  {0x1aa9728970954982u, 0x13b374f06526ddb8u}, // 5^-114
+  {0xf775840f1a88759du, 0x1f8587e7083e2f8cu}, // 5^-115
+  {0x5f9136727ba05e17u, 0x19379fec0698260au}, // 5^-116
+  {0x1940f85b9619e4dfu, 0x142c7ff0054684d5u}, // 5^-117
+  {0xe100c6afab47ea4cu, 0x1023998cd1053710u}, // 5^-118
+  {0xce67a44c453fdd47u, 0x19d28f47b4d524e7u}, // 5^-119
+  {0xd852e9d69dccb106u, 0x14a8729fc3ddb71fu}, // 5^-120
+  {0x79dbee454b0a2738u, 0x1086c219697e2c19u}, // 5^-121
+  {0x295fe3a211a9d859u, 0x1a71368f0f30468fu}, // 5^-122
+  {0xbab31c81a7bb137au, 0x15275ed8d8f36ba5u}, // 5^-123
+  {0x6228e39aec95a92fu, 0x10ec4be0ad8f8951u}, // 5^-124
+  {0x9d0e38f7e0ef7517u, 0x1b13ac9aaf4c0ee8u}, // 5^-125
+  {0xb0d82d931a592a79u, 0x15a956e225d67253u}, // 5^-126
+  {0x8d79be0f4847552eu, 0x11544581b7dec1dcu}, // 5^-127
+  {0x158f967eda0bbb7cu, 0x1bba08cf8c979c94u}, // 5^-128
+  {0x77a611ff14d62f97u, 0x162e6d72d6dfb076u}, // 5^-129
+  {0xf951a7ff43de8c79u, 0x11bebdf578b2f391u}, // 5^-130
+  {0xc21c3ffed2fdad8eu, 0x1c6463225ab7ec1cu}, // 5^-131
+  {0x01b0333242648ad8u, 0x16b6b5b5155ff017u}, // 5^-132
+  {0x0159c28e9b83a246u, 0x122bc490dde659acu}, // 5^-133
+  {0xcef604175f3903a3u, 0x1d12d41afca3c2acu}, // 5^-134
+  {0x725e69ac4c2d9c83u, 0x17424348ca1c9bbdu}, // 5^-135
+  {0xf5185489d68ae39cu, 0x129b69070816e2fdu}, // 5^-136
+  {0xee8d540fbdab05c6u, 0x1dc574d80cf16b2fu}, // 5^-137
+  {0xbed77672fe226b05u, 0x17d12a4670c1228cu}, // 5^-138
+  {0xff12c528cb4ebc04u, 0x130dbb6b8d674ed6u}, // 5^-139
+  {0xcb513b74787df9a0u, 0x1e7c5f127bd87e24u}, // 5^-140
+  {0x090dc929f9fe614du, 0x18637f41fcad31b7u}, // 5^-141
+  {0xa0d7d42194cb810au, 0x1382cc34ca2427c5u}, // 5^-142
+  {0x67bfb9cf5478ce77u, 0x1f37ad21436d0c6fu}, // 5^-143
+  {0x1fcc94a5dd2d71f9u, 0x18f9574dcf8a7059u}, // 5^-144
+  {0x7fd6dd517dbdf4c7u, 0x13faac3e3fa1f37au}, // 5^-145
+  {0xffbe2ee8c92fee0bu, 0x1ff779fd329cb8c3u}, // 5^-146
+  {0x6631bf20a0f324d6u, 0x1992c7fdc216fa36u}, // 5^-147
+  {0xb827cc1a1a5c1d78u, 0x14756ccb01abfb5eu}, // 5^-148
+  {0x935309ae7b7ce460u, 0x105df0a267bcc918u}, // 5^-149
+  {0x1eeb42b0c594a099u, 0x1a2fe76a3f9474f4u}, // 5^-150
+  {0xe58902270476e6e1u, 0x14f31f8832dd2a5cu}, // 5^-151
+  {0xb7a0ce859d2bebe7u, 0x10c27fa028b0eeb0u}, // 5^-152
+  {0x59014a6f61dfdfd8u, 0x1ad0cc33744e4ab4u}, // 5^-153
+  {0xe0cdd525e7e64cadu, 0x1573d68f903ea229u}, // 5^-154
+  {0x4d7177518651d6f1u, 0x11297872d9cbb4eeu}, // 5^-155
+  {0x7be8bee8d6e957e8u, 0x1b758d848fac54b0u}, // 5^-156
+  {0xfcba3253df211320u, 0x15f7a46a0c89dd59u}, // 5^-157
+  {0x63c8284318e74280u, 0x1192e9ee706e4aaeu}, // 5^-158
+  {0x060d0d3827d86a66u, 0x1c1e43171a4a1117u}, // 5^-159
+  {0x6b3da42cecad21ebu, 0x167e9c127b6e7412u}, // 5^-160
+  {0x88fe1cf0bd574e56u, 0x11fee341fc585cdbu}, // 5^-161
+  {0x419694b462254a23u, 0x1ccb0536608d615fu}, // 5^-162
+  {0x67abaa29e81dd4e9u, 0x1708d0f84d3de77fu}, // 5^-163
+  {0xb95621bb2017dd87u, 0x126d73f9d764b932u}, // 5^-164
+  {0xc223692b668c95a5u, 0x1d7becc2f23ac1eau}, // 5^-165
+  {0xce82ba891ed6de1du, 0x179657025b6234bbu}, // 5^-166
+  {0xa53562074bdf1818u, 0x12deac01e2b4f6fcu}, // 5^-167
+  {0x3b889cd87964f359u, 0x1e3113363787f194u}, // 5^-168
+  {0xfc6d4a46c783f5e1u, 0x18274291c6065adcu}, // 5^-169
+  {0x30576e9f06032b1au, 0x13529ba7d19eaf17u}, // 5^-170
+  {0x1a257dcb3cd1de90u, 0x1eea92a61c311825u}, // 5^-171
+  {0x481dfe3c30a7e540u, 0x18bba884e35a79b7u}, // 5^-172
+  {0xd34b31c9c0865100u, 0x13c9539d82aec7c5u}, // 5^-173
+  {0x5211e942cda3b4cdu, 0x1fa885c8d117a609u}, // 5^-174
+  {0x74db21023e1c90a4u, 0x19539e3a40dfb807u}, // 5^-175
+  {0xf715b401cb4a0d50u, 0x1442e4fb67196005u}, // 5^-176
+  {0xf8de299b09080aa7u, 0x103583fc527ab337u}, // 5^-177
+  {0x8e304291a80cddd7u, 0x19ef3993b72ab859u}, // 5^-178
+  {0x3e8d020e200a4b13u, 0x14bf6142f8eef9e1u}, // 5^-179
+  {0x653d9b3e80083c0fu, 0x10991a9bfa58c7e7u}, // 5^-180
+  {0x6ec8f864000d2ce4u, 0x1a8e90f9908e0ca5u}, // 5^-181
+  {0x8bd3f9e999a423eau, 0x153eda614071a3b7u}, // 5^-182
+  {0x3ca994bae1501cbbu, 0x10ff151a99f482f9u}, // 5^-183
+  {0xc775bac49bb3612bu, 0x1b31bb5dc320d18eu}, // 5^-184
+  {0xd2c4956a16291a89u, 0x15c162b168e70e0bu}, // 5^-185
+  {0xdbd0778811ba7ba1u, 0x11678227871f3e6fu}, // 5^-186
+  {0x2c80bf401c5d929bu, 0x1bd8d03f3e9863e6u}, // 5^-187
+  {0xbd33cc3349e47549u, 0x16470cff6546b651u}, // 5^-188
+  {0xca8fd68f6e505dd4u, 0x11d270cc51055ea7u}, // 5^-189
+  {0x4419574be3b3c953u, 0x1c83e7ad4e6efdd9u}, // 5^-190
+  {0x0347790982f63aa9u, 0x16cfec8aa52597e1u}, // 5^-191
+  {0xcf6c60d468c4fbbau, 0x123ff06eea847980u}, // 5^-192
+  {0xe57a34870e07f92au, 0x1d331a4b10d3f59au}, // 5^-193
+  {0x512e906c0b399422u, 0x175c1508da432ae2u}, // 5^-194
+  {0xda8ba6bcd5c7a9b5u, 0x12b010d3e1cf5581u}, // 5^-195
+  {0x90df712e22d90f87u, 0x1de6815302e5559cu}, // 5^-196
+  {0xda4c5a8b4f140c6cu, 0x17eb9aa8cf1dde16u}, // 5^-197
+  {0xaea37ba2a5a9a38au, 0x1322e220a5b17e78u}, // 5^-198
+  {0x7dd25f6aa2a905a9u, 0x1e9e369aa2b59727u}, // 5^-199
+  {0x97db7f888220d154u, 0x187e92154ef7ac1fu}, // 5^-200
+  {0x797c6606ce80a777u, 0x139874ddd8c6234cu}, // 5^-201
+  {0x8f2d700ae4010bf1u, 0x1f5a549627a36badu}, // 5^-202
+  {0x0c2459a25000d65au, 0x191510781fb5efbeu}, // 5^-203
+  {0x701d1481d99a4515u, 0x1410d9f9b2f7f2feu}, // 5^-204
+  {0xc017439b147b6a77u, 0x100d7b2e28c65bfeu}, // 5^-205
+  {0xccf205c4ed9243f2u, 0x19af2b7d0e0a2ccau}, // 5^-206
+  {0x0a5b37d0be0e9cc2u, 0x148c22ca71a1bd6fu}, // 5^-207
+  {0x0848f973cb3ee3ceu, 0x10701bd527b4978cu}, // 5^-208
+  {0xda0e5bec78649fb0u, 0x1a4cf9550c5425acu}, // 5^-209
+  {0x7b3eaff060507fc0u, 0x150a6110d6a9b7bdu}, // 5^-210
+  {0x95cbbff380406633u, 0x10d51a73deee2c97u}, // 5^-211
+  {0xefac665266cd7052u, 0x1aee90b964b04758u}, // 5^-212
+  {0x2623850eb8a459dbu, 0x158ba6fab6f36c47u}, // 5^-213
+  {0x1e82d0d893b6ae49u, 0x113c85955f29236cu}, // 5^-214
+  {0xfd9e1af41f8ab075u, 0x1b9408eefea838acu}, // 5^-215
+  {0x97b1af29b2d559f7u, 0x16100725988693bdu}, // 5^-216
+  {0xac8e25baf5777b2cu, 0x11a66c1e139edc97u}, // 5^-217
+  {0x7a7d092b2258c513u, 0x1c3d79c9b8fe2dbfu}, // 5^-218
+  {0x61fda0ef4ead6a76u, 0x169794a160cb57ccu}, // 5^-219
+  {0xe7fe1a590bbdeec5u, 0x1212dd4de7091309u}, // 5^-220
+  {0xa6635d5b45fcb13au, 0x1ceafbafd80e84dcu}, // 5^-221
+  {0x851c4aaf6b308dc8u, 0x172262f3133ed0b0u}, // 5^-222
+  {0xd0e36ef2bc26d7d4u, 0x1281e8c275cbda26u}, // 5^-223
+  {0xb49f17eac6a48c86u, 0x1d9ca79d894629d7u}, // 5^-224
+  {0x2a18dfef0550706bu, 0x17b08617a104ee46u}, // 5^-225
+  {0x54e0b3259dd9f389u, 0x12f39e794d9d8b6bu}, // 5^-226
+  {0x87cdeb6f62f65274u, 0x1e5297287c2f4578u}, // 5^-227
+  {0xd30b22bf825ea85du, 0x18421286c9bf6ac6u}, // 5^-228
+  {0x0f3c1bcc684bb9e4u, 0x13680ed23aff889fu}, // 5^-229
+  {0x18602c7a4079296du, 0x1f0ce4839198da98u}, // 5^-230
+  {0x46b356c833942124u, 0x18d71d360e13e213u}, // 5^-231
+  {0x388f78a029434db6u, 0x13df4a91a4dcb4dcu}, // 5^-232
+  {0x5a7f2766a86baf8au, 0x1fcbaa82a1612160u}, // 5^-233
+  {0x153285ebb9efbfa2u, 0x196fbb9bb44db44du}, // 5^-234
+  {0xaa8ed189618c994eu, 0x145962e2f6a4903du}, // 5^-235
+  {0xeed8a7a11ad6e10cu, 0x1047824f2bb6d9cau}, // 5^-236
+  {0x7e27729b5e249b45u, 0x1a0c03b1df8af611u}, // 5^-237
+  {0xfe85f549181d4904u, 0x14d6695b193bf80du}, // 5^-238
+  {0xcb9e5dd4134aa0d0u, 0x10ab877c142ff9a4u}, // 5^-239
+  {0xdf63c9535211014du, 0x1aac0bf9b9e65c3au}, // 5^-240
+  {0x191ca10f74da6771u, 0x15566ffafb1eb02fu}, // 5^-241
+  {0xadb080d92a4852c1u, 0x1111f32f2f4bc025u}, // 5^-242
+  {0x15e7348eaa0d5134u, 0x1b4feb7eb212cd09u}, // 5^-243
+  {0xab1f5d3eee710dc4u, 0x15d98932280f0a6du}, // 5^-244
+  {0xbc1917658b8da49du, 0x117ad428200c0857u}, // 5^-245
+  {0x2cf4f23c127c3a94u, 0x1bf7b9d9cce00d59u}, // 5^-246
+  {0xf0c3f4fcdb969543u, 0x165fc7e170b33de0u}, // 5^-247
+  {0x5a365d9716121103u, 0x11e6398126f5cb1au}, // 5^-248
+  {0x9056fc24f01ce804u, 0x1ca38f350b22de90u}, // 5^-249
+  {0xd9df301d8ce3ecd0u, 0x16e93f5da2824ba6u}, // 5^-250
+  {0xe17f59b13d8323dau, 0x125432b14ecea2ebu}, // 5^-251
+  {0x68cbc2b52f38395cu, 0x1d53844ee47dd179u}, // 5^-252
+  {0x53d6355dbf602de3u, 0x177603725064a794u}, // 5^-253
+  {0xa9782ab165e68b1cu, 0x12c4cf8ea6b6ec76u}, // 5^-254
+  {0x0f26aab56fd744fau, 0x1e07b27dd78b13f1u}, // 5^-255
+  {0x3f52222abfdf6a62u, 0x18062864ac6f4327u}, // 5^-256
+  {0x65db4e88997f884eu, 0x1338205089f29c1fu}, // 5^-257
+  {0x6fc54a7428cc0d4au, 0x1ec033b40fea9365u}, // 5^-258
+  {0x596aa1f68709a43bu, 0x1899c2f673220f84u}, // 5^-259
+  {0xadeee7f86c07b696u, 0x13ae3591f5b4d936u}, // 5^-260
+  {0x497e3ff3e00c5756u, 0x1f7d228322baf524u}, // 5^-261
+  {0xd464fff64cd6ac45u, 0x1930e868e89590e9u}, // 5^-262
+  {0x4383fff83d7889d1u, 0x14272053ed4473eeu}, // 5^-263
+  {0xcf9cccc69793a174u, 0x101f4d0ff1038ff1u}, // 5^-264
+  {0x7f6147a425b90252u, 0x19cbae7fe805b31cu}, // 5^-265
+  {0xcc4dd2e9b7c7350fu, 0x14a2f1ffecd15c16u}, // 5^-266
+  {0x3d0b0f215fd290d9u, 0x10825b3323dab012u}, // 5^-267
+  {0x61ab4b689950e7c1u, 0x1a6a2b85062ab350u}, // 5^-268
+  {0x4e22a2ba1440b967u, 0x1521bc6a6b555c40u}, // 5^-269
+  {0x0b4ee894dd009453u, 0x10e7c9eebc4449cdu}, // 5^-270
+  {0x1217da87c800ed51u, 0x1b0c764ac6d3a948u}, // 5^-271
+  {0xdb46486ca000bddau, 0x15a391d56bdc876cu}, // 5^-272
+  {0x490506bd4ccd64afu, 0x114fa7ddefe39f8au}, // 5^-273
+  {0xa8080ac87ae23ab1u, 0x1bb2a62fe638ff43u}, // 5^-274
+  {0x5339a239fbe82ef4u, 0x162884f31e93ff69u}, // 5^-275
+  {0x75c7b4fb2fecf25du, 0x11ba03f5b20fff87u}, // 5^-276
+  {0x22d92191e647ea2eu, 0x1c5cd322b67fff3fu}, // 5^-277
+  {0xb57a8141850654f2u, 0x16b0a8e891ffff65u}, // 5^-278
+  {0xc4620101373843f5u, 0x1226ed86db3332b7u}, // 5^-279
+  {0x3a366801f1f39feeu, 0x1d0b15a491eb8459u}, // 5^-280
+  {0xfb5eb99b27f6198bu, 0x173c115074bc69e0u}, // 5^-281
+  {0x2f7efae2865e7ad6u, 0x129674405d6387e7u}, // 5^-282
+  {0xe597f7d0d6fd9156u, 0x1dbd86cd6238d971u}, // 5^-283
+  {0x8479930d78cadaabu, 0x17cad23de82d7ac1u}, // 5^-284
+  {0xd06142712d6f1556u, 0x1308a831868ac89au}, // 5^-285
+  {0x4d686a4eaf182222u, 0x1e74404f3daada91u}, // 5^-286
+  {0xa453883ef279b4e8u, 0x185d003f6488aedau}, // 5^-287
+  {0xe9dc6cff28615d87u, 0x137d99cc506d58aeu}, // 5^-288
+  {0xa960ae650d6895a4u, 0x1f2f5c7a1a488de4u}, // 5^-289
+  {0xbab3beb73ded4483u, 0x18f2b061aea07183u}, // 5^-290
+  {0x2ef6322c318a9d36u, 0x13f559e7bee6c136u}, // 5^-291
+  {0xe4bd1d13827761f0u, 0x1feef63f97d79b89u}, // 5^-292
+  {0x83ca7da9352c4e5au, 0x198bf832dfdfafa1u}, // 5^-293
+  {0x9ca1fe20f756a515u, 0x146ff9c24cb2f2e7u}, // 5^-294
+  {0x4a1b31b3f9121daau, 0x1059949b708f28b9u}, // 5^-295
+  {0x435eb5ecc1b695ddu, 0x1a28edc580e50df5u}, // 5^-296
+  {0x35e55e57015ede4au, 0x14ed8b04671da4c4u}, // 5^-297
+  {0xc4b77eac0118b1d5u, 0x10be08d0527e1d69u}, // 5^-298
+  {0xa12597799b5ab622u, 0x1ac9a7b3b7302f0fu}, // 5^-299
+  {0x4db7ac6149155e81u, 0x156e1fc2f8f358d9u}, // 5^-300
+  {0xd7c6238107444b9bu, 0x1124e63593f5e0adu}, // 5^-301
+  {0x593d059b3ed3ac2bu, 0x1b6e3d2286563449u}, // 5^-302
+  {0xe0fd9e15cbdc89bcu, 0x15f1ca820511c36du}, // 5^-303
+  {0xb3fe18116fe3a163u, 0x118e3b9b37416924u}, // 5^-304
+  {0x866359b57fd29bd1u, 0x1c16c5c525357507u}, // 5^-305
+  {0xd1e91491330ee30eu, 0x16789e3750f790d2u}, // 5^-306
+  {0x74ba76da8f3f1c0bu, 0x11fa182c40c60d75u}, // 5^-307
+  {0xedf72490e531c678u, 0x1cc359e067a348bbu}, // 5^-308
+  {0x8b2c1d40b75b052du, 0x1702ae4d1fb5d3c9u}, // 5^-309
+  {0x6f567dcd5f7c0424u, 0x12688b70e62b0fd4u}, // 5^-310
+  {0x7ef0c94898c66d06u, 0x1d74124e3d11b2edu}, // 5^-311
+  {0x98c0a106e09ebd9fu, 0x17900ea4fda7c257u}, // 5^-312
+  {0x470080d24d4bcae6u, 0x12d9a550caec9b79u}, // 5^-313
+  {0xd800ce1d487944a2u, 0x1e29088144adc58eu}, // 5^-314
+  {0x1333d8176d2dd082u, 0x1820d39a9d57d13fu}, // 5^-315
+  {0xa8f646792424a6ceu, 0x134d76154aaca765u}, // 5^-316
+  {0x74bd3d8ea03aa47du, 0x1ee25688777aa56fu}, // 5^-317
+  {0x5d64313ee6955064u, 0x18b51206c5fbb78cu}, // 5^-318
+  {0x4ab68dcbebaaa6b7u, 0x13c40e6bd1962c70u}, // 5^-319
+  {0x1124161312aaa457u, 0x1fa01712e8f0471au}, // 5^-320
+  {0xda8344dc0eeee9dfu, 0x194cdf4253f36c14u}, // 5^-321
+  {0xe2029d7cd8bf2180u, 0x143d7f6843292343u}, // 5^-322
+  {0x4e687dfd7a328133u, 0x103132b9cf541c36u}, // 5^-323
+  {0x4a40c9959050ceb8u, 0x19e851294bb9c6bdu}, // 5^-324
+  {0x0833d477a6a70bc6u, 0x14b9da876fc7d231u}, // 5^-325
+  {0xa02976c61eec096bu, 0x1094aed2bfd30e8du}, // 5^-326
+  {0x004257a364acdbdfu, 0x1a877e1dffb81749u}, // 5^-327
+  {0xcd01dfb5ea23e319u, 0x153931b1996012a0u}, // 5^-328
+  {0x70ce4c91881cb5aeu, 0x10fa8e27ade6754du}, // 5^-329
+  {0x1ae3adb5a69455e2u, 0x1b2a7d0c4970bbafu}, // 5^-330
+  {0x7be957c4854377e8u, 0x15bb973d078d62f2u}, // 5^-331
+  {0xc987796a0435f987u, 0x1162df64060ab58eu}, // 5^-332
+  {0x75a58f1006bcc271u, 0x1bd1656cd67788e4u}, // 5^-333
+  {0xf7b7a5a66bca3527u, 0x16411df0ab92d3e9u}, // 5^-334
+  {0x5fc61e1ebca1c41fu, 0x11cdb18d560f0feeu}, // 5^-335
+  {0xffa363646102d365u, 0x1c7c4f4889b1b316u}, // 5^-336
+  {0x32e91c504d9bdc51u, 0x16c9d906d48e28dfu}, // 5^-337
+  {0x8f20e37371497d0eu, 0x123b140576d820b2u}, // 5^-338
+  {0x7e9b0585820f2e7cu, 0x1d2b533bf159cdeau}, // 5^-339
+  {0xcbaf379e01a5becau, 0x1755dc2ff447d7eeu}, // 5^-340
+  {0x0958f94b348498a1u, 0x12ab168cc36cacbfu}, // 5^-341
+};
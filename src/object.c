@@ -6,76 +6,238 @@
 #include "memory.h"
 #include "value.h"
 #include "vm.h"
+#include "table.h"
 
 // file local prototypes
-static void object_free_object(struct Object *object);
 static uint32_t hash_cstr(const char *key, size_t length);
+static void write_string(struct Output *output, struct ObjectString *string);
+static void intern_string(struct VM *vm, struct ObjectString *string);
+static struct ObjectString *intern_new_string(struct VM *vm, struct ObjectString *string);
+static struct Object *flat_or_self(struct Object *object);
+#ifdef OBJECT_ROPES
+static size_t rope_depth(struct Object *object);
+#endif
+static void copy_rope(struct Object *object, char *end);
+static void *allocate_object_memory(struct VM *vm, size_t size);
+static void release_object_memory(struct VM *vm, void *object, size_t size);
 
-struct ObjectString *object_object_string_from_parts(const char *buffer, size_t length) {
-  struct ObjectString *new_string = object_object_string_allocate(length);
+// every string lives in vm->strings, so equal strings are always the
+// same object and can be compared by pointer
+struct ObjectString *object_object_string_from_parts(struct VM *vm, const char *buffer, size_t length) {
+  uint32_t hash = hash_cstr(buffer, length);
+  struct ObjectString *interned = table_find_string(&vm->strings, buffer, length, hash);
+  if (interned != NULL) {
+    // the string and its copy of the bytes were never allocated
+    vm->interned_bytes_saved += sizeof(struct ObjectString) + length + 1;
+    return interned;
+  }
+
+  struct ObjectString *new_string = object_object_string_allocate(vm, length);
   memcpy(new_string->buffer, buffer, length);
   new_string->buffer[length] = '\0';
-  object_object_string_update_hash(new_string);
+  new_string->hash = hash;
+  intern_string(vm, new_string);
   return new_string;
 }
 
-struct ObjectString *object_object_string_copy(struct ObjectString *string) {
-  struct ObjectString *new_string = object_object_string_allocate(string->length);
-  memcpy(new_string->buffer, string->buffer, string->length);
-  new_string->buffer[string->length] = '\0';
-  object_object_string_update_hash(new_string);
-  return new_string;
+// a string that keeps its bytes where they already are, for literals of a
+// program that outlives them. hash was computed when the bytes were written,
+// so they are not even read unless a string with the same hash is interned.
+// whoever owns the bytes must detach every string borrowing them before
+// letting them go
+struct ObjectString *object_object_string_borrow(struct VM *vm, const char *chars, size_t length, uint32_t hash) {
+  struct ObjectString *interned = table_find_string(&vm->strings, chars, length, hash);
+  if (interned != NULL) {
+    // a borrowed string would not have copied its bytes
+    vm->interned_bytes_saved += sizeof(struct ObjectString);
+    return interned;
+  }
+
+  struct ObjectString *string = (struct ObjectString *) object_allocate_object(vm, sizeof(struct ObjectString), OBJECT_TYPE_STRING);
+  string->length = length;
+  string->hash = hash;
+  string->is_borrowed = TRUE;
+  string->chars = chars;
+  intern_string(vm, string);
+  return string;
+}
+
+// give a borrowed string a copy of its bytes, the string object itself stays
+// put since any number of values may point at it
+void object_object_string_detach(struct VM *vm, struct ObjectString *string) {
+  assert(string->is_borrowed);
+
+  // the copy may start a collection, and string need not be reachable
+  vm_push(vm, VALUE_OBJECT(string));
+  char *chars = (char *) allocate_object_memory(vm, string->length + 1);
+  vm_pop(vm);
+
+  memcpy(chars, string->chars, string->length);
+  chars[string->length] = '\0';
+  string->chars = chars;
+  string->is_borrowed = FALSE;
+}
+
+// strings are immutable and interned, a copy is the string itself
+struct ObjectString *object_object_string_copy(struct VM *vm, struct ObjectString *string) {
+  (void) vm;
+  return string;
+}
+
+struct ObjectString *object_object_string_concatenate(struct VM *vm, struct ObjectString *a, struct ObjectString *b) {
+  size_t length = a->length + b->length;
+
+  // call to object_allocate_object adds new node to allocation list
+  struct ObjectString *result = object_object_string_allocate(vm, length);
+
+  memcpy(result->buffer, a->chars, a->length);
+  memcpy(result->buffer + a->length, b->chars, b->length);
+  result->buffer[length] = '\0';
+  object_object_string_update_hash(result);
+  return intern_new_string(vm, result);
+}
+
+// join count string values in one allocation, one copy pass and one hash,
+// rather than building every intermediate string of a + b + c + ... the
+// caller keeps the parts reachable, they are read after the allocation
+struct ObjectString *object_object_string_concatenate_n(struct VM *vm, const struct Value *parts, size_t count) {
+  size_t length = 0;
+  for (size_t i = 0; i < count; ++i) {
+    length += OBJECT_STRING_FROM_VALUE(parts[i])->length;
+  }
+
+  struct ObjectString *result = object_object_string_allocate(vm, length);
+
+  char *cursor = result->buffer;
+  for (size_t i = 0; i < count; ++i) {
+    struct ObjectString *part = OBJECT_STRING_FROM_VALUE(parts[i]);
+    memcpy(cursor, part->chars, part->length);
+    cursor += part->length;
+  }
+  *cursor = '\0';
+  object_object_string_update_hash(result);
+  return intern_new_string(vm, result);
+}
+
+// a + b for strings or ropes, the caller keeps both reachable. short results
+// are copied and interned straight away, longer ones become a rope and are
+// only copied once something needs their bytes
+struct Object *object_object_string_join(struct VM *vm, struct Object *a, struct Object *b) {
+  a = flat_or_self(a);
+  b = flat_or_self(b);
+
+#ifdef OBJECT_ROPES
+  size_t length = object_string_length(a) + object_string_length(b);
+  if (length >= OBJECT_ROPE_MIN_LENGTH) {
+    // keep the recursion of copy_rope bounded
+    if (rope_depth(b) >= OBJECT_ROPE_MAX_DEPTH) {
+      b = &object_object_rope_flatten(vm, OBJECT_ROPE_FROM_OBJECT(b))->object;
+    }
+
+    struct ObjectRope *rope = (struct ObjectRope *) object_allocate_object(vm, sizeof(struct ObjectRope), OBJECT_TYPE_ROPE);
+    rope->length = length;
+    rope->depth = rope_depth(a) > rope_depth(b) + 1 ? rope_depth(a) : rope_depth(b) + 1;
+    rope->left = a;
+    rope->right = b;
+    rope->flat = NULL;
+    vm->rope_count += 1;
+    return &rope->object;
+  }
+#endif
+
+  // every rope is at least OBJECT_ROPE_MIN_LENGTH long, so these are strings
+  assert(a->type == OBJECT_TYPE_STRING && b->type == OBJECT_TYPE_STRING);
+  return &object_object_string_concatenate(vm, OBJECT_STRING_FROM_OBJECT(a), OBJECT_STRING_FROM_OBJECT(b))->object;
+}
+
+// copy a rope into one interned string, hashed only now. the rope must be
+// reachable, it keeps the string so later calls cost nothing
+struct ObjectString *object_object_rope_flatten(struct VM *vm, struct ObjectRope *rope) {
+  if (rope->flat != NULL) return rope->flat;
+
+  struct ObjectString *string = object_object_string_allocate(vm, rope->length);
+  copy_rope(&rope->object, string->buffer + rope->length);
+  string->buffer[rope->length] = '\0';
+  object_object_string_update_hash(string);
+
+  rope->flat = intern_new_string(vm, string);
+  rope->left = NULL;
+  rope->right = NULL;
+  vm->flattened_rope_count += 1;
+  return rope->flat;
 }
 
 // allocate a single sized buffer with 
-struct ObjectString *object_object_string_allocate(size_t length) {
-  struct ObjectString *string = (struct ObjectString *) object_allocate_object(sizeof(struct ObjectString) + length + 1, OBJECT_TYPE_STRING);
+struct ObjectString *object_object_string_allocate(struct VM *vm, size_t length) {
+  struct ObjectString *string = (struct ObjectString *) object_allocate_object(vm, sizeof(struct ObjectString) + length + 1, OBJECT_TYPE_STRING);
   string->length = length;
+  string->is_borrowed = FALSE;
+  string->chars = string->buffer;
   return string;
 }
 
-struct Object *object_allocate_object(size_t size, enum ObjectType type) {
-  struct Object *object = memory_reallocate(NULL, 0, size);
+struct Object *object_allocate_object(struct VM *vm, size_t size, enum ObjectType type) {
+  struct Object *object = (struct Object *) allocate_object_memory(vm, size);
   object->type = type;
+  object->is_marked = FALSE;
 
   // insert head
-  object->next = global_vm.objects;
-  global_vm.objects = object;
+  object->next = vm->objects;
+  vm->objects = object;
 
   return object;
 }
 
 void object_object_string_update_hash(struct ObjectString *string) {
-  string->hash = hash_cstr(string->buffer, string->length);
+  string->hash = hash_cstr(string->chars, string->length);
+}
+
+void object_free_object(struct VM *vm, struct Object *object) {
+  switch (object->type) {
+    case OBJECT_TYPE_STRING: {
+      struct ObjectString *string = OBJECT_STRING_FROM_OBJECT(object);
+      if (string->chars == string->buffer) {
+        release_object_memory(vm, string, sizeof(struct ObjectString) + string->length + 1);
+        break;
+      }
+
+      // borrowed bytes are left alone, detached ones were allocated separately
+      if (!string->is_borrowed) release_object_memory(vm, (void *) string->chars, string->length + 1);
+      release_object_memory(vm, string, sizeof(struct ObjectString));
+      break;
+    }
+    case OBJECT_TYPE_ROPE: release_object_memory(vm, object, sizeof(struct ObjectRope)); break;
+  }
 }
 
-void object_free_objects(void) {
-  struct Object *object = global_vm.objects;
+void object_free_objects(struct VM *vm) {
+#ifdef OBJECT_ARENA
+  // every object lives in the arena, drop its pages instead of walking the list
+  arena_free(vm, &vm->object_arena);
+  vm->objects = NULL;
+#else
+  struct Object *object = vm->objects;
   while (object != NULL) {
     struct Object *next = object->next;
-    object_free_object(object);
+    object_free_object(vm, object);
     object = next;
   }
+#endif
 }
 
-void object_print(struct Value value) {
+void object_write(struct Output *output, struct Value value) {
   switch (OBJECT_TYPE(value)) {
-    case OBJECT_TYPE_STRING: printf("%s", OBJECT_STRING_CSTR_FROM_VALUE(value)); break;
+    case OBJECT_TYPE_STRING: write_string(output, OBJECT_STRING_FROM_VALUE(value)); break;
+    case OBJECT_TYPE_ROPE: {
+      // vm_run flattens a rope before printing it
+      assert(OBJECT_ROPE_FROM_VALUE(value)->flat != NULL);
+      write_string(output, OBJECT_ROPE_FROM_VALUE(value)->flat);
+    } break;
   }
 }
 
 // file local functions
 
-static void object_free_object(struct Object *object) {
-  switch (object->type) {
-    case OBJECT_TYPE_STRING: {
-      struct ObjectString *string = OBJECT_STRING_FROM_OBJECT(object);
-      memory_reallocate(string, sizeof(struct ObjectString) + string->length + 1, 0);
-      break;
-    }
-  }
-}
-
 static uint32_t hash_cstr(const char *key, size_t length) {
   uint32_t hash = 2166136261u;
   for (size_t i = 0; i < length; ++i) {
@@ -83,4 +245,78 @@ static uint32_t hash_cstr(const char *key, size_t length) {
     hash *= 16777619;
   }
   return hash;
-}
\ No newline at end of file
+}
+
+// borrowed bytes have no terminator, so the length decides
+static void write_string(struct Output *output, struct ObjectString *string) {
+  output_write(output, string->chars, string->length);
+}
+
+static void intern_string(struct VM *vm, struct ObjectString *string) {
+  // the table may grow, keep the new string reachable meanwhile
+  vm_push(vm, VALUE_OBJECT(string));
+  table_set(vm, &vm->strings, string, VALUE_NIL());
+  vm_pop(vm);
+  vm->interned_string_count += 1;
+}
+
+// string must be the most recent allocation, it is dropped again when an
+// equal string is already interned
+static struct ObjectString *intern_new_string(struct VM *vm, struct ObjectString *string) {
+  struct ObjectString *interned = table_find_string(&vm->strings, string->chars, string->length, string->hash);
+  if (interned != NULL) {
+    // string is still the head of the allocation list, unlink and drop it
+    vm->objects = string->object.next;
+    object_free_object(vm, &string->object);
+    return interned;
+  }
+
+  intern_string(vm, string);
+  return string;
+}
+
+// a flattened rope stands for its string, which lets its children go
+static struct Object *flat_or_self(struct Object *object) {
+  if (object->type == OBJECT_TYPE_ROPE && OBJECT_ROPE_FROM_OBJECT(object)->flat != NULL) {
+    return &OBJECT_ROPE_FROM_OBJECT(object)->flat->object;
+  }
+  return object;
+}
+
+#ifdef OBJECT_ROPES
+static size_t rope_depth(struct Object *object) {
+  return object->type == OBJECT_TYPE_ROPE ? OBJECT_ROPE_FROM_OBJECT(object)->depth : 0;
+}
+#endif
+
+// write the bytes of a string or rope so they end right before end. right
+// children are copied recursively and left children in a loop, so long
+// chains of appends, which nest to the left, take no stack
+static void copy_rope(struct Object *object, char *end) {
+  object = flat_or_self(object);
+  while (object->type == OBJECT_TYPE_ROPE) {
+    struct ObjectRope *rope = OBJECT_ROPE_FROM_OBJECT(object);
+    copy_rope(rope->right, end);
+    end -= object_string_length(rope->right);
+    object = flat_or_self(rope->left);
+  }
+
+  struct ObjectString *string = OBJECT_STRING_FROM_OBJECT(object);
+  memcpy(end - string->length, string->chars, string->length);
+}
+
+static void *allocate_object_memory(struct VM *vm, size_t size) {
+#ifdef OBJECT_ARENA
+  return arena_allocate(vm, &vm->object_arena, size);
+#else
+  return memory_reallocate(vm, NULL, 0, size, MEMORY_TAG_OBJECT);
+#endif
+}
+
+static void release_object_memory(struct VM *vm, void *object, size_t size) {
+#ifdef OBJECT_ARENA
+  arena_release(vm, &vm->object_arena, object, size);
+#else
+  memory_reallocate(vm, object, size, 0, MEMORY_TAG_OBJECT);
+#endif
+}
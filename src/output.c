@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include "output.h"
+
+// file local prototypes
+static uint8_t file_write(void *context, const char *bytes, size_t length);
+
+void output_init(struct Output *output, struct OutputSink sink, enum OutputFlush flush) {
+  output->sink = sink;
+  output->flush = flush;
+  output->length = 0;
+}
+
+uint8_t output_flush(struct Output *output) {
+  if (output->length == 0) return TRUE;
+
+  size_t length = output->length;
+  output->length = 0;
+  return output->sink.write(output->sink.context, output->buffer, length);
+}
+
+void output_write(struct Output *output, const char *bytes, size_t length) {
+  if (output->length + length <= OUTPUT_BUFFER_SIZE) {
+    memcpy(output->buffer + output->length, bytes, length);
+    output->length += length;
+    return;
+  }
+
+  output_flush(output);
+
+  // anything a whole buffer long would only be copied to be flushed again
+  if (length >= OUTPUT_BUFFER_SIZE) {
+    output->sink.write(output->sink.context, bytes, length);
+    return;
+  }
+
+  memcpy(output->buffer, bytes, length);
+  output->length = length;
+}
+
+void output_end_result(struct Output *output) {
+  if (output->length == OUTPUT_BUFFER_SIZE) output_flush(output);
+  output->buffer[output->length++] = '\n';
+
+  if (output->flush == OUTPUT_FLUSH_RESULT) output_flush(output);
+}
+
+struct OutputSink output_file_sink(FILE *file) {
+  return (struct OutputSink) {file_write, file};
+}
+
+// file local functions
+
+// the file is flushed as well, output stays in order with anything else
+// written to it
+static uint8_t file_write(void *context, const char *bytes, size_t length) {
+  FILE *file = (FILE *) context;
+  size_t written = fwrite(bytes, 1, length, file);
+  return fflush(file) == 0 && written == length;
+}
@@ -0,0 +1,196 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "peephole.h"
+#include "opcode.h"
+#include "memory.h"
+
+// one decoded instruction, operand bytes are kept as encoded
+struct Instruction {
+  uint8_t opcode;
+  uint8_t operands[3];
+  size_t line;
+  size_t column;
+};
+
+// file local prototypes
+static size_t decode_instructions(struct Chunk *chunk, struct Instruction *instructions);
+static void encode_instructions(struct VM *vm, struct Chunk *chunk, struct Instruction *instructions, size_t instruction_count);
+static uint8_t fuse(struct Instruction *first, struct Instruction *second, struct Instruction *out);
+static uint8_t fuse_constant(uint8_t opcode);
+static uint8_t fuse_immediate(uint8_t opcode);
+static uint8_t fuse_not(uint8_t opcode);
+
+// rewrite common instruction pairs of a finished chunk into superinstructions,
+// repeating until nothing else fuses, and return how many instructions were
+// removed. the chunk is straight-line code (there are no jumps yet), so
+// instructions can be merged without patching any branch offsets
+size_t peephole_optimize(struct VM *vm, struct Chunk *chunk) {
+  if (chunk->byte_count == 0) return 0;
+
+  // every instruction is at least one byte
+  size_t capacity = chunk->byte_count;
+  struct Instruction *instructions = MEMORY_ALLOCATE(vm, struct Instruction, capacity, MEMORY_TAG_SCRATCH);
+  size_t initial_count = decode_instructions(chunk, instructions);
+  size_t count = initial_count;
+
+  for (uint8_t changed = TRUE; changed;) {
+    changed = FALSE;
+
+    size_t written = 0;
+    for (size_t i = 0; i < count;) {
+      if (i + 1 < count && fuse(&instructions[i], &instructions[i + 1], &instructions[written])) {
+        changed = TRUE;
+        i += 2;
+      } else {
+        instructions[written] = instructions[i];
+        i += 1;
+      }
+      written += 1;
+    }
+
+    count = written;
+  }
+
+  if (count < initial_count) {
+    encode_instructions(vm, chunk, instructions, count);
+  }
+
+  MEMORY_FREE_ARRAY(vm, struct Instruction, instructions, capacity, MEMORY_TAG_SCRATCH);
+  return initial_count - count;
+}
+
+// file local functions
+
+static size_t decode_instructions(struct Chunk *chunk, struct Instruction *instructions) {
+  size_t count = 0;
+
+  // walk the line runs alongside the bytecode rather than searching them
+  // for every instruction
+  struct LineCursor cursor;
+  line_cursor_init(&cursor, &chunk->lines);
+
+  for (size_t offset = 0; offset < chunk->byte_count;) {
+    struct LinePosition position = line_cursor_advance(&cursor, offset);
+
+    struct Instruction *instruction = &instructions[count];
+    instruction->opcode = chunk->buffer[offset];
+    instruction->line = position.line;
+    instruction->column = position.column;
+
+    size_t size = opcode_size(instruction->opcode);
+    assert(offset + size <= chunk->byte_count);
+    memset(instruction->operands, 0, sizeof(instruction->operands));
+    memcpy(instruction->operands, chunk->buffer + offset + 1, size - 1);
+
+    offset += size;
+    count += 1;
+  }
+
+  return count;
+}
+
+// re-emit the bytecode and its line information, the constant pool is
+// untouched since fused instructions keep their constant index operand
+static void encode_instructions(struct VM *vm, struct Chunk *chunk, struct Instruction *instructions, size_t instruction_count) {
+  struct Chunk optimized;
+  chunk_init(&optimized);
+
+  for (size_t i = 0; i < instruction_count; ++i) {
+    struct Instruction *instruction = &instructions[i];
+    chunk_write(vm, &optimized, instruction->opcode, instruction->line, instruction->column);
+
+    size_t size = opcode_size(instruction->opcode);
+    for (size_t j = 1; j < size; ++j) {
+      chunk_write(vm, &optimized, instruction->operands[j - 1], instruction->line, instruction->column);
+    }
+  }
+
+  // hand the constant pool over before releasing the old bytecode
+  optimized.constants = chunk->constants;
+  value_array_init(&chunk->constants);
+  chunk_free(vm, chunk);
+
+  *chunk = optimized;
+}
+
+// a fused instruction takes the operands of the first instruction and the
+// position of the one that can fail, which is where vm_run reports any
+// runtime error raised by the pair
+static uint8_t fuse(struct Instruction *first, struct Instruction *second, struct Instruction *out) {
+  uint8_t opcode = OPCODE_COUNT;
+  struct Instruction *failing = first;
+
+  if (first->opcode == OPCODE_CONSTANT) {
+    opcode = fuse_constant(second->opcode);
+    failing = second;
+  } else if (first->opcode == OPCODE_NUMBER_BYTE) {
+    opcode = fuse_immediate(second->opcode);
+    failing = second;
+  } else if (second->opcode == OPCODE_NOT) {
+    opcode = fuse_not(first->opcode);
+  }
+
+  if (opcode == OPCODE_COUNT) return FALSE;
+
+  size_t line = failing->line;
+  size_t column = failing->column;
+  *out = *first;
+  out->opcode = opcode;
+  out->line = line;
+  out->column = column;
+  return TRUE;
+}
+
+// OPCODE_CONSTANT k, op -> op against constant k
+static uint8_t fuse_constant(uint8_t opcode) {
+  switch (opcode) {
+    case OPCODE_ADD:           return OPCODE_ADD_CONSTANT;
+    case OPCODE_SUBTRACT:      return OPCODE_SUBTRACT_CONSTANT;
+    case OPCODE_MULTIPLY:      return OPCODE_MULTIPLY_CONSTANT;
+    case OPCODE_DIVIDE:        return OPCODE_DIVIDE_CONSTANT;
+    case OPCODE_GREATER:       return OPCODE_GREATER_CONSTANT;
+    case OPCODE_GREATER_EQUAL: return OPCODE_GREATER_EQUAL_CONSTANT;
+    case OPCODE_LESS:          return OPCODE_LESS_CONSTANT;
+    case OPCODE_LESS_EQUAL:    return OPCODE_LESS_EQUAL_CONSTANT;
+    case OPCODE_EQUAL_EQUAL:   return OPCODE_EQUAL_CONSTANT;
+    case OPCODE_BANG_EQUAL:    return OPCODE_BANG_EQUAL_CONSTANT;
+    default:                   return OPCODE_COUNT;
+  }
+}
+
+// OPCODE_NUMBER_BYTE n, op -> op against immediate n
+static uint8_t fuse_immediate(uint8_t opcode) {
+  switch (opcode) {
+    case OPCODE_ADD:           return OPCODE_ADD_IMMEDIATE;
+    case OPCODE_SUBTRACT:      return OPCODE_SUBTRACT_IMMEDIATE;
+    case OPCODE_MULTIPLY:      return OPCODE_MULTIPLY_IMMEDIATE;
+    case OPCODE_DIVIDE:        return OPCODE_DIVIDE_IMMEDIATE;
+    case OPCODE_GREATER:       return OPCODE_GREATER_IMMEDIATE;
+    case OPCODE_GREATER_EQUAL: return OPCODE_GREATER_EQUAL_IMMEDIATE;
+    case OPCODE_LESS:          return OPCODE_LESS_IMMEDIATE;
+    case OPCODE_LESS_EQUAL:    return OPCODE_LESS_EQUAL_IMMEDIATE;
+    case OPCODE_EQUAL_EQUAL:   return OPCODE_EQUAL_IMMEDIATE;
+    case OPCODE_BANG_EQUAL:    return OPCODE_BANG_EQUAL_IMMEDIATE;
+    default:                   return OPCODE_COUNT;
+  }
+}
+
+// op, OPCODE_NOT -> negated op. comparisons get their own negated forms
+// because !(a < b) is not a >= b once NaN is involved
+static uint8_t fuse_not(uint8_t opcode) {
+  switch (opcode) {
+    case OPCODE_EQUAL_EQUAL:              return OPCODE_BANG_EQUAL;
+    case OPCODE_BANG_EQUAL:               return OPCODE_EQUAL_EQUAL;
+    case OPCODE_EQUAL_CONSTANT:           return OPCODE_BANG_EQUAL_CONSTANT;
+    case OPCODE_BANG_EQUAL_CONSTANT:      return OPCODE_EQUAL_CONSTANT;
+    case OPCODE_EQUAL_IMMEDIATE:          return OPCODE_BANG_EQUAL_IMMEDIATE;
+    case OPCODE_BANG_EQUAL_IMMEDIATE:     return OPCODE_EQUAL_IMMEDIATE;
+    case OPCODE_GREATER:                  return OPCODE_NOT_GREATER;
+    case OPCODE_GREATER_EQUAL:            return OPCODE_NOT_GREATER_EQUAL;
+    case OPCODE_LESS:                     return OPCODE_NOT_LESS;
+    case OPCODE_LESS_EQUAL:               return OPCODE_NOT_LESS_EQUAL;
+    default:                              return OPCODE_COUNT;
+  }
+}
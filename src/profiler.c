@@ -0,0 +1,88 @@
+
+#include "profiler.h"
+
+// file local prototypes
+static void *profiler_reallocate(void *context, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag);
+static void record(struct Profiler *profiler, size_t old_size, size_t new_size, enum MemoryTag tag);
+static size_t histogram_bucket(size_t size);
+
+// inner is the allocator requests are forwarded to, NULL for the default
+void profiler_init(struct Profiler *profiler, const struct Allocator *inner) {
+  *profiler = (struct Profiler) {0};
+  profiler->inner = inner != NULL ? *inner : memory_default_allocator();
+}
+
+struct Allocator profiler_allocator(struct Profiler *profiler) {
+  return (struct Allocator) {profiler_reallocate, profiler};
+}
+
+// print what the profiler behind allocator has seen so far, returns FALSE
+// if allocator is not a profiler
+uint8_t profiler_report(const struct Allocator *allocator, FILE *out) {
+  if (allocator->reallocate != profiler_reallocate) return FALSE;
+  struct Profiler *profiler = (struct Profiler *) allocator->context;
+
+  fprintf(out, "== memory profile ==\n");
+  fprintf(out, "%-15s %12s %12s %9s %9s %9s\n", "tag", "live bytes", "peak bytes", "allocs", "reallocs", "frees");
+  for (size_t i = 0; i < MEMORY_TAG_COUNT; ++i) {
+    struct TagProfile *tag = &profiler->tags[i];
+    fprintf(out, "%-15s %12lu %12lu %9lu %9lu %9lu\n", memory_tag_name((enum MemoryTag) i),
+            tag->live_bytes, tag->peak_bytes, tag->allocation_count, tag->reallocation_count, tag->free_count);
+  }
+  fprintf(out, "%-15s %12lu %12lu\n", "total", profiler->live_bytes, profiler->peak_bytes);
+
+  fprintf(out, "\n== request sizes ==\n");
+  for (size_t i = 0; i < MEMORY_TAG_COUNT; ++i) {
+    struct TagProfile *tag = &profiler->tags[i];
+    if (tag->allocation_count + tag->reallocation_count == 0) continue;
+
+    fprintf(out, "%s:", memory_tag_name((enum MemoryTag) i));
+    for (size_t bucket = 0; bucket < PROFILER_HISTOGRAM_BUCKETS; ++bucket) {
+      if (tag->histogram[bucket] == 0) continue;
+
+      size_t limit = (size_t) 1 << (bucket + PROFILER_SMALLEST_BUCKET_SHIFT);
+      if (bucket + 1 < PROFILER_HISTOGRAM_BUCKETS) fprintf(out, "  <=%lu: %lu", limit, tag->histogram[bucket]);
+      else                                         fprintf(out, "  >%lu: %lu", limit / 2, tag->histogram[bucket]);
+    }
+    fprintf(out, "\n");
+  }
+
+  return TRUE;
+}
+
+// file local functions
+
+static void *profiler_reallocate(void *context, void *buffer, size_t old_size, size_t new_size, enum MemoryTag tag) {
+  struct Profiler *profiler = (struct Profiler *) context;
+
+  void *result = profiler->inner.reallocate(profiler->inner.context, buffer, old_size, new_size, tag);
+  // a failed request changes nothing
+  if (new_size == 0 || result != NULL) record(profiler, old_size, new_size, tag);
+
+  return result;
+}
+
+static void record(struct Profiler *profiler, size_t old_size, size_t new_size, enum MemoryTag tag) {
+  struct TagProfile *profile = &profiler->tags[tag];
+
+  if (old_size == 0 && new_size == 0) return; // freeing an empty array
+  if      (old_size == 0) profile->allocation_count += 1;
+  else if (new_size == 0) profile->free_count += 1;
+  else                    profile->reallocation_count += 1;
+
+  if (new_size > 0) profile->histogram[histogram_bucket(new_size)] += 1;
+
+  profile->live_bytes += new_size - old_size;
+  profiler->live_bytes += new_size - old_size;
+  if (profile->live_bytes > profile->peak_bytes)   profile->peak_bytes = profile->live_bytes;
+  if (profiler->live_bytes > profiler->peak_bytes) profiler->peak_bytes = profiler->live_bytes;
+}
+
+static size_t histogram_bucket(size_t size) {
+  size_t bucket = 0;
+  while (bucket + 1 < PROFILER_HISTOGRAM_BUCKETS &&
+         size > ((size_t) 1 << (bucket + PROFILER_SMALLEST_BUCKET_SHIFT))) {
+    bucket += 1;
+  }
+  return bucket;
+}
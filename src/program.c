@@ -0,0 +1,546 @@
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "program.h"
+#include "compiler.h"
+#include "object.h"
+#include "opcode.h"
+#include "memory.h"
+#include "gc.h"
+
+// sections start on this boundary so they can be used in place
+#define PROGRAM_FILE_ALIGNMENT 16
+
+#ifdef VALUE_NAN_BOXING
+#define PROGRAM_FILE_FLAG_NAN_BOXING 1
+#else
+#define PROGRAM_FILE_FLAG_NAN_BOXING 0
+#endif
+
+// on-disk layout, every section PROGRAM_FILE_ALIGNMENT aligned:
+//   header
+//   bytecode
+//   constant pool, struct Value as in memory, string constants stored as nil
+//   line runs, struct Line as in memory
+//   column changes of the line runs
+//   string table, one ProgramFileString per string constant
+//   string bytes
+//   source bytes, only when program_write was given the source
+// values and lines are written in the host's layout, so a file only loads on
+// a build with the same value representation and word size
+struct ProgramFileHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t flags;
+  uint32_t value_size;
+  uint32_t line_size;
+  uint32_t reserved;
+  uint64_t byte_offset;
+  uint64_t byte_count;
+  uint64_t constant_offset;
+  uint64_t constant_count;
+  uint64_t line_offset;
+  uint64_t line_count;
+  uint64_t column_offset;
+  uint64_t column_count;
+  uint64_t string_offset;
+  uint64_t string_count;
+  uint64_t source_offset; // source the program was compiled from, if written
+  uint64_t source_length; // with it
+  uint64_t checksum; // program_hash of everything after the header
+};
+
+struct ProgramFileString {
+  uint64_t constant_index;
+  uint64_t offset; // of the bytes, from the start of the file
+  uint64_t length;
+  uint32_t hash; // of the bytes as interned, so loading never reads them
+  uint32_t reserved;
+};
+
+// file local prototypes
+static void link_program(struct VM *vm, struct Program *program);
+static void unlink_program(struct VM *vm, struct Program *program);
+static void materialize_strings(struct VM *vm, struct Program *program);
+static void detach_strings(struct VM *vm, struct Program *program);
+static void release_program(struct VM *vm, struct Program *program);
+static uint8_t validate_file(const uint8_t *file, size_t file_size);
+static uint8_t validate_instruction(const uint8_t *instruction, uint64_t constant_count, size_t *depth);
+static uint8_t section_in_file(uint64_t offset, uint64_t count, size_t element_size, size_t file_size);
+static size_t align_up(size_t position);
+
+struct Program *program_compile(struct VM *vm, const char *source) {
+  struct Program *program = MEMORY_ALLOCATE(vm, struct Program, 1, MEMORY_TAG_CHUNK_BYTECODE);
+  *program = (struct Program) {0};
+  chunk_init(&program->chunk);
+
+  // the compiler roots the chunk's constants until it returns, the vm's
+  // program list does from then on
+  if (!compiler_compile(vm, source, &program->chunk)) {
+    release_program(vm, program);
+    return NULL;
+  }
+
+  link_program(vm, program);
+  return program;
+}
+
+// map the file privately and run its bytecode, number constants and line runs
+// where they lie. pages are only copied once quickening writes to them
+struct Program *program_load(struct VM *vm, const char *file_path) {
+  int fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    fprintf(vm->err, "Error - could not open file \"%s\".\n", file_path);
+    return NULL;
+  }
+
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+    fprintf(vm->err, "Error - could not read file \"%s\".\n", file_path);
+    close(fd);
+    return NULL;
+  }
+
+  size_t file_size = (size_t) file_stat.st_size;
+  void *mapping = mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    fprintf(vm->err, "Error - could not map file \"%s\".\n", file_path);
+    return NULL;
+  }
+
+  if (!validate_file((const uint8_t *) mapping, file_size)) {
+    fprintf(vm->err, "Error - \"%s\" is not a program for this build.\n", file_path);
+    munmap(mapping, file_size);
+    return NULL;
+  }
+
+  uint8_t *file = (uint8_t *) mapping;
+  const struct ProgramFileHeader *header = (const struct ProgramFileHeader *) file;
+
+  struct Program *program = MEMORY_ALLOCATE(vm, struct Program, 1, MEMORY_TAG_CHUNK_BYTECODE);
+  *program = (struct Program) {0};
+  program->mapping = mapping;
+  program->mapping_size = file_size;
+
+  struct Chunk *chunk = &program->chunk;
+  chunk->buffer = file + header->byte_offset;
+  chunk->byte_count = header->byte_count;
+  chunk->byte_capacity = header->byte_count;
+  chunk->constants.buffer = (struct Value *) (file + header->constant_offset);
+  chunk->constants.value_count = header->constant_count;
+  chunk->constants.value_capacity = header->constant_count;
+  chunk->lines.lines = (struct Line *) (file + header->line_offset);
+  chunk->lines.line_struct_count = header->line_count;
+  chunk->lines.line_struct_capacity = header->line_count;
+  chunk->lines.columns = file + header->column_offset;
+  chunk->lines.column_byte_count = header->column_count;
+  chunk->lines.column_byte_capacity = header->column_count;
+
+  program->pending_strings = (const struct ProgramFileString *) (file + header->string_offset);
+  program->pending_string_count = header->string_count;
+
+  link_program(vm, program);
+  return program;
+}
+
+// the whole file is laid out in memory first so its checksum can go into
+// the header, then written with a single fwrite
+uint8_t program_write(struct VM *vm, struct Program *program, const char *source, const char *file_path) {
+  materialize_strings(vm, program);
+
+  struct Chunk *chunk = &program->chunk;
+  size_t string_count = 0;
+  size_t string_bytes = 0;
+  for (size_t i = 0; i < chunk->constants.value_count; ++i) {
+    struct Value constant = chunk->constants.buffer[i];
+    if (!OBJECT_IS_OBJECT_STRING(constant)) continue;
+
+    string_count += 1;
+    string_bytes += OBJECT_STRING_FROM_VALUE(constant)->length;
+  }
+
+  struct ProgramFileHeader header = {0};
+  memcpy(header.magic, PROGRAM_FILE_MAGIC, sizeof(header.magic));
+  header.version = PROGRAM_FILE_VERSION;
+  header.flags = PROGRAM_FILE_FLAG_NAN_BOXING;
+  header.value_size = sizeof(struct Value);
+  header.line_size = sizeof(struct Line);
+
+  size_t file_size = sizeof(struct ProgramFileHeader);
+#define PLACE_SECTION(offset_field, count_field, count, element_size) do { \
+    file_size = align_up(file_size);                                    \
+    header.offset_field = file_size;                                    \
+    header.count_field = (count);                                       \
+    file_size += (count) * (element_size);                              \
+  } while (FALSE)
+  PLACE_SECTION(byte_offset, byte_count, chunk->byte_count, sizeof(uint8_t));
+  PLACE_SECTION(constant_offset, constant_count, chunk->constants.value_count, sizeof(struct Value));
+  PLACE_SECTION(line_offset, line_count, chunk->lines.line_struct_count, sizeof(struct Line));
+  PLACE_SECTION(column_offset, column_count, chunk->lines.column_byte_count, sizeof(uint8_t));
+  PLACE_SECTION(string_offset, string_count, string_count, sizeof(struct ProgramFileString));
+#undef PLACE_SECTION
+  file_size += string_bytes;
+  header.source_offset = file_size;
+  header.source_length = source != NULL ? strlen(source) : 0;
+  file_size += header.source_length;
+
+  uint8_t *file = MEMORY_ALLOCATE(vm, uint8_t, file_size, MEMORY_TAG_SCRATCH);
+  memset(file, 0, file_size);
+
+  memcpy(file + header.byte_offset, chunk->buffer, chunk->byte_count);
+  memcpy(file + header.line_offset, chunk->lines.lines, sizeof(struct Line) * chunk->lines.line_struct_count);
+  memcpy(file + header.column_offset, chunk->lines.columns, chunk->lines.column_byte_count);
+
+  // string constants are stored as nil, their bytes follow the string table
+  struct Value *constants = (struct Value *) (file + header.constant_offset);
+  struct ProgramFileString *strings = (struct ProgramFileString *) (file + header.string_offset);
+  size_t bytes_offset = header.string_offset + string_count * sizeof(struct ProgramFileString);
+  for (size_t i = 0; i < chunk->constants.value_count; ++i) {
+    struct Value constant = chunk->constants.buffer[i];
+    if (!OBJECT_IS_OBJECT_STRING(constant)) {
+      constants[i] = constant;
+      continue;
+    }
+
+    struct ObjectString *string = OBJECT_STRING_FROM_VALUE(constant);
+    constants[i] = VALUE_NIL();
+    *strings = (struct ProgramFileString) {
+      .constant_index = i, .offset = bytes_offset, .length = string->length, .hash = string->hash
+    };
+    memcpy(file + bytes_offset, string->chars, string->length);
+
+    strings += 1;
+    bytes_offset += string->length;
+  }
+  if (source != NULL) memcpy(file + header.source_offset, source, header.source_length);
+
+  header.checksum = program_hash(PROGRAM_HASH_SEED, file + sizeof(header), file_size - sizeof(header));
+  memcpy(file, &header, sizeof(header));
+
+  FILE *f = fopen(file_path, "wb");
+  uint8_t ok = f != NULL && fwrite(file, 1, file_size, f) == file_size;
+  if (f != NULL && fclose(f) != 0) ok = FALSE;
+  if (!ok) fprintf(vm->err, "Error - could not write file \"%s\".\n", file_path);
+
+  MEMORY_FREE_ARRAY(vm, uint8_t, file, file_size, MEMORY_TAG_SCRATCH);
+  return ok;
+}
+
+// 64-bit FNV-1a, continued from hash so several buffers can be hashed as one
+uint64_t program_hash(uint64_t hash, const void *bytes, size_t length) {
+  const uint8_t *byte = (const uint8_t *) bytes;
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= byte[i];
+    hash *= 1099511628211u;
+  }
+  return hash;
+}
+
+// only a program loaded from a file written with this exact source matches,
+// the file's checksum already vouches for the stored bytes
+uint8_t program_source_matches(struct Program *program, const char *source, size_t length) {
+  if (program->mapping == NULL) return FALSE;
+
+  const struct ProgramFileHeader *header = (const struct ProgramFileHeader *) program->mapping;
+  return header->source_length == length &&
+         memcmp((const uint8_t *) program->mapping + header->source_offset, source, length) == 0;
+}
+
+uint8_t program_is_program_file(const char *file_path) {
+  // programs are mapped, so only regular files can be one. peeking into a
+  // pipe would also take the bytes away from whoever reads the source
+  struct stat file_stat;
+  if (stat(file_path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) return FALSE;
+
+  FILE *f = fopen(file_path, "rb");
+  if (f == NULL) return FALSE;
+
+  char magic[4];
+  uint8_t is_program = fread(magic, 1, sizeof(magic), f) == sizeof(magic) &&
+                       memcmp(magic, PROGRAM_FILE_MAGIC, sizeof(magic)) == 0;
+  fclose(f);
+  return is_program;
+}
+
+// the bytecode is never changed in meaning, but quickening still rewrites
+// instructions in place as it learns operand types. that is a cache local to
+// the program, so a program must not run on two threads at once
+enum InterpretResult program_execute(struct VM *vm, struct Program *program) {
+  materialize_strings(vm, program);
+  return vm_interpret_chunk(vm, &program->chunk);
+}
+
+// strings borrowing from the mapping may be shared with other programs or
+// values still in use, they get their own copy first. the program stays
+// linked meanwhile so its constants survive any collection this starts
+void program_free(struct VM *vm, struct Program *program) {
+  if (program->mapping != NULL) detach_strings(vm, program);
+
+  unlink_program(vm, program);
+  release_program(vm, program);
+}
+
+// every object goes away with the vm, so nothing needs detaching
+void program_free_programs(struct VM *vm) {
+  while (vm->programs != NULL) {
+    struct Program *program = vm->programs;
+    unlink_program(vm, program);
+    release_program(vm, program);
+  }
+}
+
+void program_mark_roots(struct VM *vm) {
+  for (struct Program *program = vm->programs; program != NULL; program = program->next) {
+    gc_mark_array(vm, &program->chunk.constants);
+  }
+}
+
+// file local functions
+
+static void link_program(struct VM *vm, struct Program *program) {
+  program->previous = NULL;
+  program->next = vm->programs;
+  if (vm->programs != NULL) vm->programs->previous = program;
+  vm->programs = program;
+}
+
+static void unlink_program(struct VM *vm, struct Program *program) {
+  if (program->previous != NULL) {
+    program->previous->next = program->next;
+  } else {
+    vm->programs = program->next;
+  }
+  if (program->next != NULL) program->next->previous = program->previous;
+}
+
+// string constants of a loaded program become objects on its first run,
+// borrowing their bytes from the mapping. slots filled so far are already
+// rooted through the program list
+static void materialize_strings(struct VM *vm, struct Program *program) {
+  const uint8_t *file = (const uint8_t *) program->mapping;
+
+  while (program->pending_string_count > 0) {
+    const struct ProgramFileString *entry = program->pending_strings;
+    struct ObjectString *string = object_object_string_borrow(vm, (const char *) file + entry->offset, entry->length, entry->hash);
+    program->chunk.constants.buffer[entry->constant_index] = VALUE_OBJECT(string);
+
+    program->pending_strings += 1;
+    program->pending_string_count -= 1;
+  }
+}
+
+// only string constants borrow from the mapping, though a constant may also
+// be a string another program loaded first and still borrows from its own
+static void detach_strings(struct VM *vm, struct Program *program) {
+  const char *start = (const char *) program->mapping;
+  const char *end = start + program->mapping_size;
+
+  for (size_t i = 0; i < program->chunk.constants.value_count; ++i) {
+    struct Value constant = program->chunk.constants.buffer[i];
+    if (!OBJECT_IS_OBJECT_STRING(constant)) continue;
+
+    struct ObjectString *string = OBJECT_STRING_FROM_VALUE(constant);
+    if (string->is_borrowed && string->chars >= start && string->chars < end) {
+      object_object_string_detach(vm, string);
+    }
+  }
+}
+
+static void release_program(struct VM *vm, struct Program *program) {
+  if (program->mapping != NULL) {
+    munmap(program->mapping, program->mapping_size);
+  } else {
+    chunk_free(vm, &program->chunk);
+  }
+  MEMORY_FREE(vm, struct Program, program, MEMORY_TAG_CHUNK_BYTECODE);
+}
+
+// everything program_load and vm_run trust later: header fields, section
+// bounds, the checksum, constants that are plain values, and bytecode that
+// decodes into whole instructions reading constants in the pool and never
+// popping more than it pushed. the checksum only catches accidental damage,
+// the rest keeps a crafted file from reaching outside the mapping
+static uint8_t validate_file(const uint8_t *file, size_t file_size) {
+  if (file_size < sizeof(struct ProgramFileHeader)) return FALSE;
+
+  const struct ProgramFileHeader *header = (const struct ProgramFileHeader *) file;
+  if (memcmp(header->magic, PROGRAM_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->version != PROGRAM_FILE_VERSION ||
+      header->flags != PROGRAM_FILE_FLAG_NAN_BOXING ||
+      header->value_size != sizeof(struct Value) ||
+      header->line_size != sizeof(struct Line)) {
+    return FALSE;
+  }
+
+  if (!section_in_file(header->byte_offset, header->byte_count, sizeof(uint8_t), file_size) ||
+      !section_in_file(header->constant_offset, header->constant_count, sizeof(struct Value), file_size) ||
+      !section_in_file(header->line_offset, header->line_count, sizeof(struct Line), file_size) ||
+      !section_in_file(header->column_offset, header->column_count, sizeof(uint8_t), file_size) ||
+      !section_in_file(header->string_offset, header->string_count, sizeof(struct ProgramFileString), file_size) ||
+      !section_in_file(header->source_offset, header->source_length, sizeof(char), file_size)) {
+    return FALSE;
+  }
+
+  // an object in the file would be a pointer into some other process
+  const struct Value *constants = (const struct Value *) (file + header->constant_offset);
+  for (size_t i = 0; i < header->constant_count; ++i) {
+    if (!VALUE_IS_NIL(constants[i]) && !VALUE_IS_BOOL(constants[i]) && !VALUE_IS_NUMBER(constants[i])) return FALSE;
+  }
+
+  // string constants are stored as nil
+  const struct ProgramFileString *strings = (const struct ProgramFileString *) (file + header->string_offset);
+  for (size_t i = 0; i < header->string_count; ++i) {
+    if (strings[i].constant_index >= header->constant_count ||
+        !VALUE_IS_NIL(constants[strings[i].constant_index]) ||
+        !section_in_file(strings[i].offset, strings[i].length, sizeof(char), file_size)) {
+      return FALSE;
+    }
+  }
+
+  // each run's column changes end where the next run's start
+  const struct Line *lines = (const struct Line *) (file + header->line_offset);
+  for (size_t i = 0; i < header->line_count; ++i) {
+    if (lines[i].column_start > header->column_count ||
+        (i > 0 && lines[i].column_start < lines[i - 1].column_start)) {
+      return FALSE;
+    }
+  }
+
+  if (program_hash(PROGRAM_HASH_SEED, file + sizeof(*header), file_size - sizeof(*header)) != header->checksum) {
+    return FALSE;
+  }
+
+  // the bytecode is straight-line, one pass sees the stack depth every
+  // instruction runs at
+  const uint8_t *bytecode = file + header->byte_offset;
+  size_t offset = 0;
+  size_t depth = 0;
+  uint8_t opcode = OPCODE_COUNT;
+  while (offset < header->byte_count) {
+    opcode = bytecode[offset];
+    if (opcode >= OPCODE_COUNT || opcode_size(opcode) > header->byte_count - offset) return FALSE;
+    if (!validate_instruction(bytecode + offset, header->constant_count, &depth)) return FALSE;
+    offset += opcode_size(opcode);
+  }
+
+  return opcode == OPCODE_RETURN;
+}
+
+// the constant an instruction reads is in the pool, and the stack holds
+// the operands it pops and stays within STACK_MAX once it pushes
+static uint8_t validate_instruction(const uint8_t *instruction, uint64_t constant_count, size_t *depth) {
+  size_t pops = 0;
+  size_t pushes = 1;
+  uint8_t reads_constant = FALSE;
+  size_t constant = 0;
+
+  switch (instruction[0]) {
+    case OPCODE_CONSTANT: {
+      reads_constant = TRUE;
+      constant = instruction[1];
+    } break;
+    case OPCODE_CONSTANT_LONG: {
+      reads_constant = TRUE;
+      constant = ((size_t) instruction[1] << 16) | ((size_t) instruction[2] << 8) | instruction[3];
+    } break;
+
+    case OPCODE_NUMBER_BYTE:
+    case OPCODE_NUMBER_SHORT:
+    case OPCODE_NIL:
+    case OPCODE_TRUE:
+    case OPCODE_FALSE:
+      break;
+
+    case OPCODE_NOT:
+    case OPCODE_NEGATE:
+    case OPCODE_ADD_IMMEDIATE:
+    case OPCODE_SUBTRACT_IMMEDIATE:
+    case OPCODE_MULTIPLY_IMMEDIATE:
+    case OPCODE_DIVIDE_IMMEDIATE:
+    case OPCODE_GREATER_IMMEDIATE:
+    case OPCODE_GREATER_EQUAL_IMMEDIATE:
+    case OPCODE_LESS_IMMEDIATE:
+    case OPCODE_LESS_EQUAL_IMMEDIATE:
+    case OPCODE_EQUAL_IMMEDIATE:
+    case OPCODE_BANG_EQUAL_IMMEDIATE:
+      pops = 1;
+      break;
+
+    case OPCODE_ADD_CONSTANT:
+    case OPCODE_SUBTRACT_CONSTANT:
+    case OPCODE_MULTIPLY_CONSTANT:
+    case OPCODE_DIVIDE_CONSTANT:
+    case OPCODE_GREATER_CONSTANT:
+    case OPCODE_GREATER_EQUAL_CONSTANT:
+    case OPCODE_LESS_CONSTANT:
+    case OPCODE_LESS_EQUAL_CONSTANT:
+    case OPCODE_EQUAL_CONSTANT:
+    case OPCODE_BANG_EQUAL_CONSTANT:
+      reads_constant = TRUE;
+      constant = instruction[1];
+      pops = 1;
+      break;
+
+    case OPCODE_BANG_EQUAL:
+    case OPCODE_EQUAL_EQUAL:
+    case OPCODE_GREATER:
+    case OPCODE_GREATER_EQUAL:
+    case OPCODE_LESS:
+    case OPCODE_LESS_EQUAL:
+    case OPCODE_ADD:
+    case OPCODE_SUBTRACT:
+    case OPCODE_MULTIPLY:
+    case OPCODE_DIVIDE:
+    case OPCODE_NOT_GREATER:
+    case OPCODE_NOT_GREATER_EQUAL:
+    case OPCODE_NOT_LESS:
+    case OPCODE_NOT_LESS_EQUAL:
+    case OPCODE_ADD_NUMBER:
+    case OPCODE_ADD_STRING:
+    case OPCODE_SUBTRACT_NUMBER:
+    case OPCODE_MULTIPLY_NUMBER:
+    case OPCODE_DIVIDE_NUMBER:
+    case OPCODE_GREATER_NUMBER:
+    case OPCODE_GREATER_EQUAL_NUMBER:
+    case OPCODE_LESS_NUMBER:
+    case OPCODE_LESS_EQUAL_NUMBER:
+      pops = 2;
+      break;
+
+    case OPCODE_CONCAT_N: {
+      pops = instruction[1];
+      if (pops < 2 || pops > OPCODE_CONCAT_N_MAX) return FALSE;
+    } break;
+
+    case OPCODE_RETURN: {
+      pops = 1;
+      pushes = 0;
+    } break;
+
+    default: return FALSE;
+  }
+
+  if (reads_constant && constant >= constant_count) return FALSE;
+  if (*depth < pops) return FALSE;
+
+  *depth = *depth - pops + pushes;
+  return *depth <= STACK_MAX;
+}
+
+static uint8_t section_in_file(uint64_t offset, uint64_t count, size_t element_size, size_t file_size) {
+  if (offset % PROGRAM_FILE_ALIGNMENT != 0 && element_size > 1) return FALSE;
+  if (offset > file_size) return FALSE;
+  return count <= (file_size - offset) / element_size;
+}
+
+static size_t align_up(size_t position) {
+  return (position + PROGRAM_FILE_ALIGNMENT - 1) & ~(size_t) (PROGRAM_FILE_ALIGNMENT - 1);
+}
@@ -1,10 +1,18 @@
+#define _POSIX_C_SOURCE 200809L
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "repl.h"
 #include "vm.h"
+#include "profiler.h"
+#include "executor.h"
+#include "program.h"
+#include "cache.h"
 
 enum LineStatus {
   LINE_STATUS_BREAK,
@@ -12,11 +20,21 @@ enum LineStatus {
   LINE_STATUS_CONTINUE
 };
 
-// file local prototypes
-static char *read_file(const char *file_path);
-static enum LineStatus process_line(const char *line);
+// text of a source file, '\0' terminated
+struct SourceFile {
+  char *chars;
+  size_t mapping_size; // 0 when chars was read into memory instead
+};
 
-void repl_run(void) {
+// file local prototypes
+static FILE *open_file(const char *file_path);
+static void source_file_open(const char *file_path, struct SourceFile *source);
+static void source_file_close(struct SourceFile *source);
+static uint8_t map_file(FILE *f, struct SourceFile *source);
+static char *read_file(FILE *f, const char *file_path);
+static enum LineStatus process_line(struct VM *vm, const char *line);
+
+void repl_run(struct VM *vm) {
   char line[1024];
   for (;;) {
     printf("> ");
@@ -26,19 +44,102 @@ void repl_run(void) {
       break;
     }
 
-    enum LineStatus status = process_line(line);
+    enum LineStatus status = process_line(vm, line);
     if (status == LINE_STATUS_CONTINUE)   continue;
     else if (status == LINE_STATUS_BREAK) break;
     else {} // resume
 
-    vm_interpret(line);
+    vm_interpret(vm, line);
+  }
+}
+
+// files written by --compile are mapped and run without compiling, with a
+// compile cache sources are only compiled the first time they are seen.
+// other sources are mapped, or when that is not possible (pipes, or a size
+// leaving no room for the '\0' in the last page) scanned from the file as
+// they are compiled, so they are never copied into memory whole
+void repl_run_file(struct VM *vm, const char *file_path) {
+  enum InterpretResult result;
+  if (program_is_program_file(file_path)) {
+    struct Program *program = program_load(vm, file_path);
+    if (program == NULL) exit(65);
+
+    result = program_execute(vm, program);
+    program_free(vm, program);
+  } else if (vm->cache != NULL) {
+    struct SourceFile source;
+    source_file_open(file_path, &source);
+    struct Program *program = cache_compile(vm, vm->cache, source.chars);
+    source_file_close(&source);
+    if (program == NULL) exit(65);
+
+    result = program_execute(vm, program);
+    program_free(vm, program);
+  } else {
+    FILE *f = open_file(file_path);
+    struct SourceFile source;
+    if (map_file(f, &source)) {
+      fclose(f);
+      result = vm_interpret(vm, source.chars);
+      source_file_close(&source);
+    } else {
+      result = vm_interpret_file(vm, f);
+      fclose(f);
+    }
   }
+
+  if (result == INTERPRET_RESULT_COMPILE_ERROR) exit(65);
+  if (result == INTERPRET_RESULT_RUNTIME_ERROR) exit(70);
+}
+
+void repl_compile_file(struct VM *vm, const char *file_path, const char *output_path) {
+  struct SourceFile source;
+  source_file_open(file_path, &source);
+  struct Program *program = program_compile(vm, source.chars);
+  source_file_close(&source);
+
+  if (program == NULL) exit(65);
+
+  uint8_t written = program_write(vm, program, NULL, output_path);
+  program_free(vm, program);
+
+  if (!written) exit(74);
 }
 
-void repl_run_file(const char *file_path) {
-  const char *source = read_file(file_path);
-  enum InterpretResult result = vm_interpret(source);
-  free((void *) source);
+// run every file on a pool of worker threads, then print their output in
+// the order given. exits like repl_run_file with the first failure
+void repl_run_files(const char **file_paths, size_t file_count, size_t worker_count) {
+  struct SourceFile *sources = (struct SourceFile *) malloc(sizeof(struct SourceFile) * file_count);
+  struct ExecutorJob *jobs = (struct ExecutorJob *) malloc(sizeof(struct ExecutorJob) * file_count);
+  if (sources == NULL || jobs == NULL) {
+    fprintf(stderr, "Error - not enough memory for %lu jobs.\n", file_count);
+    exit(74);
+  }
+
+  struct Executor executor;
+  executor_init(&executor, worker_count, NULL);
+
+  for (size_t i = 0; i < file_count; ++i) {
+    source_file_open(file_paths[i], &sources[i]);
+    executor_job_init(&jobs[i], sources[i].chars);
+    executor_submit(&executor, &jobs[i]);
+  }
+
+  executor_wait(&executor);
+  executor_free(&executor);
+
+  enum InterpretResult result = INTERPRET_RESULT_OK;
+  for (size_t i = 0; i < file_count; ++i) {
+    fwrite(jobs[i].output, sizeof(char), jobs[i].output_length, stdout);
+    fwrite(jobs[i].errors, sizeof(char), jobs[i].errors_length, stderr);
+    if (result == INTERPRET_RESULT_OK) result = jobs[i].result;
+
+    executor_job_free(&jobs[i]);
+    source_file_close(&sources[i]);
+  }
+
+  free(jobs);
+  free(sources);
 
   if (result == INTERPRET_RESULT_COMPILE_ERROR) exit(65);
   if (result == INTERPRET_RESULT_RUNTIME_ERROR) exit(70);
@@ -46,36 +147,79 @@ void repl_run_file(const char *file_path) {
 
 // file local functions
 
-static char *read_file(const char *file_path) {
+static FILE *open_file(const char *file_path) {
   FILE *f = fopen(file_path, "rb");
   if (f == NULL) {
     fprintf(stderr, "Error - could not open file \"%s\".\n", file_path);
     exit(74);
   }
+  return f;
+}
+
+static void source_file_open(const char *file_path, struct SourceFile *source) {
+  FILE *f = open_file(file_path);
+  if (!map_file(f, source)) {
+    source->chars = read_file(f, file_path);
+    source->mapping_size = 0;
+  }
+  fclose(f);
+}
 
-  fseek(f, 0L, SEEK_END);
-  size_t file_size = ftell(f);
-  rewind(f);
+static void source_file_close(struct SourceFile *source) {
+  if (source->mapping_size > 0) munmap(source->chars, source->mapping_size);
+  else                          free(source->chars);
+}
 
-  char *buffer = (char *) malloc(file_size + 1);
-  if (buffer == NULL) {
-    fprintf(stderr, "Error - not enough memory to read \"%s\".\n", file_path);
-    exit(74);
+// map a regular file read-only in place of reading it. the rest of the last
+// page of a mapping reads as zeros, which terminates the source for free, so
+// only sizes that are not a multiple of the page size can be mapped
+static uint8_t map_file(FILE *f, struct SourceFile *source) {
+  struct stat file_stat;
+  if (fstat(fileno(f), &file_stat) != 0 || !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0) return FALSE;
+
+  size_t file_size = (size_t) file_stat.st_size;
+  if (file_size % (size_t) sysconf(_SC_PAGESIZE) == 0) return FALSE;
+
+  void *mapping = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+  if (mapping == MAP_FAILED) return FALSE;
+
+  // the scanner reads the source once from front to back
+  posix_madvise(mapping, file_size, POSIX_MADV_SEQUENTIAL);
+
+  source->chars = (char *) mapping;
+  source->mapping_size = file_size;
+  return TRUE;
+}
+
+// read until the end of the file, which need not be seekable
+static char *read_file(FILE *f, const char *file_path) {
+  size_t capacity = 4096;
+  size_t length = 0;
+  char *buffer = (char *) malloc(capacity + 1);
+
+  for (;;) {
+    if (buffer == NULL) {
+      fprintf(stderr, "Error - not enough memory to read \"%s\".\n", file_path);
+      exit(74);
+    }
+
+    length += fread(buffer + length, sizeof(char), capacity - length, f);
+    if (length < capacity) break;
+
+    capacity *= 2;
+    buffer = (char *) realloc(buffer, capacity + 1);
   }
 
-  size_t bytes_read = fread(buffer, sizeof(char), file_size, f);
-  if (bytes_read < file_size) {
+  if (ferror(f)) {
     fprintf(stderr, "Error - could not read file \"%s\".\n", file_path);
     exit(74);
   }
 
-  buffer[bytes_read] = '\0';
-
-  fclose(f);
+  buffer[length] = '\0';
   return buffer;
 }
 
-static enum LineStatus process_line(const char *line) {
+static enum LineStatus process_line(struct VM *vm, const char *line) {
   if (strncmp(line, "!exit", 4) == 0) {
     printf("Goodbye!\n");
     return LINE_STATUS_BREAK;
@@ -86,5 +230,17 @@ static enum LineStatus process_line(const char *line) {
     return LINE_STATUS_CONTINUE;
   }
 
+  if (strncmp(line, "!memory", 7) == 0) {
+    if (!profiler_report(&vm->allocator, stdout)) {
+      printf("Memory profiling is off, start with --profile-memory\n");
+    }
+    return LINE_STATUS_CONTINUE;
+  }
+
+  if (strncmp(line, "!stats", 6) == 0) {
+    vm_print_stats(vm);
+    return LINE_STATUS_CONTINUE;
+  }
+
   return LINE_STATUS_RESUME;
 }
\ No newline at end of file
@@ -3,190 +3,416 @@
 #include <string.h>
 
 #include "scanner.h"
-
-struct Scanner {
-  const char *start;
-  const char *current;
-  size_t line;
+#include "memory.h"
+
+#ifdef SCANNER_SIMD
+#include <immintrin.h>
+#endif
+
+// the loops that run over many bytes at once, each returns the first byte it
+// stops at. every one of them stops at the '\0' ending the source, which is
+// what lets the vector versions read whole aligned blocks past current
+struct ScannerKernels {
+  const char *name;
+  const char *(*skip_blanks)(const char *current, size_t *line, const char **line_start);
+  const char *(*skip_string)(const char *current, size_t *line, const char **line_start); // to '"'
+  const char *(*skip_comment)(const char *current); // to '\n'
+  const char *(*skip_identifier)(const char *current);
+  const char *(*skip_digits)(const char *current);
 };
 
-// global singleton instance
-static struct Scanner global_scanner = {0};
-
 // file local prototypes
-static uint8_t scanner_at_end(void);
-static struct Token make_identifier(void);
-static struct Token make_number(void);
-static struct Token make_string(void);
-static struct Token make_token(enum TokenType type);
-static struct Token make_error(const char *error_message);
-static char scanner_advance(void);
-static uint8_t scanner_match(char expected);
-static void scanner_skip_whitespace(void);
-static char scanner_peek(void);
-static char scanner_peek_next(void);
-static struct Token make_string(void);
+static void token_stream_reserve(struct VM *vm, struct TokenStream *stream, size_t capacity);
+static void token_stream_append(struct VM *vm, struct TokenStream *stream, struct Scanner *scanner, struct Token *token);
+static void scanner_window_refill(struct Scanner *scanner, struct Token *keep);
+static const struct ScannerKernels *select_kernels(void);
+#ifndef SCANNER_SIMD
+static const char *scalar_skip_blanks(const char *current, size_t *line, const char **line_start);
+static const char *scalar_skip_string(const char *current, size_t *line, const char **line_start);
+static const char *scalar_skip_comment(const char *current);
+static const char *scalar_skip_identifier(const char *current);
+static const char *scalar_skip_digits(const char *current);
+#endif
+static uint8_t scanner_at_end(struct Scanner *scanner);
+static struct Token make_identifier(struct Scanner *scanner);
+static struct Token make_number(struct Scanner *scanner);
+static struct Token make_string(struct Scanner *scanner);
+static struct Token make_token(struct Scanner *scanner, enum TokenType type);
+static struct Token make_error(struct Scanner *scanner, const char *error_message);
+static char scanner_advance(struct Scanner *scanner);
+static uint8_t scanner_match(struct Scanner *scanner, char expected);
+static void scanner_skip_whitespace(struct Scanner *scanner);
+static char scanner_peek(struct Scanner *scanner);
+static char scanner_peek_next(struct Scanner *scanner);
+static struct Token make_string(struct Scanner *scanner);
+static uint8_t is_blank(char c);
 static uint8_t is_alpha(char c);
 static uint8_t is_digit(char c);
-static enum TokenType identifier_type(void);
-static enum TokenType check_keyword(size_t start, size_t length, const char *rest, enum TokenType type);
+static enum TokenType identifier_type(struct Scanner *scanner);
+static enum TokenType check_keyword(struct Scanner *scanner, size_t start, size_t length, const char *rest, enum TokenType type);
+
+void scanner_init(struct Scanner *scanner, const char *source) {
+  scanner->start = source;
+  scanner->current = source;
+  scanner->line_start = source;
+  scanner->line = 1;
+  scanner->column = 1;
+  scanner->kernels = select_kernels();
+  scanner->window = NULL;
+  scanner->dropped_line = 0;
+  scanner->dropped_bytes = 0;
+}
 
-void scanner_init(const char *source) {
-  global_scanner.start = source;
-  global_scanner.current = source;
-  global_scanner.line = 1;
+// "avx2", "sse2" or "scalar"
+const char *scanner_kernel_name(struct Scanner *scanner) {
+  return scanner->kernels->name;
 }
 
-struct Token scanner_scan_token(void) {
-  scanner_skip_whitespace();
+struct Token scanner_scan_token(struct Scanner *scanner) {
+  scanner_skip_whitespace(scanner);
 
-  global_scanner.start = global_scanner.current;
+  scanner->start = scanner->current;
+  scanner->column = (size_t) (scanner->start - scanner->line_start) + 1;
+  if (scanner->line == scanner->dropped_line) scanner->column += scanner->dropped_bytes;
 
-  if (scanner_at_end()) return make_token(TOKEN_TYPE_EOF);
+  if (scanner_at_end(scanner)) return make_token(scanner, TOKEN_TYPE_EOF);
   
-  char c = scanner_advance();
+  char c = scanner_advance(scanner);
 
-  if (is_alpha(c)) return make_identifier();
-  if (is_digit(c)) return make_number();
+  if (is_alpha(c)) return make_identifier(scanner);
+  if (is_digit(c)) return make_number(scanner);
 
   switch (c) {
-    case '"': return make_string();
-    case '(': return make_token(TOKEN_TYPE_LEFT_PAREN);
-    case ')': return make_token(TOKEN_TYPE_RIGHT_PAREN);
-    case '{': return make_token(TOKEN_TYPE_LEFT_BRACE);
-    case '}': return make_token(TOKEN_TYPE_RIGHT_BRACE);
-    case ';': return make_token(TOKEN_TYPE_SEMICOLON);
-    case ',': return make_token(TOKEN_TYPE_COMMA);
-    case '.': return make_token(TOKEN_TYPE_DOT);
-    case '-': return make_token(TOKEN_TYPE_MINUS);
-    case '+': return make_token(TOKEN_TYPE_PLUS);
-    case '/': return make_token(TOKEN_TYPE_SLASH);
-    case '*': return make_token(TOKEN_TYPE_STAR);
+    case '"': return make_string(scanner);
+    case '(': return make_token(scanner, TOKEN_TYPE_LEFT_PAREN);
+    case ')': return make_token(scanner, TOKEN_TYPE_RIGHT_PAREN);
+    case '{': return make_token(scanner, TOKEN_TYPE_LEFT_BRACE);
+    case '}': return make_token(scanner, TOKEN_TYPE_RIGHT_BRACE);
+    case ';': return make_token(scanner, TOKEN_TYPE_SEMICOLON);
+    case ',': return make_token(scanner, TOKEN_TYPE_COMMA);
+    case '.': return make_token(scanner, TOKEN_TYPE_DOT);
+    case '-': return make_token(scanner, TOKEN_TYPE_MINUS);
+    case '+': return make_token(scanner, TOKEN_TYPE_PLUS);
+    case '/': return make_token(scanner, TOKEN_TYPE_SLASH);
+    case '*': return make_token(scanner, TOKEN_TYPE_STAR);
     case '!':
-      return make_token(scanner_match('=')
+      return make_token(scanner, scanner_match(scanner, '=')
         ? TOKEN_TYPE_BANG_EQUAL
         : TOKEN_TYPE_BANG);
     case '=':
-      return make_token(scanner_match('=')
+      return make_token(scanner, scanner_match(scanner, '=')
         ? TOKEN_TYPE_EQUAL_EQUAL
         : TOKEN_TYPE_EQUAL);
     case '<':
-      return make_token(scanner_match('=')
+      return make_token(scanner, scanner_match(scanner, '=')
         ? TOKEN_TYPE_LESS_EQUAL
         : TOKEN_TYPE_LESS);
     case '>':
-      return make_token(scanner_match('=')
+      return make_token(scanner, scanner_match(scanner, '=')
         ? TOKEN_TYPE_GREATER_EQUAL
         : TOKEN_TYPE_GREATER);
     default: {}
   }
 
-  return make_error("Error - unexpected character");
+  return make_error(scanner, "Error - unexpected character");
+}
+
+// scan a source read through window, which starts out empty and is filled
+// by the first scanner_scan_token_keeping
+void scanner_init_window(struct Scanner *scanner, struct ScannerWindow *window) {
+  scanner_init(scanner, window->buffer);
+  scanner->window = window;
+}
+
+// as scanner_scan_token, except a scanner with a window refills it whenever a
+// token reaches its end. tokens returned before may then move, keep is the
+// one the caller still uses, and is updated to where its text now is
+struct Token scanner_scan_token_keeping(struct Scanner *scanner, struct Token *keep) {
+  if (scanner->window == NULL) return scanner_scan_token(scanner);
+
+  for (;;) {
+    struct Scanner before = *scanner;
+    struct Token token = scanner_scan_token(scanner);
+
+    // the scanner looks at most one byte past a token, anything ending
+    // closer than that to the end of the window may continue past it
+    const char *end = scanner->window->buffer + scanner->window->length;
+    if (scanner->window->is_eof || end - scanner->current >= 2) return token;
+
+    *scanner = before;
+    scanner_window_refill(scanner, keep);
+  }
+}
+
+void scanner_window_init(struct VM *vm, struct ScannerWindow *window, FILE *file) {
+  window->vm = vm;
+  window->file = file;
+  window->capacity = SCANNER_WINDOW_SIZE;
+  window->buffer = MEMORY_ALLOCATE(vm, char, window->capacity + 1, MEMORY_TAG_SCRATCH);
+  window->buffer[0] = '\0';
+  window->length = 0;
+  window->is_eof = FALSE;
+  window->has_error = FALSE;
+}
+
+void scanner_window_free(struct ScannerWindow *window) {
+  MEMORY_FREE_ARRAY(window->vm, char, window->buffer, window->capacity + 1, MEMORY_TAG_SCRATCH);
+  window->buffer = NULL;
+  window->length = 0;
+  window->capacity = 0;
+}
+
+void token_stream_init(struct TokenStream *stream) {
+  *stream = (struct TokenStream) {0};
+}
+
+// tokenize all of source, stopping after the TOKEN_TYPE_EOF. returns FALSE,
+// with the stream left empty, for a source too long for 32-bit offsets
+uint8_t token_stream_scan(struct VM *vm, struct TokenStream *stream, const char *source) {
+  struct Scanner scanner;
+  scanner_init(&scanner, source);
+  stream->source = source;
+
+  // scripts average a token every few bytes, start out with room for most
+  token_stream_reserve(vm, stream, strlen(source) / 4 + 1);
+
+  for (;;) {
+    struct Token token = scanner_scan_token(&scanner);
+    if ((size_t) (scanner.current - source) > UINT32_MAX) {
+      token_stream_free(vm, stream);
+      return FALSE;
+    }
+
+    token_stream_append(vm, stream, &scanner, &token);
+    if (token.type == TOKEN_TYPE_EOF) return TRUE;
+  }
+}
+
+// rebuild token index of the stream. line_run is a cursor into the line runs
+// kept by the caller, starting at 0, and indices must not go backwards
+struct Token token_stream_token(const struct TokenStream *stream, size_t index, size_t *line_run) {
+  assert(index < stream->count);
+  while (*line_run + 1 < stream->line_count && stream->lines[*line_run + 1].token <= index) {
+    *line_run += 1;
+  }
+  const struct TokenLine *line = &stream->lines[*line_run];
+  assert(line->token <= index);
+
+  struct Token token;
+  token.type = (enum TokenType) stream->types[index];
+  token.start = stream->source + stream->offsets[index];
+  token.length = stream->lengths[index];
+  token.line = line->line;
+  token.column = stream->offsets[index] - line->line_start + 1;
+
+  if (token.type == TOKEN_TYPE_ERROR) {
+    token.start = stream->messages[stream->lengths[index]];
+    token.length = strlen(token.start);
+  }
+  return token;
+}
+
+void token_stream_free(struct VM *vm, struct TokenStream *stream) {
+  MEMORY_FREE_ARRAY(vm, uint8_t, stream->types, stream->capacity, MEMORY_TAG_SCRATCH);
+  MEMORY_FREE_ARRAY(vm, uint32_t, stream->offsets, stream->capacity, MEMORY_TAG_SCRATCH);
+  MEMORY_FREE_ARRAY(vm, uint32_t, stream->lengths, stream->capacity, MEMORY_TAG_SCRATCH);
+  MEMORY_FREE_ARRAY(vm, struct TokenLine, stream->lines, stream->line_capacity, MEMORY_TAG_SCRATCH);
+  MEMORY_FREE_ARRAY(vm, const char *, stream->messages, stream->message_capacity, MEMORY_TAG_SCRATCH);
+  token_stream_init(stream);
 }
 
 // file local functions
 
-static uint8_t scanner_at_end(void) {
-  return *global_scanner.current == '\0';
+// a new line run starts whenever the line or the start of the line the
+// column is counted from changes. they differ within one token for a string
+// spanning lines, which is reported on its last line but with the column it
+// started at
+static void token_stream_append(struct VM *vm, struct TokenStream *stream, struct Scanner *scanner, struct Token *token) {
+  if (stream->count == stream->capacity) {
+    token_stream_reserve(vm, stream, MEMORY_GROW_CAPACITY(stream->capacity, 256));
+  }
+
+  // error tokens point at their message, scanner->start is still where they begin
+  uint32_t offset = (uint32_t) (scanner->start - stream->source);
+  uint32_t length = (uint32_t) token->length;
+  if (token->type == TOKEN_TYPE_ERROR) {
+    if (stream->message_count == stream->message_capacity) {
+      size_t old_capacity = stream->message_capacity;
+      stream->message_capacity = MEMORY_GROW_CAPACITY(old_capacity, 8);
+      stream->messages = MEMORY_GROW_ARRAY(vm, const char *, stream->messages, old_capacity, stream->message_capacity, MEMORY_TAG_SCRATCH);
+    }
+    length = (uint32_t) stream->message_count;
+    stream->messages[stream->message_count++] = token->start;
+  }
+
+  uint32_t line_start = offset + 1 - (uint32_t) token->column;
+  struct TokenLine *last = stream->line_count > 0 ? &stream->lines[stream->line_count - 1] : NULL;
+  if (last == NULL || last->line != token->line || last->line_start != line_start) {
+    if (stream->line_count == stream->line_capacity) {
+      size_t old_capacity = stream->line_capacity;
+      stream->line_capacity = MEMORY_GROW_CAPACITY(old_capacity, 64);
+      stream->lines = MEMORY_GROW_ARRAY(vm, struct TokenLine, stream->lines, old_capacity, stream->line_capacity, MEMORY_TAG_SCRATCH);
+    }
+    stream->lines[stream->line_count++] = (struct TokenLine) {(uint32_t) stream->count, (uint32_t) token->line, line_start};
+  }
+
+  stream->types[stream->count] = (uint8_t) token->type;
+  stream->offsets[stream->count] = offset;
+  stream->lengths[stream->count] = length;
+  stream->count += 1;
 }
 
-static struct Token make_identifier(void) {
-  while (is_alpha(scanner_peek()) || is_digit(scanner_peek())) 
-    scanner_advance();
-  return make_token(identifier_type());
+static void token_stream_reserve(struct VM *vm, struct TokenStream *stream, size_t capacity) {
+  size_t old_capacity = stream->capacity;
+  stream->capacity = capacity;
+  stream->types = MEMORY_GROW_ARRAY(vm, uint8_t, stream->types, old_capacity, capacity, MEMORY_TAG_SCRATCH);
+  stream->offsets = MEMORY_GROW_ARRAY(vm, uint32_t, stream->offsets, old_capacity, capacity, MEMORY_TAG_SCRATCH);
+  stream->lengths = MEMORY_GROW_ARRAY(vm, uint32_t, stream->lengths, old_capacity, capacity, MEMORY_TAG_SCRATCH);
 }
 
-static struct Token make_number(void) {
-  while (is_digit(scanner_peek())) scanner_advance();
+// drop what the scanner is done with, everything before current and keep,
+// and read from the file into the space this frees. the window doubles
+// when less than half of it would be free, so a long token costs a number
+// of rescans logarithmic in its length
+static void scanner_window_refill(struct Scanner *scanner, struct Token *keep) {
+  struct ScannerWindow *window = scanner->window;
+  const char *buffer = window->buffer;
+
+  uint8_t keeps_token = keep != NULL && keep->start >= buffer && keep->start <= buffer + window->length;
+  const char *first = keeps_token && keep->start < scanner->current ? keep->start : scanner->current;
+
+  // columns on the current line carry on counting from the dropped bytes
+  if (scanner->line_start < first) {
+    if (scanner->dropped_line != scanner->line) {
+      scanner->dropped_line = scanner->line;
+      scanner->dropped_bytes = 0;
+    }
+    scanner->dropped_bytes += (size_t) (first - scanner->line_start);
+    scanner->line_start = first;
+  }
+
+  size_t dropped = (size_t) (first - buffer);
+  size_t current = (size_t) (scanner->current - first);
+  size_t line_start = (size_t) (scanner->line_start - first);
+  size_t token_start = keeps_token ? (size_t) (keep->start - first) : 0;
 
-  // lex fractional part if it exists
-  if (scanner_peek() == '.' && is_digit(scanner_peek_next())) {
-    scanner_advance(); // consume decimal '.'
-    while (is_digit(scanner_peek())) scanner_advance();
+  window->length -= dropped;
+  memmove(window->buffer, first, window->length);
+
+  if (window->capacity - window->length < window->capacity / 2) {
+    size_t old_capacity = window->capacity;
+    window->capacity *= 2;
+    window->buffer = MEMORY_GROW_ARRAY(window->vm, char, window->buffer, old_capacity + 1, window->capacity + 1, MEMORY_TAG_SCRATCH);
   }
 
-  return make_token(TOKEN_TYPE_NUMBER);
+  size_t wanted = window->capacity - window->length;
+  size_t read = fread(window->buffer + window->length, sizeof(char), wanted, window->file);
+  if (read < wanted) {
+    window->is_eof = TRUE;
+    window->has_error = ferror(window->file) != 0;
+  }
+  window->length += read;
+  window->buffer[window->length] = '\0';
+
+  scanner->start = window->buffer + current;
+  scanner->current = window->buffer + current;
+  scanner->line_start = window->buffer + line_start;
+  if (keeps_token) keep->start = window->buffer + token_start;
+}
+
+static uint8_t scanner_at_end(struct Scanner *scanner) {
+  return *scanner->current == '\0';
 }
 
-static struct Token make_string(void) {
-  while (scanner_peek() != '"' && !scanner_at_end()) {
-    if (scanner_peek() == '\n') global_scanner.line += 1;
-    scanner_advance();
+// single character names and numbers are common enough that the kernels are
+// only called once a second character continues the token
+static struct Token make_identifier(struct Scanner *scanner) {
+  if (is_alpha(scanner_peek(scanner)) || is_digit(scanner_peek(scanner))) {
+    scanner->current = scanner->kernels->skip_identifier(scanner->current);
   }
+  return make_token(scanner, identifier_type(scanner));
+}
 
-  if (scanner_at_end()) return make_error("Error - unterminated string literal");
+static struct Token make_number(struct Scanner *scanner) {
+  if (is_digit(scanner_peek(scanner))) scanner->current = scanner->kernels->skip_digits(scanner->current);
 
-  scanner_advance(); // closing quote '"'
-  return make_token(TOKEN_TYPE_STRING);
+  // lex fractional part if it exists
+  if (scanner_peek(scanner) == '.' && is_digit(scanner_peek_next(scanner))) {
+    scanner_advance(scanner); // consume decimal '.'
+    scanner->current = scanner->kernels->skip_digits(scanner->current);
+  }
+
+  return make_token(scanner, TOKEN_TYPE_NUMBER);
 }
 
-static struct Token make_token(enum TokenType type) {
+static struct Token make_string(struct Scanner *scanner) {
+  scanner->current = scanner->kernels->skip_string(scanner->current, &scanner->line, &scanner->line_start);
+
+  if (scanner_at_end(scanner)) return make_error(scanner, "Error - unterminated string literal");
+
+  scanner_advance(scanner); // closing quote '"'
+  return make_token(scanner, TOKEN_TYPE_STRING);
+}
+
+static struct Token make_token(struct Scanner *scanner, enum TokenType type) {
   struct Token token;
   token.type = type;
-  token.start = global_scanner.start;
-  token.length = (size_t) (global_scanner.current - global_scanner.start);
-  token.line = global_scanner.line;
+  token.start = scanner->start;
+  token.length = (size_t) (scanner->current - scanner->start);
+  token.line = scanner->line;
+  token.column = scanner->column;
   return token;
 }
 
-static struct Token make_error(const char *error_message) {
+static struct Token make_error(struct Scanner *scanner, const char *error_message) {
   struct Token token;
   token.type = TOKEN_TYPE_ERROR;
   token.start = error_message;
   token.length = (size_t) strlen(error_message);
-  token.line = global_scanner.line;
+  token.line = scanner->line;
+  token.column = scanner->column;
   return token;
 }
 
-static char scanner_advance(void) {
-  global_scanner.current += 1;
-  return global_scanner.current[-1];
+static char scanner_advance(struct Scanner *scanner) {
+  scanner->current += 1;
+  return scanner->current[-1];
 }
 
-static uint8_t scanner_match(char expected) {
-  if (scanner_at_end()) return 0;
-  if (*global_scanner.current != expected) return 0;
+static uint8_t scanner_match(struct Scanner *scanner, char expected) {
+  if (scanner_at_end(scanner)) return 0;
+  if (*scanner->current != expected) return 0;
 
-  global_scanner.current += 1;
+  scanner->current += 1;
 
   return 1;
 }
 
-static void scanner_skip_whitespace(void) {
+static void scanner_skip_whitespace(struct Scanner *scanner) {
   for (;;) {
-    switch (scanner_peek()) {
-      case ' ':
-      case '\r':
-      case '\t':
-        scanner_advance();
-        break;
-
-      case '\n':
-        global_scanner.line += 1;
-        scanner_advance();
-        break;
-
-      // skip comments, treat as whitespace
-      case '/':
-        if (scanner_peek_next() == '/') {
-          while (scanner_peek() != '\n' && !scanner_at_end()) scanner_advance();
-        } else {
-          return;
-        }
-        break;
-
-      default: return;
+    // a single space between tokens is handled without calling a kernel
+    if (scanner_peek(scanner) == ' ') scanner_advance(scanner);
+    if (is_blank(scanner_peek(scanner))) {
+      scanner->current = scanner->kernels->skip_blanks(scanner->current, &scanner->line, &scanner->line_start);
     }
+
+    // skip comments, treat as whitespace
+    if (scanner_peek(scanner) != '/' || scanner_peek_next(scanner) != '/') return;
+    scanner->current = scanner->kernels->skip_comment(scanner->current);
   }
 }
 
-static char scanner_peek(void) {
-  return global_scanner.current[0];
+static char scanner_peek(struct Scanner *scanner) {
+  return scanner->current[0];
+}
+
+static char scanner_peek_next(struct Scanner *scanner) {
+  if (scanner_at_end(scanner)) return '\0';
+  return scanner->current[1];
 }
 
-static char scanner_peek_next(void) {
-  if (scanner_at_end()) return '\0';
-  return global_scanner.current[1];
+static uint8_t is_blank(char c) {
+  return c == ' ' || c == '\r' || c == '\t' || c == '\n';
 }
 
 static uint8_t is_alpha(char c) {
@@ -199,46 +425,236 @@ static uint8_t is_digit(char c) {
   return c >= '0' && c <= '9';
 }
 
-static enum TokenType identifier_type(void) {
-  switch (global_scanner.start[0]) {
-    case 'a': return check_keyword(1, 2, "nd",    TOKEN_TYPE_AND);
-    case 'c': return check_keyword(1, 4, "lass",  TOKEN_TYPE_CLASS);
-    case 'e': return check_keyword(1, 3, "lse",   TOKEN_TYPE_ELSE);
+static enum TokenType identifier_type(struct Scanner *scanner) {
+  switch (scanner->start[0]) {
+    case 'a': return check_keyword(scanner, 1, 2, "nd",    TOKEN_TYPE_AND);
+    case 'c': return check_keyword(scanner, 1, 4, "lass",  TOKEN_TYPE_CLASS);
+    case 'e': return check_keyword(scanner, 1, 3, "lse",   TOKEN_TYPE_ELSE);
     case 'f': {
-      if (global_scanner.current - global_scanner.start > 1) {
-        switch (global_scanner.start[1]) {
-          case 'a': return check_keyword(2, 3, "lse", TOKEN_TYPE_FALSE);
-          case 'o': return check_keyword(2, 1, "r",   TOKEN_TYPE_FOR);
-          case 'u': return check_keyword(2, 1, "n",   TOKEN_TYPE_FUN);
+      if (scanner->current - scanner->start > 1) {
+        switch (scanner->start[1]) {
+          case 'a': return check_keyword(scanner, 2, 3, "lse", TOKEN_TYPE_FALSE);
+          case 'o': return check_keyword(scanner, 2, 1, "r",   TOKEN_TYPE_FOR);
+          case 'u': return check_keyword(scanner, 2, 1, "n",   TOKEN_TYPE_FUN);
         }
       }
     } break;
-    case 'i': return check_keyword(1, 1, "f",     TOKEN_TYPE_IF);
-    case 'n': return check_keyword(1, 2, "il",    TOKEN_TYPE_NIL);
-    case 'o': return check_keyword(1, 1, "r",     TOKEN_TYPE_OR);
-    case 'p': return check_keyword(1, 4, "rint",  TOKEN_TYPE_PRINT);
-    case 'r': return check_keyword(1, 5, "eturn", TOKEN_TYPE_RETURN);
-    case 's': return check_keyword(1, 4, "uper",  TOKEN_TYPE_SUPER);
+    case 'i': return check_keyword(scanner, 1, 1, "f",     TOKEN_TYPE_IF);
+    case 'n': return check_keyword(scanner, 1, 2, "il",    TOKEN_TYPE_NIL);
+    case 'o': return check_keyword(scanner, 1, 1, "r",     TOKEN_TYPE_OR);
+    case 'p': return check_keyword(scanner, 1, 4, "rint",  TOKEN_TYPE_PRINT);
+    case 'r': return check_keyword(scanner, 1, 5, "eturn", TOKEN_TYPE_RETURN);
+    case 's': return check_keyword(scanner, 1, 4, "uper",  TOKEN_TYPE_SUPER);
     case 't': {
-      if (global_scanner.current - global_scanner.start > 1) {
-        switch (global_scanner.start[1]) {
-          case 'h': return check_keyword(2, 2, "is", TOKEN_TYPE_THIS);
-          case 'r': return check_keyword(2, 2, "ue", TOKEN_TYPE_TRUE);
+      if (scanner->current - scanner->start > 1) {
+        switch (scanner->start[1]) {
+          case 'h': return check_keyword(scanner, 2, 2, "is", TOKEN_TYPE_THIS);
+          case 'r': return check_keyword(scanner, 2, 2, "ue", TOKEN_TYPE_TRUE);
         }
       }
     } break;
-    case 'v': return check_keyword(1, 2, "ar",    TOKEN_TYPE_VAR);
-    case 'w': return check_keyword(1, 4, "hile",  TOKEN_TYPE_WHILE);
+    case 'v': return check_keyword(scanner, 1, 2, "ar",    TOKEN_TYPE_VAR);
+    case 'w': return check_keyword(scanner, 1, 4, "hile",  TOKEN_TYPE_WHILE);
   }
 
   return TOKEN_TYPE_IDENTIFIER;
 }
 
-static enum TokenType check_keyword(size_t start, size_t length, const char *rest, enum TokenType type) {
-  if ((size_t) (global_scanner.current - global_scanner.start) == start + length &&
-      memcmp(global_scanner.start + start, rest, length) == 0) {
+static enum TokenType check_keyword(struct Scanner *scanner, size_t start, size_t length, const char *rest, enum TokenType type) {
+  if ((size_t) (scanner->current - scanner->start) == start + length &&
+      memcmp(scanner->start + start, rest, length) == 0) {
     return type;
   }
 
   return TOKEN_TYPE_IDENTIFIER;
-}
\ No newline at end of file
+}
+
+#ifndef SCANNER_SIMD
+
+static const struct ScannerKernels scalar_kernels = {
+  "scalar",
+  scalar_skip_blanks,
+  scalar_skip_string,
+  scalar_skip_comment,
+  scalar_skip_identifier,
+  scalar_skip_digits,
+};
+
+static const char *scalar_skip_blanks(const char *current, size_t *line, const char **line_start) {
+  for (;; current += 1) {
+    switch (*current) {
+      case ' ':
+      case '\r':
+      case '\t':
+        break;
+
+      case '\n':
+        *line += 1;
+        *line_start = current + 1;
+        break;
+
+      default: return current;
+    }
+  }
+}
+
+static const char *scalar_skip_string(const char *current, size_t *line, const char **line_start) {
+  for (; *current != '"' && *current != '\0'; current += 1) {
+    if (*current == '\n') {
+      *line += 1;
+      *line_start = current + 1;
+    }
+  }
+  return current;
+}
+
+static const char *scalar_skip_comment(const char *current) {
+  while (*current != '\n' && *current != '\0') current += 1;
+  return current;
+}
+
+static const char *scalar_skip_identifier(const char *current) {
+  while (is_alpha(*current) || is_digit(*current)) current += 1;
+  return current;
+}
+
+static const char *scalar_skip_digits(const char *current) {
+  while (is_digit(*current)) current += 1;
+  return current;
+}
+
+#else
+
+// the vector kernels classify one aligned block at a time into a mask with a
+// bit per byte, set where the kernel has to stop. aligned blocks never cross
+// a page boundary, so reading the whole block that holds the terminating
+// '\0' is safe even though it runs past the end of the source. that read is
+// outside the source buffer as far as AddressSanitizer knows, so it is told
+// to look away
+#define SCANNER_SIMD_ATTRIBUTES(instruction_set) __attribute__((target(instruction_set), no_sanitize_address))
+
+// byte in [low, high], shifted so that low lands on -128 and one signed
+// comparison against the top of the range decides
+#define SCANNER_SIMD_IN_RANGE(isa, bytes, low, high) \
+  isa##_less(isa##_sub(bytes, isa##_splat((char) ((low) + 128))), isa##_splat((char) ((high) - (low) - 127)))
+
+// expands into the classifiers, the two block loops and the kernel table of
+// one instruction set, given isa##_vector, isa##_load, isa##_splat, isa##_sub,
+// isa##_equal, isa##_less, isa##_or, isa##_mask, isa##_full_mask and the block
+// width
+#define SCANNER_SIMD_KERNELS(isa, width, instruction_set)                                                                   \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static inline uint32_t isa##_blank_stop(isa##_vector bytes) {                    \
+    isa##_vector blank = isa##_or(isa##_or(isa##_equal(bytes, isa##_splat(' ')), isa##_equal(bytes, isa##_splat('\t'))),    \
+                                  isa##_or(isa##_equal(bytes, isa##_splat('\r')), isa##_equal(bytes, isa##_splat('\n'))));  \
+    return ~isa##_mask(blank) & isa##_full_mask;                                                                            \
+  }                                                                                                                         \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static inline uint32_t isa##_string_stop(isa##_vector bytes) {                   \
+    return isa##_mask(isa##_or(isa##_equal(bytes, isa##_splat('"')), isa##_equal(bytes, isa##_splat('\0'))));               \
+  }                                                                                                                         \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static inline uint32_t isa##_comment_stop(isa##_vector bytes) {                  \
+    return isa##_mask(isa##_or(isa##_equal(bytes, isa##_splat('\n')), isa##_equal(bytes, isa##_splat('\0'))));              \
+  }                                                                                                                         \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static inline uint32_t isa##_identifier_stop(isa##_vector bytes) {               \
+    /* setting 0x20 folds upper case letters onto lower case ones */                                                        \
+    isa##_vector letter = SCANNER_SIMD_IN_RANGE(isa, isa##_or(bytes, isa##_splat(0x20)), 'a', 'z');                         \
+    isa##_vector digit = SCANNER_SIMD_IN_RANGE(isa, bytes, '0', '9');                                                       \
+    isa##_vector part = isa##_or(isa##_or(letter, digit), isa##_equal(bytes, isa##_splat('_')));                            \
+    return ~isa##_mask(part) & isa##_full_mask;                                                                             \
+  }                                                                                                                         \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static inline uint32_t isa##_digit_stop(isa##_vector bytes) {                    \
+    return ~isa##_mask(SCANNER_SIMD_IN_RANGE(isa, bytes, '0', '9')) & isa##_full_mask;                                      \
+  }                                                                                                                         \
+                                                                                                                            \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static inline const char *isa##_find(const char *current,                        \
+      uint32_t (*stop)(isa##_vector)) {                                                                                     \
+    const char *block = (const char *) ((uintptr_t) current & ~(uintptr_t) ((width) - 1));                                  \
+    /* bytes of the first block before current do not count */                                                              \
+    uint32_t mask = stop(isa##_load(block)) >> (current - block) << (current - block);                                      \
+    while (mask == 0) {                                                                                                     \
+      block += (width);                                                                                                     \
+      mask = stop(isa##_load(block));                                                                                       \
+    }                                                                                                                       \
+    return block + __builtin_ctz(mask);                                                                                     \
+  }                                                                                                                         \
+                                                                                                                            \
+  /* isa##_find that also counts the newlines it steps over */                                                              \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static inline const char *isa##_find_counting_lines(const char *current,         \
+      uint32_t (*stop)(isa##_vector), size_t *line, const char **line_start) {                                              \
+    const char *block = (const char *) ((uintptr_t) current & ~(uintptr_t) ((width) - 1));                                  \
+    uint32_t skipped = (uint32_t) (current - block);                                                                        \
+    for (;;) {                                                                                                              \
+      isa##_vector bytes = isa##_load(block);                                                                               \
+      uint32_t mask = stop(bytes) >> skipped << skipped;                                                                    \
+      uint32_t newlines = isa##_mask(isa##_equal(bytes, isa##_splat('\n'))) >> skipped << skipped;                          \
+      if (mask != 0) newlines &= (1u << __builtin_ctz(mask)) - 1;                                                           \
+      if (newlines != 0) {                                                                                                  \
+        *line += (size_t) __builtin_popcount(newlines);                                                                     \
+        *line_start = block + (31 - __builtin_clz(newlines)) + 1;                                                           \
+      }                                                                                                                     \
+      if (mask != 0) return block + __builtin_ctz(mask);                                                                    \
+      block += (width);                                                                                                     \
+      skipped = 0;                                                                                                          \
+    }                                                                                                                       \
+  }                                                                                                                         \
+                                                                                                                            \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static const char *isa##_skip_blanks(const char *current, size_t *line,          \
+      const char **line_start) {                                                                                            \
+    return isa##_find_counting_lines(current, isa##_blank_stop, line, line_start);                                          \
+  }                                                                                                                         \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static const char *isa##_skip_string(const char *current, size_t *line,          \
+      const char **line_start) {                                                                                            \
+    return isa##_find_counting_lines(current, isa##_string_stop, line, line_start);                                         \
+  }                                                                                                                         \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static const char *isa##_skip_comment(const char *current) {                     \
+    return isa##_find(current, isa##_comment_stop);                                                                         \
+  }                                                                                                                         \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static const char *isa##_skip_identifier(const char *current) {                  \
+    return isa##_find(current, isa##_identifier_stop);                                                                      \
+  }                                                                                                                         \
+  SCANNER_SIMD_ATTRIBUTES(instruction_set) static const char *isa##_skip_digits(const char *current) {                      \
+    return isa##_find(current, isa##_digit_stop);                                                                           \
+  }                                                                                                                         \
+                                                                                                                            \
+  static const struct ScannerKernels isa##_kernels = {                                                                      \
+    #isa,                                                                                                                   \
+    isa##_skip_blanks,                                                                                                      \
+    isa##_skip_string,                                                                                                      \
+    isa##_skip_comment,                                                                                                     \
+    isa##_skip_identifier,                                                                                                  \
+    isa##_skip_digits,                                                                                                      \
+  };
+
+// 16 byte blocks, part of every x86-64 cpu
+typedef __m128i sse2_vector;
+#define sse2_full_mask 0xffffu
+#define sse2_load(block)   _mm_load_si128((const __m128i *) (block))
+#define sse2_splat(c)      _mm_set1_epi8(c)
+#define sse2_sub(a, b)     _mm_sub_epi8(a, b)
+#define sse2_equal(a, b)   _mm_cmpeq_epi8(a, b)
+#define sse2_less(a, b)    _mm_cmplt_epi8(a, b)
+#define sse2_or(a, b)      _mm_or_si128(a, b)
+#define sse2_mask(a)       ((uint32_t) _mm_movemask_epi8(a))
+SCANNER_SIMD_KERNELS(sse2, 16, "sse2")
+
+// 32 byte blocks, used when the cpu running the scanner has them
+typedef __m256i avx2_vector;
+#define avx2_full_mask 0xffffffffu
+#define avx2_load(block)   _mm256_load_si256((const __m256i *) (block))
+#define avx2_splat(c)      _mm256_set1_epi8(c)
+#define avx2_sub(a, b)     _mm256_sub_epi8(a, b)
+#define avx2_equal(a, b)   _mm256_cmpeq_epi8(a, b)
+#define avx2_less(a, b)    _mm256_cmpgt_epi8(b, a)
+#define avx2_or(a, b)      _mm256_or_si256(a, b)
+#define avx2_mask(a)       ((uint32_t) _mm256_movemask_epi8(a))
+SCANNER_SIMD_KERNELS(avx2, 32, "avx2")
+
+#endif
+
+static const struct ScannerKernels *select_kernels(void) {
+#ifdef SCANNER_SIMD
+  if (__builtin_cpu_supports("avx2")) return &avx2_kernels;
+  return &sse2_kernels;
+#else
+  return &scalar_kernels;
+#endif
+}
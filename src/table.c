@@ -1,5 +1,6 @@
 
 #include <stdio.h>
+#include <string.h>
 
 #include "table.h"
 #include "memory.h"
@@ -9,7 +10,7 @@
 #define TABLE_MAX_LOAD 0.75
 
 // file local prototypes
-static void table_adjust_capacity(struct Table *table, size_t capacity);
+static void table_adjust_capacity(struct VM *vm, struct Table *table, size_t capacity);
 static struct Entry *find_entry(struct Entry *entries, size_t capacity, struct ObjectString *key);
 
 void table_init(struct Table *table) {
@@ -18,15 +19,15 @@ void table_init(struct Table *table) {
   table->entries  = NULL;
 }
 
-void table_free(struct Table *table) {
-  MEMORY_FREE_ARRAY(struct Entry, table->entries, table->capacity);
+void table_free(struct VM *vm, struct Table *table) {
+  MEMORY_FREE_ARRAY(vm, struct Entry, table->entries, table->capacity, MEMORY_TAG_TABLE);
   table_init(table);
 }
 
-uint8_t table_set(struct Table *table, struct ObjectString *key, struct Value value) {
+uint8_t table_set(struct VM *vm, struct Table *table, struct ObjectString *key, struct Value value) {
   if (table->count + 1 > table->capacity * TABLE_MAX_LOAD) {
     size_t capacity = MEMORY_GROW_CAPACITY(table->capacity, 8);
-    table_adjust_capacity(table, capacity);
+    table_adjust_capacity(vm, table, capacity);
   }
 
   struct Entry *entry = find_entry(table->entries, table->capacity, key);
@@ -60,19 +61,53 @@ uint8_t table_remove(struct Table *table, struct ObjectString *key) {
   return TRUE;
 }
 
-void table_set_all_from(struct Table *dest, struct Table *src) {
+// look a string up by contents rather than by pointer, used to intern strings
+struct ObjectString *table_find_string(struct Table *table, const char *buffer, size_t length, uint32_t hash) {
+  if (table->count == 0) return NULL;
+
+  uint32_t index = hash % table->capacity;
+  for (;;) {
+    struct Entry *entry = &table->entries[index];
+    if (entry->key == NULL) {
+      // stop at an empty slot, step over tombstones
+      if (VALUE_IS_NIL(entry->value)) return NULL;
+    } else if (entry->key->length == length &&
+               entry->key->hash == hash &&
+               memcmp(entry->key->chars, buffer, length) == 0) {
+      return entry->key;
+    }
+
+    index = (index + 1) % table->capacity;
+  }
+}
+
+// drop every entry whose key was not reached by the collector, returning
+// how many were removed
+size_t table_remove_unmarked(struct Table *table) {
+  size_t removed_count = 0;
+  for (size_t i = 0; i < table->capacity; ++i) {
+    struct Entry *entry = &table->entries[i];
+    if (entry->key != NULL && !entry->key->object.is_marked) {
+      table_remove(table, entry->key);
+      removed_count += 1;
+    }
+  }
+  return removed_count;
+}
+
+void table_set_all_from(struct VM *vm, struct Table *dest, struct Table *src) {
   for (size_t i = 0; i < src->capacity; ++i) {
     struct Entry *entry = &src->entries[i];
     if (entry->key != NULL) {
-      table_set(dest, entry->key, entry->value);
+      table_set(vm, dest, entry->key, entry->value);
     }
   }
 }
 
 // file local functions
 
-static void table_adjust_capacity(struct Table *table, size_t capacity) {
-  struct Entry *entries = MEMORY_ALLOCATE(struct Entry, capacity);
+static void table_adjust_capacity(struct VM *vm, struct Table *table, size_t capacity) {
+  struct Entry *entries = MEMORY_ALLOCATE(vm, struct Entry, capacity, MEMORY_TAG_TABLE);
   for (size_t i = 0; i < capacity; ++i) {
     entries[i].key = NULL;
     entries[i].value = VALUE_NIL();
@@ -91,7 +126,7 @@ static void table_adjust_capacity(struct Table *table, size_t capacity) {
     table->count += 1;
   }
 
-  MEMORY_FREE_ARRAY(struct Entry, table->entries, table->capacity);
+  MEMORY_FREE_ARRAY(vm, struct Entry, table->entries, table->capacity, MEMORY_TAG_TABLE);
 
   table->entries = entries;
   table->capacity = capacity;
@@ -10,224 +10,532 @@
 #include "compiler.h"
 #include "object.h"
 #include "memory.h"
+#include "gc.h"
+#include "program.h"
+#include "cache.h"
 
-// global singleton instance (declared extern in header)
-struct VM global_vm = {0};
- 
 // file local prototypes
-static enum InterpretResult vm_run(void);
-static void vm_reset_stack(void);
-static struct Value vm_peek(size_t distance);
-static void vm_runtime_error(const char *format, ...);
+static enum InterpretResult vm_run(struct VM *vm);
+#ifdef DEBUG_TRACE_EXECUTION
+static void vm_trace_execution(struct VM *vm);
+#endif
+static void vm_reset_stack(struct VM *vm);
+static struct Value vm_peek(struct VM *vm, size_t distance);
+static void vm_runtime_error(struct VM *vm, const char *format, ...);
 static uint8_t is_falsey(struct Value value);
-static void string_concatenate(void);
+static uint8_t vm_add(struct VM *vm);
+static uint8_t vm_add_n(struct VM *vm, size_t count);
+static void string_concatenate(struct VM *vm);
+static void flatten_slot(struct VM *vm, struct Value *slot);
 // binary op functions
 static uint8_t gt(double a, double b);
 static uint8_t gt_eq(double a, double b);
 static uint8_t lt(double a, double b);
 static uint8_t lt_eq(double a, double b);
+static uint8_t not_gt(double a, double b);
+static uint8_t not_gt_eq(double a, double b);
+static uint8_t not_lt(double a, double b);
+static uint8_t not_lt_eq(double a, double b);
 static double add(double a, double b);
 static double subtract(double a, double b);
 static double multiply(double a, double b);
 static double divide(double a, double b);
 
-void vm_init(void) {
-  vm_reset_stack();
-  global_vm.objects = NULL;
+void vm_init(struct VM *vm, const struct Allocator *allocator) {
+  // counters, gray stack and the chunk/compiler/program roots all start out zeroed
+  *vm = (struct VM) {0};
+  vm->allocator = allocator != NULL ? *allocator : memory_default_allocator();
+  output_init(&vm->out, output_file_sink(stdout), OUTPUT_FLUSH_RESULT);
+  vm->err = stderr;
+  vm_reset_stack(vm);
+  vm->objects = NULL;
+#ifdef OBJECT_ARENA
+  arena_init(&vm->object_arena);
+#endif
+  table_init(&vm->strings);
+  vm->next_gc = GC_HEAP_MINIMUM;
+}
+
+void vm_free(struct VM *vm) {
+  output_flush(&vm->out);
+  program_free_programs(vm);
+  table_free(vm, &vm->strings);
+  object_free_objects(vm);
 }
 
-void vm_free(void) {
-  object_free_objects();
+void vm_set_output(struct VM *vm, struct OutputSink sink, enum OutputFlush flush) {
+  output_flush(&vm->out);
+  output_init(&vm->out, sink, flush);
 }
 
-enum InterpretResult vm_interpret(const char *source) {
+enum InterpretResult vm_interpret(struct VM *vm, const char *source) {
   struct Chunk chunk = {0};
   chunk_init(&chunk);
 
-  if (!compiler_compile(source, &chunk)) {
-    chunk_free(&chunk);
+  if (!compiler_compile(vm, source, &chunk)) {
+    chunk_free(vm, &chunk);
     return INTERPRET_RESULT_COMPILE_ERROR;
   }
 
-  global_vm.chunk = &chunk;
-  global_vm.ip = global_vm.chunk->buffer;
+  enum InterpretResult result = vm_interpret_chunk(vm, &chunk);
+
+  chunk_free(vm, &chunk);
+  return result;
+}
+
+enum InterpretResult vm_interpret_file(struct VM *vm, FILE *file) {
+  struct Chunk chunk = {0};
+  chunk_init(&chunk);
+
+  if (!compiler_compile_file(vm, file, &chunk)) {
+    chunk_free(vm, &chunk);
+    return INTERPRET_RESULT_COMPILE_ERROR;
+  }
 
-  enum InterpretResult result = vm_run();
-  //enum InterpretResult result = INTERPRET_RESULT_OK;
+  enum InterpretResult result = vm_interpret_chunk(vm, &chunk);
 
-  chunk_free(&chunk);
+  chunk_free(vm, &chunk);
   return result;
 }
 
-void vm_push(struct Value value) {
-  *global_vm.stack_top = value;
-  global_vm.stack_top += 1;
+void vm_print_stats(struct VM *vm) {
+  printf("== vm stats ==\n");
+  printf("interned strings:    %lu\n", vm->interned_string_count);
+  printf("intern bytes saved:  %lu\n", vm->interned_bytes_saved);
+  printf("ropes:               %lu\n", vm->rope_count);
+  printf("flattened ropes:     %lu\n", vm->flattened_rope_count);
+  printf("heap bytes:          %lu\n", vm->bytes_allocated);
+  printf("next collection at:  %lu\n", vm->next_gc);
+  printf("collections:         %lu\n", vm->gc_collection_count);
+  printf("collected bytes:     %lu\n", vm->gc_freed_bytes);
+#ifdef OBJECT_ARENA
+  printf("object arena pages:  %lu\n", vm->object_arena.page_count);
+#endif
+  if (vm->cache != NULL) cache_print_stats(vm->cache, stdout);
 }
 
-struct Value vm_pop() {
-  global_vm.stack_top -= 1;
-  return *global_vm.stack_top;
+enum InterpretResult vm_interpret_chunk(struct VM *vm, struct Chunk *chunk) {
+  vm->chunk = chunk;
+  vm->ip = vm->chunk->buffer;
+
+  enum InterpretResult result = vm_run(vm);
+
+  // the caller owns the chunk, its constants stop being roots once it returns
+  vm->chunk = NULL;
+  return result;
+}
+
+void vm_push(struct VM *vm, struct Value value) {
+  *vm->stack_top = value;
+  vm->stack_top += 1;
+}
+
+struct Value vm_pop(struct VM *vm) {
+  vm->stack_top -= 1;
+  return *vm->stack_top;
 }
 
 // file local functions
 
-static enum InterpretResult vm_run(void) {
-
-#define READ_BYTE()     (*global_vm.ip++)
-#define READ_CONSTANT() (global_vm.chunk->constants.buffer[READ_BYTE()])
-#define BINARY_OP(value_type, op) do {                      \
-    if (!VALUE_IS_NUMBER(vm_peek(0)) ||                     \
-        !VALUE_IS_NUMBER(vm_peek(1))) {                     \
-      vm_runtime_error("Error - operands must be numbers"); \
-      return INTERPRET_RESULT_RUNTIME_ERROR;                \
-    }                                                       \
-    double b = vm_pop().as.number;                          \
-    double a = vm_pop().as.number;                          \
-    vm_push(value_type(op(a, b)));                          \
+#ifdef VM_COMPUTED_GOTO
+// labels-as-values and the ranged table initializer are GNU extensions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+
+static enum InterpretResult vm_run(struct VM *vm) {
+
+#define READ_BYTE()     (*vm->ip++)
+#define READ_CONSTANT() (vm->chunk->constants.buffer[READ_BYTE()])
+#define BINARY_OP(value_type, op) do {                          \
+    if (!VALUE_IS_NUMBER(vm_peek(vm, 0)) ||                     \
+        !VALUE_IS_NUMBER(vm_peek(vm, 1))) {                     \
+      vm_runtime_error(vm, "Error - operands must be numbers"); \
+      return INTERPRET_RESULT_RUNTIME_ERROR;                    \
+    }                                                           \
+    double b = VALUE_AS_NUMBER(vm_pop(vm));                     \
+    double a = VALUE_AS_NUMBER(vm_pop(vm));                     \
+    vm_push(vm, value_type(op(a, b)));                          \
+  } while (FALSE)
+#define BINARY_CONSTANT_OP(value_type, op) do {                 \
+    struct Value constant = READ_CONSTANT();                    \
+    if (!VALUE_IS_NUMBER(constant) ||                           \
+        !VALUE_IS_NUMBER(vm_peek(vm, 0))) {                     \
+      vm_runtime_error(vm, "Error - operands must be numbers"); \
+      return INTERPRET_RESULT_RUNTIME_ERROR;                    \
+    }                                                           \
+    double a = VALUE_AS_NUMBER(vm_pop(vm));                     \
+    vm_push(vm, value_type(op(a, VALUE_AS_NUMBER(constant))));  \
+  } while (FALSE)
+#define BINARY_IMMEDIATE_OP(value_type, op) do {                \
+    double b = opcode_byte_immediate(READ_BYTE());              \
+    if (!VALUE_IS_NUMBER(vm_peek(vm, 0))) {                     \
+      vm_runtime_error(vm, "Error - operands must be numbers"); \
+      return INTERPRET_RESULT_RUNTIME_ERROR;                    \
+    }                                                           \
+    double a = VALUE_AS_NUMBER(vm_pop(vm));                     \
+    vm_push(vm, value_type(op(a, b)));                          \
+  } while (FALSE)
+
+// QUICKEN rewrites the instruction being executed into a type-specialized
+// form, whose guard calls DEOPTIMIZE to restore and re-run the generic
+// opcode once it sees operand types it was not specialized for
+#ifdef VM_QUICKENING
+#define QUICKEN(opcode) (vm->ip[-1] = (opcode))
+#else
+#define QUICKEN(opcode) do {} while (FALSE)
+#endif
+#define DEOPTIMIZE(generic) do { \
+    vm->ip -= 1;                 \
+    *vm->ip = (generic);         \
+    NEXT();                      \
+  } while (FALSE)
+#define QUICK_BINARY_OP(value_type, op, generic) do {                             \
+    struct Value *top = vm->stack_top;                                            \
+    if (!VALUE_IS_NUMBER(top[-1]) || !VALUE_IS_NUMBER(top[-2])) {                 \
+      DEOPTIMIZE(generic);                                                        \
+    }                                                                             \
+    top[-2] = value_type(op(VALUE_AS_NUMBER(top[-2]), VALUE_AS_NUMBER(top[-1]))); \
+    vm->stack_top = top - 1;                                                      \
   } while (FALSE)
 
-  printf("\n== Running Virtal Machine ==\n");
-  for (;;) {
 #ifdef DEBUG_TRACE_EXECUTION
-    printf("stack:\t");
-    for (struct Value *slot = global_vm.stack; slot < global_vm.stack_top; ++slot) {
-      printf("[ ");
-      value_print(*slot);
-      printf(" ]");
-    }
-    printf("\n");
+#define TRACE_EXECUTION() vm_trace_execution(vm)
+#else
+#define TRACE_EXECUTION() do {} while (FALSE)
+#endif
+
+// DISPATCH opens the instruction body, CASE labels a handler and NEXT
+// transfers control to the handler of the following instruction
+#ifdef VM_COMPUTED_GOTO
+#define DISPATCH()   NEXT();
+#define CASE(opcode) label_##opcode
+#define DEFAULT      label_unknown
+#define NEXT()       do {                   \
+    TRACE_EXECUTION();                      \
+    goto *dispatch_table[READ_BYTE()];      \
+  } while (FALSE)
 
-    size_t offset = (size_t)(global_vm.ip - global_vm.chunk->buffer);
-    assert(offset < global_vm.chunk->byte_count);
-    debug_disassemble_instruction(global_vm.chunk, offset);
+#define OPCODE_LABEL_ENTRY(opcode, operand_bytes) [opcode] = &&label_##opcode,
+  // every byte value has a target, unknown opcodes land on label_unknown
+  static void *dispatch_table[UINT8_MAX + 1] = {
+    [0 ... UINT8_MAX] = &&label_unknown,
+    OPCODE_LIST(OPCODE_LABEL_ENTRY)
+  };
+#undef OPCODE_LABEL_ENTRY
+#else
+#define DISPATCH()   dispatch: TRACE_EXECUTION(); switch (READ_BYTE())
+#define CASE(opcode) case opcode
+#define DEFAULT      default
+#define NEXT()       goto dispatch
 #endif
 
-    uint8_t instruction = 0;
-    switch (instruction = READ_BYTE()) {
-      case OPCODE_CONSTANT: {
-        struct Value constant = READ_CONSTANT();
-        vm_push(constant);
-      } break;
-
-      case OPCODE_CONSTANT_LONG: {
-        size_t value_index = 
-          (READ_BYTE() << 16) |
-          (READ_BYTE() << 8)  |
-          (READ_BYTE() << 0);
-
-        struct Value constant = global_vm.chunk->constants.buffer[value_index];
-        vm_push(constant);
-      } break;
-
-      case OPCODE_NIL:   vm_push(VALUE_NIL());         break;
-      case OPCODE_TRUE:  vm_push(VALUE_BOOL(TRUE));   break;
-      case OPCODE_FALSE: vm_push(VALUE_BOOL(FALSE)); break;
-
-      case OPCODE_BANG_EQUAL: {
-        struct Value b = vm_pop();
-        struct Value a = vm_pop();
-        vm_push(VALUE_BOOL(!value_equal(a, b)));
-      } break;
-      case OPCODE_EQUAL_EQUAL: {
-        struct Value b = vm_pop();
-        struct Value a = vm_pop();
-        vm_push(VALUE_BOOL(value_equal(a, b)));
-      } break;
-      case OPCODE_GREATER:       BINARY_OP(VALUE_BOOL, gt);    break;
-      case OPCODE_GREATER_EQUAL: BINARY_OP(VALUE_BOOL, gt_eq); break; // a >= b <-> !(a < b)
-      case OPCODE_LESS:          BINARY_OP(VALUE_BOOL, lt);    break;
-      case OPCODE_LESS_EQUAL:    BINARY_OP(VALUE_BOOL, lt_eq); break; // a <= b <-> !(a > b)
-
-      case OPCODE_ADD: {
-        if (OBJECT_IS_OBJECT_STRING(vm_peek(0)) && OBJECT_IS_OBJECT_STRING(vm_peek(1))) {
-          string_concatenate();
-        } else if (VALUE_IS_NUMBER(vm_peek(0)) && VALUE_IS_NUMBER(vm_peek(1))) {
-          double b = vm_pop().as.number;
-          double a = vm_pop().as.number;
-          vm_push(VALUE_NUMBER(add(a, b)));
-        } else {
-          vm_runtime_error("Error - operands must be two numbers or two strings");
-          return INTERPRET_RESULT_RUNTIME_ERROR;
-        }
-      } break;
-      case OPCODE_SUBTRACT: BINARY_OP(VALUE_NUMBER, subtract); break;
-      case OPCODE_MULTIPLY: BINARY_OP(VALUE_NUMBER, multiply); break;
-      case OPCODE_DIVIDE:   BINARY_OP(VALUE_NUMBER, divide);   break;
-
-      case OPCODE_NOT: vm_push(VALUE_BOOL(is_falsey(vm_pop()))); break;
-      case OPCODE_NEGATE: {
-        if (!VALUE_IS_NUMBER(vm_peek(0))) {
-          vm_runtime_error("Error - operand must be a number");
-          return INTERPRET_RESULT_RUNTIME_ERROR;
-        }
-        vm_push(VALUE_NUMBER(-vm_pop().as.number));
-      } break; // top of stack, index back by 1
-
-      case OPCODE_RETURN: {
-        value_print(vm_pop());
-        printf("\n");
-        return INTERPRET_RESULT_OK; 
-      } break;
-
-      default: {}
+#ifdef DEBUG_TRACE_EXECUTION
+  printf("\n== Running Virtal Machine ==\n");
+#endif
+  DISPATCH() {
+    CASE(OPCODE_CONSTANT): {
+      struct Value constant = READ_CONSTANT();
+      vm_push(vm, constant);
+    } NEXT();
+
+    CASE(OPCODE_CONSTANT_LONG): {
+      size_t value_index = READ_BYTE() << 16;
+      value_index |= READ_BYTE() << 8;
+      value_index |= READ_BYTE() << 0;
+
+      struct Value constant = vm->chunk->constants.buffer[value_index];
+      vm_push(vm, constant);
+    } NEXT();
+
+    CASE(OPCODE_NUMBER_BYTE): vm_push(vm, VALUE_NUMBER(opcode_byte_immediate(READ_BYTE()))); NEXT();
+    CASE(OPCODE_NUMBER_SHORT): {
+      uint8_t high = READ_BYTE();
+      uint8_t low = READ_BYTE();
+      vm_push(vm, VALUE_NUMBER(opcode_short_immediate(high, low)));
+    } NEXT();
+
+    CASE(OPCODE_NIL):   vm_push(vm, VALUE_NIL());       NEXT();
+    CASE(OPCODE_TRUE):  vm_push(vm, VALUE_BOOL(TRUE));  NEXT();
+    CASE(OPCODE_FALSE): vm_push(vm, VALUE_BOOL(FALSE)); NEXT();
+
+    CASE(OPCODE_BANG_EQUAL): {
+      flatten_slot(vm, vm->stack_top - 1);
+      flatten_slot(vm, vm->stack_top - 2);
+      struct Value b = vm_pop(vm);
+      struct Value a = vm_pop(vm);
+      vm_push(vm, VALUE_BOOL(!value_equal(a, b)));
+    } NEXT();
+    CASE(OPCODE_EQUAL_EQUAL): {
+      flatten_slot(vm, vm->stack_top - 1);
+      flatten_slot(vm, vm->stack_top - 2);
+      struct Value b = vm_pop(vm);
+      struct Value a = vm_pop(vm);
+      vm_push(vm, VALUE_BOOL(value_equal(a, b)));
+    } NEXT();
+    CASE(OPCODE_GREATER):       BINARY_OP(VALUE_BOOL, gt);    QUICKEN(OPCODE_GREATER_NUMBER);       NEXT();
+    CASE(OPCODE_GREATER_EQUAL): BINARY_OP(VALUE_BOOL, gt_eq); QUICKEN(OPCODE_GREATER_EQUAL_NUMBER); NEXT(); // a >= b <-> !(a < b)
+    CASE(OPCODE_LESS):          BINARY_OP(VALUE_BOOL, lt);    QUICKEN(OPCODE_LESS_NUMBER);          NEXT();
+    CASE(OPCODE_LESS_EQUAL):    BINARY_OP(VALUE_BOOL, lt_eq); QUICKEN(OPCODE_LESS_EQUAL_NUMBER);    NEXT(); // a <= b <-> !(a > b)
+
+    CASE(OPCODE_ADD): {
+      if (OBJECT_IS_ANY_STRING(vm_peek(vm, 0)) && OBJECT_IS_ANY_STRING(vm_peek(vm, 1))) {
+        QUICKEN(OPCODE_ADD_STRING);
+      } else if (VALUE_IS_NUMBER(vm_peek(vm, 0)) && VALUE_IS_NUMBER(vm_peek(vm, 1))) {
+        QUICKEN(OPCODE_ADD_NUMBER);
+      }
+      if (!vm_add(vm)) return INTERPRET_RESULT_RUNTIME_ERROR;
+    } NEXT();
+    CASE(OPCODE_SUBTRACT): BINARY_OP(VALUE_NUMBER, subtract); QUICKEN(OPCODE_SUBTRACT_NUMBER); NEXT();
+    CASE(OPCODE_MULTIPLY): BINARY_OP(VALUE_NUMBER, multiply); QUICKEN(OPCODE_MULTIPLY_NUMBER); NEXT();
+    CASE(OPCODE_DIVIDE):   BINARY_OP(VALUE_NUMBER, divide);   QUICKEN(OPCODE_DIVIDE_NUMBER);   NEXT();
+
+    CASE(OPCODE_NOT): vm_push(vm, VALUE_BOOL(is_falsey(vm_pop(vm)))); NEXT();
+    CASE(OPCODE_NEGATE): {
+      if (!VALUE_IS_NUMBER(vm_peek(vm, 0))) {
+        vm_runtime_error(vm, "Error - operand must be a number");
+        return INTERPRET_RESULT_RUNTIME_ERROR;
+      }
+      vm_push(vm, VALUE_NUMBER(-VALUE_AS_NUMBER(vm_pop(vm))));
+    } NEXT(); // top of stack, index back by 1
+    CASE(OPCODE_CONCAT_N): {
+      size_t count = READ_BYTE();
+      if (!vm_add_n(vm, count)) return INTERPRET_RESULT_RUNTIME_ERROR;
+    } NEXT();
+
+    CASE(OPCODE_RETURN): {
+      flatten_slot(vm, vm->stack_top - 1);
+      value_write(&vm->out, vm_pop(vm));
+      output_end_result(&vm->out);
+      return INTERPRET_RESULT_OK;
     }
+
+    // superinstructions, the constant is always the right hand operand
+    CASE(OPCODE_ADD_CONSTANT): {
+      vm_push(vm, READ_CONSTANT());
+      if (!vm_add(vm)) return INTERPRET_RESULT_RUNTIME_ERROR;
+    } NEXT();
+    CASE(OPCODE_SUBTRACT_CONSTANT):      BINARY_CONSTANT_OP(VALUE_NUMBER, subtract); NEXT();
+    CASE(OPCODE_MULTIPLY_CONSTANT):      BINARY_CONSTANT_OP(VALUE_NUMBER, multiply); NEXT();
+    CASE(OPCODE_DIVIDE_CONSTANT):        BINARY_CONSTANT_OP(VALUE_NUMBER, divide);   NEXT();
+    CASE(OPCODE_GREATER_CONSTANT):       BINARY_CONSTANT_OP(VALUE_BOOL, gt);         NEXT();
+    CASE(OPCODE_GREATER_EQUAL_CONSTANT): BINARY_CONSTANT_OP(VALUE_BOOL, gt_eq);      NEXT();
+    CASE(OPCODE_LESS_CONSTANT):          BINARY_CONSTANT_OP(VALUE_BOOL, lt);         NEXT();
+    CASE(OPCODE_LESS_EQUAL_CONSTANT):    BINARY_CONSTANT_OP(VALUE_BOOL, lt_eq);      NEXT();
+    CASE(OPCODE_EQUAL_CONSTANT): {
+      flatten_slot(vm, vm->stack_top - 1);
+      struct Value b = READ_CONSTANT();
+      struct Value a = vm_pop(vm);
+      vm_push(vm, VALUE_BOOL(value_equal(a, b)));
+    } NEXT();
+    CASE(OPCODE_BANG_EQUAL_CONSTANT): {
+      flatten_slot(vm, vm->stack_top - 1);
+      struct Value b = READ_CONSTANT();
+      struct Value a = vm_pop(vm);
+      vm_push(vm, VALUE_BOOL(!value_equal(a, b)));
+    } NEXT();
+    CASE(OPCODE_NOT_GREATER):       BINARY_OP(VALUE_BOOL, not_gt);    NEXT();
+    CASE(OPCODE_NOT_GREATER_EQUAL): BINARY_OP(VALUE_BOOL, not_gt_eq); NEXT();
+    CASE(OPCODE_NOT_LESS):          BINARY_OP(VALUE_BOOL, not_lt);    NEXT();
+    CASE(OPCODE_NOT_LESS_EQUAL):    BINARY_OP(VALUE_BOOL, not_lt_eq); NEXT();
+
+    // immediate superinstructions, the small integer is the right hand operand
+    CASE(OPCODE_ADD_IMMEDIATE): {
+      vm_push(vm, VALUE_NUMBER(opcode_byte_immediate(READ_BYTE())));
+      if (!vm_add(vm)) return INTERPRET_RESULT_RUNTIME_ERROR;
+    } NEXT();
+    CASE(OPCODE_SUBTRACT_IMMEDIATE):      BINARY_IMMEDIATE_OP(VALUE_NUMBER, subtract); NEXT();
+    CASE(OPCODE_MULTIPLY_IMMEDIATE):      BINARY_IMMEDIATE_OP(VALUE_NUMBER, multiply); NEXT();
+    CASE(OPCODE_DIVIDE_IMMEDIATE):        BINARY_IMMEDIATE_OP(VALUE_NUMBER, divide);   NEXT();
+    CASE(OPCODE_GREATER_IMMEDIATE):       BINARY_IMMEDIATE_OP(VALUE_BOOL, gt);         NEXT();
+    CASE(OPCODE_GREATER_EQUAL_IMMEDIATE): BINARY_IMMEDIATE_OP(VALUE_BOOL, gt_eq);      NEXT();
+    CASE(OPCODE_LESS_IMMEDIATE):          BINARY_IMMEDIATE_OP(VALUE_BOOL, lt);         NEXT();
+    CASE(OPCODE_LESS_EQUAL_IMMEDIATE):    BINARY_IMMEDIATE_OP(VALUE_BOOL, lt_eq);      NEXT();
+    CASE(OPCODE_EQUAL_IMMEDIATE): {
+      struct Value b = VALUE_NUMBER(opcode_byte_immediate(READ_BYTE()));
+      struct Value a = vm_pop(vm);
+      vm_push(vm, VALUE_BOOL(value_equal(a, b)));
+    } NEXT();
+    CASE(OPCODE_BANG_EQUAL_IMMEDIATE): {
+      struct Value b = VALUE_NUMBER(opcode_byte_immediate(READ_BYTE()));
+      struct Value a = vm_pop(vm);
+      vm_push(vm, VALUE_BOOL(!value_equal(a, b)));
+    } NEXT();
+
+    // quickened forms
+    CASE(OPCODE_ADD_NUMBER): QUICK_BINARY_OP(VALUE_NUMBER, add, OPCODE_ADD); NEXT();
+    CASE(OPCODE_ADD_STRING): {
+      if (!OBJECT_IS_ANY_STRING(vm_peek(vm, 0)) || !OBJECT_IS_ANY_STRING(vm_peek(vm, 1))) {
+        DEOPTIMIZE(OPCODE_ADD);
+      }
+      string_concatenate(vm);
+    } NEXT();
+    CASE(OPCODE_SUBTRACT_NUMBER):      QUICK_BINARY_OP(VALUE_NUMBER, subtract, OPCODE_SUBTRACT);   NEXT();
+    CASE(OPCODE_MULTIPLY_NUMBER):      QUICK_BINARY_OP(VALUE_NUMBER, multiply, OPCODE_MULTIPLY);   NEXT();
+    CASE(OPCODE_DIVIDE_NUMBER):        QUICK_BINARY_OP(VALUE_NUMBER, divide, OPCODE_DIVIDE);       NEXT();
+    CASE(OPCODE_GREATER_NUMBER):       QUICK_BINARY_OP(VALUE_BOOL, gt, OPCODE_GREATER);            NEXT();
+    CASE(OPCODE_GREATER_EQUAL_NUMBER): QUICK_BINARY_OP(VALUE_BOOL, gt_eq, OPCODE_GREATER_EQUAL);   NEXT();
+    CASE(OPCODE_LESS_NUMBER):          QUICK_BINARY_OP(VALUE_BOOL, lt, OPCODE_LESS);               NEXT();
+    CASE(OPCODE_LESS_EQUAL_NUMBER):    QUICK_BINARY_OP(VALUE_BOOL, lt_eq, OPCODE_LESS_EQUAL);      NEXT();
+
+    DEFAULT: NEXT(); // skip unknown opcodes
   }
 
 #undef READ_BYTE
 #undef READ_CONSTANT
 #undef BINARY_OP
+#undef BINARY_CONSTANT_OP
+#undef BINARY_IMMEDIATE_OP
+#undef QUICKEN
+#undef DEOPTIMIZE
+#undef QUICK_BINARY_OP
+#undef TRACE_EXECUTION
+#undef DISPATCH
+#undef CASE
+#undef DEFAULT
+#undef NEXT
+}
+
+#ifdef VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+#ifdef DEBUG_TRACE_EXECUTION
+static void vm_trace_execution(struct VM *vm) {
+  printf("stack:\t");
+  for (struct Value *slot = vm->stack; slot < vm->stack_top; ++slot) {
+    flatten_slot(vm, slot); // only flat strings can be printed
+    printf("[ ");
+    value_print(stdout, *slot);
+    printf(" ]");
+  }
+  printf("\n");
+
+  size_t offset = (size_t)(vm->ip - vm->chunk->buffer);
+  assert(offset < vm->chunk->byte_count);
+  debug_disassemble_instruction(vm->chunk, offset);
 }
+#endif
 
-static void vm_reset_stack(void) {
-  global_vm.stack_top = global_vm.stack;
+static void vm_reset_stack(struct VM *vm) {
+  vm->stack_top = vm->stack;
 }
 
-static struct Value vm_peek(size_t distance) {
-  return global_vm.stack_top[-1 - distance];
+static struct Value vm_peek(struct VM *vm, size_t distance) {
+  return vm->stack_top[-1 - distance];
 }
 
-static void vm_runtime_error(const char *format, ...) {
+static void vm_runtime_error(struct VM *vm, const char *format, ...) {
   va_list args;
   va_start(args, format);
-  vfprintf(stderr, format, args);
+  vfprintf(vm->err, format, args);
   va_end(args);
-  fputs("\n", stderr);
+  fputs("\n", vm->err);
 
-  size_t instruction = global_vm.ip - global_vm.chunk->buffer - 1;
-  size_t line = chunk_get_line(global_vm.chunk, instruction);
-  fprintf(stderr, "[line %lu] in script\n", line);
-  vm_reset_stack();
+  size_t instruction = vm->ip - vm->chunk->buffer - 1;
+  fprintf(vm->err, "[line %lu, column %lu] in script\n",
+          chunk_get_line(vm->chunk, instruction), chunk_get_column(vm->chunk, instruction));
+  vm_reset_stack(vm);
 }
 
 static uint8_t is_falsey(struct Value value) {
   // && short circuits, access is safe
-  return VALUE_IS_NIL(value) || (VALUE_IS_BOOL(value) && !value.as.boolean);
+  return VALUE_IS_NIL(value) || (VALUE_IS_BOOL(value) && !VALUE_AS_BOOL(value));
 }
 
-static void string_concatenate(void) {
-  struct ObjectString *b = OBJECT_STRING_FROM_VALUE(vm_pop());
-  struct ObjectString *a = OBJECT_STRING_FROM_VALUE(vm_pop());
+// add the two values on top of the stack, reports and returns FALSE when
+// they are not two numbers or two strings
+static uint8_t vm_add(struct VM *vm) {
+  if (OBJECT_IS_ANY_STRING(vm_peek(vm, 0)) && OBJECT_IS_ANY_STRING(vm_peek(vm, 1))) {
+    string_concatenate(vm);
+  } else if (VALUE_IS_NUMBER(vm_peek(vm, 0)) && VALUE_IS_NUMBER(vm_peek(vm, 1))) {
+    double b = VALUE_AS_NUMBER(vm_pop(vm));
+    double a = VALUE_AS_NUMBER(vm_pop(vm));
+    vm_push(vm, VALUE_NUMBER(add(a, b)));
+  } else {
+    vm_runtime_error(vm, "Error - operands must be two numbers or two strings");
+    return FALSE;
+  }
 
-  size_t length = a->length + b->length;
+  return TRUE;
+}
 
-  // call to object_allocate_object adds new node to allocation list
-  struct ObjectString *result = object_object_string_allocate(length);
+// the count values on top of the stack added left to right. the compiler
+// only gathers string literals onto a running result known to be a string,
+// so the last operand is the only one that can be anything else. a rope
+// there, a string the compiler could not see, is joined on after the rest,
+// and any other value fails like the OPCODE_ADD it replaced. a program file
+// holding some other mix fails the same way
+static uint8_t vm_add_n(struct VM *vm, size_t count) {
+  struct Value *operands = vm->stack_top - count;
+
+  // flat strings, only the running result and the last operand may be ropes
+  for (size_t i = 0; i < count; ++i) {
+    uint8_t may_be_rope = i == 0 || i == count - 1;
+    if (!OBJECT_IS_OBJECT_STRING(operands[i]) && !(may_be_rope && OBJECT_IS_OBJECT_ROPE(operands[i]))) {
+      vm_runtime_error(vm, "Error - operands must be two numbers or two strings");
+      return FALSE;
+    }
+  }
 
-  memcpy(result->buffer, a->buffer, a->length);
-  memcpy(result->buffer + a->length, b->buffer, b->length);
-  result->buffer[length] = '\0';
+  // the operands stay on the stack until the result exists, the running
+  // result lives in the first operand's slot
+  size_t flat_count = OBJECT_IS_OBJECT_ROPE(operands[count - 1]) ? count - 1 : count;
+  if (flat_count > 1) {
+#ifdef OBJECT_ROPES
+    // a long first operand, such as the running result of a chain split at
+    // OPCODE_CONCAT_N_MAX, is referenced by a rope rather than copied again
+    struct Object *first = VALUE_AS_OBJECT(operands[0]);
+    if (object_string_length(first) >= OBJECT_ROPE_MIN_LENGTH) {
+      operands[1] = VALUE_OBJECT(object_object_string_concatenate_n(vm, operands + 1, flat_count - 1));
+      operands[0] = VALUE_OBJECT(object_object_string_join(vm, first, VALUE_AS_OBJECT(operands[1])));
+    } else {
+      operands[0] = VALUE_OBJECT(object_object_string_concatenate_n(vm, operands, flat_count));
+    }
+#else
+    operands[0] = VALUE_OBJECT(object_object_string_concatenate_n(vm, operands, flat_count));
+#endif
+  }
 
-  object_object_string_update_hash(result);
+  if (flat_count < count) {
+    operands[0] = VALUE_OBJECT(object_object_string_join(vm, VALUE_AS_OBJECT(operands[0]), VALUE_AS_OBJECT(operands[count - 1])));
+  }
+
+  vm->stack_top = operands + 1;
+  return TRUE;
+}
+
+static void string_concatenate(struct VM *vm) {
+  // leave the operands on the stack so a collection during the
+  // allocation still sees them
+  struct Object *b = VALUE_AS_OBJECT(vm_peek(vm, 0));
+  struct Object *a = VALUE_AS_OBJECT(vm_peek(vm, 1));
 
-  vm_push(VALUE_OBJECT(result));
+  struct Object *result = object_object_string_join(vm, a, b);
+  vm_pop(vm);
+  vm_pop(vm);
+  vm_push(vm, VALUE_OBJECT(result));
+}
+
+// equality compares interned strings by pointer, so a rope on the stack is
+// replaced by its flattened string first
+static void flatten_slot(struct VM *vm, struct Value *slot) {
+  if (OBJECT_IS_OBJECT_ROPE(*slot)) {
+    *slot = VALUE_OBJECT(object_object_rope_flatten(vm, OBJECT_ROPE_FROM_VALUE(*slot)));
+  }
 }
 
-static uint8_t gt(double a, double b)      { return a > b;  }
-static uint8_t gt_eq(double a, double b)   { return a >= b; }
-static uint8_t lt(double a, double b)      { return a < b;  }
-static uint8_t lt_eq(double a, double b)   { return a <= b; }
-static double add(double a, double b)      { return a + b;  }
-static double subtract(double a, double b) { return a - b;  }
-static double multiply(double a, double b) { return a * b;  }
-static double divide(double a, double b)   { return a / b;  }
+static uint8_t gt(double a, double b)        { return a > b;     }
+static uint8_t gt_eq(double a, double b)     { return a >= b;    }
+static uint8_t lt(double a, double b)        { return a < b;     }
+static uint8_t lt_eq(double a, double b)     { return a <= b;    }
+static uint8_t not_gt(double a, double b)    { return !(a > b);  }
+static uint8_t not_gt_eq(double a, double b) { return !(a >= b); }
+static uint8_t not_lt(double a, double b)    { return !(a < b);  }
+static uint8_t not_lt_eq(double a, double b) { return !(a <= b); }
+static double add(double a, double b)        { return a + b;     }
+static double subtract(double a, double b)   { return a - b;     }
+static double multiply(double a, double b)   { return a * b;     }
+static double divide(double a, double b)     { return a / b;     }
 